@@ -1083,6 +1083,21 @@ do_page_fault(struct pt_regs *regs, unsigned long error_code)
 		return;
 	}
 
+	/*
+	 * Populating anonymous memory from user mode is tried without
+	 * mmap_sem first, see handle_speculative_fault():
+	 */
+	if ((error_code & (PF_USER | PF_PROT)) == PF_USER) {
+		fault = handle_speculative_fault(mm, address, flags);
+		if (!(fault & VM_FAULT_RETRY)) {
+			tsk->min_flt++;
+			perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS_MIN, 1,
+				      regs, address);
+			check_v8086_mode(regs, address, tsk);
+			return;
+		}
+	}
+
 	/*
 	 * When running in the kernel we expect faults to occur only to
 	 * addresses in user space.  All other faults represent errors in
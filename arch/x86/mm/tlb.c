@@ -319,6 +319,28 @@ void flush_tlb_page(struct vm_area_struct *vma, unsigned long va)
 	preempt_enable();
 }
 
+static void do_flush_tlb_user(void *info)
+{
+	local_flush_tlb();
+}
+
+/*
+ * Flush the user TLB entries of whatever mm is loaded on the cpus in
+ * @cpumask, this one included. Reclaim uses it to complete unmaps of
+ * pages from several mms with a single IPI per cpu.
+ */
+void flush_tlb_cpumask(const struct cpumask *cpumask)
+{
+	int cpu = get_cpu();
+
+	if (cpumask_test_cpu(cpu, cpumask))
+		local_flush_tlb();
+	if (cpumask_any_but(cpumask, cpu) < nr_cpu_ids)
+		smp_call_function_many(cpumask, do_flush_tlb_user, NULL, 1);
+
+	put_cpu();
+}
+
 static void do_flush_tlb_all(void *info)
 {
 	__flush_tlb_all();
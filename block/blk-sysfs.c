@@ -78,6 +78,9 @@ queue_requests_store(struct request_queue *q, const char *page, size_t count)
 		wake_up(&rl->wait[BLK_RW_ASYNC]);
 	}
 	spin_unlock_irq(q->queue_lock);
+
+	/* Keep the old merge hash if a bigger one can't be had */
+	elv_resize_hash(q);
 	return ret;
 }
 
@@ -273,6 +276,24 @@ queue_rq_affinity_store(struct request_queue *q, const char *page, size_t count)
 	return ret;
 }
 
+#ifdef CONFIG_BLK_DEV_THROTTLING
+static ssize_t queue_throtl_burst_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(blk_throtl_burst_ms(q), page);
+}
+
+static ssize_t
+queue_throtl_burst_store(struct request_queue *q, const char *page,
+			 size_t count)
+{
+	unsigned long msecs;
+	ssize_t ret = queue_var_store(&msecs, page, count);
+
+	blk_throtl_set_burst_ms(q, msecs);
+	return ret;
+}
+#endif
+
 static struct queue_sysfs_entry queue_requests_entry = {
 	.attr = {.name = "nr_requests", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_requests_show,
@@ -317,6 +338,11 @@ static struct queue_sysfs_entry queue_iosched_entry = {
 	.store = elv_iosched_store,
 };
 
+static struct queue_sysfs_entry queue_merge_stats_entry = {
+	.attr = {.name = "merge_stats", .mode = S_IRUGO },
+	.show = elv_merge_stats_show,
+};
+
 static struct queue_sysfs_entry queue_hw_sector_size_entry = {
 	.attr = {.name = "hw_sector_size", .mode = S_IRUGO },
 	.show = queue_logical_block_size_show,
@@ -387,6 +413,14 @@ static struct queue_sysfs_entry queue_random_entry = {
 	.store = queue_store_random,
 };
 
+#ifdef CONFIG_BLK_DEV_THROTTLING
+static struct queue_sysfs_entry queue_throtl_burst_entry = {
+	.attr = {.name = "throttle_burst_ms", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_throtl_burst_show,
+	.store = queue_throtl_burst_store,
+};
+#endif
+
 static struct attribute *default_attrs[] = {
 	&queue_requests_entry.attr,
 	&queue_ra_entry.attr,
@@ -396,6 +430,7 @@ static struct attribute *default_attrs[] = {
 	&queue_max_integrity_segments_entry.attr,
 	&queue_max_segment_size_entry.attr,
 	&queue_iosched_entry.attr,
+	&queue_merge_stats_entry.attr,
 	&queue_hw_sector_size_entry.attr,
 	&queue_logical_block_size_entry.attr,
 	&queue_physical_block_size_entry.attr,
@@ -409,6 +444,9 @@ static struct attribute *default_attrs[] = {
 	&queue_rq_affinity_entry.attr,
 	&queue_iostats_entry.attr,
 	&queue_random_entry.attr,
+#ifdef CONFIG_BLK_DEV_THROTTLING
+	&queue_throtl_burst_entry.attr,
+#endif
 	NULL,
 };
 
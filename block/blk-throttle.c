@@ -17,8 +17,17 @@ static int throtl_grp_quantum = 8;
 /* Total max dispatch from all groups in one round */
 static int throtl_quantum = 32;
 
-/* Throttling is performed over 100ms slice and after that slice is renewed */
-static unsigned long throtl_slice = HZ/10;	/* 100 ms */
+/*
+ * Default burst allowance. A group which stayed below its limits may
+ * dispatch up to this much worth of its rate back to back.
+ */
+static unsigned long throtl_burst = HZ/10;	/* 100 ms */
+
+/*
+ * Share of a bucket, as a shift, which may sit in per cpu charge caches
+ * at any time.
+ */
+#define THROTL_CACHE_SHIFT	2
 
 /* A workqueue to queue throttle related work */
 static struct workqueue_struct *kthrotld_workqueue;
@@ -37,6 +46,18 @@ struct throtl_rb_root {
 
 #define rb_entry_tg(node)	rb_entry((node), struct throtl_grp, rb_node)
 
+/*
+ * Tokens a cpu took from the buckets of a group and its ancestors in
+ * advance. Bios submitted on that cpu are charged here without taking
+ * queue_lock as long as the cache covers them.
+ */
+struct throtl_charge_cache {
+	u64 bytes[2];
+	unsigned int ios[2];
+	/* cache is stale unless this matches the group's cache_gen */
+	unsigned int gen;
+};
+
 struct throtl_grp {
 	/* List of throtl groups on the request queue*/
 	struct hlist_node tg_node;
@@ -67,14 +88,23 @@ struct throtl_grp {
 	/* IOPS limits */
 	unsigned int iops[2];
 
-	/* Number of bytes disptached in current slice */
-	uint64_t bytes_disp[2];
-	/* Number of bio's dispatched in current slice */
-	unsigned int io_disp[2];
+	/* Group of the parent cgroup. Its limits apply to this group too */
+	struct throtl_grp *parent;
+
+	/*
+	 * Token buckets. Tokens are kept in bytes (or ios) times HZ, so
+	 * every elapsed jiffy adds exactly bps (or iops) tokens. A bucket
+	 * holds at most burst jiffies worth of tokens and goes negative
+	 * when a bio bigger than the whole bucket is dispatched.
+	 */
+	s64 bytes_tokens[2];
+	s64 io_tokens[2];
+
+	/* When were the buckets last refilled */
+	unsigned long last_refill[2];
 
-	/* When did we start a new slice */
-	unsigned long slice_start[2];
-	unsigned long slice_end[2];
+	struct throtl_charge_cache __percpu *charge_cache;
+	unsigned int cache_gen;
 
 	/* Some throttle limits got updated for the group */
 	int limits_changed;
@@ -105,6 +135,9 @@ struct throtl_data
 	struct delayed_work throtl_work;
 
 	int limits_changed;
+
+	/* Bucket depth in jiffies */
+	unsigned long burst;
 };
 
 enum tg_state_flags {
@@ -153,15 +186,18 @@ static inline struct throtl_grp *throtl_ref_get_tg(struct throtl_grp *tg)
 	return tg;
 }
 
-static void throtl_free_tg(struct rcu_head *head)
+static void __throtl_free_tg(struct throtl_grp *tg)
 {
-	struct throtl_grp *tg;
-
-	tg = container_of(head, struct throtl_grp, rcu_head);
+	free_percpu(tg->charge_cache);
 	free_percpu(tg->blkg.stats_cpu);
 	kfree(tg);
 }
 
+static void throtl_free_tg(struct rcu_head *head)
+{
+	__throtl_free_tg(container_of(head, struct throtl_grp, rcu_head));
+}
+
 static void throtl_put_tg(struct throtl_grp *tg)
 {
 	BUG_ON(atomic_read(&tg->ref) <= 0);
@@ -177,6 +213,8 @@ static void throtl_put_tg(struct throtl_grp *tg)
 	 * Having a reference to blkg under an rcu allows acess to only
 	 * values local to groups like group stats and group rate limits
 	 */
+	if (tg->parent)
+		throtl_put_tg(tg->parent);
 	call_rcu(&tg->rcu_head, throtl_free_tg);
 }
 
@@ -245,11 +283,119 @@ throtl_tg_fill_dev_details(struct throtl_data *td, struct throtl_grp *tg)
 	spin_unlock_irq(td->queue->queue_lock);
 }
 
+/* Number of tokens a full bucket filling at @rate holds */
+static s64 throtl_bucket_size(struct throtl_data *td, u64 rate)
+{
+	if (rate > LLONG_MAX / td->burst)
+		return LLONG_MAX;
+	return rate * td->burst;
+}
+
+static void throtl_refill_bucket(struct throtl_data *td, s64 *tokens,
+				u64 rate, unsigned long elapsed)
+{
+	s64 size = throtl_bucket_size(td, rate);
+
+	/* Bucket is full, or burst was reduced under us */
+	if (*tokens >= size) {
+		*tokens = size;
+		return;
+	}
+
+	if (elapsed > div64_u64(size - *tokens, rate))
+		*tokens = size;
+	else
+		*tokens += rate * elapsed;
+}
+
+static void
+throtl_refill_tokens(struct throtl_data *td, struct throtl_grp *tg, bool rw)
+{
+	unsigned long elapsed = jiffies - tg->last_refill[rw];
+
+	if (!elapsed)
+		return;
+
+	tg->last_refill[rw] = jiffies;
+
+	if (tg->bps[rw] != -1)
+		throtl_refill_bucket(td, &tg->bytes_tokens[rw], tg->bps[rw],
+					elapsed);
+	if (tg->iops[rw] != -1)
+		throtl_refill_bucket(td, &tg->io_tokens[rw], tg->iops[rw],
+					elapsed);
+}
+
+/* Start over with full buckets, used for new groups and limit changes */
+static void
+throtl_reset_tokens(struct throtl_data *td, struct throtl_grp *tg, bool rw)
+{
+	tg->last_refill[rw] = jiffies;
+	tg->bytes_tokens[rw] = tg->bps[rw] == -1 ? 0 :
+				throtl_bucket_size(td, tg->bps[rw]);
+	tg->io_tokens[rw] = tg->iops[rw] == -1 ? 0 :
+				throtl_bucket_size(td, tg->iops[rw]);
+}
+
+/*
+ * Return number of jiffies until a bucket filling at @rate holds @cost
+ * tokens. A bio bigger than the bucket only waits for a full bucket.
+ */
+static unsigned long throtl_bucket_wait(struct throtl_data *td, s64 tokens,
+				u64 rate, s64 cost)
+{
+	cost = min(cost, throtl_bucket_size(td, rate));
+	if (tokens >= cost)
+		return 0;
+
+	return div64_u64(cost - tokens + rate - 1, rate);
+}
+
+/* Take tokens for @bytes and @ios from @tg and all its ancestors */
+static void throtl_charge_tokens(struct throtl_grp *tg, bool rw, u64 bytes,
+				unsigned int ios)
+{
+	for (; tg; tg = tg->parent) {
+		if (tg->bps[rw] != -1)
+			tg->bytes_tokens[rw] -= bytes * HZ;
+		if (tg->iops[rw] != -1)
+			tg->io_tokens[rw] -= (s64)ios * HZ;
+	}
+}
+
+static struct throtl_grp *
+throtl_find_tg(struct throtl_data *td, struct blkio_cgroup *blkcg);
+
+static struct blkio_cgroup *blkcg_parent(struct blkio_cgroup *blkcg)
+{
+	struct cgroup *parent;
+
+	if (blkcg == &blkio_root_cgroup)
+		return NULL;
+
+	parent = blkcg->css.cgroup->parent;
+	return parent ? cgroup_to_blkio_cgroup(parent) : NULL;
+}
+
 static void throtl_init_add_tg_lists(struct throtl_data *td,
 			struct throtl_grp *tg, struct blkio_cgroup *blkcg)
 {
+	struct blkio_cgroup *parent = blkcg_parent(blkcg);
+
 	__throtl_tg_fill_dev_details(td, tg);
 
+	/*
+	 * Groups are created top down, so the parent group exists already.
+	 * It has to be linked before the group becomes visible to lockless
+	 * lookups in blk_throtl_bio().
+	 */
+	if (parent) {
+		struct throtl_grp *ptg = throtl_find_tg(td, parent);
+
+		if (ptg)
+			tg->parent = throtl_ref_get_tg(ptg);
+	}
+
 	/* Add group onto cgroup list */
 	blkiocg_add_blkio_group(blkcg, &tg->blkg, (void *)td,
 				tg->blkg.dev, BLKIO_POLICY_THROTL);
@@ -258,6 +404,8 @@ static void throtl_init_add_tg_lists(struct throtl_data *td,
 	tg->bps[WRITE] = blkcg_get_write_bps(blkcg, tg->blkg.dev);
 	tg->iops[READ] = blkcg_get_read_iops(blkcg, tg->blkg.dev);
 	tg->iops[WRITE] = blkcg_get_write_iops(blkcg, tg->blkg.dev);
+	throtl_reset_tokens(td, tg, READ);
+	throtl_reset_tokens(td, tg, WRITE);
 
 	throtl_add_group_to_td_list(td, tg);
 }
@@ -279,6 +427,12 @@ static struct throtl_grp *throtl_alloc_tg(struct throtl_data *td)
 		return NULL;
 	}
 
+	tg->charge_cache = alloc_percpu(struct throtl_charge_cache);
+	if (!tg->charge_cache) {
+		__throtl_free_tg(tg);
+		return NULL;
+	}
+
 	throtl_init_group(tg);
 	return tg;
 }
@@ -302,78 +456,96 @@ throtl_grp *throtl_find_tg(struct throtl_data *td, struct blkio_cgroup *blkcg)
 	return tg;
 }
 
+/*
+ * Return the topmost cgroup between @blkcg and the root which does not
+ * have a group on @td yet, NULL if they all have one.
+ */
+static struct blkio_cgroup *
+throtl_missing_blkcg(struct throtl_data *td, struct blkio_cgroup *blkcg)
+{
+	struct blkio_cgroup *missing = NULL;
+
+	for (; blkcg; blkcg = blkcg_parent(blkcg))
+		if (!throtl_find_tg(td, blkcg))
+			missing = blkcg;
+
+	return missing;
+}
+
 /*
  * This function returns with queue lock unlocked in case of error, like
  * request queue is no more
  */
 static struct throtl_grp * throtl_get_tg(struct throtl_data *td)
 {
-	struct throtl_grp *tg = NULL, *__tg = NULL;
-	struct blkio_cgroup *blkcg;
+	struct throtl_grp *tg = NULL;
+	struct blkio_cgroup *blkcg, *missing;
 	struct request_queue *q = td->queue;
 
 	rcu_read_lock();
 	blkcg = task_blkio_cgroup(current);
-	tg = throtl_find_tg(td, blkcg);
-	if (tg) {
-		rcu_read_unlock();
-		return tg;
-	}
 
 	/*
-	 * Need to allocate a group. Allocation of group also needs allocation
-	 * of per cpu stats which in-turn takes a mutex() and can block. Hence
-	 * we need to drop rcu lock and queue_lock before we call alloc
-	 *
-	 * Take the request queue reference to make sure queue does not
-	 * go away once we return from allocation.
+	 * Limits apply hierarchically, so the groups of all ancestor cgroups
+	 * are needed as well. Create the missing ones top down, allocating
+	 * one group per pass.
 	 */
-	blk_get_queue(q);
-	rcu_read_unlock();
-	spin_unlock_irq(q->queue_lock);
+	while ((missing = throtl_missing_blkcg(td, blkcg))) {
+		if (tg) {
+			throtl_init_add_tg_lists(td, tg, missing);
+			tg = NULL;
+			continue;
+		}
 
-	tg = throtl_alloc_tg(td);
-	/*
-	 * We might have slept in group allocation. Make sure queue is not
-	 * dead
-	 */
-	if (unlikely(test_bit(QUEUE_FLAG_DEAD, &q->queue_flags))) {
-		blk_put_queue(q);
-		if (tg)
-			kfree(tg);
+		/*
+		 * Need to allocate a group. Allocation of group also needs
+		 * allocation of per cpu stats which in-turn takes a mutex()
+		 * and can block. Hence we need to drop rcu lock and
+		 * queue_lock before we call alloc
+		 *
+		 * Take the request queue reference to make sure queue does
+		 * not go away once we return from allocation.
+		 */
+		blk_get_queue(q);
+		rcu_read_unlock();
+		spin_unlock_irq(q->queue_lock);
 
-		return ERR_PTR(-ENODEV);
-	}
-	blk_put_queue(q);
+		tg = throtl_alloc_tg(td);
+		/*
+		 * We might have slept in group allocation. Make sure queue is
+		 * not dead
+		 */
+		if (unlikely(test_bit(QUEUE_FLAG_DEAD, &q->queue_flags))) {
+			blk_put_queue(q);
+			if (tg)
+				__throtl_free_tg(tg);
 
-	/* Group allocated and queue is still alive. take the lock */
-	spin_lock_irq(q->queue_lock);
+			return ERR_PTR(-ENODEV);
+		}
+		blk_put_queue(q);
 
-	/*
-	 * Initialize the new group. After sleeping, read the blkcg again.
-	 */
-	rcu_read_lock();
-	blkcg = task_blkio_cgroup(current);
+		/* Group allocated and queue is still alive. take the lock */
+		spin_lock_irq(q->queue_lock);
 
-	/*
-	 * If some other thread already allocated the group while we were
-	 * not holding queue lock, free up the group
-	 */
-	__tg = throtl_find_tg(td, blkcg);
+		/*
+		 * After sleeping, read the blkcg again. If some other thread
+		 * created the groups meanwhile, the loop ends and the spare
+		 * group gets freed below.
+		 */
+		rcu_read_lock();
+		blkcg = task_blkio_cgroup(current);
 
-	if (__tg) {
-		kfree(tg);
-		rcu_read_unlock();
-		return __tg;
+		/* Group allocation failed. Account the IO to root group */
+		if (!tg) {
+			rcu_read_unlock();
+			return td->root_tg;
+		}
 	}
 
-	/* Group allocation failed. Account the IO to root group */
-	if (!tg) {
-		tg = td->root_tg;
-		return tg;
-	}
+	if (tg)
+		__throtl_free_tg(tg);
 
-	throtl_init_add_tg_lists(td, tg, blkcg);
+	tg = throtl_find_tg(td, blkcg);
 	rcu_read_unlock();
 	return tg;
 }
@@ -493,199 +665,19 @@ static void throtl_schedule_next_dispatch(struct throtl_data *td)
 		throtl_schedule_delayed_work(td, (st->min_disptime - jiffies));
 }
 
-static inline void
-throtl_start_new_slice(struct throtl_data *td, struct throtl_grp *tg, bool rw)
-{
-	tg->bytes_disp[rw] = 0;
-	tg->io_disp[rw] = 0;
-	tg->slice_start[rw] = jiffies;
-	tg->slice_end[rw] = jiffies + throtl_slice;
-	throtl_log_tg(td, tg, "[%c] new slice start=%lu end=%lu jiffies=%lu",
-			rw == READ ? 'R' : 'W', tg->slice_start[rw],
-			tg->slice_end[rw], jiffies);
-}
-
-static inline void throtl_set_slice_end(struct throtl_data *td,
-		struct throtl_grp *tg, bool rw, unsigned long jiffy_end)
-{
-	tg->slice_end[rw] = roundup(jiffy_end, throtl_slice);
-}
-
-static inline void throtl_extend_slice(struct throtl_data *td,
-		struct throtl_grp *tg, bool rw, unsigned long jiffy_end)
-{
-	tg->slice_end[rw] = roundup(jiffy_end, throtl_slice);
-	throtl_log_tg(td, tg, "[%c] extend slice start=%lu end=%lu jiffies=%lu",
-			rw == READ ? 'R' : 'W', tg->slice_start[rw],
-			tg->slice_end[rw], jiffies);
-}
-
-/* Determine if previously allocated or extended slice is complete or not */
-static bool
-throtl_slice_used(struct throtl_data *td, struct throtl_grp *tg, bool rw)
-{
-	if (time_in_range(jiffies, tg->slice_start[rw], tg->slice_end[rw]))
-		return 0;
-
-	return 1;
-}
-
-/* Trim the used slices and adjust slice start accordingly */
-static inline void
-throtl_trim_slice(struct throtl_data *td, struct throtl_grp *tg, bool rw)
-{
-	unsigned long nr_slices, time_elapsed, io_trim;
-	u64 bytes_trim, tmp;
-
-	BUG_ON(time_before(tg->slice_end[rw], tg->slice_start[rw]));
-
-	/*
-	 * If bps are unlimited (-1), then time slice don't get
-	 * renewed. Don't try to trim the slice if slice is used. A new
-	 * slice will start when appropriate.
-	 */
-	if (throtl_slice_used(td, tg, rw))
-		return;
-
-	/*
-	 * A bio has been dispatched. Also adjust slice_end. It might happen
-	 * that initially cgroup limit was very low resulting in high
-	 * slice_end, but later limit was bumped up and bio was dispached
-	 * sooner, then we need to reduce slice_end. A high bogus slice_end
-	 * is bad because it does not allow new slice to start.
-	 */
-
-	throtl_set_slice_end(td, tg, rw, jiffies + throtl_slice);
-
-	time_elapsed = jiffies - tg->slice_start[rw];
-
-	nr_slices = time_elapsed / throtl_slice;
-
-	if (!nr_slices)
-		return;
-	tmp = tg->bps[rw] * throtl_slice * nr_slices;
-	do_div(tmp, HZ);
-	bytes_trim = tmp;
-
-	io_trim = (tg->iops[rw] * throtl_slice * nr_slices)/HZ;
-
-	if (!bytes_trim && !io_trim)
-		return;
-
-	if (tg->bytes_disp[rw] >= bytes_trim)
-		tg->bytes_disp[rw] -= bytes_trim;
-	else
-		tg->bytes_disp[rw] = 0;
-
-	if (tg->io_disp[rw] >= io_trim)
-		tg->io_disp[rw] -= io_trim;
-	else
-		tg->io_disp[rw] = 0;
-
-	tg->slice_start[rw] += nr_slices * throtl_slice;
-
-	throtl_log_tg(td, tg, "[%c] trim slice nr=%lu bytes=%llu io=%lu"
-			" start=%lu end=%lu jiffies=%lu",
-			rw == READ ? 'R' : 'W', nr_slices, bytes_trim, io_trim,
-			tg->slice_start[rw], tg->slice_end[rw], jiffies);
-}
-
-static bool tg_with_in_iops_limit(struct throtl_data *td, struct throtl_grp *tg,
-		struct bio *bio, unsigned long *wait)
-{
-	bool rw = bio_data_dir(bio);
-	unsigned int io_allowed;
-	unsigned long jiffy_elapsed, jiffy_wait, jiffy_elapsed_rnd;
-	u64 tmp;
-
-	jiffy_elapsed = jiffy_elapsed_rnd = jiffies - tg->slice_start[rw];
-
-	/* Slice has just started. Consider one slice interval */
-	if (!jiffy_elapsed)
-		jiffy_elapsed_rnd = throtl_slice;
-
-	jiffy_elapsed_rnd = roundup(jiffy_elapsed_rnd, throtl_slice);
-
-	/*
-	 * jiffy_elapsed_rnd should not be a big value as minimum iops can be
-	 * 1 then at max jiffy elapsed should be equivalent of 1 second as we
-	 * will allow dispatch after 1 second and after that slice should
-	 * have been trimmed.
-	 */
-
-	tmp = (u64)tg->iops[rw] * jiffy_elapsed_rnd;
-	do_div(tmp, HZ);
-
-	if (tmp > UINT_MAX)
-		io_allowed = UINT_MAX;
-	else
-		io_allowed = tmp;
-
-	if (tg->io_disp[rw] + 1 <= io_allowed) {
-		if (wait)
-			*wait = 0;
+static bool tg_no_rule_group(struct throtl_grp *tg, bool rw) {
+	if (tg->bps[rw] == -1 && tg->iops[rw] == -1)
 		return 1;
-	}
-
-	/* Calc approx time to dispatch */
-	jiffy_wait = ((tg->io_disp[rw] + 1) * HZ)/tg->iops[rw] + 1;
-
-	if (jiffy_wait > jiffy_elapsed)
-		jiffy_wait = jiffy_wait - jiffy_elapsed;
-	else
-		jiffy_wait = 1;
-
-	if (wait)
-		*wait = jiffy_wait;
 	return 0;
 }
 
-static bool tg_with_in_bps_limit(struct throtl_data *td, struct throtl_grp *tg,
-		struct bio *bio, unsigned long *wait)
+/* Neither the group nor any of its ancestors has a limit for @rw */
+static bool tg_no_rule_hierarchy(struct throtl_grp *tg, bool rw)
 {
-	bool rw = bio_data_dir(bio);
-	u64 bytes_allowed, extra_bytes, tmp;
-	unsigned long jiffy_elapsed, jiffy_wait, jiffy_elapsed_rnd;
-
-	jiffy_elapsed = jiffy_elapsed_rnd = jiffies - tg->slice_start[rw];
-
-	/* Slice has just started. Consider one slice interval */
-	if (!jiffy_elapsed)
-		jiffy_elapsed_rnd = throtl_slice;
-
-	jiffy_elapsed_rnd = roundup(jiffy_elapsed_rnd, throtl_slice);
-
-	tmp = tg->bps[rw] * jiffy_elapsed_rnd;
-	do_div(tmp, HZ);
-	bytes_allowed = tmp;
-
-	if (tg->bytes_disp[rw] + bio->bi_size <= bytes_allowed) {
-		if (wait)
-			*wait = 0;
-		return 1;
-	}
-
-	/* Calc approx time to dispatch */
-	extra_bytes = tg->bytes_disp[rw] + bio->bi_size - bytes_allowed;
-	jiffy_wait = div64_u64(extra_bytes * HZ, tg->bps[rw]);
-
-	if (!jiffy_wait)
-		jiffy_wait = 1;
-
-	/*
-	 * This wait time is without taking into consideration the rounding
-	 * up we did. Add that time also.
-	 */
-	jiffy_wait = jiffy_wait + (jiffy_elapsed_rnd - jiffy_elapsed);
-	if (wait)
-		*wait = jiffy_wait;
-	return 0;
-}
-
-static bool tg_no_rule_group(struct throtl_grp *tg, bool rw) {
-	if (tg->bps[rw] == -1 && tg->iops[rw] == -1)
-		return 1;
-	return 0;
+	for (; tg; tg = tg->parent)
+		if (!tg_no_rule_group(tg, rw))
+			return 0;
+	return 1;
 }
 
 /*
@@ -696,7 +688,7 @@ static bool tg_may_dispatch(struct throtl_data *td, struct throtl_grp *tg,
 				struct bio *bio, unsigned long *wait)
 {
 	bool rw = bio_data_dir(bio);
-	unsigned long bps_wait = 0, iops_wait = 0, max_wait = 0;
+	unsigned long max_wait = 0;
 
 	/*
  	 * Currently whole state machine of group depends on first bio
@@ -706,41 +698,26 @@ static bool tg_may_dispatch(struct throtl_data *td, struct throtl_grp *tg,
 	 */
 	BUG_ON(tg->nr_queued[rw] && bio != bio_list_peek(&tg->bio_lists[rw]));
 
-	/* If tg->bps = -1, then BW is unlimited */
-	if (tg->bps[rw] == -1 && tg->iops[rw] == -1) {
-		if (wait)
-			*wait = 0;
-		return 1;
-	}
+	for (; tg; tg = tg->parent) {
+		/* If tg->bps = -1, then BW is unlimited */
+		if (tg_no_rule_group(tg, rw))
+			continue;
 
-	/*
-	 * If previous slice expired, start a new one otherwise renew/extend
-	 * existing slice to make sure it is at least throtl_slice interval
-	 * long since now.
-	 */
-	if (throtl_slice_used(td, tg, rw))
-		throtl_start_new_slice(td, tg, rw);
-	else {
-		if (time_before(tg->slice_end[rw], jiffies + throtl_slice))
-			throtl_extend_slice(td, tg, rw, jiffies + throtl_slice);
-	}
+		throtl_refill_tokens(td, tg, rw);
 
-	if (tg_with_in_bps_limit(td, tg, bio, &bps_wait)
-	    && tg_with_in_iops_limit(td, tg, bio, &iops_wait)) {
-		if (wait)
-			*wait = 0;
-		return 1;
+		if (tg->bps[rw] != -1)
+			max_wait = max(max_wait, throtl_bucket_wait(td,
+					tg->bytes_tokens[rw], tg->bps[rw],
+					(s64)bio->bi_size * HZ));
+		if (tg->iops[rw] != -1)
+			max_wait = max(max_wait, throtl_bucket_wait(td,
+					tg->io_tokens[rw], tg->iops[rw], HZ));
 	}
 
-	max_wait = max(bps_wait, iops_wait);
-
 	if (wait)
 		*wait = max_wait;
 
-	if (time_before(tg->slice_end[rw], jiffies + max_wait))
-		throtl_extend_slice(td, tg, rw, jiffies + max_wait);
-
-	return 0;
+	return !max_wait;
 }
 
 static void throtl_charge_bio(struct throtl_grp *tg, struct bio *bio)
@@ -748,13 +725,91 @@ static void throtl_charge_bio(struct throtl_grp *tg, struct bio *bio)
 	bool rw = bio_data_dir(bio);
 	bool sync = rw_is_sync(bio->bi_rw);
 
-	/* Charge the bio to the group */
-	tg->bytes_disp[rw] += bio->bi_size;
-	tg->io_disp[rw]++;
+	/* Charge the bio to the group and its ancestors */
+	throtl_charge_tokens(tg, rw, bio->bi_size, 1);
 
 	blkiocg_update_dispatch_stats(&tg->blkg, bio->bi_size, rw, sync);
 }
 
+/*
+ * Move a batch of tokens from the buckets of @tg and its ancestors to
+ * this cpu's charge cache, so that the next bios can be charged without
+ * queue_lock. This is only done while all buckets on the way up are at
+ * least half full. Once a group actually gets throttled, caching stops
+ * and every bio is accounted exactly under queue_lock again.
+ *
+ * Called with queue_lock held.
+ */
+static void
+throtl_fill_charge_cache(struct throtl_data *td, struct throtl_grp *tg, bool rw)
+{
+	struct throtl_charge_cache *cache = this_cpu_ptr(tg->charge_cache);
+	unsigned int divisor = num_possible_cpus() * HZ;
+	u64 bytes = -1;
+	unsigned int ios = -1;
+	struct throtl_grp *p;
+	s64 size;
+
+	for (p = tg; p; p = p->parent) {
+		if (p->bps[rw] != -1) {
+			size = throtl_bucket_size(td, p->bps[rw]);
+			if (p->bytes_tokens[rw] < size / 2)
+				return;
+			bytes = min(bytes, div_u64(size >> THROTL_CACHE_SHIFT,
+							divisor));
+		}
+		if (p->iops[rw] != -1) {
+			size = throtl_bucket_size(td, p->iops[rw]);
+			if (p->io_tokens[rw] < size / 2)
+				return;
+			ios = min_t(u64, ios, div_u64(size >> THROTL_CACHE_SHIFT,
+							divisor));
+		}
+	}
+
+	/* Not worth it for tiny buckets */
+	if (bytes < PAGE_SIZE || !ios)
+		return;
+
+	if (cache->gen != tg->cache_gen) {
+		memset(cache, 0, sizeof(*cache));
+		cache->gen = tg->cache_gen;
+	}
+
+	throtl_charge_tokens(tg, rw, bytes, ios);
+	cache->bytes[rw] = bytes == -1 ? -1 : cache->bytes[rw] + bytes;
+	cache->ios[rw] = ios == -1 ? -1 : cache->ios[rw] + ios;
+}
+
+/*
+ * Charge @bio against this cpu's cached tokens. Returns true if the bio
+ * was charged and may be dispatched right away. Called without
+ * queue_lock, under rcu.
+ */
+static bool throtl_charge_cached(struct throtl_grp *tg, struct bio *bio)
+{
+	bool rw = bio_data_dir(bio);
+	struct throtl_charge_cache *cache;
+	unsigned long flags;
+	bool ret = false;
+
+	/* Don't overtake bios already waiting in the group */
+	if (ACCESS_ONCE(tg->nr_queued[rw]))
+		return false;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(tg->charge_cache);
+	if (cache->gen == ACCESS_ONCE(tg->cache_gen) &&
+	    cache->bytes[rw] >= bio->bi_size && cache->ios[rw]) {
+		cache->bytes[rw] -= bio->bi_size;
+		cache->ios[rw]--;
+		ret = true;
+	}
+	local_irq_restore(flags);
+
+	return ret;
+}
+
 static void throtl_add_bio_tg(struct throtl_data *td, struct throtl_grp *tg,
 			struct bio *bio)
 {
@@ -804,8 +859,6 @@ static void tg_dispatch_one_bio(struct throtl_data *td, struct throtl_grp *tg,
 	throtl_charge_bio(tg, bio);
 	bio_list_add(bl, bio);
 	bio->bi_rw |= REQ_THROTTLED;
-
-	throtl_trim_slice(td, tg, rw);
 }
 
 static int throtl_dispatch_tg(struct throtl_data *td, struct throtl_grp *tg,
@@ -885,6 +938,12 @@ static void throtl_process_limit_change(struct throtl_data *td)
 	throtl_log(td, "limits changed");
 
 	hlist_for_each_entry_safe(tg, pos, n, &td->tg_list, tg_node) {
+		/*
+		 * Tokens cached by cpus were taken under the old limits of
+		 * this group or one of its ancestors. Drop them all.
+		 */
+		tg->cache_gen++;
+
 		if (!tg->limits_changed)
 			continue;
 
@@ -896,13 +955,13 @@ static void throtl_process_limit_change(struct throtl_data *td)
 			tg->iops[READ], tg->iops[WRITE]);
 
 		/*
-		 * Restart the slices for both READ and WRITES. It
+		 * Refill the buckets for both READ and WRITES. It
 		 * might happen that a group's limit are dropped
 		 * suddenly and we don't want to account recently
 		 * dispatched IO with new low rate
 		 */
-		throtl_start_new_slice(td, tg, 0);
-		throtl_start_new_slice(td, tg, 1);
+		throtl_reset_tokens(td, tg, READ);
+		throtl_reset_tokens(td, tg, WRITE);
 
 		if (throtl_tg_on_rr(tg))
 			tg_update_disptime(td, tg);
@@ -1148,7 +1207,8 @@ int blk_throtl_bio(struct request_queue *q, struct bio **biop)
 	if (tg) {
 		throtl_tg_fill_dev_details(td, tg);
 
-		if (tg_no_rule_group(tg, rw)) {
+		if (tg_no_rule_hierarchy(tg, rw) ||
+		    throtl_charge_cached(tg, bio)) {
 			blkiocg_update_dispatch_stats(&tg->blkg, bio->bi_size,
 					rw, rw_is_sync(bio->bi_rw));
 			rcu_read_unlock();
@@ -1187,29 +1247,17 @@ int blk_throtl_bio(struct request_queue *q, struct bio **biop)
 	/* Bio is with-in rate limit of group */
 	if (tg_may_dispatch(td, tg, bio, NULL)) {
 		throtl_charge_bio(tg, bio);
-
-		/*
-		 * We need to trim slice even when bios are not being queued
-		 * otherwise it might happen that a bio is not queued for
-		 * a long time and slice keeps on extending and trim is not
-		 * called for a long time. Now if limits are reduced suddenly
-		 * we take into account all the IO dispatched so far at new
-		 * low rate and * newly queued IO gets a really long dispatch
-		 * time.
-		 *
-		 * So keep on trimming slice even if bio is not queued.
-		 */
-		throtl_trim_slice(td, tg, rw);
+		throtl_fill_charge_cache(td, tg, rw);
 		goto out;
 	}
 
 queue_bio:
-	throtl_log_tg(td, tg, "[%c] bio. bdisp=%llu sz=%u bps=%llu"
-			" iodisp=%u iops=%u queued=%d/%d",
+	throtl_log_tg(td, tg, "[%c] bio. btok=%lld sz=%u bps=%llu"
+			" iotok=%lld iops=%u queued=%d/%d",
 			rw == READ ? 'R' : 'W',
-			tg->bytes_disp[rw], bio->bi_size, tg->bps[rw],
-			tg->io_disp[rw], tg->iops[rw],
-			tg->nr_queued[READ], tg->nr_queued[WRITE]);
+			div_s64(tg->bytes_tokens[rw], HZ), bio->bi_size,
+			tg->bps[rw], div_s64(tg->io_tokens[rw], HZ),
+			tg->iops[rw], tg->nr_queued[READ], tg->nr_queued[WRITE]);
 
 	throtl_add_bio_tg(q->td, tg, bio);
 	*biop = NULL;
@@ -1236,6 +1284,7 @@ int blk_throtl_init(struct request_queue *q)
 	INIT_HLIST_HEAD(&td->tg_list);
 	td->tg_service_tree = THROTL_RB_ROOT;
 	td->limits_changed = false;
+	td->burst = throtl_burst;
 	INIT_DELAYED_WORK(&td->throtl_work, blk_throtl_work);
 
 	/* alloc and Init root group. */
@@ -1299,6 +1348,19 @@ void blk_throtl_exit(struct request_queue *q)
 	throtl_td_free(td);
 }
 
+unsigned int blk_throtl_burst_ms(struct request_queue *q)
+{
+	return jiffies_to_msecs(q->td->burst);
+}
+
+void blk_throtl_set_burst_ms(struct request_queue *q, unsigned int msecs)
+{
+	/* Buckets pick up the new depth lazily on refill */
+	spin_lock_irq(q->queue_lock);
+	q->td->burst = max(msecs_to_jiffies(msecs), 1UL);
+	spin_unlock_irq(q->queue_lock);
+}
+
 static int __init throtl_init(void)
 {
 	kthrotld_workqueue = alloc_workqueue("kthrotld", WQ_MEM_RECLAIM, 0);
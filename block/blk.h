@@ -25,6 +25,11 @@ void blk_delete_timer(struct request *);
 void blk_add_timer(struct request *);
 void __generic_unplug_device(struct request_queue *);
 
+#ifdef CONFIG_BLK_DEV_THROTTLING
+unsigned int blk_throtl_burst_ms(struct request_queue *q);
+void blk_throtl_set_burst_ms(struct request_queue *q, unsigned int msecs);
+#endif
+
 /*
  * Internal atomic flags for request handling
  */
@@ -44,13 +44,15 @@ static DEFINE_SPINLOCK(elv_list_lock);
 static LIST_HEAD(elv_list);
 
 /*
- * Merge hash stuff.
+ * Merge hash stuff. The hash is sized to the queue depth, see
+ * elv_hash_shift().
  */
-static const int elv_hash_shift = 6;
+#define ELV_HASH_SHIFT_MIN	6
+#define ELV_HASH_SHIFT_MAX	12
 #define ELV_HASH_BLOCK(sec)	((sec) >> 3)
-#define ELV_HASH_FN(sec)	\
-		(hash_long(ELV_HASH_BLOCK((sec)), elv_hash_shift))
-#define ELV_HASH_ENTRIES	(1 << elv_hash_shift)
+#define ELV_HASH_FN(e, sec)	\
+		(hash_long(ELV_HASH_BLOCK((sec)), (e)->hash_shift))
+#define ELV_HASH_ENTRIES(e)	(1 << (e)->hash_shift)
 #define rq_hash_key(rq)		(blk_rq_pos(rq) + blk_rq_sectors(rq))
 
 /*
@@ -198,11 +200,35 @@ __setup("elevator=", elevator_setup);
 
 static struct kobj_type elv_ktype;
 
+/*
+ * About one hash bucket per request which may be queued in either
+ * direction.
+ */
+static unsigned int elv_hash_shift(struct request_queue *q)
+{
+	return clamp_t(unsigned int, ilog2(q->nr_requests) + 1,
+		       ELV_HASH_SHIFT_MIN, ELV_HASH_SHIFT_MAX);
+}
+
+static struct hlist_head *elv_hash_alloc(struct request_queue *q,
+					 unsigned int shift)
+{
+	struct hlist_head *hash;
+	int i;
+
+	hash = kmalloc_node(sizeof(struct hlist_head) << shift, GFP_KERNEL,
+			    q->node);
+	if (hash)
+		for (i = 0; i < 1 << shift; i++)
+			INIT_HLIST_HEAD(&hash[i]);
+
+	return hash;
+}
+
 static struct elevator_queue *elevator_alloc(struct request_queue *q,
 				  struct elevator_type *e)
 {
 	struct elevator_queue *eq;
-	int i;
 
 	eq = kmalloc_node(sizeof(*eq), GFP_KERNEL | __GFP_ZERO, q->node);
 	if (unlikely(!eq))
@@ -213,14 +239,11 @@ static struct elevator_queue *elevator_alloc(struct request_queue *q,
 	kobject_init(&eq->kobj, &elv_ktype);
 	mutex_init(&eq->sysfs_lock);
 
-	eq->hash = kmalloc_node(sizeof(struct hlist_head) * ELV_HASH_ENTRIES,
-					GFP_KERNEL, q->node);
+	eq->hash_shift = elv_hash_shift(q);
+	eq->hash = elv_hash_alloc(q, eq->hash_shift);
 	if (!eq->hash)
 		goto err;
 
-	for (i = 0; i < ELV_HASH_ENTRIES; i++)
-		INIT_HLIST_HEAD(&eq->hash[i]);
-
 	return eq;
 err:
 	kfree(eq);
@@ -318,7 +341,7 @@ static void elv_rqhash_add(struct request_queue *q, struct request *rq)
 	struct elevator_queue *e = q->elevator;
 
 	BUG_ON(ELV_ON_HASH(rq));
-	hlist_add_head(&rq->hash, &e->hash[ELV_HASH_FN(rq_hash_key(rq))]);
+	hlist_add_head(&rq->hash, &e->hash[ELV_HASH_FN(e, rq_hash_key(rq))]);
 }
 
 static void elv_rqhash_reposition(struct request_queue *q, struct request *rq)
@@ -330,7 +353,7 @@ static void elv_rqhash_reposition(struct request_queue *q, struct request *rq)
 static struct request *elv_rqhash_find(struct request_queue *q, sector_t offset)
 {
 	struct elevator_queue *e = q->elevator;
-	struct hlist_head *hash_list = &e->hash[ELV_HASH_FN(offset)];
+	struct hlist_head *hash_list = &e->hash[ELV_HASH_FN(e, offset)];
 	struct hlist_node *entry, *next;
 	struct request *rq;
 
@@ -349,6 +372,89 @@ static struct request *elv_rqhash_find(struct request_queue *q, sector_t offset)
 	return NULL;
 }
 
+/*
+ * Resize the merge hash after the queue depth changed. Called with the
+ * queue's sysfs_lock held, which keeps the elevator from being switched.
+ */
+int elv_resize_hash(struct request_queue *q)
+{
+	struct elevator_queue *e = q->elevator;
+	struct hlist_head *hash, *old_hash;
+	struct hlist_node *entry, *next;
+	unsigned int shift, old_shift;
+	struct request *rq;
+	int i;
+
+	shift = elv_hash_shift(q);
+	if (!e || shift == e->hash_shift)
+		return 0;
+
+	hash = elv_hash_alloc(q, shift);
+	if (!hash)
+		return -ENOMEM;
+
+	spin_lock_irq(q->queue_lock);
+	old_hash = e->hash;
+	old_shift = e->hash_shift;
+	e->hash = hash;
+	e->hash_shift = shift;
+
+	for (i = 0; i < 1 << old_shift; i++) {
+		hlist_for_each_entry_safe(rq, entry, next, &old_hash[i], hash) {
+			__elv_rqhash_del(rq);
+			elv_rqhash_add(q, rq);
+		}
+	}
+	spin_unlock_irq(q->queue_lock);
+
+	kfree(old_hash);
+	return 0;
+}
+
+/*
+ * Per task one-hit merge cache. Interleaved streams from several tasks
+ * keep knocking each other out of q->last_merge, this remembers the
+ * last request each task merged into or added. As elv_try_merge()
+ * checks both ends of the request, it also saves the io scheduler's
+ * rbtree walk for repeated front merges.
+ */
+static inline struct elv_merge_hint *elv_task_hint(struct elevator_queue *e)
+{
+	return &e->merge_hint[hash_ptr(current, ELV_MERGE_HINT_SHIFT)];
+}
+
+static struct request *elv_task_last_merge(struct elevator_queue *e)
+{
+	struct elv_merge_hint *hint = elv_task_hint(e);
+
+	return hint->task == current ? hint->rq : NULL;
+}
+
+static void elv_set_task_last_merge(struct elevator_queue *e,
+				    struct request *rq)
+{
+	struct elv_merge_hint *hint = elv_task_hint(e);
+
+	hint->task = current;
+	hint->rq = rq;
+}
+
+/*
+ * rq leaves the elevator, drop it from the merge caches.
+ */
+static void elv_forget_merge(struct request_queue *q, struct request *rq)
+{
+	struct elevator_queue *e = q->elevator;
+	int i;
+
+	if (q->last_merge == rq)
+		q->last_merge = NULL;
+
+	for (i = 0; i < ELV_MERGE_HINT_ENTRIES; i++)
+		if (e->merge_hint[i].rq == rq)
+			e->merge_hint[i].rq = NULL;
+}
+
 /*
  * RB-tree support functions for inserting/lookup/removal of requests
  * in a sorted RB tree.
@@ -416,9 +522,7 @@ void elv_dispatch_sort(struct request_queue *q, struct request *rq)
 	struct list_head *entry;
 	int stop_flags;
 
-	if (q->last_merge == rq)
-		q->last_merge = NULL;
-
+	elv_forget_merge(q, rq);
 	elv_rqhash_del(q, rq);
 
 	q->nr_sorted--;
@@ -457,9 +561,7 @@ EXPORT_SYMBOL(elv_dispatch_sort);
  */
 void elv_dispatch_add_tail(struct request_queue *q, struct request *rq)
 {
-	if (q->last_merge == rq)
-		q->last_merge = NULL;
-
+	elv_forget_merge(q, rq);
 	elv_rqhash_del(q, rq);
 
 	q->nr_sorted--;
@@ -492,12 +594,26 @@ int elv_merge(struct request_queue *q, struct request **req, struct bio *bio)
 		ret = elv_try_merge(q->last_merge, bio);
 		if (ret != ELEVATOR_NO_MERGE) {
 			*req = q->last_merge;
+			e->merge_stats.last_merge++;
+			return ret;
+		}
+	}
+
+	/*
+	 * Then the one-hit cache of the submitting task.
+	 */
+	__rq = elv_task_last_merge(e);
+	if (__rq && __rq != q->last_merge) {
+		ret = elv_try_merge(__rq, bio);
+		if (ret != ELEVATOR_NO_MERGE) {
+			*req = __rq;
+			e->merge_stats.task_hint++;
 			return ret;
 		}
 	}
 
 	if (blk_queue_noxmerges(q))
-		return ELEVATOR_NO_MERGE;
+		goto miss;
 
 	/*
 	 * See if our hash lookup can find a potential backmerge.
@@ -505,12 +621,20 @@ int elv_merge(struct request_queue *q, struct request **req, struct bio *bio)
 	__rq = elv_rqhash_find(q, bio->bi_sector);
 	if (__rq && elv_rq_merge_ok(__rq, bio)) {
 		*req = __rq;
+		e->merge_stats.hash++;
 		return ELEVATOR_BACK_MERGE;
 	}
 
-	if (e->ops->elevator_merge_fn)
-		return e->ops->elevator_merge_fn(q, req, bio);
+	if (e->ops->elevator_merge_fn) {
+		ret = e->ops->elevator_merge_fn(q, req, bio);
+		if (ret != ELEVATOR_NO_MERGE) {
+			e->merge_stats.sched++;
+			return ret;
+		}
+	}
 
+miss:
+	e->merge_stats.miss++;
 	return ELEVATOR_NO_MERGE;
 }
 
@@ -559,6 +683,7 @@ void elv_merged_request(struct request_queue *q, struct request *rq, int type)
 		elv_rqhash_reposition(q, rq);
 
 	q->last_merge = rq;
+	elv_set_task_last_merge(e, rq);
 }
 
 void elv_merge_requests(struct request_queue *q, struct request *rq,
@@ -577,6 +702,7 @@ void elv_merge_requests(struct request_queue *q, struct request *rq,
 		q->nr_sorted--;
 	}
 
+	elv_forget_merge(q, next);
 	q->last_merge = rq;
 }
 
@@ -707,6 +833,7 @@ void __elv_add_request(struct request_queue *q, struct request *rq, int where)
 			elv_rqhash_add(q, rq);
 			if (!q->last_merge)
 				q->last_merge = rq;
+			elv_set_task_last_merge(q->elevator, rq);
 		}
 
 		/*
@@ -1094,6 +1221,26 @@ ssize_t elv_iosched_show(struct request_queue *q, char *name)
 	return len;
 }
 
+ssize_t elv_merge_stats_show(struct request_queue *q, char *page)
+{
+	struct elevator_queue *e = q->elevator;
+	struct elv_merge_stats stats;
+	unsigned int buckets;
+
+	if (!e)
+		return -EINVAL;
+
+	spin_lock_irq(q->queue_lock);
+	stats = e->merge_stats;
+	buckets = ELV_HASH_ENTRIES(e);
+	spin_unlock_irq(q->queue_lock);
+
+	return sprintf(page, "last_merge %lu\ntask_hint %lu\nhash %lu\n"
+		       "sched %lu\nmiss %lu\nhash_buckets %u\n",
+		       stats.last_merge, stats.task_hint, stats.hash,
+		       stats.sched, stats.miss, buckets);
+}
+
 struct request *elv_rb_former_request(struct request_queue *q,
 				      struct request *rq)
 {
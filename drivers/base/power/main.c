@@ -17,6 +17,7 @@
  * subsystem list maintains.
  */
 
+#include <linux/debugfs.h>
 #include <linux/device.h>
 #include <linux/kallsyms.h>
 #include <linux/mutex.h>
@@ -26,6 +27,8 @@
 #include <linux/interrupt.h>
 #include <linux/sched.h>
 #include <linux/async.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
 #include <linux/suspend.h>
 #include <linux/timer.h>
 
@@ -58,6 +61,22 @@ struct dpm_drv_wd_data {
 
 static int async_error;
 
+/*
+ * PM dependencies between devices other than parent and child, such as a
+ * device and the regulator or clock provider it needs. A supplier is
+ * suspended after and resumed before all of its consumers, whether or not
+ * either of them is handled asynchronously. Protected by dpm_list_mtx.
+ */
+struct dpm_link {
+	struct device		*supplier;
+	struct device		*consumer;
+	struct list_head	s_node;		/* supplier->power.consumers */
+	struct list_head	c_node;		/* consumer->power.suppliers */
+};
+
+/* Wall clock time of each phase during the last transition, for debugfs. */
+static unsigned int dpm_phase_wall_usecs[DPM_PHASE_NR];
+
 /**
  * device_pm_init - Initialize the PM-related part of a device object.
  * @dev: Device object being initialized.
@@ -66,12 +85,17 @@ void device_pm_init(struct device *dev)
 {
 	dev->power.is_prepared = false;
 	dev->power.is_suspended = false;
+#ifdef CONFIG_PM_ASYNC_DEFAULT
+	dev->power.async_suspend = true;
+#endif
 	init_completion(&dev->power.completion);
 	complete_all(&dev->power.completion);
 	dev->power.wakeup = NULL;
 	spin_lock_init(&dev->power.lock);
 	pm_runtime_init(dev);
 	INIT_LIST_HEAD(&dev->power.entry);
+	INIT_LIST_HEAD(&dev->power.suppliers);
+	INIT_LIST_HEAD(&dev->power.consumers);
 }
 
 /**
@@ -90,6 +114,23 @@ void device_pm_unlock(void)
 	mutex_unlock(&dpm_list_mtx);
 }
 
+static void dpm_free_link(struct dpm_link *link)
+{
+	list_del(&link->s_node);
+	list_del(&link->c_node);
+	kfree(link);
+}
+
+static void dpm_drop_links(struct device *dev)
+{
+	struct dpm_link *link, *tmp;
+
+	list_for_each_entry_safe(link, tmp, &dev->power.suppliers, c_node)
+		dpm_free_link(link);
+	list_for_each_entry_safe(link, tmp, &dev->power.consumers, s_node)
+		dpm_free_link(link);
+}
+
 /**
  * device_pm_add - Add a device to the PM core's list of active devices.
  * @dev: Device to add to the list.
@@ -117,6 +158,7 @@ void device_pm_remove(struct device *dev)
 	complete_all(&dev->power.completion);
 	mutex_lock(&dpm_list_mtx);
 	list_del_init(&dev->power.entry);
+	dpm_drop_links(dev);
 	mutex_unlock(&dpm_list_mtx);
 	device_wakeup_disable(dev);
 	pm_runtime_remove(dev);
@@ -161,6 +203,104 @@ void device_pm_move_last(struct device *dev)
 	list_move_tail(&dev->power.entry, &dpm_list);
 }
 
+/* Is @target @dev itself or does it depend on @dev? */
+static int dpm_is_dependent(struct device *dev, void *target)
+{
+	struct dpm_link *link;
+
+	if (dev == target)
+		return 1;
+
+	if (device_for_each_child(dev, target, dpm_is_dependent))
+		return 1;
+
+	list_for_each_entry(link, &dev->power.consumers, s_node)
+		if (dpm_is_dependent(link->consumer, target))
+			return 1;
+
+	return 0;
+}
+
+/* Move @dev and everything that depends on it to the end of dpm_list. */
+static int dpm_reorder_to_tail(struct device *dev, void *not_used)
+{
+	struct dpm_link *link;
+
+	device_pm_move_last(dev);
+	device_for_each_child(dev, NULL, dpm_reorder_to_tail);
+	list_for_each_entry(link, &dev->power.consumers, s_node)
+		dpm_reorder_to_tail(link->consumer, NULL);
+
+	return 0;
+}
+
+/**
+ * device_pm_add_link - Make system PM of a device depend on another device.
+ * @consumer: Device that needs @supplier to be functional.
+ * @supplier: Device that @consumer depends on.
+ *
+ * Make the PM core suspend @supplier after and resume it before @consumer,
+ * like it does for a parent and its children. Both devices have to be
+ * registered. Must not be called during a system power transition.
+ */
+int device_pm_add_link(struct device *consumer, struct device *supplier)
+{
+	struct dpm_link *link;
+	int error = 0;
+
+	link = kzalloc(sizeof(*link), GFP_KERNEL);
+	if (!link)
+		return -ENOMEM;
+
+	link->supplier = supplier;
+	link->consumer = consumer;
+
+	mutex_lock(&dpm_list_mtx);
+	if (list_empty(&consumer->power.entry) ||
+	    list_empty(&supplier->power.entry)) {
+		error = -ENODEV;
+		goto out;
+	}
+	if (consumer->power.is_prepared || supplier->power.is_prepared) {
+		error = -EBUSY;
+		goto out;
+	}
+	/* A dependency cycle would deadlock the next transition. */
+	if (dpm_is_dependent(consumer, supplier)) {
+		error = -EINVAL;
+		goto out;
+	}
+
+	list_add_tail(&link->s_node, &supplier->power.consumers);
+	list_add_tail(&link->c_node, &consumer->power.suppliers);
+	dpm_reorder_to_tail(consumer, NULL);
+	link = NULL;
+ out:
+	mutex_unlock(&dpm_list_mtx);
+	kfree(link);
+	return error;
+}
+EXPORT_SYMBOL_GPL(device_pm_add_link);
+
+/**
+ * device_pm_remove_link - Remove a dependency added by device_pm_add_link().
+ * @consumer: Device that needed @supplier.
+ * @supplier: Device that @consumer depended on.
+ */
+void device_pm_remove_link(struct device *consumer, struct device *supplier)
+{
+	struct dpm_link *link;
+
+	mutex_lock(&dpm_list_mtx);
+	list_for_each_entry(link, &consumer->power.suppliers, c_node)
+		if (link->supplier == supplier) {
+			dpm_free_link(link);
+			break;
+		}
+	mutex_unlock(&dpm_list_mtx);
+}
+EXPORT_SYMBOL_GPL(device_pm_remove_link);
+
 static ktime_t initcall_debug_start(struct device *dev)
 {
 	ktime_t calltime = ktime_set(0, 0);
@@ -212,6 +352,61 @@ static void dpm_wait_for_children(struct device *dev, bool async)
        device_for_each_child(dev, &async, dpm_wait_fn);
 }
 
+static struct device *dpm_link_pending(struct device *dev, bool suppliers)
+{
+	struct dpm_link *link;
+
+	if (suppliers) {
+		list_for_each_entry(link, &dev->power.suppliers, c_node)
+			if (!completion_done(&link->supplier->power.completion))
+				return link->supplier;
+	} else {
+		list_for_each_entry(link, &dev->power.consumers, s_node)
+			if (!completion_done(&link->consumer->power.completion))
+				return link->consumer;
+	}
+
+	return NULL;
+}
+
+/**
+ * dpm_wait_for_links - Wait for the devices linked to a device.
+ * @dev: Device to handle.
+ * @suppliers: Wait for the suppliers of @dev if set, for its consumers if not.
+ *
+ * Links are not ordered by dpm_list position when they are handled
+ * asynchronously, so always wait for the completion. dpm_list_mtx can't be
+ * held while doing that, so the list walk starts over after each wait.
+ */
+static void dpm_wait_for_links(struct device *dev, bool suppliers)
+{
+	struct device *other;
+
+	if (list_empty(suppliers ? &dev->power.suppliers :
+				   &dev->power.consumers))
+		return;
+
+	for (;;) {
+		mutex_lock(&dpm_list_mtx);
+		other = dpm_link_pending(dev, suppliers);
+		if (other)
+			get_device(other);
+		mutex_unlock(&dpm_list_mtx);
+
+		if (!other)
+			break;
+
+		wait_for_completion(&other->power.completion);
+		put_device(other);
+	}
+}
+
+static void dpm_save_time(struct device *dev, enum dpm_phase phase,
+			  ktime_t starttime)
+{
+	dev->power.phase_usecs[phase] = ktime_us_delta(ktime_get(), starttime);
+}
+
 /**
  * pm_op - Execute the PM operation appropriate for given PM event.
  * @dev: Device to handle.
@@ -398,7 +593,8 @@ static void pm_dev_err(struct device *dev, pm_message_t state, char *info,
 		dev_name(dev), pm_verb(state.event), info, error);
 }
 
-static void dpm_show_time(ktime_t starttime, pm_message_t state, char *info)
+static void dpm_show_time(ktime_t starttime, pm_message_t state, char *info,
+			  enum dpm_phase phase)
 {
 	ktime_t calltime;
 	u64 usecs64;
@@ -410,6 +606,7 @@ static void dpm_show_time(ktime_t starttime, pm_message_t state, char *info)
 	usecs = usecs64;
 	if (usecs == 0)
 		usecs = 1;
+	dpm_phase_wall_usecs[phase] = usecs;
 	pr_info("PM: %s%s%s of devices complete after %ld.%03ld msecs\n",
 		info ?: "", info ? " " : "", pm_verb(state.event),
 		usecs / USEC_PER_MSEC, usecs % USEC_PER_MSEC);
@@ -427,6 +624,7 @@ static void dpm_show_time(ktime_t starttime, pm_message_t state, char *info)
  */
 static int device_resume_noirq(struct device *dev, pm_message_t state)
 {
+	ktime_t starttime = ktime_get();
 	int error = 0;
 
 	TRACE_DEVICE(dev);
@@ -446,6 +644,7 @@ static int device_resume_noirq(struct device *dev, pm_message_t state)
 		error = pm_noirq_op(dev, dev->bus->pm, state);
 	}
 
+	dpm_save_time(dev, DPM_PHASE_RESUME_NOIRQ, starttime);
 	TRACE_RESUME(error);
 	return error;
 }
@@ -478,7 +677,7 @@ void dpm_resume_noirq(pm_message_t state)
 		put_device(dev);
 	}
 	mutex_unlock(&dpm_list_mtx);
-	dpm_show_time(starttime, state, "early");
+	dpm_show_time(starttime, state, "early", DPM_PHASE_RESUME_NOIRQ);
 	resume_device_irqs();
 }
 EXPORT_SYMBOL_GPL(dpm_resume_noirq);
@@ -511,6 +710,7 @@ static int legacy_resume(struct device *dev, int (*cb)(struct device *dev))
  */
 static int device_resume(struct device *dev, pm_message_t state, bool async)
 {
+	ktime_t starttime;
 	int error = 0;
 	bool put = false;
 
@@ -518,6 +718,8 @@ static int device_resume(struct device *dev, pm_message_t state, bool async)
 	TRACE_RESUME(0);
 
 	dpm_wait(dev->parent, async);
+	dpm_wait_for_links(dev, true);
+	starttime = ktime_get();
 	device_lock(dev);
 
 	/*
@@ -571,6 +773,7 @@ static int device_resume(struct device *dev, pm_message_t state, bool async)
 
  Unlock:
 	device_unlock(dev);
+	dpm_save_time(dev, DPM_PHASE_RESUME, starttime);
 	complete_all(&dev->power.completion);
 
 	TRACE_RESUME(error);
@@ -668,7 +871,7 @@ void dpm_resume(pm_message_t state)
 	}
 	mutex_unlock(&dpm_list_mtx);
 	async_synchronize_full();
-	dpm_show_time(starttime, state, NULL);
+	dpm_show_time(starttime, state, NULL, DPM_PHASE_RESUME);
 }
 
 /**
@@ -678,6 +881,8 @@ void dpm_resume(pm_message_t state)
  */
 static void device_complete(struct device *dev, pm_message_t state)
 {
+	ktime_t starttime = ktime_get();
+
 	device_lock(dev);
 
 	if (dev->pm_domain) {
@@ -699,6 +904,7 @@ static void device_complete(struct device *dev, pm_message_t state)
 	}
 
 	device_unlock(dev);
+	dpm_save_time(dev, DPM_PHASE_COMPLETE, starttime);
 }
 
 /**
@@ -710,6 +916,7 @@ static void device_complete(struct device *dev, pm_message_t state)
  */
 void dpm_complete(pm_message_t state)
 {
+	ktime_t starttime = ktime_get();
 	struct list_head list;
 
 	might_sleep();
@@ -731,6 +938,8 @@ void dpm_complete(pm_message_t state)
 	}
 	list_splice(&list, &dpm_list);
 	mutex_unlock(&dpm_list_mtx);
+	dpm_phase_wall_usecs[DPM_PHASE_COMPLETE] =
+		ktime_us_delta(ktime_get(), starttime);
 }
 
 /**
@@ -781,31 +990,25 @@ static pm_message_t resume_event(pm_message_t sleep_state)
  */
 static int device_suspend_noirq(struct device *dev, pm_message_t state)
 {
-	int error;
+	ktime_t starttime = ktime_get();
+	int error = 0;
 
 	if (dev->pm_domain) {
 		pm_dev_dbg(dev, state, "LATE power domain ");
 		error = pm_noirq_op(dev, &dev->pm_domain->ops, state);
-		if (error)
-			return error;
 	} else if (dev->type && dev->type->pm) {
 		pm_dev_dbg(dev, state, "LATE type ");
 		error = pm_noirq_op(dev, dev->type->pm, state);
-		if (error)
-			return error;
 	} else if (dev->class && dev->class->pm) {
 		pm_dev_dbg(dev, state, "LATE class ");
 		error = pm_noirq_op(dev, dev->class->pm, state);
-		if (error)
-			return error;
 	} else if (dev->bus && dev->bus->pm) {
 		pm_dev_dbg(dev, state, "LATE ");
 		error = pm_noirq_op(dev, dev->bus->pm, state);
-		if (error)
-			return error;
 	}
 
-	return 0;
+	dpm_save_time(dev, DPM_PHASE_SUSPEND_NOIRQ, starttime);
+	return error;
 }
 
 /**
@@ -844,7 +1047,7 @@ int dpm_suspend_noirq(pm_message_t state)
 	if (error)
 		dpm_resume_noirq(resume_event(state));
 	else
-		dpm_show_time(starttime, state, "late");
+		dpm_show_time(starttime, state, "late", DPM_PHASE_SUSPEND_NOIRQ);
 	return error;
 }
 EXPORT_SYMBOL_GPL(dpm_suspend_noirq);
@@ -880,21 +1083,19 @@ static int legacy_suspend(struct device *dev, pm_message_t state,
 static int __device_suspend(struct device *dev, pm_message_t state, bool async)
 {
 	int error = 0;
+	ktime_t starttime;
 	struct timer_list timer;
 	struct dpm_drv_wd_data data;
 
 	dpm_wait_for_children(dev, async);
+	dpm_wait_for_links(dev, false);
 
-	data.dev = dev;
-	data.tsk = get_current();
-	init_timer_on_stack(&timer);
-	timer.expires = jiffies + HZ * 12;
-	timer.function = dpm_drv_timeout;
-	timer.data = (unsigned long)&data;
-	add_timer(&timer);
-
+	/*
+	 * Whoever waits for this device must not be left hanging if it is
+	 * skipped, so bail out through complete_all().
+	 */
 	if (async_error)
-		return 0;
+		goto Complete;
 
 	pm_runtime_get_noresume(dev);
 	if (pm_runtime_barrier(dev) && device_may_wakeup(dev))
@@ -903,9 +1104,18 @@ static int __device_suspend(struct device *dev, pm_message_t state, bool async)
 	if (pm_wakeup_pending()) {
 		pm_runtime_put_sync(dev);
 		async_error = -EBUSY;
-		return 0;
+		goto Complete;
 	}
 
+	data.dev = dev;
+	data.tsk = get_current();
+	init_timer_on_stack(&timer);
+	timer.expires = jiffies + HZ * 12;
+	timer.function = dpm_drv_timeout;
+	timer.data = (unsigned long)&data;
+	add_timer(&timer);
+
+	starttime = ktime_get();
 	device_lock(dev);
 
 	if (dev->pm_domain) {
@@ -950,7 +1160,7 @@ static int __device_suspend(struct device *dev, pm_message_t state, bool async)
 	del_timer_sync(&timer);
 	destroy_timer_on_stack(&timer);
 
-	complete_all(&dev->power.completion);
+	dpm_save_time(dev, DPM_PHASE_SUSPEND, starttime);
 
 	if (error) {
 		pm_runtime_put_sync(dev);
@@ -959,6 +1169,9 @@ static int __device_suspend(struct device *dev, pm_message_t state, bool async)
 		__pm_runtime_disable(dev, false);
 	}
 
+ Complete:
+	complete_all(&dev->power.completion);
+
 	return error;
 }
 
@@ -1026,7 +1239,7 @@ int dpm_suspend(pm_message_t state)
 	if (!error)
 		error = async_error;
 	if (!error)
-		dpm_show_time(starttime, state, NULL);
+		dpm_show_time(starttime, state, NULL, DPM_PHASE_SUSPEND);
 	return error;
 }
 
@@ -1040,8 +1253,12 @@ int dpm_suspend(pm_message_t state)
  */
 static int device_prepare(struct device *dev, pm_message_t state)
 {
+	ktime_t starttime = ktime_get();
 	int error = 0;
 
+	/* Don't report stale times if the transition is aborted early. */
+	memset(dev->power.phase_usecs, 0, sizeof(dev->power.phase_usecs));
+
 	device_lock(dev);
 
 	if (dev->pm_domain) {
@@ -1074,6 +1291,7 @@ static int device_prepare(struct device *dev, pm_message_t state)
 
  End:
 	device_unlock(dev);
+	dpm_save_time(dev, DPM_PHASE_PREPARE, starttime);
 
 	return error;
 }
@@ -1086,6 +1304,7 @@ static int device_prepare(struct device *dev, pm_message_t state)
  */
 int dpm_prepare(pm_message_t state)
 {
+	ktime_t starttime = ktime_get();
 	int error = 0;
 
 	might_sleep();
@@ -1118,6 +1337,8 @@ int dpm_prepare(pm_message_t state)
 		put_device(dev);
 	}
 	mutex_unlock(&dpm_list_mtx);
+	dpm_phase_wall_usecs[DPM_PHASE_PREPARE] =
+		ktime_us_delta(ktime_get(), starttime);
 	return error;
 }
 
@@ -1157,3 +1378,67 @@ int device_pm_wait_for_dev(struct device *subordinate, struct device *dev)
 	return async_error;
 }
 EXPORT_SYMBOL_GPL(device_pm_wait_for_dev);
+
+#ifdef CONFIG_DEBUG_FS
+static const char * const dpm_phase_names[DPM_PHASE_NR] = {
+	[DPM_PHASE_PREPARE]		= "prepare",
+	[DPM_PHASE_SUSPEND]		= "suspend",
+	[DPM_PHASE_SUSPEND_NOIRQ]	= "late",
+	[DPM_PHASE_RESUME_NOIRQ]	= "early",
+	[DPM_PHASE_RESUME]		= "resume",
+	[DPM_PHASE_COMPLETE]		= "complete",
+};
+
+/*
+ * Callback times in usecs of every device for the last system transition,
+ * after the wall clock time of each phase. Devices whose callbacks ran in
+ * parallel add up to more than the wall clock time of the phase.
+ */
+static int dpm_times_show(struct seq_file *s, void *unused)
+{
+	struct device *dev;
+	int i;
+
+	for (i = 0; i < DPM_PHASE_NR; i++)
+		seq_printf(s, "%9s", dpm_phase_names[i]);
+	seq_printf(s, " async device\n");
+
+	for (i = 0; i < DPM_PHASE_NR; i++)
+		seq_printf(s, "%9u", dpm_phase_wall_usecs[i]);
+	seq_printf(s, "     - (wall clock)\n");
+
+	mutex_lock(&dpm_list_mtx);
+	list_for_each_entry(dev, &dpm_list, power.entry) {
+		for (i = 0; i < DPM_PHASE_NR; i++)
+			seq_printf(s, "%9u", dev->power.phase_usecs[i]);
+		seq_printf(s, " %5s %s", dev->power.async_suspend ? "yes" : "no",
+			   dev_name(dev));
+		if (dev->driver)
+			seq_printf(s, " (%s)", dev->driver->name);
+		seq_putc(s, '\n');
+	}
+	mutex_unlock(&dpm_list_mtx);
+
+	return 0;
+}
+
+static int dpm_times_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dpm_times_show, NULL);
+}
+
+static const struct file_operations dpm_times_fops = {
+	.open		= dpm_times_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init dpm_times_init(void)
+{
+	debugfs_create_file("suspend_device_times", 0444, NULL, NULL,
+			    &dpm_times_fops);
+	return 0;
+}
+late_initcall(dpm_times_init);
+#endif /* CONFIG_DEBUG_FS */
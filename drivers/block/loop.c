@@ -76,6 +76,10 @@
 #include <linux/splice.h>
 #include <linux/sysfs.h>
 #include <linux/miscdevice.h>
+#include <linux/mempool.h>
+#include <linux/vmalloc.h>
+#include <linux/falloc.h>
+#include <linux/fiemap.h>
 #include <asm/uaccess.h>
 
 static DEFINE_IDR(loop_index_idr);
@@ -476,6 +480,25 @@ static int do_bio_filebacked(struct loop_device *lo, struct bio *bio)
 	if (bio_rw(bio) == WRITE) {
 		struct file *file = lo->lo_backing_file;
 
+		/*
+		 * We use punch hole to reclaim the free space used by the
+		 * image a.k.a. discard.
+		 */
+		if (bio->bi_rw & REQ_DISCARD) {
+			int mode = FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE;
+
+			if (!file->f_op->fallocate || lo->lo_encrypt_key_size) {
+				ret = -EOPNOTSUPP;
+				goto out;
+			}
+			ret = file->f_op->fallocate(file, mode, pos,
+						    bio->bi_size);
+			if (unlikely(ret && ret != -EINVAL &&
+				     ret != -EOPNOTSUPP))
+				ret = -EIO;
+			goto out;
+		}
+
 		if (bio->bi_rw & REQ_FLUSH) {
 			ret = vfs_fsync(file, 0);
 			if (unlikely(ret && ret != -EINVAL)) {
@@ -498,6 +521,402 @@ out:
 	return ret;
 }
 
+/*
+ * Direct I/O mode.  The blocks of the backing file are mapped to sectors
+ * of the device holding the file system once, like swap files do, and
+ * bios are then remapped and submitted to that device directly.  This
+ * bypasses the page cache of the backing file and the loop thread, so
+ * any number of requests can be in flight.
+ *
+ * Only blocks the file system has allocated and written can be accessed
+ * like this: holes have no blocks, and unwritten extents read back as
+ * zeroes whatever is written to their blocks.  Like a swap file, the
+ * backing file is marked S_SWAPFILE while the mode is on, so that it
+ * can't be truncated, defragmented or have holes punched into it.
+ * Discards of the loop device would punch holes, so the device doesn't
+ * support discard while the mode is on.
+ */
+struct loop_dio_extent {
+	sector_t start;			/* first sector on the loop device */
+	sector_t nr_sects;
+	sector_t disk_sector;		/* first sector on map->bdev */
+};
+
+struct loop_dio_map {
+	struct block_device *bdev;
+	unsigned int nr_extents;
+	struct loop_dio_extent extents[0];
+};
+
+/* Tracks a loop bio until all the bios it was remapped to complete */
+struct loop_dio {
+	struct loop_device *lo;
+	struct bio *bio;
+	atomic_t remaining;
+	int error;
+};
+
+static mempool_t *loop_dio_pool;
+static struct bio_set *loop_dio_bs;
+
+static struct loop_dio_map *loop_dio_alloc_map(unsigned int nr)
+{
+	return vmalloc(sizeof(struct loop_dio_map) +
+		       nr * sizeof(struct loop_dio_extent));
+}
+
+static int loop_dio_add_extent(struct loop_dio_map **mapp, unsigned int *max,
+			       sector_t start, sector_t nr_sects,
+			       sector_t disk_sector)
+{
+	struct loop_dio_map *map = *mapp;
+	struct loop_dio_extent *ext;
+
+	if (map->nr_extents) {
+		ext = &map->extents[map->nr_extents - 1];
+		if (ext->start + ext->nr_sects == start &&
+		    ext->disk_sector + ext->nr_sects == disk_sector) {
+			ext->nr_sects += nr_sects;
+			return 0;
+		}
+	}
+
+	if (map->nr_extents == *max) {
+		struct loop_dio_map *new = loop_dio_alloc_map(*max * 2);
+
+		if (!new)
+			return -ENOMEM;
+		memcpy(new, map, sizeof(*map) +
+				 map->nr_extents * sizeof(*ext));
+		vfree(map);
+		*mapp = map = new;
+		*max *= 2;
+	}
+
+	ext = &map->extents[map->nr_extents++];
+	ext->start = start;
+	ext->nr_sects = nr_sects;
+	ext->disk_sector = disk_sector;
+	return 0;
+}
+
+#define LOOP_DIO_FIEMAP_EXTENTS	32
+
+/*
+ * Check that the @len bytes of @file from @start are allocated and
+ * written, with ->fiemap, which unlike bmap() tells unwritten extents
+ * apart.  File systems that can preallocate space but have no ->fiemap
+ * are refused.
+ */
+static int loop_dio_check_extents(struct file *file, u64 start, u64 len)
+{
+	struct inode *inode = file->f_mapping->host;
+	struct fiemap_extent_info fieinfo;
+	struct fiemap_extent *extents;
+	u64 pos = start, end = start + len;
+	mm_segment_t old_fs;
+	unsigned int i;
+	int err = 0;
+
+	if (!inode->i_op->fiemap)
+		return file->f_op->fallocate ? -EINVAL : 0;
+
+	extents = kmalloc(LOOP_DIO_FIEMAP_EXTENTS * sizeof(*extents),
+			  GFP_KERNEL);
+	if (!extents)
+		return -ENOMEM;
+
+	/* fiemap_fill_next_extent() copies the extents "to user" */
+	old_fs = get_fs();
+	set_fs(KERNEL_DS);
+
+	while (pos < end) {
+		fieinfo.fi_flags = 0;
+		fieinfo.fi_extents_mapped = 0;
+		fieinfo.fi_extents_max = LOOP_DIO_FIEMAP_EXTENTS;
+		fieinfo.fi_extents_start =
+			(struct fiemap_extent __user *)extents;
+
+		err = inode->i_op->fiemap(inode, &fieinfo, pos, end - pos);
+		if (err)
+			break;
+
+		/* Nothing but a hole up to the end */
+		err = -EINVAL;
+		if (!fieinfo.fi_extents_mapped)
+			break;
+
+		for (i = 0; i < fieinfo.fi_extents_mapped; i++) {
+			struct fiemap_extent *fe = &extents[i];
+
+			if (fe->fe_logical > pos ||
+			    (fe->fe_flags & ~(FIEMAP_EXTENT_LAST |
+					      FIEMAP_EXTENT_MERGED)))
+				goto out;
+			pos = max(pos, fe->fe_logical + fe->fe_length);
+			if (pos >= end)
+				break;
+			if (fe->fe_flags & FIEMAP_EXTENT_LAST)
+				goto out;
+		}
+		err = 0;
+		cond_resched();
+	}
+out:
+	set_fs(old_fs);
+	kfree(extents);
+	return err;
+}
+
+/*
+ * Map the part of @file backing @lo to sectors of the underlying block
+ * device.  Fails if the file has holes or unwritten extents, or the file
+ * system can't map its blocks.
+ */
+static struct loop_dio_map *
+loop_dio_build_map(struct loop_device *lo, struct file *file)
+{
+	struct inode *inode = file->f_mapping->host;
+	sector_t size = get_loop_size(lo, file);
+	struct loop_dio_map *map;
+	unsigned int max = 16;
+	unsigned int blkbits;
+	sector_t block, last;
+	int err;
+
+	if (lo->lo_offset & 511 || !size)
+		return ERR_PTR(-EINVAL);
+
+	map = loop_dio_alloc_map(max);
+	if (!map)
+		return ERR_PTR(-ENOMEM);
+	map->nr_extents = 0;
+
+	if (S_ISBLK(inode->i_mode)) {
+		map->bdev = inode->i_bdev;
+		loop_dio_add_extent(&map, &max, 0, size, lo->lo_offset >> 9);
+		return map;
+	}
+
+	err = -EINVAL;
+	if (!S_ISREG(inode->i_mode) || !inode->i_mapping->a_ops->bmap ||
+	    !inode->i_sb->s_bdev)
+		goto out_free;
+
+	err = loop_dio_check_extents(file, lo->lo_offset, (u64)size << 9);
+	if (err)
+		goto out_free;
+	err = -EINVAL;
+
+	map->bdev = inode->i_sb->s_bdev;
+	blkbits = inode->i_blkbits;
+	block = lo->lo_offset >> blkbits;
+	last = (lo->lo_offset + ((loff_t)size << 9) - 1) >> blkbits;
+
+	for (; block <= last; block++) {
+		loff_t pos = (loff_t)block << blkbits;
+		loff_t end = pos + (1 << blkbits);
+		sector_t phys = bmap(inode, block);
+
+		/* Holes would need the file system to allocate blocks */
+		if (!phys)
+			goto out_free;
+
+		phys <<= blkbits - 9;
+		if (pos < lo->lo_offset) {
+			phys += (lo->lo_offset - pos) >> 9;
+			pos = lo->lo_offset;
+		}
+		end = min_t(loff_t, end, lo->lo_offset + ((loff_t)size << 9));
+
+		err = loop_dio_add_extent(&map, &max,
+					  (pos - lo->lo_offset) >> 9,
+					  (end - pos) >> 9, phys);
+		if (err)
+			goto out_free;
+		err = -EINVAL;
+
+		cond_resched();
+	}
+
+	return map;
+
+out_free:
+	vfree(map);
+	return ERR_PTR(err);
+}
+
+static struct loop_dio_extent *
+loop_dio_find_extent(struct loop_dio_map *map, sector_t sector)
+{
+	unsigned int lo = 0, hi = map->nr_extents;
+
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+		struct loop_dio_extent *ext = &map->extents[mid];
+
+		if (sector < ext->start)
+			hi = mid;
+		else if (sector >= ext->start + ext->nr_sects)
+			lo = mid + 1;
+		else
+			return ext;
+	}
+
+	return NULL;
+}
+
+static void loop_dio_put(struct loop_dio *dio)
+{
+	struct loop_device *lo = dio->lo;
+
+	if (!atomic_dec_and_test(&dio->remaining))
+		return;
+
+	bio_endio(dio->bio, dio->error);
+	mempool_free(dio, loop_dio_pool);
+
+	if (atomic_dec_and_test(&lo->lo_dio_pending))
+		wake_up(&lo->lo_dio_wait);
+}
+
+static void loop_dio_end_io(struct bio *clone, int error)
+{
+	struct loop_dio *dio = clone->bi_private;
+
+	if (error)
+		dio->error = error;
+
+	bio_put(clone);
+	loop_dio_put(dio);
+}
+
+static struct bio *loop_dio_alloc_clone(struct loop_dio *dio,
+					struct block_device *bdev,
+					sector_t sector, unsigned long rw,
+					unsigned int nr_vecs)
+{
+	struct bio *clone;
+
+	clone = bio_alloc_bioset(GFP_NOIO, nr_vecs, loop_dio_bs);
+	clone->bi_sector = sector;
+	clone->bi_bdev = bdev;
+	clone->bi_rw = rw;
+	clone->bi_end_io = loop_dio_end_io;
+	clone->bi_private = dio;
+
+	return clone;
+}
+
+static void loop_dio_submit_clone(struct loop_dio *dio, struct bio *clone)
+{
+	atomic_inc(&dio->remaining);
+	generic_make_request(clone);
+}
+
+/*
+ * Remap @bio through @map and submit it to the underlying device.  The
+ * caller has accounted the bio in lo_dio_pending, which keeps @map
+ * around until it completes.
+ */
+static void loop_dio_submit(struct loop_device *lo, struct loop_dio_map *map,
+			    struct bio *bio)
+{
+	unsigned long rw = bio->bi_rw & ~REQ_THROTTLED;
+	unsigned int nr_vecs = min(bio_segments(bio) + 1, BIO_MAX_PAGES);
+	struct loop_dio_extent *ext = NULL;
+	sector_t sector = bio->bi_sector;
+	struct bio *clone = NULL;
+	struct loop_dio *dio;
+	struct bio_vec *bvec;
+	int i;
+
+	dio = mempool_alloc(loop_dio_pool, GFP_NOIO);
+	dio->lo = lo;
+	dio->bio = bio;
+	dio->error = 0;
+	atomic_set(&dio->remaining, 1);
+
+	/* Empty flush, pass it on */
+	if (!bio->bi_size) {
+		clone = loop_dio_alloc_clone(dio, map->bdev, 0, rw, 0);
+		loop_dio_submit_clone(dio, clone);
+		goto out;
+	}
+
+	bio_for_each_segment(bvec, bio, i) {
+		unsigned int offset = bvec->bv_offset;
+		unsigned int len = bvec->bv_len;
+
+		while (len) {
+			unsigned int chunk;
+
+			if (!ext) {
+				ext = loop_dio_find_extent(map, sector);
+				if (!ext) {
+					dio->error = -EIO;
+					goto out_submit;
+				}
+			}
+
+			chunk = min_t(sector_t, len,
+				      (ext->start + ext->nr_sects - sector) << 9);
+
+			if (!clone)
+				clone = loop_dio_alloc_clone(dio, map->bdev,
+					ext->disk_sector + sector - ext->start,
+					rw, nr_vecs);
+
+			if (bio_add_page(clone, bvec->bv_page, chunk,
+					 offset) < chunk) {
+				/* The underlying queue is full, start anew */
+				if (!clone->bi_size) {
+					bio_put(clone);
+					clone = NULL;
+					dio->error = -EIO;
+					goto out;
+				}
+				loop_dio_submit_clone(dio, clone);
+				clone = NULL;
+				rw &= ~REQ_FLUSH;
+				continue;
+			}
+
+			sector += chunk >> 9;
+			offset += chunk;
+			len -= chunk;
+
+			/* Extent boundary, the next chunk lives elsewhere */
+			if (sector == ext->start + ext->nr_sects) {
+				loop_dio_submit_clone(dio, clone);
+				clone = NULL;
+				ext = NULL;
+				rw &= ~REQ_FLUSH;
+			}
+		}
+	}
+
+out_submit:
+	if (clone)
+		loop_dio_submit_clone(dio, clone);
+out:
+	loop_dio_put(dio);
+}
+
+/*
+ * Return the direct I/O map if the mode is on, and account a bio in
+ * lo_dio_pending.  Call with lo_lock held.
+ */
+static struct loop_dio_map *loop_dio_get_map(struct loop_device *lo)
+{
+	struct loop_dio_map *map = lo->lo_dio_map;
+
+	if (map)
+		atomic_inc(&lo->lo_dio_pending);
+
+	return map;
+}
+
 /*
  * Add bio to back of pending list
  */
@@ -529,6 +948,26 @@ static int loop_make_request(struct request_queue *q, struct bio *old_bio)
 		goto out;
 	if (unlikely(rw == WRITE && (lo->lo_flags & LO_FLAGS_READ_ONLY)))
 		goto out;
+	/* Switch requests always go through the loop thread */
+	if ((lo->lo_flags & LO_FLAGS_DIRECT_IO) && old_bio->bi_bdev) {
+		struct loop_dio_map *map = loop_dio_get_map(lo);
+
+		/*
+		 * Punching a hole would free blocks the map points to.
+		 * Discard isn't advertised in this mode, see
+		 * loop_config_discard(); refuse any that was already
+		 * on its way.
+		 */
+		if (unlikely(old_bio->bi_rw & REQ_DISCARD)) {
+			spin_unlock_irq(&lo->lo_lock);
+			bio_endio(old_bio, -EOPNOTSUPP);
+			return 0;
+		}
+
+		spin_unlock_irq(&lo->lo_lock);
+		loop_dio_submit(lo, map, old_bio);
+		return 0;
+	}
 	loop_add_bio(lo, old_bio);
 	wake_up(&lo->lo_event);
 	spin_unlock_irq(&lo->lo_lock);
@@ -542,6 +981,8 @@ out:
 
 struct switch_request {
 	struct file *file;
+	bool direct_io;			/* enable direct I/O instead */
+	int error;
 	struct completion wait;
 };
 
@@ -553,7 +994,19 @@ static inline void loop_handle_bio(struct loop_device *lo, struct bio *bio)
 		do_loop_switch(lo, bio->bi_private);
 		bio_put(bio);
 	} else {
-		int ret = do_bio_filebacked(lo, bio);
+		struct loop_dio_map *map;
+		int ret;
+
+		/* Queued before direct I/O got enabled, but not yet handled */
+		spin_lock_irq(&lo->lo_lock);
+		map = loop_dio_get_map(lo);
+		spin_unlock_irq(&lo->lo_lock);
+		if (map) {
+			loop_dio_submit(lo, map, bio);
+			return;
+		}
+
+		ret = do_bio_filebacked(lo, bio);
 		bio_endio(bio, ret);
 	}
 }
@@ -609,6 +1062,7 @@ static int loop_switch(struct loop_device *lo, struct file *file)
 		return -ENOMEM;
 	init_completion(&w.wait);
 	w.file = file;
+	w.direct_io = false;
 	bio->bi_private = &w;
 	bio->bi_bdev = NULL;
 	loop_make_request(lo->lo_queue, bio);
@@ -628,6 +1082,54 @@ static int loop_flush(struct loop_device *lo)
 	return loop_switch(lo, NULL);
 }
 
+/*
+ * Enable direct I/O; called from the loop thread, so that all bios
+ * queued so far, discards among them, are done before the map is built.
+ */
+static int loop_dio_enable(struct loop_device *lo)
+{
+	struct file *file = lo->lo_backing_file;
+	struct inode *inode = file->f_mapping->host;
+	struct loop_dio_map *map;
+	int err;
+
+	/*
+	 * All bios so far went through the page cache.  Get them and any
+	 * delayed allocations on disk, so that bmap() sees the blocks.
+	 */
+	err = vfs_fsync(file, 0);
+	if (err && err != -EINVAL)
+		return err;
+
+	if (S_ISREG(inode->i_mode)) {
+		mutex_lock(&inode->i_mutex);
+		if (IS_SWAPFILE(inode)) {
+			mutex_unlock(&inode->i_mutex);
+			return -EBUSY;
+		}
+	}
+
+	map = loop_dio_build_map(lo, file);
+
+	/* Keep the blocks where the map says they are */
+	if (S_ISREG(inode->i_mode)) {
+		if (!IS_ERR(map))
+			inode->i_flags |= S_SWAPFILE;
+		mutex_unlock(&inode->i_mutex);
+	}
+	if (IS_ERR(map))
+		return PTR_ERR(map);
+
+	/* Drop the cached pages before bios start bypassing them */
+	invalidate_inode_pages2(file->f_mapping);
+
+	spin_lock_irq(&lo->lo_lock);
+	lo->lo_dio_map = map;
+	lo->lo_flags |= LO_FLAGS_DIRECT_IO;
+	spin_unlock_irq(&lo->lo_lock);
+	return 0;
+}
+
 /*
  * Do the actual switch; called from the BIO completion routine
  */
@@ -637,6 +1139,11 @@ static void do_loop_switch(struct loop_device *lo, struct switch_request *p)
 	struct file *old_file = lo->lo_backing_file;
 	struct address_space *mapping;
 
+	if (p->direct_io) {
+		p->error = loop_dio_enable(lo);
+		goto out;
+	}
+
 	/* if no new file, only flush of queued bios requested */
 	if (!file)
 		goto out;
@@ -652,6 +1159,85 @@ out:
 	complete(&p->wait);
 }
 
+static int loop_set_direct_io(struct loop_device *lo, bool enable)
+{
+	struct inode *inode = lo->lo_backing_file->f_mapping->host;
+	struct loop_dio_map *map;
+	struct switch_request w;
+	struct bio *bio;
+
+	if (!enable) {
+		spin_lock_irq(&lo->lo_lock);
+		lo->lo_flags &= ~LO_FLAGS_DIRECT_IO;
+		map = lo->lo_dio_map;
+		lo->lo_dio_map = NULL;
+		spin_unlock_irq(&lo->lo_lock);
+
+		if (!map)
+			return 0;
+
+		wait_event(lo->lo_dio_wait, !atomic_read(&lo->lo_dio_pending));
+		vfree(map);
+
+		if (S_ISREG(inode->i_mode)) {
+			mutex_lock(&inode->i_mutex);
+			inode->i_flags &= ~S_SWAPFILE;
+			mutex_unlock(&inode->i_mutex);
+		}
+		return 0;
+	}
+
+	/* Data has to pass unchanged */
+	if (lo->lo_encryption || lo->transfer != transfer_none)
+		return -EINVAL;
+
+	bio = bio_alloc(GFP_KERNEL, 0);
+	if (!bio)
+		return -ENOMEM;
+
+	/* The loop thread switches once it's done with queued bios */
+	init_completion(&w.wait);
+	w.file = NULL;
+	w.direct_io = true;
+	w.error = 0;
+	bio->bi_private = &w;
+	bio->bi_bdev = NULL;
+	loop_make_request(lo->lo_queue, bio);
+	wait_for_completion(&w.wait);
+
+	return w.error;
+}
+
+static void loop_config_discard(struct loop_device *lo)
+{
+	struct file *file = lo->lo_backing_file;
+	struct inode *inode = file->f_mapping->host;
+	struct request_queue *q = lo->lo_queue;
+
+	/*
+	 * We use punch hole to reclaim the free space used by the
+	 * image a.k.a. discard. However we do not support discard if
+	 * encryption is enabled, because it may give an attacker
+	 * useful information, nor with direct I/O, whose block map
+	 * a hole would invalidate.
+	 */
+	if (!file->f_op->fallocate || lo->lo_encrypt_key_size ||
+	    (lo->lo_flags & LO_FLAGS_DIRECT_IO)) {
+		q->limits.discard_granularity = 0;
+		q->limits.discard_alignment = 0;
+		q->limits.max_discard_sectors = 0;
+		q->limits.discard_zeroes_data = 0;
+		queue_flag_clear_unlocked(QUEUE_FLAG_DISCARD, q);
+		return;
+	}
+
+	q->limits.discard_granularity = inode->i_sb->s_blocksize;
+	q->limits.discard_alignment = 0;
+	q->limits.max_discard_sectors = UINT_MAX >> 9;
+	q->limits.discard_zeroes_data = 1;
+	queue_flag_set_unlocked(QUEUE_FLAG_DISCARD, q);
+}
+
 
 /*
  * loop_change_fd switched the backing store of a loopback device to
@@ -677,6 +1263,10 @@ static int loop_change_fd(struct loop_device *lo, struct block_device *bdev,
 	if (!(lo->lo_flags & LO_FLAGS_READ_ONLY))
 		goto out;
 
+	/* the map of the old file is useless for the new one */
+	if (lo->lo_flags & LO_FLAGS_DIRECT_IO)
+		goto out;
+
 	error = -EBADF;
 	file = fget(arg);
 	if (!file)
@@ -777,16 +1367,25 @@ static ssize_t loop_attr_autoclear_show(struct loop_device *lo, char *buf)
 	return sprintf(buf, "%s\n", autoclear ? "1" : "0");
 }
 
+static ssize_t loop_attr_direct_io_show(struct loop_device *lo, char *buf)
+{
+	int direct_io = (lo->lo_flags & LO_FLAGS_DIRECT_IO);
+
+	return sprintf(buf, "%s\n", direct_io ? "1" : "0");
+}
+
 LOOP_ATTR_RO(backing_file);
 LOOP_ATTR_RO(offset);
 LOOP_ATTR_RO(sizelimit);
 LOOP_ATTR_RO(autoclear);
+LOOP_ATTR_RO(direct_io);
 
 static struct attribute *loop_attrs[] = {
 	&loop_attr_backing_file.attr,
 	&loop_attr_offset.attr,
 	&loop_attr_sizelimit.attr,
 	&loop_attr_autoclear.attr,
+	&loop_attr_direct_io.attr,
 	NULL,
 };
 
@@ -903,6 +1502,8 @@ static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 	if (!(lo_flags & LO_FLAGS_READ_ONLY) && file->f_op->fsync)
 		blk_queue_flush(lo->lo_queue, REQ_FLUSH);
 
+	loop_config_discard(lo);
+
 	set_capacity(lo->lo_disk, size);
 	bd_set_size(bdev, size << 9);
 	loop_sysfs_init(lo);
@@ -999,6 +1600,7 @@ static int loop_clr_fd(struct loop_device *lo, struct block_device *bdev)
 	spin_unlock_irq(&lo->lo_lock);
 
 	kthread_stop(lo->lo_thread);
+	loop_set_direct_io(lo, false);
 
 	spin_lock_irq(&lo->lo_lock);
 	lo->lo_backing_file = NULL;
@@ -1058,6 +1660,9 @@ loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
 		return -ENXIO;
 	if ((unsigned int) info->lo_encrypt_key_size > LO_KEY_SIZE)
 		return -EINVAL;
+	/* direct I/O passes data to the backing file untransformed */
+	if (info->lo_encrypt_type && (info->lo_flags & LO_FLAGS_DIRECT_IO))
+		return -EINVAL;
 
 	err = loop_release_xfer(lo);
 	if (err)
@@ -1080,6 +1685,9 @@ loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
 
 	if (lo->lo_offset != info->lo_offset ||
 	    lo->lo_sizelimit != info->lo_sizelimit) {
+		/* the block map is rebuilt for the new geometry below */
+		if (lo->lo_flags & LO_FLAGS_DIRECT_IO)
+			loop_set_direct_io(lo, false);
 		lo->lo_offset = info->lo_offset;
 		lo->lo_sizelimit = info->lo_sizelimit;
 		if (figure_loop_size(lo))
@@ -1100,6 +1708,14 @@ loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
 	     (info->lo_flags & LO_FLAGS_AUTOCLEAR))
 		lo->lo_flags ^= LO_FLAGS_AUTOCLEAR;
 
+	if ((lo->lo_flags & LO_FLAGS_DIRECT_IO) !=
+	     (info->lo_flags & LO_FLAGS_DIRECT_IO)) {
+		err = loop_set_direct_io(lo,
+				info->lo_flags & LO_FLAGS_DIRECT_IO);
+		if (err)
+			return err;
+	}
+
 	lo->lo_encrypt_key_size = info->lo_encrypt_key_size;
 	lo->lo_init[0] = info->lo_init[0];
 	lo->lo_init[1] = info->lo_init[1];
@@ -1108,6 +1724,7 @@ loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
 		       info->lo_encrypt_key_size);
 		lo->lo_key_owner = uid;
 	}	
+	loop_config_discard(lo);
 
 	return 0;
 }
@@ -1640,6 +2257,8 @@ static int loop_add(struct loop_device **l, int i)
 	lo->lo_thread		= NULL;
 	init_waitqueue_head(&lo->lo_event);
 	spin_lock_init(&lo->lo_lock);
+	atomic_set(&lo->lo_dio_pending, 0);
+	init_waitqueue_head(&lo->lo_dio_wait);
 	disk->major		= LOOP_MAJOR;
 	disk->first_minor	= i << part_shift;
 	disk->fops		= &lo_fops;
@@ -1836,8 +2455,21 @@ static int __init loop_init(void)
 		range = 1UL << MINORBITS;
 	}
 
-	if (register_blkdev(LOOP_MAJOR, "loop"))
-		return -EIO;
+	loop_dio_pool = mempool_create_kmalloc_pool(BIO_POOL_SIZE,
+						    sizeof(struct loop_dio));
+	if (!loop_dio_pool)
+		return -ENOMEM;
+
+	loop_dio_bs = bioset_create(BIO_POOL_SIZE, 0);
+	if (!loop_dio_bs) {
+		err = -ENOMEM;
+		goto out_destroy_pool;
+	}
+
+	if (register_blkdev(LOOP_MAJOR, "loop")) {
+		err = -EIO;
+		goto out_free_bs;
+	}
 
 	blk_register_region(MKDEV(LOOP_MAJOR, 0), range,
 				  THIS_MODULE, loop_probe, NULL, NULL);
@@ -1850,6 +2482,12 @@ static int __init loop_init(void)
 
 	printk(KERN_INFO "loop: module loaded\n");
 	return 0;
+
+out_free_bs:
+	bioset_free(loop_dio_bs);
+out_destroy_pool:
+	mempool_destroy(loop_dio_pool);
+	return err;
 }
 
 static int loop_exit_cb(int id, void *ptr, void *data)
@@ -1874,6 +2512,9 @@ static void __exit loop_exit(void)
 	unregister_blkdev(LOOP_MAJOR, "loop");
 
 	misc_deregister(&loop_misc);
+
+	bioset_free(loop_dio_bs);
+	mempool_destroy(loop_dio_pool);
 }
 
 module_init(loop_init);
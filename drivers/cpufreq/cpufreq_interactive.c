@@ -19,8 +19,12 @@
 #include <linux/cpu.h>
 #include <linux/cpumask.h>
 #include <linux/cpufreq.h>
+#include <linux/cpufreq_interactive.h>
+#include <linux/irq_work.h>
+#include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/sched.h>
+#include <linux/slab.h>
 #include <linux/tick.h>
 #include <linux/timer.h>
 #include <linux/workqueue.h>
@@ -29,8 +33,29 @@
 
 #include <asm/cputime.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/cpufreq_interactive.h>
+
 static atomic_t active_count = ATOMIC_INIT(0);
 
+/*
+ * Per-policy state of the scheduler-driven mode: the scheduler pushes
+ * the cpu utilization on enqueue, dequeue and tick, the target is
+ * computed right there and applied from a per-policy work item.
+ */
+struct cpufreq_interactive_policy {
+	struct cpufreq_policy *policy;
+	struct cpufreq_frequency_table *freq_table;
+	/* protects target_freq and the time stamps below */
+	spinlock_t target_lock;
+	unsigned int target_freq;
+	u64 last_eval;
+	u64 freq_change_time;
+	u64 decision_time;
+	struct irq_work irq_work;
+	struct work_struct work;
+};
+
 struct cpufreq_interactive_cpuinfo {
 	struct timer_list cpu_timer;
 	int timer_idlecancel;
@@ -46,6 +71,11 @@ struct cpufreq_interactive_cpuinfo {
 	struct cpufreq_frequency_table *freq_table;
 	unsigned int target_freq;
 	int governor_enabled;
+	/* scheduler-driven mode */
+	struct update_util_data update_util;
+	struct cpufreq_interactive_policy *ppol;
+	unsigned int util_load;
+	u64 util_time;
 };
 
 static DEFINE_PER_CPU(struct cpufreq_interactive_cpuinfo, cpuinfo);
@@ -60,6 +90,23 @@ static cpumask_t down_cpumask;
 static spinlock_t down_cpumask_lock;
 static struct mutex set_speed_lock;
 
+/* Take load from scheduler callbacks instead of sampling timers */
+static bool sched_util;
+module_param(sched_util, bool, 0444);
+MODULE_PARM_DESC(sched_util, "Use scheduler utilization callbacks instead "
+		 "of idle-time sampling timers");
+
+/* Minimum time between two evaluations of a policy, in us */
+#define UTIL_EVAL_INTERVAL 1000
+
+static struct workqueue_struct *util_wq;
+
+/* Latency from target decision to driver call in scheduler-driven mode */
+static DEFINE_SPINLOCK(util_latency_lock);
+static u64 util_latency_count;
+static u64 util_latency_total;
+static u64 util_latency_max;
+
 /* Go to max speed when CPU load at or above this value. */
 #define DEFAULT_GO_MAXSPEED_LOAD 85
 static unsigned long go_maxspeed_load;
@@ -105,36 +152,18 @@ struct cpufreq_governor cpufreq_gov_interactive = {
 };
 
 static unsigned int cpufreq_interactive_get_target(
-	int cpu_load, int load_since_change, struct cpufreq_policy *policy)
+	int cpu_load, int load_since_change, struct cpufreq_policy *policy,
+	int *reason)
 {
-	unsigned int target_freq;
-
-	/*
-	 * Choose greater of short-term load (since last idle timer
-	 * started or timer function re-armed itself) or long-term load
-	 * (since last frequency change).
-	 */
-	if (load_since_change > cpu_load)
-		cpu_load = load_since_change;
-
-	if (cpu_load >= go_maxspeed_load) {
-		if (!boost_factor)
-			return policy->max;
-
-		target_freq = policy->cur * boost_factor;
-
-		if (max_boost && target_freq > policy->cur + max_boost)
-			target_freq = policy->cur + max_boost;
-	}
-	else {
-		if (!sustain_load)
-			return policy->max * cpu_load / 100;
-
-		target_freq = policy->cur * cpu_load / sustain_load;
-	}
-
-	target_freq = min(target_freq, policy->max);
-	return target_freq;
+	struct interactive_tunables t = {
+		.go_maxspeed_load	= go_maxspeed_load,
+		.boost_factor		= boost_factor,
+		.max_boost		= max_boost,
+		.sustain_load		= sustain_load,
+	};
+
+	return interactive_target_freq(&t, cpu_load, load_since_change,
+				       policy->cur, policy->max, reason);
 }
 
 static inline cputime64_t get_cpu_iowait_time(
@@ -162,9 +191,10 @@ static void cpufreq_interactive_timer(unsigned long data)
 		&per_cpu(cpuinfo, data);
 	u64 now_idle;
 	u64 now_iowait;
-	unsigned int new_freq;
+	unsigned int target, new_freq;
 	unsigned int index;
 	unsigned long flags;
+	int reason;
 
 	smp_rmb();
 
@@ -233,11 +263,11 @@ static void cpufreq_interactive_timer(unsigned long data)
 	 * function re-armed itself) and long-term load (since last frequency
 	 * change) to determine new target frequency
 	 */
-	new_freq = cpufreq_interactive_get_target(cpu_load, load_since_change,
-						  pcpu->policy);
+	target = cpufreq_interactive_get_target(cpu_load, load_since_change,
+						pcpu->policy, &reason);
 
 	if (cpufreq_frequency_table_target(pcpu->policy, pcpu->freq_table,
-					   new_freq, CPUFREQ_RELATION_H,
+					   target, CPUFREQ_RELATION_H,
 					   &index)) {
 		pr_warn_once("timer %d: cpufreq_frequency_table_target error\n",
 			     (int) data);
@@ -246,8 +276,12 @@ static void cpufreq_interactive_timer(unsigned long data)
 
 	new_freq = pcpu->freq_table[index].frequency;
 
-	if (pcpu->target_freq == new_freq)
+	if (pcpu->target_freq == new_freq) {
+		trace_cpufreq_interactive_target(data, cpu_load,
+				load_since_change, pcpu->policy->cur, target,
+				new_freq, reason);
 		goto rearm_if_notmax;
+	}
 
 	/*
 	 * Do not scale down unless we have been at this frequency for the
@@ -255,10 +289,19 @@ static void cpufreq_interactive_timer(unsigned long data)
 	 */
 	if (new_freq < pcpu->target_freq) {
 		if (cputime64_sub(pcpu->timer_run_time, pcpu->freq_change_time)
-		    < min_sample_time)
+		    < min_sample_time) {
+			trace_cpufreq_interactive_target(data, cpu_load,
+					load_since_change, pcpu->policy->cur,
+					target, pcpu->target_freq,
+					INTERACTIVE_HOLD);
 			goto rearm;
+		}
 	}
 
+	trace_cpufreq_interactive_target(data, cpu_load, load_since_change,
+					 pcpu->policy->cur, target, new_freq,
+					 reason);
+
 	if (new_freq < pcpu->target_freq) {
 		pcpu->target_freq = new_freq;
 		spin_lock_irqsave(&down_cpumask_lock, flags);
@@ -316,7 +359,7 @@ static void cpufreq_interactive_idle_start(void)
 		&per_cpu(cpuinfo, smp_processor_id());
 	int pending;
 
-	if (!pcpu->governor_enabled)
+	if (!pcpu->governor_enabled || pcpu->ppol)
 		return;
 
 	pcpu->idling = 1;
@@ -385,7 +428,7 @@ static void cpufreq_interactive_idle_end(void)
 	 */
 	if (timer_pending(&pcpu->cpu_timer) == 0 &&
 	    pcpu->timer_run_time >= pcpu->idle_exit_time &&
-	    pcpu->governor_enabled) {
+	    pcpu->governor_enabled && !pcpu->ppol) {
 		pcpu->time_in_idle =
 			get_cpu_idle_time_us(smp_processor_id(),
 					     &pcpu->idle_exit_time);
@@ -505,6 +548,182 @@ static void cpufreq_interactive_freq_down(struct work_struct *work)
 	}
 }
 
+/*
+ * Called by the scheduler with the runqueue lock held. Another cpu of
+ * the policy that is evaluating at the same time wins; its result
+ * includes our freshly published load anyway.
+ */
+static void cpufreq_interactive_update_util(struct update_util_data *data,
+		u64 time, unsigned long util, unsigned long max)
+{
+	struct cpufreq_interactive_cpuinfo *pcpu =
+		container_of(data, struct cpufreq_interactive_cpuinfo,
+			     update_util);
+	struct cpufreq_interactive_policy *ppol = pcpu->ppol;
+	unsigned int load, target, new_freq, index, j;
+	bool kick = false;
+	int reason;
+
+	pcpu->util_load = util * 100 / max;
+	pcpu->util_time = time;
+
+	if ((s64)(time - ppol->last_eval) < UTIL_EVAL_INTERVAL * NSEC_PER_USEC)
+		return;
+
+	if (!spin_trylock(&ppol->target_lock))
+		return;
+
+	ppol->last_eval = time;
+
+	/*
+	 * The policy runs at the speed of its busiest cpu. Cpus that have
+	 * not reported for a couple of ticks are idle and do not count.
+	 */
+	load = 0;
+	for_each_cpu(j, ppol->policy->cpus) {
+		struct cpufreq_interactive_cpuinfo *pjcpu =
+			&per_cpu(cpuinfo, j);
+
+		if ((s64)(time - ACCESS_ONCE(pjcpu->util_time)) >
+		    2 * TICK_NSEC)
+			continue;
+
+		load = max(load, ACCESS_ONCE(pjcpu->util_load));
+	}
+
+	/* The utilization is already a decayed history. */
+	target = cpufreq_interactive_get_target(load, load, ppol->policy,
+						&reason);
+
+	if (cpufreq_frequency_table_target(ppol->policy, ppol->freq_table,
+					   target, CPUFREQ_RELATION_H,
+					   &index))
+		goto unlock;
+
+	new_freq = ppol->freq_table[index].frequency;
+
+	/*
+	 * Do not scale down unless we have been at this frequency for the
+	 * minimum sample time.
+	 */
+	if (new_freq < ppol->target_freq &&
+	    (s64)(time - ppol->freq_change_time) <
+	    min_sample_time * NSEC_PER_USEC) {
+		trace_cpufreq_interactive_target(ppol->policy->cpu, load, load,
+				ppol->policy->cur, target, ppol->target_freq,
+				INTERACTIVE_HOLD);
+		goto unlock;
+	}
+
+	trace_cpufreq_interactive_target(ppol->policy->cpu, load, load,
+					 ppol->policy->cur, target, new_freq,
+					 reason);
+	if (new_freq == ppol->target_freq)
+		goto unlock;
+
+	ppol->target_freq = new_freq;
+	ppol->freq_change_time = time;
+	ppol->decision_time = local_clock();
+	kick = true;
+
+unlock:
+	spin_unlock(&ppol->target_lock);
+
+	/* We may not wake anything up under the runqueue lock. */
+	if (kick)
+		irq_work_queue(&ppol->irq_work);
+}
+
+static void cpufreq_interactive_util_irq_work(struct irq_work *irq_work)
+{
+	struct cpufreq_interactive_policy *ppol =
+		container_of(irq_work, struct cpufreq_interactive_policy,
+			     irq_work);
+
+	queue_work(util_wq, &ppol->work);
+}
+
+static void cpufreq_interactive_util_work(struct work_struct *work)
+{
+	struct cpufreq_interactive_policy *ppol =
+		container_of(work, struct cpufreq_interactive_policy, work);
+	unsigned int target_freq;
+	unsigned long flags;
+	u64 decision_time, latency;
+
+	spin_lock_irqsave(&ppol->target_lock, flags);
+	target_freq = ppol->target_freq;
+	decision_time = ppol->decision_time;
+	spin_unlock_irqrestore(&ppol->target_lock, flags);
+
+	__cpufreq_driver_target(ppol->policy, target_freq, CPUFREQ_RELATION_H);
+
+	latency = local_clock() - decision_time;
+	spin_lock_irqsave(&util_latency_lock, flags);
+	util_latency_count++;
+	util_latency_total += latency;
+	if (latency > util_latency_max)
+		util_latency_max = latency;
+	spin_unlock_irqrestore(&util_latency_lock, flags);
+}
+
+static int cpufreq_interactive_util_start(struct cpufreq_policy *policy,
+		struct cpufreq_frequency_table *freq_table)
+{
+	struct cpufreq_interactive_policy *ppol;
+	struct cpufreq_interactive_cpuinfo *pcpu;
+	unsigned int j;
+
+	ppol = kzalloc(sizeof(*ppol), GFP_KERNEL);
+	if (!ppol)
+		return -ENOMEM;
+
+	ppol->policy = policy;
+	ppol->freq_table = freq_table;
+	ppol->target_freq = policy->cur;
+	spin_lock_init(&ppol->target_lock);
+	init_irq_work(&ppol->irq_work, cpufreq_interactive_util_irq_work);
+	INIT_WORK(&ppol->work, cpufreq_interactive_util_work);
+
+	for_each_cpu(j, policy->cpus) {
+		pcpu = &per_cpu(cpuinfo, j);
+		pcpu->policy = policy;
+		pcpu->freq_table = freq_table;
+		pcpu->target_freq = policy->cur;
+		pcpu->util_load = 0;
+		pcpu->util_time = 0;
+		pcpu->ppol = ppol;
+		pcpu->update_util.func = cpufreq_interactive_update_util;
+		pcpu->governor_enabled = 1;
+		smp_wmb();
+		cpufreq_set_update_util_data(j, &pcpu->update_util);
+	}
+
+	return 0;
+}
+
+static void cpufreq_interactive_util_stop(struct cpufreq_policy *policy)
+{
+	struct cpufreq_interactive_policy *ppol =
+		per_cpu(cpuinfo, policy->cpu).ppol;
+	unsigned int j;
+
+	for_each_cpu(j, policy->cpus) {
+		per_cpu(cpuinfo, j).governor_enabled = 0;
+		cpufreq_set_update_util_data(j, NULL);
+	}
+
+	/* Wait for callbacks in flight, then for what they queued. */
+	synchronize_sched();
+	irq_work_sync(&ppol->irq_work);
+	cancel_work_sync(&ppol->work);
+
+	for_each_cpu(j, policy->cpus)
+		per_cpu(cpuinfo, j).ppol = NULL;
+
+	kfree(ppol);
+}
+
 static ssize_t show_go_maxspeed_load(struct kobject *kobj,
 				     struct attribute *attr, char *buf)
 {
@@ -655,6 +874,29 @@ static ssize_t store_timer_rate(struct kobject *kobj,
 static struct global_attr timer_rate_attr = __ATTR(timer_rate, 0644,
 		show_timer_rate, store_timer_rate);
 
+static ssize_t show_target_latency(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	u64 count, total, max;
+	unsigned long flags;
+
+	spin_lock_irqsave(&util_latency_lock, flags);
+	count = util_latency_count;
+	total = util_latency_total;
+	max = util_latency_max;
+	spin_unlock_irqrestore(&util_latency_lock, flags);
+
+	if (count)
+		total = div64_u64(total, count);
+
+	return sprintf(buf, "%llu %llu %llu\n", count,
+		       div_u64(total, NSEC_PER_USEC),
+		       div_u64(max, NSEC_PER_USEC));
+}
+
+static struct global_attr target_latency_attr = __ATTR(target_latency, 0444,
+		show_target_latency, NULL);
+
 static struct attribute *interactive_attributes[] = {
 	&go_maxspeed_load_attr.attr,
 	&boost_factor_attr.attr,
@@ -663,6 +905,7 @@ static struct attribute *interactive_attributes[] = {
 	&sustain_load_attr.attr,
 	&min_sample_time_attr.attr,
 	&timer_rate_attr.attr,
+	&target_latency_attr.attr,
 	NULL,
 };
 
@@ -687,6 +930,13 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 		freq_table =
 			cpufreq_frequency_get_table(policy->cpu);
 
+		if (sched_util) {
+			rc = cpufreq_interactive_util_start(policy, freq_table);
+			if (rc)
+				return rc;
+			goto started;
+		}
+
 		for_each_cpu(j, policy->cpus) {
 			pcpu = &per_cpu(cpuinfo, j);
 			pcpu->policy = policy;
@@ -709,6 +959,7 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 				mod_timer(&pcpu->cpu_timer, jiffies + 2);
 		}
 
+started:
 		/*
 		 * Do not register the idle hook and create sysfs
 		 * entries if we have already done so.
@@ -724,6 +975,11 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 		break;
 
 	case CPUFREQ_GOV_STOP:
+		if (per_cpu(cpuinfo, policy->cpu).ppol) {
+			cpufreq_interactive_util_stop(policy);
+			goto stopped;
+		}
+
 		for_each_cpu(j, policy->cpus) {
 			pcpu = &per_cpu(cpuinfo, j);
 			pcpu->governor_enabled = 0;
@@ -740,6 +996,7 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 		}
 
 		flush_work(&freq_scale_down_work);
+stopped:
 		if (atomic_dec_return(&active_count) > 0)
 			return 0;
 
@@ -816,6 +1073,12 @@ static int __init cpufreq_interactive_init(void)
 	INIT_WORK(&freq_scale_down_work,
 		  cpufreq_interactive_freq_down);
 
+	/* One work item per policy, never run concurrently with itself. */
+	util_wq = alloc_workqueue("kinteractive_util",
+				  WQ_HIGHPRI | WQ_NON_REENTRANT, 0);
+	if (!util_wq)
+		goto err_freedownwq;
+
 	spin_lock_init(&up_cpumask_lock);
 	spin_lock_init(&down_cpumask_lock);
 	mutex_init(&set_speed_lock);
@@ -824,6 +1087,8 @@ static int __init cpufreq_interactive_init(void)
 
 	return cpufreq_register_governor(&cpufreq_gov_interactive);
 
+err_freedownwq:
+	destroy_workqueue(down_wq);
 err_freeuptask:
 	put_task_struct(up_task);
 	return -ENOMEM;
@@ -841,6 +1106,7 @@ static void __exit cpufreq_interactive_exit(void)
 	kthread_stop(up_task);
 	put_task_struct(up_task);
 	destroy_workqueue(down_wq);
+	destroy_workqueue(util_wq);
 }
 
 module_exit(cpufreq_interactive_exit);
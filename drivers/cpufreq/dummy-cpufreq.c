@@ -0,0 +1,177 @@
+/*
+ * drivers/cpufreq/dummy-cpufreq.c
+ *
+ * Dummy CPU frequency scaling driver. It exposes an evenly spaced
+ * frequency table and only remembers the frequency the governor asked
+ * for, optionally sleeping for a configurable transition latency, so
+ * governors can be exercised and measured on machines (such as QEMU
+ * guests) without frequency scaling hardware.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/cpufreq.h>
+#include <linux/delay.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+
+#define DUMMY_MAX_STATES	32
+
+static unsigned int nr_states = 8;
+module_param(nr_states, uint, 0444);
+MODULE_PARM_DESC(nr_states, "Number of frequency steps (max 32)");
+
+static unsigned int min_khz = 200000;
+module_param(min_khz, uint, 0444);
+MODULE_PARM_DESC(min_khz, "Lowest frequency in kHz");
+
+static unsigned int step_khz = 200000;
+module_param(step_khz, uint, 0444);
+MODULE_PARM_DESC(step_khz, "Distance between frequency steps in kHz");
+
+static unsigned int transition_latency_us = 50;
+module_param(transition_latency_us, uint, 0444);
+MODULE_PARM_DESC(transition_latency_us,
+		 "Time a frequency change pretends to take, in us");
+
+static bool shared_policy;
+module_param(shared_policy, bool, 0444);
+MODULE_PARM_DESC(shared_policy, "Run all cpus at the same frequency");
+
+static struct cpufreq_frequency_table *dummy_freq_table;
+static DEFINE_PER_CPU(unsigned int, dummy_cur_freq);
+
+static int dummy_cpufreq_verify(struct cpufreq_policy *policy)
+{
+	return cpufreq_frequency_table_verify(policy, dummy_freq_table);
+}
+
+static unsigned int dummy_cpufreq_get(unsigned int cpu)
+{
+	return per_cpu(dummy_cur_freq, cpu);
+}
+
+static int dummy_cpufreq_target(struct cpufreq_policy *policy,
+				unsigned int target_freq,
+				unsigned int relation)
+{
+	struct cpufreq_freqs freqs;
+	unsigned int index, cpu;
+
+	if (cpufreq_frequency_table_target(policy, dummy_freq_table,
+					   target_freq, relation, &index))
+		return -EINVAL;
+
+	freqs.old = dummy_cpufreq_get(policy->cpu);
+	freqs.new = dummy_freq_table[index].frequency;
+	if (freqs.old == freqs.new)
+		return 0;
+
+	for_each_cpu(cpu, policy->cpus) {
+		freqs.cpu = cpu;
+		cpufreq_notify_transition(&freqs, CPUFREQ_PRECHANGE);
+	}
+
+	if (transition_latency_us)
+		usleep_range(transition_latency_us, transition_latency_us + 10);
+
+	for_each_cpu(cpu, policy->cpus) {
+		per_cpu(dummy_cur_freq, cpu) = freqs.new;
+		freqs.cpu = cpu;
+		cpufreq_notify_transition(&freqs, CPUFREQ_POSTCHANGE);
+	}
+
+	return 0;
+}
+
+static int dummy_cpufreq_cpu_init(struct cpufreq_policy *policy)
+{
+	unsigned int cpu;
+
+	/* Start out at the top speed, like most boot loaders leave it. */
+	if (!per_cpu(dummy_cur_freq, policy->cpu)) {
+		unsigned int max = dummy_freq_table[nr_states - 1].frequency;
+
+		if (shared_policy)
+			for_each_possible_cpu(cpu)
+				per_cpu(dummy_cur_freq, cpu) = max;
+		else
+			per_cpu(dummy_cur_freq, policy->cpu) = max;
+	}
+	policy->cur = dummy_cpufreq_get(policy->cpu);
+
+	cpufreq_frequency_table_get_attr(dummy_freq_table, policy->cpu);
+
+	policy->cpuinfo.transition_latency = transition_latency_us * 1000;
+
+	if (shared_policy)
+		cpumask_setall(policy->cpus);
+
+	return cpufreq_frequency_table_cpuinfo(policy, dummy_freq_table);
+}
+
+static int dummy_cpufreq_cpu_exit(struct cpufreq_policy *policy)
+{
+	cpufreq_frequency_table_put_attr(policy->cpu);
+	return 0;
+}
+
+static struct freq_attr *dummy_cpufreq_attr[] = {
+	&cpufreq_freq_attr_scaling_available_freqs,
+	NULL,
+};
+
+static struct cpufreq_driver dummy_cpufreq_driver = {
+	.verify		= dummy_cpufreq_verify,
+	.target		= dummy_cpufreq_target,
+	.get		= dummy_cpufreq_get,
+	.init		= dummy_cpufreq_cpu_init,
+	.exit		= dummy_cpufreq_cpu_exit,
+	.name		= "dummy-cpufreq",
+	.owner		= THIS_MODULE,
+	.attr		= dummy_cpufreq_attr,
+};
+
+static int __init dummy_cpufreq_init(void)
+{
+	unsigned int i;
+	int ret;
+
+	if (!nr_states || nr_states > DUMMY_MAX_STATES || !min_khz ||
+	    (nr_states > 1 && !step_khz))
+		return -EINVAL;
+
+	dummy_freq_table = kcalloc(nr_states + 1, sizeof(*dummy_freq_table),
+				   GFP_KERNEL);
+	if (!dummy_freq_table)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_states; i++) {
+		dummy_freq_table[i].index = i;
+		dummy_freq_table[i].frequency = min_khz + i * step_khz;
+	}
+	dummy_freq_table[i].index = i;
+	dummy_freq_table[i].frequency = CPUFREQ_TABLE_END;
+
+	ret = cpufreq_register_driver(&dummy_cpufreq_driver);
+	if (ret)
+		kfree(dummy_freq_table);
+
+	return ret;
+}
+module_init(dummy_cpufreq_init);
+
+static void __exit dummy_cpufreq_exit(void)
+{
+	cpufreq_unregister_driver(&dummy_cpufreq_driver);
+	kfree(dummy_freq_table);
+}
+module_exit(dummy_cpufreq_exit);
+
+MODULE_DESCRIPTION("Dummy cpufreq driver for governor testing");
+MODULE_LICENSE("GPL");
@@ -52,6 +52,40 @@ static void cpuidle_kick_cpus(void) {}
 
 static int __cpuidle_register_device(struct cpuidle_device *dev);
 
+/*
+ * Judge the state the governor picked against the residency that
+ * followed: it was too deep if we left before its target residency,
+ * too shallow if a deeper state allowed by the latency constraint would
+ * have broken even. States are ordered from shallow to deep.
+ */
+static void cpuidle_account_prediction(struct cpuidle_device *dev,
+				       struct cpuidle_state *state)
+{
+	int latency_req, i;
+
+	if (!(state->flags & CPUIDLE_FLAG_TIME_VALID))
+		return;
+
+	if (dev->last_residency < state->target_residency) {
+		state->too_deep++;
+		return;
+	}
+
+	latency_req = pm_qos_request(PM_QOS_CPU_DMA_LATENCY);
+	for (i = state - dev->states + 1; i < dev->state_count; i++) {
+		struct cpuidle_state *s = &dev->states[i];
+
+		if (s->flags & CPUIDLE_FLAG_IGNORE)
+			continue;
+		if (s->exit_latency > latency_req)
+			continue;
+		if (s->target_residency <= dev->last_residency) {
+			state->too_shallow++;
+			return;
+		}
+	}
+}
+
 /**
  * cpuidle_idle_call - the main idle loop
  *
@@ -118,6 +152,7 @@ int cpuidle_idle_call(void)
 
 	target_state->time += (unsigned long long)dev->last_residency;
 	target_state->usage++;
+	cpuidle_account_prediction(dev, target_state);
 
 	/* give the governor an opportunity to reflect on the outcome */
 	if (cpuidle_curr_governor->reflect)
@@ -246,6 +281,8 @@ int cpuidle_enable_device(struct cpuidle_device *dev)
 	for (i = 0; i < dev->state_count; i++) {
 		dev->states[i].usage = 0;
 		dev->states[i].time = 0;
+		dev->states[i].too_deep = 0;
+		dev->states[i].too_shallow = 0;
 	}
 	dev->last_residency = 0;
 	dev->last_state = NULL;
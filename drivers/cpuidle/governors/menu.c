@@ -12,6 +12,8 @@
 
 #include <linux/kernel.h>
 #include <linux/cpuidle.h>
+#include <linux/interrupt.h>
+#include <linux/moduleparam.h>
 #include <linux/pm_qos_params.h>
 #include <linux/time.h>
 #include <linux/ktime.h>
@@ -77,6 +79,15 @@
  * intervals and if the stand deviation of these 8 intervals is below a
  * threshold value, we use the average of these intervals as prediction.
  *
+ * Interrupt-interval predictor
+ * ----------------------------
+ * The idle intervals above mix all wakeup sources together, so a single
+ * periodic device interrupt is lost among the others. The irq core keeps
+ * per-cpu inter-arrival statistics for each interrupt (kernel/irq/timings.c)
+ * and tells us when the next one of the regular ones is due; if that is
+ * before the predicted duration, it becomes the prediction. This can be
+ * turned off with menu.irq_predict=0.
+ *
  * Limiting Performance Impact
  * ---------------------------
  * C states, especially those with large exit latencies, can have a real
@@ -187,6 +198,11 @@ static inline int performance_multiplier(void)
 
 static DEFINE_PER_CPU(struct menu_device, menu_devices);
 
+static bool irq_predict = true;
+module_param(irq_predict, bool, 0644);
+MODULE_PARM_DESC(irq_predict, "Use interrupt inter-arrival history to "
+		 "predict the idle duration");
+
 static void menu_update(struct cpuidle_device *dev);
 
 /* This implements DIV_ROUND_CLOSEST but avoids 64 bit division */
@@ -279,6 +295,18 @@ static int menu_select(struct cpuidle_device *dev)
 
 	detect_repeating_patterns(data);
 
+	if (irq_predict) {
+		u64 now = local_clock();
+		u64 next_irq = irq_timings_next_event(now);
+
+		if (next_irq != ULLONG_MAX) {
+			u64 irq_us = div_u64(next_irq - now, NSEC_PER_USEC);
+
+			if (irq_us < data->predicted_us)
+				data->predicted_us = irq_us;
+		}
+	}
+
 	/*
 	 * We want to default to C1 (hlt), not to busy polling
 	 * unless the timer is happening really really soon.
@@ -396,13 +424,25 @@ static int menu_enable_device(struct cpuidle_device *dev)
 
 	memset(data, 0, sizeof(struct menu_device));
 
+	irq_timings_enable();
+
 	return 0;
 }
 
+/**
+ * menu_disable_device - stops interrupt tracking for a CPU
+ * @dev: the CPU
+ */
+static void menu_disable_device(struct cpuidle_device *dev)
+{
+	irq_timings_disable();
+}
+
 static struct cpuidle_governor menu_governor = {
 	.name =		"menu",
 	.rating =	20,
 	.enable =	menu_enable_device,
+	.disable =	menu_disable_device,
 	.select =	menu_select,
 	.reflect =	menu_reflect,
 	.owner =	THIS_MODULE,
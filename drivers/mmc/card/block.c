@@ -34,6 +34,8 @@
 #include <linux/delay.h>
 #include <linux/capability.h>
 #include <linux/compat.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <linux/mmc/ioctl.h>
 #include <linux/mmc/card.h>
@@ -89,6 +91,7 @@ struct mmc_blk_data {
 	unsigned int	flags;
 #define MMC_BLK_CMD23	(1 << 0)	/* Can do SET_BLOCK_COUNT for multiblock */
 #define MMC_BLK_REL_WR	(1 << 1)	/* MMC Reliable write support */
+#define MMC_BLK_PACKED_CMD	(1 << 2)	/* MMC packed command support */
 
 	unsigned int	usage;
 	unsigned int	read_only;
@@ -102,6 +105,7 @@ struct mmc_blk_data {
 	 */
 	unsigned int	part_curr;
 	struct device_attribute force_ro;
+	struct dentry	*debugfs_dir;
 };
 
 static DEFINE_MUTEX(open_lock);
@@ -119,6 +123,23 @@ enum mmc_blk_status {
 module_param(perdev_minors, int, 0444);
 MODULE_PARM_DESC(perdev_minors, "Minors numbers to allocate per device");
 
+#define mmc_req_rel_wr(req)	(((req->cmd_flags & REQ_FUA) || \
+				  (req->cmd_flags & REQ_META)) && \
+				  (rq_data_dir(req) == WRITE))
+
+static inline void mmc_blk_clear_packed(struct mmc_queue_req *mqrq)
+{
+	struct mmc_packed *packed = mqrq->packed;
+
+	BUG_ON(!packed);
+
+	mqrq->cmd_type = MMC_PACKED_NONE;
+	packed->nr_entries = MMC_PACKED_NR_ZERO;
+	packed->idx_failure = MMC_PACKED_NR_IDX;
+	packed->retries = 0;
+	packed->blocks = 0;
+}
+
 static struct mmc_blk_data *mmc_blk_get(struct gendisk *disk)
 {
 	struct mmc_blk_data *md;
@@ -913,6 +934,65 @@ static int mmc_blk_err_check(struct mmc_card *card,
 	return ret;
 }
 
+static int mmc_blk_packed_err_check(struct mmc_card *card,
+				    struct mmc_async_req *areq)
+{
+	struct mmc_queue_req *mq_rq = container_of(areq, struct mmc_queue_req,
+						   mmc_active);
+	struct request *req = mq_rq->req;
+	struct mmc_packed *packed = mq_rq->packed;
+	int err, check;
+	u32 status;
+	u8 *ext_csd;
+
+	BUG_ON(!packed);
+
+	packed->retries--;
+	check = mmc_blk_err_check(card, areq);
+	err = get_card_status(card, &status, 0);
+	if (err) {
+		pr_err("%s: error %d sending status command\n",
+		       req->rq_disk->disk_name, err);
+		return MMC_BLK_ABORT;
+	}
+
+	if (!(status & R1_EXCEPTION_EVENT))
+		return check;
+
+	ext_csd = kzalloc(512, GFP_KERNEL);
+	if (!ext_csd) {
+		pr_err("%s: unable to allocate buffer for ext_csd\n",
+		       req->rq_disk->disk_name);
+		return MMC_BLK_ABORT;
+	}
+
+	err = mmc_send_ext_csd(card, ext_csd);
+	if (err) {
+		pr_err("%s: error %d sending ext_csd\n",
+		       req->rq_disk->disk_name, err);
+		check = MMC_BLK_ABORT;
+		goto out;
+	}
+
+	if ((ext_csd[EXT_CSD_EXP_EVENTS_STATUS] & EXT_CSD_PACKED_FAILURE) &&
+	    (ext_csd[EXT_CSD_PACKED_CMD_STATUS] &
+	     EXT_CSD_PACKED_GENERIC_ERROR)) {
+		if (ext_csd[EXT_CSD_PACKED_CMD_STATUS] &
+		    EXT_CSD_PACKED_INDEXED_ERROR) {
+			/* Entries before the failed one were written */
+			packed->idx_failure =
+				ext_csd[EXT_CSD_PACKED_FAILURE_INDEX] - 1;
+			check = MMC_BLK_PARTIAL;
+		}
+		pr_err("%s: packed cmd failed, nr %u, sectors %u, failure index: %d\n",
+		       req->rq_disk->disk_name, packed->nr_entries,
+		       packed->blocks, packed->idx_failure);
+	}
+out:
+	kfree(ext_csd);
+	return check;
+}
+
 static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
 			       struct mmc_card *card,
 			       int disable_multi,
@@ -930,10 +1010,7 @@ static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
 	 * XXX: this really needs a good explanation of why REQ_META
 	 * is treated special.
 	 */
-	bool do_rel_wr = ((req->cmd_flags & REQ_FUA) ||
-			  (req->cmd_flags & REQ_META)) &&
-		(rq_data_dir(req) == WRITE) &&
-		(md->flags & MMC_BLK_REL_WR);
+	bool do_rel_wr = mmc_req_rel_wr(req) && (md->flags & MMC_BLK_REL_WR);
 
 	memset(brq, 0, sizeof(struct mmc_blk_request));
 	brq->mrq.cmd = &brq->cmd;
@@ -1014,7 +1091,7 @@ static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
 	    (do_rel_wr || !(card->quirks & MMC_QUIRK_BLK_NO_CMD23))) {
 		brq->sbc.opcode = MMC_SET_BLOCK_COUNT;
 		brq->sbc.arg = brq->data.blocks |
-			(do_rel_wr ? (1 << 31) : 0);
+			(do_rel_wr ? MMC_CMD23_ARG_REL_WR : 0);
 		brq->sbc.flags = MMC_RSP_R1 | MMC_CMD_AC;
 		brq->mrq.sbc = &brq->sbc;
 	}
@@ -1049,6 +1126,288 @@ static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
 	mmc_queue_bounce_pre(mqrq);
 }
 
+/*
+ * Collect write requests following @req from the block queue into the
+ * packed list of the current queue request.  Returns the number of
+ * packed entries, or 0 if @req is to be issued as a normal request.
+ */
+static u8 mmc_blk_prep_packed_list(struct mmc_queue *mq, struct request *req)
+{
+	struct request_queue *q = mq->queue;
+	struct mmc_card *card = mq->card;
+	struct request *cur = req, *next = NULL;
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_queue_req *mqrq = mq->mqrq_cur;
+	struct mmc_packed_stats *stats = &mq->packed_stats;
+	bool en_rel_wr = card->ext_csd.rel_param & EXT_CSD_WR_REL_PARAM_EN;
+	unsigned int req_sectors = 0, phys_segments = 0;
+	unsigned int max_blk_count, max_phys_segs;
+	enum mmc_packed_stop_reason reason;
+	bool put_back = true;
+	u8 max_packed_rw = 0;
+	u8 reqs = 0;
+
+	if (!(md->flags & MMC_BLK_PACKED_CMD))
+		goto no_packed;
+
+	if ((rq_data_dir(cur) == WRITE) &&
+	    mmc_host_packed_wr(card->host))
+		max_packed_rw = min_t(u8, card->ext_csd.max_packed_writes,
+				      MMC_PACKED_NR_MAX);
+
+	if (max_packed_rw == 0)
+		goto no_packed;
+
+	if (mmc_req_rel_wr(cur) &&
+	    (md->flags & MMC_BLK_REL_WR) && !en_rel_wr)
+		goto no_packed;
+
+	mmc_blk_clear_packed(mqrq);
+
+	max_blk_count = min(card->host->max_blk_count,
+			    card->host->max_req_size >> 9);
+	if (unlikely(max_blk_count > 0xffff))
+		max_blk_count = 0xffff;
+
+	max_phys_segs = queue_max_segments(q);
+	req_sectors += blk_rq_sectors(cur);
+	phys_segments += cur->nr_phys_segments;
+
+	/* The header takes one block and one segment of its own */
+	req_sectors++;
+	phys_segments++;
+
+	do {
+		if (reqs >= max_packed_rw - 1) {
+			reason = MMC_PACKED_STOP_THRESHOLD;
+			put_back = false;
+			break;
+		}
+
+		spin_lock_irq(q->queue_lock);
+		next = blk_fetch_request(q);
+		spin_unlock_irq(q->queue_lock);
+		if (!next) {
+			reason = MMC_PACKED_STOP_EMPTY_QUEUE;
+			put_back = false;
+			break;
+		}
+
+		if (next->cmd_flags & REQ_DISCARD ||
+		    next->cmd_flags & REQ_FLUSH) {
+			reason = MMC_PACKED_STOP_FLUSH_DISCARD;
+			break;
+		}
+
+		if (rq_data_dir(cur) != rq_data_dir(next)) {
+			reason = MMC_PACKED_STOP_DATA_DIR;
+			break;
+		}
+
+		if (mmc_req_rel_wr(next) &&
+		    (md->flags & MMC_BLK_REL_WR) && !en_rel_wr) {
+			reason = MMC_PACKED_STOP_REL_WRITE;
+			break;
+		}
+
+		req_sectors += blk_rq_sectors(next);
+		if (req_sectors > max_blk_count) {
+			reason = MMC_PACKED_STOP_SECTORS;
+			break;
+		}
+
+		phys_segments += next->nr_phys_segments;
+		if (phys_segments > max_phys_segs) {
+			reason = MMC_PACKED_STOP_SEGMENTS;
+			break;
+		}
+
+		list_add_tail(&next->queuelist, &mqrq->packed->list);
+		cur = next;
+		reqs++;
+	} while (1);
+
+	if (put_back) {
+		spin_lock_irq(q->queue_lock);
+		blk_requeue_request(q, next);
+		spin_unlock_irq(q->queue_lock);
+	}
+
+	stats->stop_reason[reason]++;
+	stats->packing_events[reqs + 1]++;
+
+	if (reqs > 0) {
+		list_add(&req->queuelist, &mqrq->packed->list);
+		mqrq->packed->nr_entries = ++reqs;
+		mqrq->packed->retries = reqs;
+		return reqs;
+	}
+
+no_packed:
+	mqrq->cmd_type = MMC_PACKED_NONE;
+	return 0;
+}
+
+static void mmc_blk_packed_hdr_wrq_prep(struct mmc_queue_req *mqrq,
+					struct mmc_card *card,
+					struct mmc_queue *mq)
+{
+	struct mmc_blk_request *brq = &mqrq->brq;
+	struct request *req = mqrq->req;
+	struct request *prq;
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_packed *packed = mqrq->packed;
+	bool do_rel_wr;
+	u32 *packed_cmd_hdr;
+	u8 i = 1;
+
+	BUG_ON(!packed);
+
+	mqrq->cmd_type = MMC_PACKED_WRITE;
+	packed->blocks = 0;
+	packed->idx_failure = MMC_PACKED_NR_IDX;
+
+	packed_cmd_hdr = packed->cmd_hdr;
+	memset(packed_cmd_hdr, 0, sizeof(packed->cmd_hdr));
+	packed_cmd_hdr[0] = (packed->nr_entries << 16) |
+		(MMC_PACKED_CMD_WR << 8) | MMC_PACKED_CMD_VER;
+
+	/*
+	 * Argument for each entry of packed group
+	 */
+	list_for_each_entry(prq, &packed->list, queuelist) {
+		do_rel_wr = mmc_req_rel_wr(prq) && (md->flags & MMC_BLK_REL_WR);
+		/* Argument of CMD23 */
+		packed_cmd_hdr[(i * 2)] =
+			(do_rel_wr ? MMC_CMD23_ARG_REL_WR : 0) |
+			blk_rq_sectors(prq);
+		/* Argument of CMD25 */
+		packed_cmd_hdr[((i * 2)) + 1] =
+			mmc_card_blockaddr(card) ?
+			blk_rq_pos(prq) : blk_rq_pos(prq) << 9;
+		packed->blocks += blk_rq_sectors(prq);
+		i++;
+	}
+
+	memset(brq, 0, sizeof(struct mmc_blk_request));
+	brq->mrq.cmd = &brq->cmd;
+	brq->mrq.data = &brq->data;
+	brq->mrq.sbc = &brq->sbc;
+	brq->mrq.stop = &brq->stop;
+
+	brq->sbc.opcode = MMC_SET_BLOCK_COUNT;
+	brq->sbc.arg = MMC_CMD23_ARG_PACKED | (packed->blocks + 1);
+	brq->sbc.flags = MMC_RSP_R1 | MMC_CMD_AC;
+
+	brq->cmd.opcode = MMC_WRITE_MULTIPLE_BLOCK;
+	brq->cmd.arg = blk_rq_pos(req);
+	if (!mmc_card_blockaddr(card))
+		brq->cmd.arg <<= 9;
+	brq->cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_ADTC;
+
+	brq->data.blksz = 512;
+	brq->data.blocks = packed->blocks + 1;
+	brq->data.flags |= MMC_DATA_WRITE;
+
+	brq->stop.opcode = MMC_STOP_TRANSMISSION;
+	brq->stop.arg = 0;
+	brq->stop.flags = MMC_RSP_SPI_R1B | MMC_RSP_R1B | MMC_CMD_AC;
+
+	mmc_set_data_timeout(&brq->data, card);
+
+	brq->data.sg = mqrq->sg;
+	brq->data.sg_len = mmc_queue_map_sg(mq, mqrq);
+
+	mqrq->mmc_active.mrq = &brq->mrq;
+	mqrq->mmc_active.err_check = mmc_blk_packed_err_check;
+
+	mmc_queue_bounce_pre(mqrq);
+}
+
+/*
+ * Complete the packed entries that made it to the card.  Returns 1 if
+ * the group has to be reissued starting at the failed entry.
+ */
+static int mmc_blk_end_packed_req(struct mmc_blk_data *md,
+				  struct mmc_queue_req *mq_rq)
+{
+	struct request *prq;
+	struct mmc_packed *packed = mq_rq->packed;
+	int idx = packed->idx_failure, i = 0;
+	int ret = 0;
+
+	BUG_ON(!packed);
+
+	spin_lock_irq(&md->lock);
+	while (!list_empty(&packed->list)) {
+		prq = list_entry_rq(packed->list.next);
+		if (idx == i) {
+			/* retry from error index */
+			packed->nr_entries -= idx;
+			mq_rq->req = prq;
+			ret = 1;
+
+			if (packed->nr_entries == MMC_PACKED_NR_SINGLE) {
+				list_del_init(&prq->queuelist);
+				mmc_blk_clear_packed(mq_rq);
+			}
+			spin_unlock_irq(&md->lock);
+			return ret;
+		}
+		list_del_init(&prq->queuelist);
+		__blk_end_request(prq, 0, blk_rq_bytes(prq));
+		i++;
+	}
+	spin_unlock_irq(&md->lock);
+
+	mmc_blk_clear_packed(mq_rq);
+	return ret;
+}
+
+static void mmc_blk_abort_packed_req(struct mmc_blk_data *md,
+				     struct mmc_queue_req *mq_rq)
+{
+	struct request *prq;
+	struct mmc_packed *packed = mq_rq->packed;
+
+	BUG_ON(!packed);
+
+	spin_lock_irq(&md->lock);
+	while (!list_empty(&packed->list)) {
+		prq = list_entry_rq(packed->list.next);
+		list_del_init(&prq->queuelist);
+		__blk_end_request(prq, -EIO, blk_rq_bytes(prq));
+	}
+	spin_unlock_irq(&md->lock);
+
+	mmc_blk_clear_packed(mq_rq);
+}
+
+/*
+ * Give every entry but the first back to the block queue, leaving
+ * mq_rq->req to be issued as a normal request.
+ */
+static void mmc_blk_revert_packed_req(struct mmc_queue *mq,
+				      struct mmc_queue_req *mq_rq)
+{
+	struct request *prq;
+	struct request_queue *q = mq->queue;
+	struct mmc_packed *packed = mq_rq->packed;
+
+	BUG_ON(!packed);
+
+	spin_lock_irq(q->queue_lock);
+	while (!list_empty(&packed->list)) {
+		prq = list_entry_rq(packed->list.prev);
+		list_del_init(&prq->queuelist);
+		if (prq != mq_rq->req)
+			blk_requeue_request(q, prq);
+	}
+	spin_unlock_irq(q->queue_lock);
+
+	mmc_blk_clear_packed(mq_rq);
+}
+
 static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 {
 	struct mmc_blk_data *md = mq->data;
@@ -1059,13 +1418,21 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 	struct mmc_queue_req *mq_rq;
 	struct request *req;
 	struct mmc_async_req *areq;
+	bool packed_fallback = false;
+	u8 reqs = 0;
 
 	if (!rqc && !mq->mqrq_prev->req)
 		return 0;
 
+	if (rqc)
+		reqs = mmc_blk_prep_packed_list(mq, rqc);
+
 	do {
 		if (rqc) {
-			mmc_blk_rw_rq_prep(mq->mqrq_cur, card, 0, mq);
+			if (reqs)
+				mmc_blk_packed_hdr_wrq_prep(mq->mqrq_cur, card, mq);
+			else
+				mmc_blk_rw_rq_prep(mq->mqrq_cur, card, 0, mq);
 			areq = &mq->mqrq_cur->mmc_active;
 		} else
 			areq = NULL;
@@ -1084,6 +1451,10 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 			/*
 			 * A block was successfully transferred.
 			 */
+			if (mmc_packed_cmd(mq_rq->cmd_type)) {
+				ret = mmc_blk_end_packed_req(md, mq_rq);
+				break;
+			}
 			spin_lock_irq(&md->lock);
 			ret = __blk_end_request(req, 0,
 						brq->data.bytes_xfered);
@@ -1103,6 +1474,10 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 			}
 			break;
 		case MMC_BLK_CMD_ERR:
+			if (mmc_packed_cmd(mq_rq->cmd_type)) {
+				packed_fallback = true;
+				break;
+			}
 			goto cmd_err;
 		case MMC_BLK_RETRY_SINGLE:
 			disable_multi = 1;
@@ -1111,6 +1486,10 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 			if (retry++ < 5)
 				break;
 		case MMC_BLK_ABORT:
+			if (mmc_packed_cmd(mq_rq->cmd_type)) {
+				packed_fallback = true;
+				break;
+			}
 			goto cmd_abort;
 		case MMC_BLK_DATA_ERR:
 			/*
@@ -1127,12 +1506,31 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 			break;
 		}
 
+		if (packed_fallback || (mmc_packed_cmd(mq_rq->cmd_type) &&
+					ret && !mq_rq->packed->retries)) {
+			/*
+			 * The packed write failed without telling which
+			 * entry was at fault, or kept failing.  Put the
+			 * group back and reissue its requests one by one,
+			 * so the regular error handling applies to each.
+			 */
+			mq->packed_stats.fallbacks++;
+			mmc_blk_revert_packed_req(mq, mq_rq);
+			packed_fallback = false;
+			retry = 0;
+			ret = 1;
+		}
+
 		if (ret) {
 			/*
 			 * In case of a none complete request
 			 * prepare it again and resend.
 			 */
-			mmc_blk_rw_rq_prep(mq_rq, card, disable_multi, mq);
+			if (mmc_packed_cmd(mq_rq->cmd_type))
+				mmc_blk_packed_hdr_wrq_prep(mq_rq, card, mq);
+			else
+				mmc_blk_rw_rq_prep(mq_rq, card, disable_multi,
+						   mq);
 			mmc_start_req(card->host, &mq_rq->mmc_active, NULL);
 		}
 	} while (ret);
@@ -1167,13 +1565,24 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 	}
 
  cmd_abort:
-	spin_lock_irq(&md->lock);
-	while (ret)
-		ret = __blk_end_request(req, -EIO, blk_rq_cur_bytes(req));
-	spin_unlock_irq(&md->lock);
+	if (mmc_packed_cmd(mq_rq->cmd_type)) {
+		mmc_blk_abort_packed_req(md, mq_rq);
+	} else {
+		spin_lock_irq(&md->lock);
+		while (ret)
+			ret = __blk_end_request(req, -EIO,
+						blk_rq_cur_bytes(req));
+		spin_unlock_irq(&md->lock);
+	}
 
  start_new_req:
 	if (rqc) {
+		/*
+		 * If current request is packed, it needs to put back.
+		 */
+		if (mmc_packed_cmd(mq->mqrq_cur->cmd_type))
+			mmc_blk_revert_packed_req(mq, mq->mqrq_cur);
+
 		mmc_blk_rw_rq_prep(mq->mqrq_cur, card, 0, mq);
 		mmc_start_req(card->host, &mq->mqrq_cur->mmc_active, NULL);
 	}
@@ -1340,6 +1749,13 @@ static struct mmc_blk_data *mmc_blk_alloc_req(struct mmc_card *card,
 		blk_queue_flush(md->queue.queue, REQ_FLUSH | REQ_FUA);
 	}
 
+	if (mmc_card_mmc(card) && !subname &&
+	    (md->flags & MMC_BLK_CMD23) &&
+	    card->ext_csd.packed_event_en) {
+		if (!mmc_packed_init(&md->queue, card))
+			md->flags |= MMC_BLK_PACKED_CMD;
+	}
+
 	return md;
 
  err_putdisk:
@@ -1441,9 +1857,141 @@ mmc_blk_set_blksize(struct mmc_blk_data *md, struct mmc_card *card)
 	return 0;
 }
 
+#ifdef CONFIG_DEBUG_FS
+static const char *mmc_blk_packed_stop_names[MMC_PACKED_STOP_MAX] = {
+	[MMC_PACKED_STOP_SEGMENTS]	= "segments",
+	[MMC_PACKED_STOP_SECTORS]	= "sectors",
+	[MMC_PACKED_STOP_DATA_DIR]	= "data_dir",
+	[MMC_PACKED_STOP_FLUSH_DISCARD]	= "flush_discard",
+	[MMC_PACKED_STOP_EMPTY_QUEUE]	= "empty_queue",
+	[MMC_PACKED_STOP_REL_WRITE]	= "rel_write",
+	[MMC_PACKED_STOP_THRESHOLD]	= "threshold",
+};
+
+static int mmc_blk_packed_stats_show(struct seq_file *s, void *data)
+{
+	struct mmc_blk_data *md = s->private;
+	struct mmc_packed_stats *stats = &md->queue.packed_stats;
+	unsigned int packed = 0;
+	int i;
+
+	for (i = 2; i <= MMC_PACKED_NR_MAX; i++)
+		packed += stats->packing_events[i];
+
+	seq_printf(s, "packed writes: %u\n", packed);
+	seq_printf(s, "unpacked writes: %u\n", stats->packing_events[1]);
+	seq_printf(s, "fallbacks: %u\n", stats->fallbacks);
+
+	seq_printf(s, "pack size:\n");
+	for (i = 2; i <= MMC_PACKED_NR_MAX; i++)
+		if (stats->packing_events[i])
+			seq_printf(s, "  %d: %u\n", i,
+				   stats->packing_events[i]);
+
+	seq_printf(s, "stop reason:\n");
+	for (i = 0; i < MMC_PACKED_STOP_MAX; i++)
+		seq_printf(s, "  %s: %u\n", mmc_blk_packed_stop_names[i],
+			   stats->stop_reason[i]);
+
+	return 0;
+}
+
+static int mmc_blk_packed_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mmc_blk_packed_stats_show, inode->i_private);
+}
+
+/* Any write resets the counters. */
+static ssize_t mmc_blk_packed_stats_write(struct file *file,
+					  const char __user *ubuf,
+					  size_t cnt, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct mmc_blk_data *md = s->private;
+
+	memset(&md->queue.packed_stats, 0, sizeof(md->queue.packed_stats));
+	return cnt;
+}
+
+static const struct file_operations mmc_blk_packed_stats_fops = {
+	.open		= mmc_blk_packed_stats_open,
+	.read		= seq_read,
+	.write		= mmc_blk_packed_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/*
+ * The files live in a directory of the block driver rather than in the
+ * card's debugfs directory: the card's directory is removed before the
+ * card is unbound from the driver on removal, but not at all when the
+ * driver is unbound through sysfs, so neither way of removing our files
+ * from there is safe.
+ */
+static struct dentry *mmc_blk_debugfs_root;
+
+static void mmc_blk_add_packed_stats(struct mmc_card *card,
+				     struct mmc_blk_data *md)
+{
+	if (!(md->flags & MMC_BLK_PACKED_CMD) || !mmc_blk_debugfs_root)
+		return;
+
+	md->debugfs_dir = debugfs_create_dir(md->disk->disk_name,
+					     mmc_blk_debugfs_root);
+	if (IS_ERR_OR_NULL(md->debugfs_dir)) {
+		md->debugfs_dir = NULL;
+		return;
+	}
+
+	if (!debugfs_create_file("packed_stats", S_IRUSR | S_IWUSR,
+				 md->debugfs_dir, md,
+				 &mmc_blk_packed_stats_fops)) {
+		debugfs_remove(md->debugfs_dir);
+		md->debugfs_dir = NULL;
+	}
+}
+
+static void mmc_blk_remove_debugfs(struct mmc_blk_data *md)
+{
+	debugfs_remove_recursive(md->debugfs_dir);
+	md->debugfs_dir = NULL;
+}
+
+static void __init mmc_blk_debugfs_init(void)
+{
+	mmc_blk_debugfs_root = debugfs_create_dir("mmcblk", NULL);
+	if (IS_ERR(mmc_blk_debugfs_root))
+		mmc_blk_debugfs_root = NULL;
+}
+
+static void mmc_blk_debugfs_exit(void)
+{
+	debugfs_remove_recursive(mmc_blk_debugfs_root);
+}
+#else
+static inline void mmc_blk_add_packed_stats(struct mmc_card *card,
+					    struct mmc_blk_data *md)
+{
+}
+
+static inline void mmc_blk_remove_debugfs(struct mmc_blk_data *md)
+{
+}
+
+static inline void mmc_blk_debugfs_init(void)
+{
+}
+
+static inline void mmc_blk_debugfs_exit(void)
+{
+}
+#endif
+
 static void mmc_blk_remove_req(struct mmc_blk_data *md)
 {
 	if (md) {
+		mmc_blk_remove_debugfs(md);
+
 		if (md->disk->flags & GENHD_FL_UP) {
 			device_remove_file(disk_to_dev(md->disk), &md->force_ro);
 
@@ -1551,6 +2099,8 @@ static int mmc_blk_probe(struct mmc_card *card)
 	if (mmc_add_disk(md))
 		goto out;
 
+	mmc_blk_add_packed_stats(card, md);
+
 	list_for_each_entry(part_md, &md->part, part) {
 		if (mmc_add_disk(part_md))
 			goto out;
@@ -1639,6 +2189,8 @@ static int __init mmc_blk_init(void)
 
 	max_devices = 256 / perdev_minors;
 
+	mmc_blk_debugfs_init();
+
 	res = register_blkdev(MMC_BLOCK_MAJOR, "mmc");
 	if (res)
 		goto out;
@@ -1651,6 +2203,7 @@ static int __init mmc_blk_init(void)
  out2:
 	unregister_blkdev(MMC_BLOCK_MAJOR, "mmc");
  out:
+	mmc_blk_debugfs_exit();
 	return res;
 }
 
@@ -1658,6 +2211,7 @@ static void __exit mmc_blk_exit(void)
 {
 	mmc_unregister_driver(&mmc_driver);
 	unregister_blkdev(MMC_BLOCK_MAJOR, "mmc");
+	mmc_blk_debugfs_exit();
 }
 
 module_init(mmc_blk_init);
@@ -12,6 +12,50 @@ struct mmc_blk_request {
 	struct mmc_data		data;
 };
 
+enum mmc_packed_type {
+	MMC_PACKED_NONE = 0,
+	MMC_PACKED_WRITE,
+};
+
+#define mmc_packed_cmd(type)	((type) != MMC_PACKED_NONE)
+#define mmc_packed_wr(type)	((type) == MMC_PACKED_WRITE)
+
+/*
+ * A 512 byte packed command header holds one header word pair plus one
+ * pair per entry, which bounds the number of packed requests.
+ */
+#define MMC_PACKED_HDR_WORDS	128
+#define MMC_PACKED_NR_MAX	(MMC_PACKED_HDR_WORDS / 2 - 1)
+#define MMC_PACKED_NR_IDX	-1
+#define MMC_PACKED_NR_ZERO	0
+#define MMC_PACKED_NR_SINGLE	1
+
+struct mmc_packed {
+	struct list_head	list;
+	u32			cmd_hdr[MMC_PACKED_HDR_WORDS];
+	unsigned int		blocks;
+	u8			nr_entries;
+	u8			retries;
+	s16			idx_failure;
+};
+
+enum mmc_packed_stop_reason {
+	MMC_PACKED_STOP_SEGMENTS = 0,	/* too many phys segments */
+	MMC_PACKED_STOP_SECTORS,	/* too many sectors for one transfer */
+	MMC_PACKED_STOP_DATA_DIR,	/* next request is a read */
+	MMC_PACKED_STOP_FLUSH_DISCARD,	/* next request is a flush/discard */
+	MMC_PACKED_STOP_EMPTY_QUEUE,	/* no more requests queued */
+	MMC_PACKED_STOP_REL_WRITE,	/* legacy reliable write */
+	MMC_PACKED_STOP_THRESHOLD,	/* card's MAX_PACKED_WRITES reached */
+	MMC_PACKED_STOP_MAX,
+};
+
+struct mmc_packed_stats {
+	unsigned int		packing_events[MMC_PACKED_NR_MAX + 1];
+	unsigned int		stop_reason[MMC_PACKED_STOP_MAX];
+	unsigned int		fallbacks;	/* groups reissued unpacked */
+};
+
 struct mmc_queue_req {
 	struct request		*req;
 	struct mmc_blk_request	brq;
@@ -20,6 +64,8 @@ struct mmc_queue_req {
 	struct scatterlist	*bounce_sg;
 	unsigned int		bounce_sg_len;
 	struct mmc_async_req	mmc_active;
+	enum mmc_packed_type	cmd_type;
+	struct mmc_packed	*packed;
 };
 
 struct mmc_queue {
@@ -33,6 +79,7 @@ struct mmc_queue {
 	struct mmc_queue_req	mqrq[2];
 	struct mmc_queue_req	*mqrq_cur;
 	struct mmc_queue_req	*mqrq_prev;
+	struct mmc_packed_stats	packed_stats;
 };
 
 extern int mmc_init_queue(struct mmc_queue *, struct mmc_card *, spinlock_t *,
@@ -40,6 +87,8 @@ extern int mmc_init_queue(struct mmc_queue *, struct mmc_card *, spinlock_t *,
 extern void mmc_cleanup_queue(struct mmc_queue *);
 extern void mmc_queue_suspend(struct mmc_queue *);
 extern void mmc_queue_resume(struct mmc_queue *);
+extern int mmc_packed_init(struct mmc_queue *, struct mmc_card *);
+extern void mmc_packed_clean(struct mmc_queue *);
 
 extern unsigned int mmc_queue_map_sg(struct mmc_queue *,
 				     struct mmc_queue_req *);
@@ -0,0 +1,911 @@
+/*
+ *  linux/drivers/mmc/host/mmc_ram.c - RAM backed virtual MMC host
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * The host emulates an eMMC 4.5 card whose contents live in a sparse
+ * store of pages, much like the brd ramdisk.  Requests complete from a
+ * workqueue after a configurable per-command latency and transfer time,
+ * so the block driver, the async request pipeline and mmc_test can be
+ * exercised and benchmarked on machines without MMC hardware.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/init.h>
+#include <linux/platform_device.h>
+#include <linux/workqueue.h>
+#include <linux/radix-tree.h>
+#include <linux/highmem.h>
+#include <linux/scatterlist.h>
+#include <linux/delay.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+
+#include <linux/mmc/host.h>
+#include <linux/mmc/card.h>
+#include <linux/mmc/mmc.h>
+
+#define DRIVER_NAME		"mmc_ram"
+
+#define MMC_RAM_SECTOR_SHIFT	9
+
+static unsigned int size_mb = 1024;
+module_param(size_mb, uint, 0444);
+MODULE_PARM_DESC(size_mb, "Card capacity in MiB (backing pages are allocated on write)");
+
+static unsigned int cmd_latency_us;
+module_param(cmd_latency_us, uint, 0644);
+MODULE_PARM_DESC(cmd_latency_us, "Latency added for every command, in microseconds");
+
+static unsigned int read_kbps;
+module_param(read_kbps, uint, 0644);
+MODULE_PARM_DESC(read_kbps, "Read bandwidth in KiB/s (0 = unlimited)");
+
+static unsigned int write_kbps;
+module_param(write_kbps, uint, 0644);
+MODULE_PARM_DESC(write_kbps, "Write bandwidth in KiB/s (0 = unlimited)");
+
+static unsigned int erase_latency_us;
+module_param(erase_latency_us, uint, 0644);
+MODULE_PARM_DESC(erase_latency_us, "Latency of an erase, trim or sanitize, in microseconds");
+
+static unsigned int max_packed = 8;
+module_param(max_packed, uint, 0444);
+MODULE_PARM_DESC(max_packed, "MAX_PACKED_WRITES reported by the card (0 = no packed commands)");
+
+struct mmc_ram_host {
+	struct mmc_host		*mmc;
+	struct mmc_request	*mrq;
+
+	struct workqueue_struct	*wq;
+	struct work_struct	req_work;
+
+	/* Emulated card state */
+	unsigned int		state;		/* R1_STATE_* */
+	u16			rca;
+	u32			status;		/* pending R1 error bits */
+	u32			cid[4];
+	u32			csd[4];
+	u8			ext_csd[512];
+	u64			sectors;
+	u32			erase_start;
+	u32			erase_end;
+	u32			blocks;		/* from CMD23, 0 if unset */
+	bool			packed;		/* CMD23 announced a packed cmd */
+
+	/* Backing store of pages indexed by page offset in the card */
+	struct radix_tree_root	pages;
+};
+
+/*
+ * Inverse of UNSTUFF_BITS() in the core: place @size bits of @val at
+ * bit @start of a 128 bit register held as four big endian words.
+ */
+static void mmc_ram_stuff_bits(u32 *resp, int start, int size, u32 val)
+{
+	const int off = 3 - (start / 32);
+	const int shft = start & 31;
+
+	resp[off] |= val << shft;
+	if (size + shft > 32)
+		resp[off - 1] |= val >> (32 - shft);
+}
+
+static void mmc_ram_init_regs(struct mmc_ram_host *host)
+{
+	u32 *cid = host->cid, *csd = host->csd;
+	u8 *ext_csd = host->ext_csd;
+	const char *name = "RAMMMC";
+	int i;
+
+	host->sectors = (u64)size_mb << (20 - MMC_RAM_SECTOR_SHIFT);
+
+	memset(cid, 0, sizeof(host->cid));
+	mmc_ram_stuff_bits(cid, 120, 8, 0xfe);		/* manfid */
+	mmc_ram_stuff_bits(cid, 104, 16, 0x5241);	/* oemid, "RA" */
+	for (i = 0; i < 6; i++)
+		mmc_ram_stuff_bits(cid, 96 - i * 8, 8, name[i]);
+	mmc_ram_stuff_bits(cid, 48, 8, 0x10);		/* prv */
+	mmc_ram_stuff_bits(cid, 16, 32, 0x12345678);	/* serial */
+	mmc_ram_stuff_bits(cid, 12, 4, 1);		/* month */
+	mmc_ram_stuff_bits(cid, 8, 4, 15);		/* year - 1997 */
+
+	memset(csd, 0, sizeof(host->csd));
+	mmc_ram_stuff_bits(csd, 126, 2, CSD_STRUCT_EXT_CSD);
+	mmc_ram_stuff_bits(csd, 122, 4, CSD_SPEC_VER_4);
+	mmc_ram_stuff_bits(csd, 115, 4, 1);		/* TAAC 1.0 x 1ns */
+	mmc_ram_stuff_bits(csd, 96, 3, 2);		/* TRAN_SPEED 25MHz */
+	mmc_ram_stuff_bits(csd, 99, 4, 6);
+	mmc_ram_stuff_bits(csd, 84, 12, CCC_BASIC | CCC_BLOCK_READ |
+			   CCC_BLOCK_WRITE | CCC_ERASE | CCC_WRITE_PROT |
+			   CCC_LOCK_CARD | CCC_APP_SPEC | CCC_SWITCH);
+	mmc_ram_stuff_bits(csd, 80, 4, 9);		/* READ_BL_LEN */
+	mmc_ram_stuff_bits(csd, 62, 12, 0xfff);		/* C_SIZE, see SEC_CNT */
+	mmc_ram_stuff_bits(csd, 47, 3, 7);		/* C_SIZE_MULT */
+	mmc_ram_stuff_bits(csd, 26, 3, 2);		/* R2W_FACTOR */
+	mmc_ram_stuff_bits(csd, 22, 4, 9);		/* WRITE_BL_LEN */
+
+	memset(ext_csd, 0, sizeof(host->ext_csd));
+	ext_csd[EXT_CSD_REV] = 6;
+	ext_csd[EXT_CSD_STRUCTURE] = 2;
+	ext_csd[EXT_CSD_CARD_TYPE] = EXT_CSD_CARD_TYPE_52 |
+				     EXT_CSD_CARD_TYPE_26;
+	ext_csd[EXT_CSD_SEC_CNT + 0] = host->sectors >> 0;
+	ext_csd[EXT_CSD_SEC_CNT + 1] = host->sectors >> 8;
+	ext_csd[EXT_CSD_SEC_CNT + 2] = host->sectors >> 16;
+	ext_csd[EXT_CSD_SEC_CNT + 3] = host->sectors >> 24;
+	ext_csd[EXT_CSD_PART_SWITCH_TIME] = 1;
+	ext_csd[EXT_CSD_S_A_TIMEOUT] = 0x10;
+	ext_csd[EXT_CSD_REL_WR_SEC_C] = 1;
+	ext_csd[EXT_CSD_WR_REL_PARAM] = EXT_CSD_WR_REL_PARAM_EN;
+	ext_csd[EXT_CSD_HC_WP_GRP_SIZE] = 1;
+	ext_csd[EXT_CSD_ERASE_TIMEOUT_MULT] = 1;
+	ext_csd[EXT_CSD_HC_ERASE_GRP_SIZE] = 1;
+	ext_csd[EXT_CSD_SEC_TRIM_MULT] = 1;
+	ext_csd[EXT_CSD_SEC_ERASE_MULT] = 1;
+	ext_csd[EXT_CSD_SEC_FEATURE_SUPPORT] = EXT_CSD_SEC_ER_EN |
+		EXT_CSD_SEC_GB_CL_EN | EXT_CSD_SEC_SANITIZE;
+	ext_csd[EXT_CSD_TRIM_MULT] = 1;
+	ext_csd[EXT_CSD_MAX_PACKED_WRITES] = min(max_packed, 255u);
+}
+
+/*
+ * CMD0 and power cycles drop the card back to idle and clear the
+ * volatile EXT_CSD modes.
+ */
+static void mmc_ram_reset_card(struct mmc_ram_host *host)
+{
+	host->state = R1_STATE_IDLE;
+	host->rca = 0;
+	host->status = 0;
+	host->blocks = 0;
+	host->packed = false;
+	host->ext_csd[EXT_CSD_BUS_WIDTH] = EXT_CSD_BUS_WIDTH_1;
+	host->ext_csd[EXT_CSD_HS_TIMING] = 0;
+	host->ext_csd[EXT_CSD_ERASE_GROUP_DEF] = 0;
+	host->ext_csd[EXT_CSD_EXP_EVENTS_CTRL] = 0;
+	host->ext_csd[EXT_CSD_EXP_EVENTS_STATUS] = 0;
+	host->ext_csd[EXT_CSD_PACKED_CMD_STATUS] = 0;
+	host->ext_csd[EXT_CSD_PACKED_FAILURE_INDEX] = 0;
+}
+
+/*
+ * Backing store.  Pages are allocated on first write, reads of pages
+ * that were never written (or were erased) return zeroes.
+ */
+static struct page *mmc_ram_lookup_page(struct mmc_ram_host *host,
+					pgoff_t idx, bool alloc)
+{
+	struct page *page;
+
+	page = radix_tree_lookup(&host->pages, idx);
+	if (page || !alloc)
+		return page;
+
+	page = alloc_page(GFP_NOIO | __GFP_HIGHMEM | __GFP_ZERO);
+	if (!page)
+		return NULL;
+
+	if (radix_tree_insert(&host->pages, idx, page)) {
+		__free_page(page);
+		return NULL;
+	}
+	page->index = idx;
+
+	return page;
+}
+
+static int mmc_ram_store_rw(struct mmc_ram_host *host, u64 pos,
+			    void *buf, size_t len, bool write)
+{
+	while (len) {
+		unsigned int offset = pos & ~PAGE_MASK;
+		size_t copy = min_t(size_t, len, PAGE_SIZE - offset);
+		struct page *page;
+		void *mem;
+
+		page = mmc_ram_lookup_page(host, pos >> PAGE_SHIFT, write);
+		if (page) {
+			mem = kmap_atomic(page, KM_USER1);
+			if (write)
+				memcpy(mem + offset, buf, copy);
+			else
+				memcpy(buf, mem + offset, copy);
+			kunmap_atomic(mem, KM_USER1);
+		} else if (write) {
+			return -ENOMEM;
+		} else {
+			memset(buf, 0, copy);
+		}
+
+		pos += copy;
+		buf += copy;
+		len -= copy;
+	}
+
+	return 0;
+}
+
+/*
+ * Drop the contents of sectors [from, to].  Whole pages are freed,
+ * partial pages are zeroed.
+ */
+#define FREE_BATCH 16
+static void mmc_ram_discard(struct mmc_ram_host *host, u64 from, u64 to)
+{
+	u64 start = from << MMC_RAM_SECTOR_SHIFT;
+	u64 end = (to + 1) << MMC_RAM_SECTOR_SHIFT;
+	pgoff_t pos = start >> PAGE_SHIFT;
+	struct page *pages[FREE_BATCH];
+	int nr_pages, i;
+
+	do {
+		nr_pages = radix_tree_gang_lookup(&host->pages,
+				(void **)pages, pos, FREE_BATCH);
+
+		for (i = 0; i < nr_pages; i++) {
+			u64 pstart = (u64)pages[i]->index << PAGE_SHIFT;
+			u64 pend = pstart + PAGE_SIZE;
+
+			pos = pages[i]->index + 1;
+			if (pstart >= end) {
+				nr_pages = 0;
+				break;
+			}
+
+			if (pstart >= start && pend <= end) {
+				radix_tree_delete(&host->pages,
+						  pages[i]->index);
+				__free_page(pages[i]);
+			} else {
+				unsigned int off = max(start, pstart) - pstart;
+				unsigned int len = min(end, pend) - pstart - off;
+				void *mem = kmap_atomic(pages[i], KM_USER1);
+
+				memset(mem + off, 0, len);
+				kunmap_atomic(mem, KM_USER1);
+			}
+		}
+	} while (nr_pages == FREE_BATCH);
+}
+
+static void mmc_ram_free_pages(struct mmc_ram_host *host)
+{
+	mmc_ram_discard(host, 0, host->sectors - 1);
+}
+
+/*
+ * Walks the data scatterlist across several store accesses, as a packed
+ * write consumes it one entry at a time.
+ */
+struct mmc_ram_iter {
+	struct sg_mapping_iter	miter;
+	size_t			used;
+};
+
+static void *mmc_ram_iter_next(struct mmc_ram_iter *it, size_t *len)
+{
+	void *buf;
+
+	if (it->used == it->miter.length) {
+		if (!sg_miter_next(&it->miter))
+			return NULL;
+		it->used = 0;
+	}
+
+	*len = min(*len, it->miter.length - it->used);
+	buf = it->miter.addr + it->used;
+	it->used += *len;
+
+	return buf;
+}
+
+static int mmc_ram_iter_rw(struct mmc_ram_host *host, struct mmc_ram_iter *it,
+			   u64 pos, size_t len, bool write)
+{
+	while (len) {
+		size_t chunk = len;
+		void *buf = mmc_ram_iter_next(it, &chunk);
+		int err;
+
+		if (!buf)
+			return -EINVAL;
+
+		if (host)
+			err = mmc_ram_store_rw(host, pos, buf, chunk, write);
+		else
+			err = 0;
+		if (err)
+			return err;
+
+		pos += chunk;
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+static bool mmc_ram_in_range(struct mmc_ram_host *host, u32 sector,
+			     u32 blocks)
+{
+	return (u64)sector + blocks <= host->sectors;
+}
+
+static void mmc_ram_packed_fail(struct mmc_ram_host *host, int index)
+{
+	u8 *ext_csd = host->ext_csd;
+
+	ext_csd[EXT_CSD_PACKED_CMD_STATUS] = EXT_CSD_PACKED_GENERIC_ERROR;
+	if (index > 0) {
+		ext_csd[EXT_CSD_PACKED_CMD_STATUS] |=
+			EXT_CSD_PACKED_INDEXED_ERROR;
+		ext_csd[EXT_CSD_PACKED_FAILURE_INDEX] = index;
+	}
+	ext_csd[EXT_CSD_EXP_EVENTS_STATUS] |= EXT_CSD_PACKED_FAILURE;
+}
+
+/*
+ * A packed write carries a header block listing the CMD23/CMD25
+ * arguments of each entry, followed by the entries' data.
+ */
+static int mmc_ram_packed_write(struct mmc_ram_host *host,
+				struct mmc_data *data, struct mmc_ram_iter *it)
+{
+	u32 *hdr;
+	unsigned int nr, blocks = 0, i;
+	int err;
+
+	hdr = kmalloc(512, GFP_NOIO);
+	if (!hdr)
+		return -ENOMEM;
+
+	err = -EILSEQ;
+	for (i = 0; i < 512; ) {
+		size_t chunk = 512 - i;
+		void *buf = mmc_ram_iter_next(it, &chunk);
+
+		if (!buf)
+			goto fail;
+		memcpy((void *)hdr + i, buf, chunk);
+		i += chunk;
+	}
+
+	nr = (le32_to_cpu(hdr[0]) >> 16) & 0xff;
+	if ((le32_to_cpu(hdr[0]) & 0xff) != MMC_PACKED_CMD_VER ||
+	    ((le32_to_cpu(hdr[0]) >> 8) & 0xff) != MMC_PACKED_CMD_WR ||
+	    nr == 0 || nr > host->ext_csd[EXT_CSD_MAX_PACKED_WRITES])
+		goto fail;
+
+	for (i = 1; i <= nr; i++)
+		blocks += le32_to_cpu(hdr[i * 2]) & 0xffff;
+	if (blocks + 1 != data->blocks)
+		goto fail;
+
+	data->bytes_xfered = 512;
+	for (i = 1; i <= nr; i++) {
+		u32 count = le32_to_cpu(hdr[i * 2]) & 0xffff;
+		u32 addr = le32_to_cpu(hdr[i * 2 + 1]);
+
+		if (!mmc_ram_in_range(host, addr, count)) {
+			mmc_ram_packed_fail(host, i);
+			err = -EIO;
+			goto out;
+		}
+
+		err = mmc_ram_iter_rw(host, it, (u64)addr << MMC_RAM_SECTOR_SHIFT,
+				      count << MMC_RAM_SECTOR_SHIFT, true);
+		if (err) {
+			mmc_ram_packed_fail(host, i);
+			goto out;
+		}
+		data->bytes_xfered += count << MMC_RAM_SECTOR_SHIFT;
+	}
+
+	err = 0;
+	goto out;
+
+fail:
+	mmc_ram_packed_fail(host, 0);
+out:
+	kfree(hdr);
+	return err;
+}
+
+static void mmc_ram_do_data(struct mmc_ram_host *host, struct mmc_command *cmd,
+			    struct mmc_data *data)
+{
+	bool write = data->flags & MMC_DATA_WRITE;
+	size_t len = data->blksz * data->blocks;
+	struct mmc_ram_iter it;
+	int err;
+
+	data->bytes_xfered = 0;
+	sg_miter_start(&it.miter, data->sg, data->sg_len,
+		       write ? SG_MITER_FROM_SG : SG_MITER_TO_SG);
+	it.used = 0;
+
+	switch (cmd->opcode) {
+	case MMC_SEND_EXT_CSD:
+		err = 0;
+		if (len > sizeof(host->ext_csd))
+			len = sizeof(host->ext_csd);
+		while (!err && data->bytes_xfered < len) {
+			size_t chunk = len - data->bytes_xfered;
+			void *buf = mmc_ram_iter_next(&it, &chunk);
+
+			if (!buf) {
+				err = -EINVAL;
+				break;
+			}
+			memcpy(buf, host->ext_csd + data->bytes_xfered, chunk);
+			data->bytes_xfered += chunk;
+		}
+		break;
+
+	case MMC_WRITE_MULTIPLE_BLOCK:
+		if (host->packed) {
+			err = mmc_ram_packed_write(host, data, &it);
+			break;
+		}
+		/* fall through */
+	case MMC_WRITE_BLOCK:
+	case MMC_READ_SINGLE_BLOCK:
+	case MMC_READ_MULTIPLE_BLOCK:
+		if (!mmc_ram_in_range(host, cmd->arg, data->blocks)) {
+			cmd->resp[0] |= R1_OUT_OF_RANGE;
+			err = 0;
+			break;
+		}
+		err = mmc_ram_iter_rw(host, &it,
+				      (u64)cmd->arg << MMC_RAM_SECTOR_SHIFT,
+				      len, write);
+		if (!err)
+			data->bytes_xfered = len;
+		break;
+
+	default:
+		/* Bus tests and the like, just sink or zero the data */
+		err = mmc_ram_iter_rw(NULL, &it, 0, len, write);
+		if (!err)
+			data->bytes_xfered = len;
+		break;
+	}
+
+	sg_miter_stop(&it.miter);
+
+	if (err) {
+		data->error = -EIO;
+		host->status |= R1_ERROR;
+	}
+}
+
+static u32 mmc_ram_r1(struct mmc_ram_host *host)
+{
+	u32 status = host->status | (host->state << 9) | R1_READY_FOR_DATA;
+
+	/* Event enable and status bits share positions */
+	if (host->ext_csd[EXT_CSD_EXP_EVENTS_STATUS] &
+	    host->ext_csd[EXT_CSD_EXP_EVENTS_CTRL])
+		status |= R1_EXCEPTION_EVENT;
+
+	/* Error bits are cleared by being reported */
+	host->status = 0;
+
+	return status;
+}
+
+static void mmc_ram_do_switch(struct mmc_ram_host *host,
+			      struct mmc_command *cmd)
+{
+	unsigned int mode = (cmd->arg >> 24) & 0x3;
+	unsigned int index = (cmd->arg >> 16) & 0xff;
+	u8 value = (cmd->arg >> 8) & 0xff;
+
+	if (index == EXT_CSD_SANITIZE_START) {
+		/* Erased contents are freed already, nothing left to scrub */
+		return;
+	}
+
+	/* Only the modes segment of EXT_CSD is writable */
+	if (index >= EXT_CSD_REV || mode == MMC_SWITCH_MODE_CMD_SET) {
+		host->status |= R1_SWITCH_ERROR;
+		return;
+	}
+
+	switch (mode) {
+	case MMC_SWITCH_MODE_SET_BITS:
+		host->ext_csd[index] |= value;
+		break;
+	case MMC_SWITCH_MODE_CLEAR_BITS:
+		host->ext_csd[index] &= ~value;
+		break;
+	case MMC_SWITCH_MODE_WRITE_BYTE:
+		host->ext_csd[index] = value;
+		break;
+	}
+}
+
+/*
+ * Execute one command against the emulated card.  Returns the number
+ * of microseconds the card would have been busy with it.
+ */
+static unsigned int mmc_ram_do_cmd(struct mmc_ram_host *host,
+				   struct mmc_command *cmd,
+				   struct mmc_data *data)
+{
+	unsigned int busy_us = cmd_latency_us;
+
+	memset(cmd->resp, 0, sizeof(cmd->resp));
+	cmd->error = 0;
+
+	switch (cmd->opcode) {
+	case MMC_GO_IDLE_STATE:
+		mmc_ram_reset_card(host);
+		break;
+
+	case MMC_SEND_OP_COND:
+		if (host->state != R1_STATE_IDLE &&
+		    host->state != R1_STATE_READY)
+			goto no_response;
+		/* Powered up, sector addressed, all voltages */
+		cmd->resp[0] = MMC_CARD_BUSY | (1 << 30) | 0x00ff8080;
+		host->state = R1_STATE_READY;
+		break;
+
+	case MMC_ALL_SEND_CID:
+		if (host->state != R1_STATE_READY)
+			goto no_response;
+		memcpy(cmd->resp, host->cid, sizeof(host->cid));
+		host->state = R1_STATE_IDENT;
+		break;
+
+	case MMC_SET_RELATIVE_ADDR:
+		cmd->resp[0] = mmc_ram_r1(host);
+		host->rca = cmd->arg >> 16;
+		host->state = R1_STATE_STBY;
+		break;
+
+	case MMC_SEND_CSD:
+	case MMC_SEND_CID:
+		if (host->state != R1_STATE_STBY ||
+		    (cmd->arg >> 16) != host->rca)
+			goto no_response;
+		if (cmd->opcode == MMC_SEND_CSD)
+			memcpy(cmd->resp, host->csd, sizeof(host->csd));
+		else
+			memcpy(cmd->resp, host->cid, sizeof(host->cid));
+		break;
+
+	case MMC_SELECT_CARD:
+		if ((cmd->arg >> 16) == host->rca) {
+			cmd->resp[0] = mmc_ram_r1(host);
+			host->state = R1_STATE_TRAN;
+		} else {
+			host->state = R1_STATE_STBY;
+			goto no_response;
+		}
+		break;
+
+	case MMC_SEND_STATUS:
+		if ((cmd->arg >> 16) != host->rca)
+			goto no_response;
+		cmd->resp[0] = mmc_ram_r1(host);
+		break;
+
+	case MMC_SWITCH:
+		cmd->resp[0] = mmc_ram_r1(host);
+		mmc_ram_do_switch(host, cmd);
+		if (((cmd->arg >> 16) & 0xff) == EXT_CSD_SANITIZE_START)
+			busy_us += erase_latency_us;
+		break;
+
+	case MMC_STOP_TRANSMISSION:
+		cmd->resp[0] = mmc_ram_r1(host);
+		host->state = R1_STATE_TRAN;
+		break;
+
+	case MMC_SET_BLOCKLEN:
+		cmd->resp[0] = mmc_ram_r1(host);
+		if (cmd->arg != 512)
+			host->status |= R1_BLOCK_LEN_ERROR;
+		break;
+
+	case MMC_SET_BLOCK_COUNT:
+		cmd->resp[0] = mmc_ram_r1(host);
+		host->blocks = cmd->arg & 0xffff;
+		host->packed = cmd->arg & MMC_CMD23_ARG_PACKED;
+		if (host->packed) {
+			/* A new packed command clears the previous failure */
+			host->ext_csd[EXT_CSD_EXP_EVENTS_STATUS] &=
+				~EXT_CSD_PACKED_FAILURE;
+			host->ext_csd[EXT_CSD_PACKED_CMD_STATUS] = 0;
+			host->ext_csd[EXT_CSD_PACKED_FAILURE_INDEX] = 0;
+		}
+		break;
+
+	case MMC_SEND_EXT_CSD:
+		/* CMD8 without data is SD_SEND_IF_COND */
+		if (!data || host->state != R1_STATE_TRAN)
+			goto no_response;
+		/* fall through */
+	case MMC_READ_SINGLE_BLOCK:
+	case MMC_READ_MULTIPLE_BLOCK:
+	case MMC_WRITE_BLOCK:
+	case MMC_WRITE_MULTIPLE_BLOCK:
+	case MMC_BUS_TEST_W:
+	case MMC_BUS_TEST_R:
+		if (host->state != R1_STATE_TRAN || !data)
+			goto no_response;
+		cmd->resp[0] = mmc_ram_r1(host);
+		mmc_ram_do_data(host, cmd, data);
+		if (data->flags & MMC_DATA_WRITE) {
+			if (write_kbps)
+				busy_us += div_u64((u64)data->bytes_xfered *
+						   1000000, write_kbps * 1024);
+		} else if (read_kbps) {
+			busy_us += div_u64((u64)data->bytes_xfered * 1000000,
+					   read_kbps * 1024);
+		}
+		host->blocks = 0;
+		host->packed = false;
+		break;
+
+	case MMC_ERASE_GROUP_START:
+		cmd->resp[0] = mmc_ram_r1(host);
+		host->erase_start = cmd->arg;
+		break;
+
+	case MMC_ERASE_GROUP_END:
+		cmd->resp[0] = mmc_ram_r1(host);
+		host->erase_end = cmd->arg;
+		break;
+
+	case MMC_ERASE:
+		cmd->resp[0] = mmc_ram_r1(host);
+		if (host->erase_end < host->erase_start ||
+		    !mmc_ram_in_range(host, host->erase_start,
+				      host->erase_end - host->erase_start + 1)) {
+			host->status |= R1_ERASE_PARAM;
+			break;
+		}
+		/* The first pass of a secure trim only marks blocks */
+		if (cmd->arg != MMC_SECURE_TRIM1_ARG)
+			mmc_ram_discard(host, host->erase_start,
+					host->erase_end);
+		busy_us += erase_latency_us;
+		break;
+
+	default:
+		/* SD and SDIO probe commands land here too */
+		goto no_response;
+	}
+
+	return busy_us;
+
+no_response:
+	cmd->error = -ETIMEDOUT;
+	return 0;
+}
+
+static void mmc_ram_req_work(struct work_struct *work)
+{
+	struct mmc_ram_host *host = container_of(work, struct mmc_ram_host,
+						 req_work);
+	struct mmc_request *mrq = host->mrq;
+	unsigned int busy_us = 0;
+	ktime_t start = ktime_get();
+	s64 elapsed_us;
+
+	if (mrq->sbc) {
+		busy_us += mmc_ram_do_cmd(host, mrq->sbc, NULL);
+		if (mrq->sbc->error)
+			goto done;
+	}
+
+	busy_us += mmc_ram_do_cmd(host, mrq->cmd, mrq->data);
+
+	if (mrq->data && mrq->cmd->error) {
+		mrq->data->error = mrq->cmd->error;
+		mrq->data->bytes_xfered = 0;
+	}
+
+	/* With CMD23 the transfer ends by itself unless it failed */
+	if (mrq->stop && mrq->data &&
+	    (!mrq->sbc || mrq->cmd->error || mrq->data->error))
+		busy_us += mmc_ram_do_cmd(host, mrq->stop, NULL);
+
+done:
+	/*
+	 * The copy itself counts towards the modelled busy time, only
+	 * sleep for what is left of it.
+	 */
+	elapsed_us = ktime_us_delta(ktime_get(), start);
+	if (busy_us > elapsed_us) {
+		unsigned long left = busy_us - elapsed_us;
+
+		if (left < 20000)
+			usleep_range(left, left + left / 16 + 1);
+		else
+			msleep(DIV_ROUND_UP(left, 1000));
+	}
+
+	host->mrq = NULL;
+	mmc_request_done(host->mmc, mrq);
+}
+
+static void mmc_ram_request(struct mmc_host *mmc, struct mmc_request *mrq)
+{
+	struct mmc_ram_host *host = mmc_priv(mmc);
+
+	WARN_ON(host->mrq);
+	host->mrq = mrq;
+	queue_work(host->wq, &host->req_work);
+}
+
+static void mmc_ram_set_ios(struct mmc_host *mmc, struct mmc_ios *ios)
+{
+	struct mmc_ram_host *host = mmc_priv(mmc);
+
+	if (ios->power_mode == MMC_POWER_OFF) {
+		flush_workqueue(host->wq);
+		mmc_ram_reset_card(host);
+	}
+}
+
+static int mmc_ram_get_ro(struct mmc_host *mmc)
+{
+	return 0;
+}
+
+static int mmc_ram_get_cd(struct mmc_host *mmc)
+{
+	return 1;
+}
+
+static const struct mmc_host_ops mmc_ram_ops = {
+	.request	= mmc_ram_request,
+	.set_ios	= mmc_ram_set_ios,
+	.get_ro		= mmc_ram_get_ro,
+	.get_cd		= mmc_ram_get_cd,
+};
+
+static int __devinit mmc_ram_probe(struct platform_device *pdev)
+{
+	struct mmc_host *mmc;
+	struct mmc_ram_host *host;
+	int ret;
+
+	if (!size_mb || ((u64)size_mb << 11) > 0xffffffffULL) {
+		dev_err(&pdev->dev, "invalid size_mb %u\n", size_mb);
+		return -EINVAL;
+	}
+
+	mmc = mmc_alloc_host(sizeof(struct mmc_ram_host), &pdev->dev);
+	if (!mmc)
+		return -ENOMEM;
+
+	host = mmc_priv(mmc);
+	host->mmc = mmc;
+	INIT_RADIX_TREE(&host->pages, GFP_NOIO);
+	INIT_WORK(&host->req_work, mmc_ram_req_work);
+	mmc_ram_init_regs(host);
+	mmc_ram_reset_card(host);
+
+	host->wq = alloc_ordered_workqueue(DRIVER_NAME, WQ_MEM_RECLAIM);
+	if (!host->wq) {
+		ret = -ENOMEM;
+		goto err_free_host;
+	}
+
+	mmc->ops = &mmc_ram_ops;
+	mmc->f_min = 400000;
+	mmc->f_max = 52000000;
+	mmc->ocr_avail = MMC_VDD_32_33 | MMC_VDD_33_34;
+	mmc->caps = MMC_CAP_4_BIT_DATA | MMC_CAP_8_BIT_DATA |
+		    MMC_CAP_MMC_HIGHSPEED | MMC_CAP_NONREMOVABLE |
+		    MMC_CAP_WAIT_WHILE_BUSY | MMC_CAP_ERASE | MMC_CAP_CMD23;
+	if (max_packed)
+		mmc->caps2 = MMC_CAP2_PACKED_WR;
+
+	mmc->max_segs = 128;
+	mmc->max_seg_size = 64 * 1024;
+	mmc->max_blk_size = 512;
+	mmc->max_blk_count = 1024;
+	mmc->max_req_size = mmc->max_blk_count * mmc->max_blk_size;
+
+	platform_set_drvdata(pdev, host);
+
+	ret = mmc_add_host(mmc);
+	if (ret)
+		goto err_destroy_wq;
+
+	dev_info(&pdev->dev, "%u MiB RAM card, %u us/cmd, rd %u wr %u KiB/s\n",
+		 size_mb, cmd_latency_us, read_kbps, write_kbps);
+
+	return 0;
+
+err_destroy_wq:
+	platform_set_drvdata(pdev, NULL);
+	destroy_workqueue(host->wq);
+err_free_host:
+	mmc_free_host(mmc);
+	return ret;
+}
+
+static int __devexit mmc_ram_remove(struct platform_device *pdev)
+{
+	struct mmc_ram_host *host = platform_get_drvdata(pdev);
+
+	platform_set_drvdata(pdev, NULL);
+	mmc_remove_host(host->mmc);
+	destroy_workqueue(host->wq);
+	mmc_ram_free_pages(host);
+	mmc_free_host(host->mmc);
+
+	return 0;
+}
+
+#ifdef CONFIG_PM
+static int mmc_ram_suspend(struct platform_device *pdev, pm_message_t state)
+{
+	struct mmc_ram_host *host = platform_get_drvdata(pdev);
+
+	return mmc_suspend_host(host->mmc);
+}
+
+static int mmc_ram_resume(struct platform_device *pdev)
+{
+	struct mmc_ram_host *host = platform_get_drvdata(pdev);
+
+	return mmc_resume_host(host->mmc);
+}
+#else
+#define mmc_ram_suspend	NULL
+#define mmc_ram_resume	NULL
+#endif
+
+static struct platform_driver mmc_ram_driver = {
+	.probe		= mmc_ram_probe,
+	.remove		= __devexit_p(mmc_ram_remove),
+	.suspend	= mmc_ram_suspend,
+	.resume		= mmc_ram_resume,
+	.driver		= {
+		.name	= DRIVER_NAME,
+		.owner	= THIS_MODULE,
+	},
+};
+
+static struct platform_device *mmc_ram_device;
+
+static int __init mmc_ram_init(void)
+{
+	int ret;
+
+	ret = platform_driver_register(&mmc_ram_driver);
+	if (ret)
+		return ret;
+
+	mmc_ram_device = platform_device_register_simple(DRIVER_NAME, -1,
+							 NULL, 0);
+	if (IS_ERR(mmc_ram_device)) {
+		platform_driver_unregister(&mmc_ram_driver);
+		return PTR_ERR(mmc_ram_device);
+	}
+
+	return 0;
+}
+
+static void __exit mmc_ram_exit(void)
+{
+	platform_device_unregister(mmc_ram_device);
+	platform_driver_unregister(&mmc_ram_driver);
+}
+
+module_init(mmc_ram_init);
+module_exit(mmc_ram_exit);
+
+MODULE_DESCRIPTION("RAM backed virtual MMC host driver");
+MODULE_LICENSE("GPL");
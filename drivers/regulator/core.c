@@ -84,6 +84,7 @@ struct regulator {
 	char *supply_name;
 	struct device_attribute dev_attr;
 	struct regulator_dev *rdev;
+	bool pm_link;		/* dev suspends before rdev->dev */
 #ifdef CONFIG_DEBUG_FS
 	struct dentry *debugfs;
 #endif
@@ -1166,6 +1167,15 @@ static struct regulator *create_regulator(struct regulator_dev *rdev,
 				  dev->kobj.name, err);
 			goto link_name_err;
 		}
+
+		/*
+		 * The consumer is rarely a child of the regulator's device,
+		 * so tell the PM core to suspend it before and resume it
+		 * after the regulator, also when both are handled
+		 * asynchronously.  Failing that is not fatal: the devices
+		 * are then ordered as they were registered.
+		 */
+		regulator->pm_link = !device_pm_add_link(dev, &rdev->dev);
 	} else {
 		regulator->supply_name = kstrdup(supply_name, GFP_KERNEL);
 		if (regulator->supply_name == NULL)
@@ -1372,6 +1382,8 @@ void regulator_put(struct regulator *regulator)
 
 	/* remove any sysfs entries */
 	if (regulator->dev) {
+		if (regulator->pm_link)
+			device_pm_remove_link(regulator->dev, &rdev->dev);
 		sysfs_remove_link(&rdev->dev.kobj, regulator->supply_name);
 		device_remove_file(regulator->dev, &regulator->dev_attr);
 		kfree(regulator->dev_attr.attr.name);
@@ -426,6 +426,9 @@ void end_writeback(struct inode *inode)
 	spin_lock_irq(&inode->i_data.tree_lock);
 	BUG_ON(inode->i_data.nrpages);
 	spin_unlock_irq(&inode->i_data.tree_lock);
+	/* Without pages, reclaim cannot add shadow entries anymore */
+	if (inode->i_data.nrshadows)
+		truncate_shadow_entries(&inode->i_data, 0, ~0UL);
 	BUG_ON(!list_empty(&inode->i_data.private_list));
 	BUG_ON(!(inode->i_state & I_FREEING));
 	BUG_ON(inode->i_state & I_CLEAR);
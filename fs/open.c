@@ -241,6 +241,13 @@ int do_fallocate(struct file *file, int mode, loff_t offset, loff_t len)
 	if (IS_IMMUTABLE(inode))
 		return -EPERM;
 
+	/*
+	 * Swap files, and backing files of loop devices in direct I/O mode,
+	 * are accessed through a map of their blocks that must stay valid.
+	 */
+	if ((mode & FALLOC_FL_PUNCH_HOLE) && IS_SWAPFILE(inode))
+		return -ETXTBSY;
+
 	/*
 	 * Revalidate the write permissions, in case security policy has
 	 * changed since the files were opened.
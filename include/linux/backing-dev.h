@@ -41,6 +41,9 @@ enum bdi_stat_item {
 	BDI_RECLAIMABLE,
 	BDI_WRITEBACK,
 	BDI_WRITTEN,
+	BDI_RA_SUBMITTED,	/* pages submitted by readahead */
+	BDI_RA_HIT,		/* pages in windows the reader caught up with */
+	BDI_RA_WASTED,		/* readahead pages evicted before use */
 	NR_BDI_STAT_ITEMS
 };
 
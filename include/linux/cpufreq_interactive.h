@@ -0,0 +1,75 @@
+/*
+ * include/linux/cpufreq_interactive.h
+ *
+ * Frequency selection of the 'interactive' cpufreq governor.
+ *
+ * This header must stay free of kernel dependencies: it is also built
+ * into tools/power/cpufreq-replay, which feeds recorded load traces
+ * through the same logic to evaluate tunables offline.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ */
+
+#ifndef _LINUX_CPUFREQ_INTERACTIVE_H
+#define _LINUX_CPUFREQ_INTERACTIVE_H
+
+/* Why a target frequency was chosen, as reported by the trace event. */
+enum interactive_reason {
+	INTERACTIVE_MAXSPEED,	/* load >= go_maxspeed_load, jump to max */
+	INTERACTIVE_BOOST,	/* load >= go_maxspeed_load, boost_factor */
+	INTERACTIVE_SCALE_MAX,	/* load relative to max speed */
+	INTERACTIVE_SUSTAIN,	/* load relative to sustain_load */
+	INTERACTIVE_HOLD,	/* ramp down deferred by min_sample_time */
+};
+
+struct interactive_tunables {
+	unsigned long go_maxspeed_load;
+	unsigned long boost_factor;
+	unsigned long max_boost;
+	unsigned long sustain_load;
+};
+
+/*
+ * Choose greater of short-term load (since last idle timer started or
+ * timer function re-armed itself) or long-term load (since last
+ * frequency change), and turn it into a frequency between cur and max.
+ */
+static inline unsigned int interactive_target_freq(
+	const struct interactive_tunables *t, int cpu_load,
+	int load_since_change, unsigned int cur, unsigned int max,
+	int *reason)
+{
+	unsigned int target_freq;
+
+	if (load_since_change > cpu_load)
+		cpu_load = load_since_change;
+
+	if (cpu_load >= (int)t->go_maxspeed_load) {
+		if (!t->boost_factor) {
+			*reason = INTERACTIVE_MAXSPEED;
+			return max;
+		}
+
+		*reason = INTERACTIVE_BOOST;
+		target_freq = cur * t->boost_factor;
+
+		if (t->max_boost && target_freq > cur + t->max_boost)
+			target_freq = cur + t->max_boost;
+	} else {
+		if (!t->sustain_load) {
+			*reason = INTERACTIVE_SCALE_MAX;
+			return max * cpu_load / 100;
+		}
+
+		*reason = INTERACTIVE_SUSTAIN;
+		target_freq = cur * cpu_load / t->sustain_load;
+	}
+
+	if (target_freq > max)
+		target_freq = max;
+	return target_freq;
+}
+
+#endif /* _LINUX_CPUFREQ_INTERACTIVE_H */
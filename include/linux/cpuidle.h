@@ -40,6 +40,8 @@ struct cpuidle_state {
 
 	unsigned long long	usage;
 	unsigned long long	time; /* in US */
+	unsigned long long	too_deep;	/* left before target_residency */
+	unsigned long long	too_shallow;	/* a deeper state would have paid off */
 
 	int (*enter)	(struct cpuidle_device *dev,
 			 struct cpuidle_state *state);
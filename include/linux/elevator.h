@@ -80,6 +80,31 @@ struct elevator_type
 	struct module *elevator_owner;
 };
 
+/*
+ * Last request each of a few recently submitting tasks merged into,
+ * indexed by a hash of the task pointer.
+ */
+#define ELV_MERGE_HINT_SHIFT	3
+#define ELV_MERGE_HINT_ENTRIES	(1 << ELV_MERGE_HINT_SHIFT)
+
+struct elv_merge_hint
+{
+	struct task_struct *task;
+	struct request *rq;
+};
+
+/*
+ * Where elv_merge() found the request a bio was merged into
+ */
+struct elv_merge_stats
+{
+	unsigned long last_merge;	/* queue one-hit cache */
+	unsigned long task_hint;	/* per task one-hit cache */
+	unsigned long hash;		/* back merge hash */
+	unsigned long sched;		/* io scheduler lookup */
+	unsigned long miss;
+};
+
 /*
  * each queue has an elevator_queue associated with it
  */
@@ -91,6 +116,9 @@ struct elevator_queue
 	struct elevator_type *elevator_type;
 	struct mutex sysfs_lock;
 	struct hlist_head *hash;
+	unsigned int hash_shift;
+	struct elv_merge_hint merge_hint[ELV_MERGE_HINT_ENTRIES];
+	struct elv_merge_stats merge_stats;
 	unsigned int registered:1;
 };
 
@@ -130,6 +158,8 @@ extern void elv_unregister(struct elevator_type *);
  * io scheduler sysfs switching
  */
 extern ssize_t elv_iosched_show(struct request_queue *, char *);
+extern ssize_t elv_merge_stats_show(struct request_queue *, char *);
+extern int elv_resize_hash(struct request_queue *);
 extern ssize_t elv_iosched_store(struct request_queue *, const char *, size_t);
 
 extern int elevator_init(struct request_queue *, char *);
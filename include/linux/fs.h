@@ -642,6 +642,7 @@ struct address_space {
 	struct mutex		i_mmap_mutex;	/* protect tree, count, list */
 	/* Protected by tree_lock together with the radix tree */
 	unsigned long		nrpages;	/* number of total pages */
+	unsigned long		nrshadows;	/* number of shadow entries */
 	pgoff_t			writeback_index;/* writeback starts here */
 	const struct address_space_operations *a_ops;	/* methods */
 	unsigned long		flags;		/* error bits/gfp mask */
@@ -924,6 +925,18 @@ struct fown_struct {
 	int signum;		/* posix.1b rt signal to be delivered on IO */
 };
 
+/*
+ * Readahead window of a sequential stream interleaved with the one
+ * tracked in file_ra_state itself
+ */
+struct file_ra_stream {
+	pgoff_t start;
+	unsigned int size;
+	unsigned int async_size;
+};
+
+#define RA_STREAMS	3
+
 /*
  * Track a single file's readahead state
  */
@@ -936,6 +949,13 @@ struct file_ra_state {
 	unsigned int ra_pages;		/* Maximum readahead window */
 	unsigned int mmap_miss;		/* Cache miss stat for mmap accesses */
 	loff_t prev_pos;		/* Cache last read() position */
+
+	pgoff_t stride_prev;		/* Last miss of a strided read */
+	unsigned int stride;		/* Distance between strided misses */
+	unsigned short stride_count;	/* # of misses matching stride */
+	unsigned short ra_shift;	/* Window is capped at ra_pages >> # */
+	unsigned int ra_hits;		/* Windows used since last thrashing */
+	struct file_ra_stream streams[RA_STREAMS];	/* Other streams */
 };
 
 /*
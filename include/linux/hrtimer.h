@@ -173,6 +173,9 @@ enum  hrtimer_base_type {
  * @nr_retries:		Total number of hrtimer interrupt retries
  * @nr_hangs:		Total number of hrtimer interrupt hangs
  * @max_hang_time:	Maximum time spent in hrtimer_interrupt
+ * @nr_wakeups_saved:	Timer interrupts avoided by running timers early,
+ *			inside their slack window, on an interrupt raised
+ *			for another timer
  * @clock_base:		array of clock bases for this cpu
  */
 struct hrtimer_cpu_base {
@@ -187,6 +190,7 @@ struct hrtimer_cpu_base {
 	unsigned long			nr_hangs;
 	ktime_t				max_hang_time;
 #endif
+	unsigned long			nr_wakeups_saved;
 	struct hrtimer_clock_base	clock_base[HRTIMER_MAX_CLOCK_BASES];
 };
 
@@ -690,4 +690,22 @@ extern int early_irq_init(void);
 extern int arch_probe_nr_irqs(void);
 extern int arch_early_irq_init(void);
 
+#ifdef CONFIG_IRQ_TIMINGS
+/* Per-cpu interrupt inter-arrival tracking, see kernel/irq/timings.c */
+extern void irq_timings_enable(void);
+extern void irq_timings_disable(void);
+extern u64 irq_timings_next_event(u64 now);
+#else
+static inline void irq_timings_enable(void)
+{
+}
+static inline void irq_timings_disable(void)
+{
+}
+static inline u64 irq_timings_next_event(u64 now)
+{
+	return ULLONG_MAX;
+}
+#endif
+
 #endif
@@ -24,11 +24,20 @@ int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 		unsigned long end, int advice, unsigned long *vm_flags);
 int __ksm_enter(struct mm_struct *mm);
 void __ksm_exit(struct mm_struct *mm);
+int ksm_set_hot(struct mm_struct *mm, bool hot);
+
+static inline int ksm_get_hot(struct mm_struct *mm)
+{
+	return test_bit(MMF_VM_MERGEABLE_HOT, &mm->flags);
+}
 
 static inline int ksm_fork(struct mm_struct *mm, struct mm_struct *oldmm)
 {
-	if (test_bit(MMF_VM_MERGEABLE, &oldmm->flags))
+	if (test_bit(MMF_VM_MERGEABLE, &oldmm->flags)) {
+		if (test_bit(MMF_VM_MERGEABLE_HOT, &oldmm->flags))
+			set_bit(MMF_VM_MERGEABLE_HOT, &mm->flags);
 		return __ksm_enter(mm);
+	}
 	return 0;
 }
 
@@ -101,6 +110,16 @@ static inline void ksm_exit(struct mm_struct *mm)
 {
 }
 
+static inline int ksm_set_hot(struct mm_struct *mm, bool hot)
+{
+	return -EINVAL;
+}
+
+static inline int ksm_get_hot(struct mm_struct *mm)
+{
+	return -EINVAL;
+}
+
 static inline int PageKsm(struct page *page)
 {
 	return 0;
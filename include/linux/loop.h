@@ -27,6 +27,7 @@ enum {
 };
 
 struct loop_func_table;
+struct loop_dio_map;
 
 struct loop_device {
 	int		lo_number;
@@ -62,6 +63,11 @@ struct loop_device {
 	struct task_struct	*lo_thread;
 	wait_queue_head_t	lo_event;
 
+	/* LO_FLAGS_DIRECT_IO state, protected by lo_lock */
+	struct loop_dio_map	*lo_dio_map;
+	atomic_t		lo_dio_pending;
+	wait_queue_head_t	lo_dio_wait;
+
 	struct request_queue	*lo_queue;
 	struct gendisk		*lo_disk;
 };
@@ -75,6 +81,8 @@ enum {
 	LO_FLAGS_READ_ONLY	= 1,
 	LO_FLAGS_USE_AOPS	= 2,
 	LO_FLAGS_AUTOCLEAR	= 4,
+	/* 8 is LO_FLAGS_PARTSCAN in later kernels */
+	LO_FLAGS_DIRECT_IO	= 16,
 };
 
 #include <asm/posix_types.h>	/* for __kernel_old_dev_t */
@@ -983,6 +983,34 @@ static inline int fixup_user_fault(struct task_struct *tsk,
 }
 #endif
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+extern int handle_speculative_fault(struct mm_struct *mm,
+			unsigned long address, unsigned int flags);
+
+/*
+ * Called with mmap_sem held for write after a vma of @mm was resized or
+ * had its flags, protection or memory policy changed, so that faults in
+ * flight without mmap_sem notice. Insertion into and removal from the
+ * vma tree do this on their own.
+ */
+static inline void mm_vmas_changed(struct mm_struct *mm)
+{
+	write_lock(&mm->mm_rb_lock);
+	mm->vma_seq++;
+	write_unlock(&mm->mm_rb_lock);
+}
+#else
+static inline int handle_speculative_fault(struct mm_struct *mm,
+			unsigned long address, unsigned int flags)
+{
+	return VM_FAULT_RETRY;
+}
+
+static inline void mm_vmas_changed(struct mm_struct *mm)
+{
+}
+#endif
+
 extern int make_pages_present(unsigned long addr, unsigned long end);
 extern int access_process_vm(struct task_struct *tsk, unsigned long addr, void *buf, int len, int write);
 extern int access_remote_vm(struct mm_struct *mm, unsigned long addr,
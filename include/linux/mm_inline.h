@@ -21,6 +21,31 @@ static inline int page_is_file_cache(struct page *page)
 	return !PageSwapBacked(page);
 }
 
+/**
+ * lru_list_head - the list pages of an LRU list are linked on
+ * @zone: the zone
+ * @l: the LRU list
+ *
+ * With the multi-generational LRU, evictable pages are kept on the
+ * youngest generation if active and on the oldest one otherwise.
+ * Must be called with zone->lru_lock held.
+ */
+static inline struct list_head *lru_list_head(struct zone *zone,
+					      enum lru_list l)
+{
+#ifdef CONFIG_LRU_GEN
+	if (lru_gen_enabled() && !is_unevictable_lru(l)) {
+		struct lru_gen *lrugen = &zone->lrugen;
+		int file = is_file_lru(l);
+		unsigned long seq;
+
+		seq = is_active_lru(l) ? lrugen->max_seq : lrugen->min_seq[file];
+		return &lrugen->lists[lru_gen_from_seq(seq)][file];
+	}
+#endif
+	return &zone->lru[l].list;
+}
+
 static inline void
 __add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list l,
 		       struct list_head *head, int tail)
@@ -36,13 +61,13 @@ __add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list l,
 static inline void
 add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list l)
 {
-	__add_page_to_lru_list(zone, page, l, &zone->lru[l].list, 0);
+	__add_page_to_lru_list(zone, page, l, lru_list_head(zone, l), 0);
 }
 
 static inline void
 add_page_to_lru_list_tail(struct zone *zone, struct page *page, enum lru_list l)
 {
-	__add_page_to_lru_list(zone, page, l, &zone->lru[l].list, 1);
+	__add_page_to_lru_list(zone, page, l, lru_list_head(zone, l), 1);
 }
 
 static inline void
@@ -83,6 +83,9 @@ struct mmc_ext_csd {
 	u8			out_of_int_time;	/* out of int time */
 	bool			bk_ops;			/* BK ops support bit */
 	bool			bk_ops_en;		/* BK ops enable bit */
+	u8			max_packed_writes;	/* 500 */
+	u8			max_packed_reads;	/* 501 */
+	bool			packed_event_en;	/* packed failure events */
 };
 
 struct sd_scr {
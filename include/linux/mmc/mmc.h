@@ -100,6 +100,27 @@ static inline bool mmc_op_multi(u32 opcode)
  *	[02:00] Command Set
  */
 
+/*
+ * MMC_SET_BLOCK_COUNT argument format:
+ *
+ *	[31]	Reliable Write Request
+ *	[30]	Packed Command
+ *	[29:16]	Always 0 (tag request and context ID are not used)
+ *	[15:00]	Number of blocks
+ */
+#define MMC_CMD23_ARG_REL_WR	(1 << 31)
+#define MMC_CMD23_ARG_PACKED	(1 << 30)
+
+/*
+ * Packed command header, carried in the first data block of a packed
+ * transfer.  Word 0 holds the version, direction and number of entries,
+ * each entry i (starting at 1) then holds the CMD23 argument in word
+ * 2 * i and the CMD18/CMD25 argument in word 2 * i + 1.
+ */
+#define MMC_PACKED_CMD_VER	0x01
+#define MMC_PACKED_CMD_RD	0x01
+#define MMC_PACKED_CMD_WR	0x02
+
 /*
   MMC status in R1, for native mode (SPI bits are different)
   Type
@@ -139,6 +160,7 @@ static inline bool mmc_op_multi(u32 opcode)
 #define R1_READY_FOR_DATA	(1 << 8)	/* sx, a */
 #define R1_SWITCH_ERROR		(1 << 7)	/* sx, c */
 #define R1_URGENT_BKOPS	(1 << 6)	/* sr, a */
+#define R1_EXCEPTION_EVENT	(1 << 6)	/* sr, a, eMMC 4.5 */
 #define R1_APP_CMD		(1 << 5)	/* sr, c */
 
 #define R1_STATE_IDLE	0
@@ -271,11 +293,16 @@ struct _mmc_csd {
  * EXT_CSD fields
  */
 
+#define EXT_CSD_PACKED_FAILURE_INDEX	35	/* RO */
+#define EXT_CSD_PACKED_CMD_STATUS	36	/* RO */
+#define EXT_CSD_EXP_EVENTS_STATUS	54	/* RO, 2 bytes */
+#define EXT_CSD_EXP_EVENTS_CTRL		56	/* R/W, 2 bytes */
 #define EXT_CSD_PARTITION_ATTRIBUTE	156	/* R/W */
 #define EXT_CSD_PARTITION_SUPPORT	160	/* RO */
 #define EXT_CSD_HPI_MGMT		161	/* R/W */
 #define EXT_CSD_BKOPS_EN		163	/* R/W */
 #define EXT_CSD_BKOPS_START		164	/* R/W */
+#define EXT_CSD_SANITIZE_START		165	/* W */
 #define EXT_CSD_WR_REL_PARAM		166	/* RO */
 #define EXT_CSD_ERASE_GROUP_DEF		175	/* R/W */
 #define EXT_CSD_PART_CONFIG		179	/* R/W */
@@ -299,6 +326,8 @@ struct _mmc_csd {
 #define EXT_CSD_SEC_FEATURE_SUPPORT	231	/* RO */
 #define EXT_CSD_TRIM_MULT		232	/* RO */
 #define EXT_CSD_BKOPS_STATUS		246	/* RO */
+#define EXT_CSD_MAX_PACKED_WRITES	500	/* RO */
+#define EXT_CSD_MAX_PACKED_READS	501	/* RO */
 #define EXT_CSD_BKOPS_SUPPORT		502	/* RO */
 #define EXT_CSD_HPI_FEATURES		503	/* RO */
 
@@ -335,6 +364,20 @@ struct _mmc_csd {
 #define EXT_CSD_SEC_ER_EN	BIT(0)
 #define EXT_CSD_SEC_BD_BLK_EN	BIT(2)
 #define EXT_CSD_SEC_GB_CL_EN	BIT(4)
+#define EXT_CSD_SEC_SANITIZE	BIT(6)	/* v4.5 only */
+
+#define EXT_CSD_PACKED_EVENT_EN	BIT(3)
+
+/*
+ * EXCEPTION_EVENT_STATUS field
+ */
+#define EXT_CSD_PACKED_FAILURE	BIT(3)
+
+/*
+ * PACKED_COMMAND_STATUS field
+ */
+#define EXT_CSD_PACKED_GENERIC_ERROR	BIT(0)
+#define EXT_CSD_PACKED_INDEXED_ERROR	BIT(1)
 
 /*
  * MMC_SWITCH access modes
@@ -106,6 +106,8 @@ enum zone_stat_item {
 	NR_SHMEM,		/* shmem pages (included tmpfs/GEM pages) */
 	NR_DIRTIED,		/* page dirtyings since bootup */
 	NR_WRITTEN,		/* page writings since bootup */
+	WORKINGSET_REFAULT,	/* evicted file pages read back in */
+	WORKINGSET_ACTIVATE,	/* refaults that were activated */
 #ifdef CONFIG_NUMA
 	NUMA_HIT,		/* allocated in intended node */
 	NUMA_MISS,		/* allocated in non intended node */
@@ -281,6 +283,44 @@ struct zone_reclaim_stat {
 	unsigned long		recent_scanned[2];
 };
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * With the multi-generational LRU (lru_gen= on the command line), the
+ * evictable pages of a zone are kept on per generation lists instead of
+ * zone->lru[]. Active pages enter the youngest generation and inactive
+ * ones the oldest, reclaim evicts from the oldest generation, and a new
+ * generation is opened after the accessed bits of all user page tables
+ * were harvested. PG_active still decides the LRU statistics a page is
+ * accounted to. Generations are indexed by sequence number modulo
+ * MAX_NR_GENS; the [0] entries are anon and the [1] entries file.
+ */
+#define MIN_NR_GENS		2
+#define MAX_NR_GENS		4
+
+struct lru_gen {
+	unsigned long		max_seq;	/* youngest generation */
+	unsigned long		min_seq[2];	/* oldest generation */
+	struct list_head	lists[MAX_NR_GENS][2];
+};
+
+extern bool lru_gen_on;
+
+static inline int lru_gen_enabled(void)
+{
+	return lru_gen_on;
+}
+
+static inline int lru_gen_from_seq(unsigned long seq)
+{
+	return seq % MAX_NR_GENS;
+}
+#else
+static inline int lru_gen_enabled(void)
+{
+	return 0;
+}
+#endif
+
 struct zone {
 	/* Fields commonly accessed by the page allocator */
 
@@ -340,6 +380,13 @@ struct zone {
 	 */
 	unsigned int		compact_considered;
 	unsigned int		compact_defer_shift;
+
+	/*
+	 * Where background compaction by kcompactd left off in this zone,
+	 * both zero when the next run starts over.
+	 */
+	unsigned long		kcompactd_migrate_pfn;
+	unsigned long		kcompactd_free_pfn;
 #endif
 
 	ZONE_PADDING(_pad1_)
@@ -349,9 +396,15 @@ struct zone {
 	struct zone_lru {
 		struct list_head list;
 	} lru[NR_LRU_LISTS];
+#ifdef CONFIG_LRU_GEN
+	struct lru_gen		lrugen;
+#endif
 
 	struct zone_reclaim_stat reclaim_stat;
 
+	/* Evictions & activations on the inactive file list */
+	atomic_long_t		inactive_age;
+
 	unsigned long		pages_scanned;	   /* since last reclaim */
 	unsigned long		flags;		   /* zone flags, see below */
 
@@ -642,6 +695,10 @@ typedef struct pglist_data {
 	struct task_struct *kswapd;
 	int kswapd_max_order;
 	enum zone_type classzone_idx;
+#ifdef CONFIG_COMPACTION
+	wait_queue_head_t kcompactd_wait;
+	struct task_struct *kcompactd;
+#endif
 } pg_data_t;
 
 #define node_present_pages(nid)	(NODE_DATA(nid)->node_present_pages)
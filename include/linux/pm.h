@@ -421,6 +421,17 @@ enum rpm_request {
 
 struct wakeup_source;
 
+/* System sleep phases the PM core records per-device callback times for */
+enum dpm_phase {
+	DPM_PHASE_PREPARE,
+	DPM_PHASE_SUSPEND,
+	DPM_PHASE_SUSPEND_NOIRQ,
+	DPM_PHASE_RESUME_NOIRQ,
+	DPM_PHASE_RESUME,
+	DPM_PHASE_COMPLETE,
+	DPM_PHASE_NR,
+};
+
 struct dev_pm_info {
 	pm_message_t		power_state;
 	unsigned int		can_wakeup:1;
@@ -432,6 +443,9 @@ struct dev_pm_info {
 	struct list_head	entry;
 	struct completion	completion;
 	struct wakeup_source	*wakeup;
+	struct list_head	suppliers;	/* Owned by the PM core */
+	struct list_head	consumers;	/* Ditto */
+	unsigned int		phase_usecs[DPM_PHASE_NR];
 #else
 	unsigned int		should_wakeup:1;
 #endif
@@ -551,6 +565,9 @@ extern void __suspend_report_result(const char *function, void *fn, int ret);
 	} while (0)
 
 extern int device_pm_wait_for_dev(struct device *sub, struct device *dev);
+extern int device_pm_add_link(struct device *consumer, struct device *supplier);
+extern void device_pm_remove_link(struct device *consumer,
+				  struct device *supplier);
 
 extern int pm_generic_prepare(struct device *dev);
 extern int pm_generic_suspend_noirq(struct device *dev);
@@ -584,6 +601,15 @@ static inline int device_pm_wait_for_dev(struct device *a, struct device *b)
 	return 0;
 }
 
+static inline int device_pm_add_link(struct device *consumer,
+				     struct device *supplier)
+{
+	return 0;
+}
+
+static inline void device_pm_remove_link(struct device *consumer,
+					 struct device *supplier) {}
+
 #define pm_generic_prepare	NULL
 #define pm_generic_suspend	NULL
 #define pm_generic_resume	NULL
@@ -102,4 +102,11 @@
 
 #define PR_MCE_KILL_GET 34
 
+/*
+ * Get/set whether KSM scans this process before the others. Numbered
+ * far outside the range mainline allocates prctl options from.
+ */
+#define PR_SET_KSM_HOT	0x4b534d00
+#define PR_GET_KSM_HOT	0x4b534d01
+
 #endif /* _LINUX_PRCTL_H */
@@ -436,6 +436,7 @@ extern int get_dumpable(struct mm_struct *mm);
 					/* leave room for more dump flags */
 #define MMF_VM_MERGEABLE	16	/* KSM may merge identical pages */
 #define MMF_VM_HUGEPAGE		17	/* set when VM_HUGEPAGE is set on vma */
+#define MMF_VM_MERGEABLE_HOT	18	/* KSM should scan this mm first */
 
 #define MMF_INIT_MASK		(MMF_DUMPABLE_MASK | MMF_DUMP_FILTER_MASK)
 
@@ -1167,6 +1168,17 @@ struct sched_statistics {
 };
 #endif
 
+/*
+ * Per-entity load tracking: geometrically decayed runnable time, with
+ * the contribution of a 1024us period halving every 32 periods.
+ */
+struct sched_avg {
+	u64			last_runnable_update;
+	u32			runnable_avg_sum;
+	u32			runnable_avg_period;
+	unsigned long		load_avg_contrib;
+};
+
 struct sched_entity {
 	struct load_weight	load;		/* for load-balancing */
 	struct rb_node		run_node;
@@ -1191,6 +1203,10 @@ struct sched_entity {
 	/* rq "owned" by this entity/group: */
 	struct cfs_rq		*my_q;
 #endif
+
+#ifdef CONFIG_SMP
+	struct sched_avg	avg;
+#endif
 };
 
 struct sched_rt_entity {
@@ -1211,6 +1227,25 @@ struct sched_rt_entity {
 
 struct rcu_node;
 
+/* Track pages that require TLB flushes */
+struct tlbflush_unmap_batch {
+	/*
+	 * Each bit set is a CPU that potentially has a TLB entry for one of
+	 * the PFNs being flushed. See set_tlb_ubc_flush_pending().
+	 */
+	struct cpumask cpumask;
+
+	/* True if any bit in cpumask is set */
+	bool flush_required;
+
+	/*
+	 * If true then the PTE was dirty when unmapped. The entry must be
+	 * flushed before IO is initiated or a stale TLB entry potentially
+	 * allows an update without redirtying the page.
+	 */
+	bool writable;
+};
+
 enum perf_event_task_context {
 	perf_invalid_context = -1,
 	perf_hw_context = 0,
@@ -1471,6 +1506,10 @@ struct task_struct {
 /* VM state */
 	struct reclaim_state *reclaim_state;
 
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+	struct tlbflush_unmap_batch tlb_ubc;
+#endif
+
 	struct backing_dev_info *backing_dev_info;
 
 	struct io_context *io_context;
@@ -2229,6 +2268,9 @@ static inline void mmdrop(struct mm_struct * mm)
 
 /* mmput gets rid of the mappings and all user-space */
 extern void mmput(struct mm_struct *);
+/* Same as above but performs the slow path from an async context. Can
+ * be called from atomic context as well as from reclaim */
+extern void mmput_async(struct mm_struct *);
 /* Grab a reference to a task's mm, if it is not already going away */
 extern struct mm_struct *get_task_mm(struct task_struct *task);
 /* Remove the current tasks stale references to the old mm_struct */
@@ -2715,6 +2757,23 @@ static inline unsigned long rlimit_max(unsigned int limit)
 	return task_rlimit_max(current, limit);
 }
 
+#ifdef CONFIG_CPU_FREQ
+/*
+ * Scheduler-driven cpufreq input. @func is called with the runqueue
+ * lock held and interrupts disabled whenever the CFS utilization of the
+ * cpu is updated; @util is the decayed busy fraction scaled to @max.
+ */
+struct update_util_data {
+	void (*func)(struct update_util_data *data,
+		     u64 time, unsigned long util, unsigned long max);
+};
+
+DECLARE_PER_CPU(struct update_util_data *, cpufreq_update_util_data);
+
+extern void cpufreq_set_update_util_data(int cpu,
+					 struct update_util_data *data);
+#endif
+
 #endif /* __KERNEL__ */
 
 #endif
@@ -22,6 +22,11 @@ struct timer_list {
 	unsigned long data;
 
 	int slack;
+	/*
+	 * Wheel bucket while pending.  Fits into the padding after slack on
+	 * 64-bit, but grows the structure from 28 to 32 bytes on 32-bit.
+	 */
+	unsigned int bucket;
 
 #ifdef CONFIG_TIMER_STATS
 	int start_pid;
@@ -0,0 +1,58 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM cpufreq_interactive
+
+#if !defined(_TRACE_CPUFREQ_INTERACTIVE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_CPUFREQ_INTERACTIVE_H
+
+#include <linux/cpufreq_interactive.h>
+#include <linux/tracepoint.h>
+
+/*
+ * One event per governor evaluation: the loads it saw, the raw target
+ * they mapped to, the frequency it settled on and why.
+ * tools/power/cpufreq-replay consumes this format.
+ */
+TRACE_EVENT(cpufreq_interactive_target,
+
+	TP_PROTO(unsigned int cpu, int load, int load_since_change,
+		 unsigned int cur, unsigned int target, unsigned int chosen,
+		 int reason),
+
+	TP_ARGS(cpu, load, load_since_change, cur, target, chosen, reason),
+
+	TP_STRUCT__entry(
+		__field(	u32,		cpu		)
+		__field(	int,		load		)
+		__field(	int,		load_since_change )
+		__field(	u32,		cur		)
+		__field(	u32,		target		)
+		__field(	u32,		chosen		)
+		__field(	int,		reason		)
+	),
+
+	TP_fast_assign(
+		__entry->cpu = cpu;
+		__entry->load = load;
+		__entry->load_since_change = load_since_change;
+		__entry->cur = cur;
+		__entry->target = target;
+		__entry->chosen = chosen;
+		__entry->reason = reason;
+	),
+
+	TP_printk("cpu=%u load=%d load_since_change=%d cur=%u target=%u "
+		  "chosen=%u reason=%s",
+		  __entry->cpu, __entry->load, __entry->load_since_change,
+		  __entry->cur, __entry->target, __entry->chosen,
+		  __print_symbolic(__entry->reason,
+				   { INTERACTIVE_MAXSPEED,	"maxspeed" },
+				   { INTERACTIVE_BOOST,		"boost" },
+				   { INTERACTIVE_SCALE_MAX,	"scale_max" },
+				   { INTERACTIVE_SUSTAIN,	"sustain" },
+				   { INTERACTIVE_HOLD,		"hold" }))
+);
+
+#endif /* _TRACE_CPUFREQ_INTERACTIVE_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
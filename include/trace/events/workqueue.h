@@ -80,39 +80,64 @@ DEFINE_EVENT(workqueue_work, workqueue_activate_work,
 /**
  * workqueue_execute_start - called immediately before the workqueue callback
  * @work:	pointer to struct work_struct
+ * @latency:	time the work waited since it was queued, in ns
  *
- * Allows to track workqueue execution.
+ * Allows to track workqueue execution. @latency is only measured with
+ * CONFIG_WORKQUEUE_STATS and is 0 otherwise.
  */
 TRACE_EVENT(workqueue_execute_start,
 
-	TP_PROTO(struct work_struct *work),
+	TP_PROTO(struct work_struct *work, u64 latency),
 
-	TP_ARGS(work),
+	TP_ARGS(work, latency),
 
 	TP_STRUCT__entry(
 		__field( void *,	work	)
 		__field( void *,	function)
+		__field( u64,		latency	)
 	),
 
 	TP_fast_assign(
 		__entry->work		= work;
 		__entry->function	= work->func;
+		__entry->latency	= latency;
 	),
 
-	TP_printk("work struct %p: function %pf", __entry->work, __entry->function)
+	TP_printk("work struct %p: function %pf latency=%llu",
+		  __entry->work, __entry->function,
+		  (unsigned long long)__entry->latency)
 );
 
 /**
- * workqueue_execute_end - called immediately before the workqueue callback
+ * workqueue_execute_end - called immediately after the workqueue callback
  * @work:	pointer to struct work_struct
+ * @runtime:	wall clock time the callback took, in ns
+ * @cputime:	cpu time the worker spent in the callback, in ns
  *
- * Allows to track workqueue execution.
+ * Allows to track workqueue execution. @runtime and @cputime are only
+ * measured with CONFIG_WORKQUEUE_STATS and are 0 otherwise.
  */
-DEFINE_EVENT(workqueue_work, workqueue_execute_end,
+TRACE_EVENT(workqueue_execute_end,
 
-	TP_PROTO(struct work_struct *work),
+	TP_PROTO(struct work_struct *work, u64 runtime, u64 cputime),
 
-	TP_ARGS(work)
+	TP_ARGS(work, runtime, cputime),
+
+	TP_STRUCT__entry(
+		__field( void *,	work	)
+		__field( u64,		runtime	)
+		__field( u64,		cputime	)
+	),
+
+	TP_fast_assign(
+		__entry->work		= work;
+		__entry->runtime	= runtime;
+		__entry->cputime	= cputime;
+	),
+
+	TP_printk("work struct %p runtime=%llu cputime=%llu", __entry->work,
+		  (unsigned long long)__entry->runtime,
+		  (unsigned long long)__entry->cputime)
 );
 
 #endif /*  _TRACE_WORKQUEUE_H */
@@ -1243,6 +1243,7 @@ static void __run_hrtimer(struct hrtimer *timer, ktime_t *now)
 void hrtimer_interrupt(struct clock_event_device *dev)
 {
 	struct hrtimer_cpu_base *cpu_base = &__get_cpu_var(hrtimer_bases);
+	ktime_t saved[HRTIMER_MAX_CLOCK_BASES];
 	ktime_t expires_next, now, entry_time, delta;
 	int i, retries = 0;
 
@@ -1253,6 +1254,8 @@ void hrtimer_interrupt(struct clock_event_device *dev)
 	entry_time = now = ktime_get();
 retry:
 	expires_next.tv64 = KTIME_MAX;
+	for (i = 0; i < HRTIMER_MAX_CLOCK_BASES; i++)
+		saved[i].tv64 = KTIME_MAX;
 
 	raw_spin_lock(&cpu_base->lock);
 	/*
@@ -1291,6 +1294,11 @@ retry:
 			 * We don't add extra wakeups by delaying timers that
 			 * are right-of a not yet expired timer, because that
 			 * timer will have to trigger a wakeup anyway.
+			 *
+			 * The event device is thus only ever programmed for
+			 * the hard expiry of the leftmost timer, the latest
+			 * point that serves it, and every timer whose slack
+			 * window has opened by then rides along.
 			 */
 
 			if (basenow.tv64 < hrtimer_get_softexpires_tv64(timer)) {
@@ -1303,10 +1311,33 @@ retry:
 				break;
 			}
 
+			/*
+			 * Run before its hard expiry, the timer needs no
+			 * interrupt of its own. Timers of one base with the
+			 * same hard expiry would have shared one, and the
+			 * base is sorted by it, so count each expiry once.
+			 */
+			if (basenow.tv64 < hrtimer_get_expires_tv64(timer)) {
+				ktime_t expires;
+
+				expires = ktime_sub(hrtimer_get_expires(timer),
+						    base->offset);
+				if (expires.tv64 != saved[i].tv64) {
+					cpu_base->nr_wakeups_saved++;
+					saved[i] = expires;
+				}
+			}
+
 			__run_hrtimer(timer, &basenow);
 		}
 	}
 
+	/* The interrupt at expires_next is coming anyway */
+	for (i = 0; i < HRTIMER_MAX_CLOCK_BASES; i++)
+		if (saved[i].tv64 != KTIME_MAX &&
+		    saved[i].tv64 == expires_next.tv64)
+			cpu_base->nr_wakeups_saved--;
+
 	/*
 	 * Store the new expiry value so the migration code can verify
 	 * against it.
@@ -1457,8 +1488,16 @@ void hrtimer_run_queues(void)
 			struct hrtimer *timer;
 
 			timer = container_of(node, struct hrtimer, node);
+
+			/*
+			 * Run the timer on this tick once its slack window
+			 * has opened, rather than have a NO_HZ cpu woken
+			 * up again for its hard expiry. Whether that would
+			 * have been a wakeup depends on whether the cpu is
+			 * idle by then, so it isn't counted.
+			 */
 			if (base->softirq_time.tv64 <=
-					hrtimer_get_expires_tv64(timer))
+					hrtimer_get_softexpires_tv64(timer))
 				break;
 
 			__run_hrtimer(timer, &base->softirq_time);
@@ -119,6 +119,8 @@ handle_irq_event_percpu(struct irq_desc *desc, struct irqaction *action)
 	irqreturn_t retval = IRQ_NONE;
 	unsigned int random = 0, irq = desc->irq_data.irq;
 
+	irq_timings_record(irq, action);
+
 	do {
 		irqreturn_t res;
 
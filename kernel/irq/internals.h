@@ -6,6 +6,7 @@
  * of this file for your non core code.
  */
 #include <linux/irqdesc.h>
+#include <linux/jump_label.h>
 
 #ifdef CONFIG_SPARSE_IRQ
 # define IRQ_BITMAP_BITS	(NR_IRQS + 8196)
@@ -169,3 +170,21 @@ static inline bool irqd_has_set(struct irq_data *d, unsigned int mask)
 {
 	return d->state_use_accessors & mask;
 }
+
+#ifdef CONFIG_IRQ_TIMINGS
+extern struct jump_label_key irq_timings_key;
+extern void __irq_timings_record(unsigned int irq);
+
+static inline void irq_timings_record(unsigned int irq,
+				      struct irqaction *action)
+{
+	/* The tick is predicted by the timer code already. */
+	if (static_branch(&irq_timings_key) && !(action->flags & IRQF_TIMER))
+		__irq_timings_record(irq);
+}
+#else
+static inline void irq_timings_record(unsigned int irq,
+				      struct irqaction *action)
+{
+}
+#endif
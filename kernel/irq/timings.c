@@ -0,0 +1,143 @@
+/*
+ * linux/kernel/irq/timings.c
+ *
+ * Per-cpu interrupt inter-arrival statistics.
+ *
+ * Device interrupts such as network rx mitigation, touch screens or
+ * audio periods often arrive at a steady rate. Idle governors only know
+ * about the next timer, so they pick deep states that such an interrupt
+ * then cuts short. This code keeps, per cpu, a small direct-mapped table
+ * of recently seen interrupts with a running average and mean absolute
+ * deviation of their inter-arrival time, and predicts the earliest next
+ * arrival among the interrupts that look periodic.
+ *
+ * Recording is patched out with a jump label unless an idle governor
+ * asked for it.
+ */
+
+#include <linux/interrupt.h>
+#include <linux/irq.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+
+#include "internals.h"
+
+#define IRQT_SLOTS		16	/* power of two */
+#define IRQT_AVG_SHIFT		3	/* new samples weigh 1/8 */
+#define IRQT_MIN_SAMPLES	4	/* before a slot is trusted */
+#define IRQT_MAX_INTERVAL	NSEC_PER_SEC	/* longer gaps restart */
+
+struct irqt_slot {
+	unsigned int	irq;
+	unsigned int	samples;
+	u64		last;		/* local_clock() of the last arrival */
+	u64		avg;		/* average interval, ns */
+	u64		dev;		/* mean absolute deviation, ns */
+};
+
+struct irqt_cpu {
+	struct irqt_slot slot[IRQT_SLOTS];
+};
+
+static DEFINE_PER_CPU(struct irqt_cpu, irq_timings);
+
+struct jump_label_key irq_timings_key;
+
+/*
+ * Called from handle_irq_event_percpu() with interrupts disabled.
+ */
+void __irq_timings_record(unsigned int irq)
+{
+	struct irqt_slot *s;
+	u64 now = local_clock();
+	u64 interval, diff;
+
+	s = &__get_cpu_var(irq_timings).slot[irq & (IRQT_SLOTS - 1)];
+
+	/* A different interrupt took over the slot, start from scratch. */
+	if (s->irq != irq || !s->last) {
+		s->irq = irq;
+		s->samples = 0;
+		s->last = now;
+		return;
+	}
+
+	interval = now - s->last;
+	s->last = now;
+
+	if (interval > IRQT_MAX_INTERVAL) {
+		s->samples = 0;
+		return;
+	}
+
+	if (!s->samples) {
+		s->avg = interval;
+		s->dev = 0;
+	} else {
+		diff = interval > s->avg ? interval - s->avg : s->avg - interval;
+		s->avg += (interval >> IRQT_AVG_SHIFT) -
+			  (s->avg >> IRQT_AVG_SHIFT);
+		s->dev += (diff >> IRQT_AVG_SHIFT) -
+			  (s->dev >> IRQT_AVG_SHIFT);
+	}
+
+	if (s->samples < UINT_MAX)
+		s->samples++;
+}
+
+/**
+ * irq_timings_next_event - predict the next device interrupt on this cpu
+ * @now: the current local_clock() value
+ *
+ * Returns the local_clock() time at which the earliest periodic
+ * interrupt is expected, @now if one is already due, or ULLONG_MAX if
+ * nothing looks predictable. Must be called with interrupts disabled.
+ */
+u64 irq_timings_next_event(u64 now)
+{
+	struct irqt_cpu *t = &__get_cpu_var(irq_timings);
+	u64 next = ULLONG_MAX, expected;
+	int i;
+
+	for (i = 0; i < IRQT_SLOTS; i++) {
+		struct irqt_slot *s = &t->slot[i];
+
+		if (s->samples < IRQT_MIN_SAMPLES)
+			continue;
+
+		/* Too irregular to be worth predicting. */
+		if (s->dev * 2 > s->avg)
+			continue;
+
+		expected = s->last + s->avg;
+		if (expected < now) {
+			/* Overdue by more than the jitter: the burst ended. */
+			if (now - expected > s->dev + (s->avg >> 1))
+				continue;
+			expected = now;
+		}
+
+		if (expected < next)
+			next = expected;
+	}
+
+	return next;
+}
+EXPORT_SYMBOL_GPL(irq_timings_next_event);
+
+/**
+ * irq_timings_enable - start recording interrupt arrivals
+ *
+ * Calls nest; may sleep.
+ */
+void irq_timings_enable(void)
+{
+	jump_label_inc(&irq_timings_key);
+}
+EXPORT_SYMBOL_GPL(irq_timings_enable);
+
+void irq_timings_disable(void)
+{
+	jump_label_dec(&irq_timings_key);
+}
+EXPORT_SYMBOL_GPL(irq_timings_disable);
@@ -13,10 +13,13 @@
  *
  */
 
+#include <linux/debugfs.h>
 #include <linux/earlysuspend.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/rtc.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
 #include <linux/syscalls.h> /* sys_sync */
 #include <linux/wakelock.h>
 #include <linux/workqueue.h>
@@ -35,12 +38,21 @@ EXPORT_SYMBOL(optimize_comp_on);
 #endif /* CONFIG_ZRAM_FOR_ANDROID */
 module_param_named(debug_mask, debug_mask, int, S_IRUGO | S_IWUSR | S_IWGRP);
 
+static bool concurrent = true;
+module_param(concurrent, bool, S_IRUGO | S_IWUSR | S_IWGRP);
+static bool defer_late_resume;
+module_param(defer_late_resume, bool, S_IRUGO | S_IWUSR | S_IWGRP);
+static unsigned int watchdog_ms = 2000;
+module_param(watchdog_ms, uint, S_IRUGO | S_IWUSR | S_IWGRP);
+
 static DEFINE_MUTEX(early_suspend_lock);
 static LIST_HEAD(early_suspend_handlers);
 static void early_suspend(struct work_struct *work);
 static void late_resume(struct work_struct *work);
+static void late_resume_deferred(struct work_struct *work);
 static DECLARE_WORK(early_suspend_work, early_suspend);
 static DECLARE_WORK(late_resume_work, late_resume);
+static DECLARE_WORK(late_resume_deferred_work, late_resume_deferred);
 static DEFINE_SPINLOCK(state_lock);
 enum {
 	SUSPEND_REQUESTED = 0x1,
@@ -49,10 +61,153 @@ enum {
 };
 static int state;
 
+/*
+ * Handlers of one level are queued on early_suspend_wq so that a slow one
+ * doesn't hold up the others; the next level starts once the queue has
+ * been flushed. handlers_resuming tells the work items which callback to
+ * run and, like the per-handler state, is protected by early_suspend_lock.
+ */
+static struct workqueue_struct *early_suspend_wq;
+static bool handlers_resuming;
+
+static ktime_t late_resume_start;
+static unsigned int early_suspend_us, late_resume_us, late_resume_display_us;
+
+struct handler_watchdog {
+	void (*fn)(struct early_suspend *h);
+	struct task_struct *tsk;
+};
+
+static void handler_watchdog_timeout(unsigned long data)
+{
+	struct handler_watchdog *wd = (void *)data;
+
+	pr_warn("early_suspend: %pf still running after %u ms\n", wd->fn,
+		watchdog_ms);
+	show_stack(wd->tsk, NULL);
+}
+
+static void call_handler(struct early_suspend *h, bool resume)
+{
+	struct handler_watchdog wd;
+	struct timer_list timer;
+	unsigned int usecs;
+	ktime_t start;
+
+	wd.fn = resume ? h->resume : h->suspend;
+	wd.tsk = current;
+
+	if (debug_mask & DEBUG_VERBOSE)
+		pr_info("%s: calling %pf\n",
+			resume ? "late_resume" : "early_suspend", wd.fn);
+
+	setup_timer_on_stack(&timer, handler_watchdog_timeout,
+			     (unsigned long)&wd);
+	if (watchdog_ms)
+		mod_timer(&timer, jiffies + msecs_to_jiffies(watchdog_ms));
+
+	start = ktime_get();
+	wd.fn(h);
+	usecs = ktime_us_delta(ktime_get(), start);
+
+	del_timer_sync(&timer);
+	destroy_timer_on_stack(&timer);
+
+	if (resume) {
+		h->resume_us = usecs;
+		h->resume_max_us = max(h->resume_max_us, usecs);
+	} else {
+		h->suspend_us = usecs;
+		h->suspend_max_us = max(h->suspend_max_us, usecs);
+	}
+}
+
+static void handler_work(struct work_struct *work)
+{
+	call_handler(container_of(work, struct early_suspend, work),
+		     handlers_resuming);
+}
+
+static void start_handler(struct early_suspend *h, bool resume)
+{
+	if (!(resume ? h->resume : h->suspend))
+		return;
+
+	if (concurrent && early_suspend_wq)
+		queue_work(early_suspend_wq, &h->work);
+	else
+		call_handler(h, resume);
+}
+
+static void wait_for_level(void)
+{
+	if (early_suspend_wq)
+		flush_workqueue(early_suspend_wq);
+}
+
+static void suspend_handlers(void)
+{
+	struct early_suspend *pos;
+	int level = 0;
+
+	handlers_resuming = false;
+	list_for_each_entry(pos, &early_suspend_handlers, link) {
+		/* Still suspended if the last late resume was cut short. */
+		if (pos->suspended)
+			continue;
+		if (pos->level != level) {
+			wait_for_level();
+			level = pos->level;
+		}
+		pos->suspended = true;
+		start_handler(pos, false);
+	}
+	wait_for_level();
+}
+
+/*
+ * Resume the handlers that are still suspended, highest level first, down
+ * to @min_level; those below it are left for a later call.
+ */
+static void resume_handlers(int min_level)
+{
+	struct early_suspend *pos;
+	bool started = false;
+	int level = 0;
+
+	handlers_resuming = true;
+	list_for_each_entry_reverse(pos, &early_suspend_handlers, link) {
+		if (!pos->suspended)
+			continue;
+		if (pos->level < min_level)
+			break;
+		if (started && pos->level != level)
+			wait_for_level();
+		started = true;
+		level = pos->level;
+		pos->suspended = false;
+		start_handler(pos, true);
+	}
+	wait_for_level();
+}
+
+static bool handlers_suspended(void)
+{
+	struct early_suspend *pos;
+
+	list_for_each_entry(pos, &early_suspend_handlers, link)
+		if (pos->suspended)
+			return true;
+	return false;
+}
+
 void register_early_suspend(struct early_suspend *handler)
 {
 	struct list_head *pos;
 
+	INIT_WORK(&handler->work, handler_work);
+	handler->suspended = false;
+
 	mutex_lock(&early_suspend_lock);
 	list_for_each(pos, &early_suspend_handlers) {
 		struct early_suspend *e;
@@ -61,8 +216,11 @@ void register_early_suspend(struct early_suspend *handler)
 			break;
 	}
 	list_add_tail(&handler->link, pos);
-	if ((state & SUSPENDED) && handler->suspend)
-		handler->suspend(handler);
+	if (state & SUSPENDED) {
+		handler->suspended = true;
+		if (handler->suspend)
+			handler->suspend(handler);
+	}
 	mutex_unlock(&early_suspend_lock);
 }
 EXPORT_SYMBOL(register_early_suspend);
@@ -77,9 +235,9 @@ EXPORT_SYMBOL(unregister_early_suspend);
 
 static void early_suspend(struct work_struct *work)
 {
-	struct early_suspend *pos;
 	unsigned long irqflags;
 	int abort = 0;
+	ktime_t start;
 
 	mutex_lock(&early_suspend_lock);
 	spin_lock_irqsave(&state_lock, irqflags);
@@ -101,13 +259,9 @@ atomic_set(&optimize_comp_on, 1);
 
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("early_suspend: call handlers\n");
-	list_for_each_entry(pos, &early_suspend_handlers, link) {
-		if (pos->suspend != NULL) {
-			if (debug_mask & DEBUG_VERBOSE)
-				pr_info("early_suspend: calling %pf\n", pos->suspend);
-			pos->suspend(pos);
-		}
-	}
+	start = ktime_get();
+	suspend_handlers();
+	early_suspend_us = ktime_us_delta(ktime_get(), start);
 	mutex_unlock(&early_suspend_lock);
 
 	if (debug_mask & DEBUG_SUSPEND)
@@ -123,7 +277,6 @@ abort:
 
 static void late_resume(struct work_struct *work)
 {
-	struct early_suspend *pos;
 	unsigned long irqflags;
 	int abort = 0;
 
@@ -145,20 +298,58 @@ static void late_resume(struct work_struct *work)
 	}
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("late_resume: call handlers\n");
-	list_for_each_entry_reverse(pos, &early_suspend_handlers, link) {
-		if (pos->resume != NULL) {
-			if (debug_mask & DEBUG_VERBOSE)
-				pr_info("late_resume: calling %pf\n", pos->resume);
 
-			pos->resume(pos);
-		}
+	/*
+	 * With defer_late_resume, only the display levels are resumed here:
+	 * the panel and framebuffer, and STOP_DRAWING so that the UI draws
+	 * again. The lower levels follow in late_resume_deferred_work, which
+	 * runs right behind us on suspend_work_queue, so this doesn't bring
+	 * the screen on any sooner. What it buys is that when the screen is
+	 * turned off again before then, the early_suspend_work queued
+	 * meanwhile runs first and the lower levels are never resumed at
+	 * all. That is safe because of the per-handler suspended flags:
+	 * early_suspend() leaves the handlers that are still suspended
+	 * alone, and late_resume_deferred() does nothing once SUSPENDED is
+	 * set again, leaving them to the next late resume. Suspend can't
+	 * get in between, since main_wake_lock is held until the next early
+	 * suspend completes.
+	 */
+	late_resume_start = ktime_get();
+	resume_handlers(defer_late_resume ? EARLY_SUSPEND_LEVEL_STOP_DRAWING :
+			INT_MIN);
+	late_resume_display_us = ktime_us_delta(ktime_get(), late_resume_start);
+	if (defer_late_resume && handlers_suspended()) {
+		queue_work(suspend_work_queue, &late_resume_deferred_work);
+		goto abort;
 	}
+	late_resume_us = late_resume_display_us;
+
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("late_resume: done\n");
 abort:
 	mutex_unlock(&early_suspend_lock);
 }
 
+static void late_resume_deferred(struct work_struct *work)
+{
+	unsigned long irqflags;
+	int abort;
+
+	mutex_lock(&early_suspend_lock);
+	spin_lock_irqsave(&state_lock, irqflags);
+	abort = state & SUSPENDED;
+	spin_unlock_irqrestore(&state_lock, irqflags);
+
+	if (!abort) {
+		resume_handlers(INT_MIN);
+		late_resume_us = ktime_us_delta(ktime_get(),
+						late_resume_start);
+		if (debug_mask & DEBUG_SUSPEND)
+			pr_info("late_resume: done\n");
+	}
+	mutex_unlock(&early_suspend_lock);
+}
+
 void request_suspend_state(suspend_state_t new_state)
 {
 	unsigned long irqflags;
@@ -195,3 +386,54 @@ suspend_state_t get_suspend_state(void)
 {
 	return requested_suspend_state;
 }
+
+#ifdef CONFIG_DEBUG_FS
+static int early_suspend_debug_show(struct seq_file *s, void *data)
+{
+	struct early_suspend *pos;
+
+	if (mutex_lock_interruptible(&early_suspend_lock))
+		return -EINTR;
+
+	seq_printf(s, "early_suspend %u us, late_resume %u us "
+		   "(display levels %u us)\n\n", early_suspend_us,
+		   late_resume_us, late_resume_display_us);
+	seq_printf(s, "level suspend_us     max_us  resume_us     max_us"
+		   "  handler\n");
+	list_for_each_entry(pos, &early_suspend_handlers, link)
+		seq_printf(s, "%5d %10u %10u %10u %10u  %pf\n", pos->level,
+			   pos->suspend_us, pos->suspend_max_us,
+			   pos->resume_us, pos->resume_max_us,
+			   pos->suspend ? pos->suspend : pos->resume);
+
+	mutex_unlock(&early_suspend_lock);
+	return 0;
+}
+
+static int early_suspend_debug_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, early_suspend_debug_show, NULL);
+}
+
+static const struct file_operations early_suspend_debug_fops = {
+	.open		= early_suspend_debug_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+#endif
+
+static int __init early_suspend_init(void)
+{
+	early_suspend_wq = alloc_workqueue("early_suspend", WQ_UNBOUND, 0);
+	if (!early_suspend_wq)
+		pr_err("early_suspend: no workqueue, calling handlers "
+		       "sequentially\n");
+
+#ifdef CONFIG_DEBUG_FS
+	debugfs_create_file("early_suspend", S_IRUGO, NULL, NULL,
+			    &early_suspend_debug_fops);
+#endif
+	return 0;
+}
+core_initcall(early_suspend_init);
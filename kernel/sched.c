@@ -319,6 +319,13 @@ struct cfs_rq {
 #ifndef CONFIG_64BIT
 	u64 min_vruntime_copy;
 #endif
+#ifdef CONFIG_SMP
+	/*
+	 * Sum of se->avg.load_avg_contrib over the entities queued on
+	 * this cfs_rq (including curr).
+	 */
+	unsigned long runnable_load_avg;
+#endif
 
 	struct rb_root tasks_timeline;
 	struct rb_node *rb_leftmost;
@@ -479,6 +486,8 @@ struct rq {
 
 	/* capture load from *all* tasks on this cpu: */
 	struct load_weight load;
+	/* decayed fraction of time this cpu had runnable tasks */
+	struct sched_avg avg;
 	unsigned long nr_load_updates;
 	u64 nr_switches;
 
@@ -1526,6 +1535,9 @@ static int tg_nop(struct task_group *tg, void *data)
 /* Used instead of source_load when we know the type == 0 */
 static unsigned long weighted_cpuload(const int cpu)
 {
+	if (sched_feat(LB_LOAD_AVG))
+		return cpu_rq(cpu)->cfs.runnable_load_avg;
+
 	return cpu_rq(cpu)->load.weight;
 }
 
@@ -1575,7 +1587,7 @@ static unsigned long cpu_avg_load_per_task(int cpu)
 	unsigned long nr_running = ACCESS_ONCE(rq->nr_running);
 
 	if (nr_running)
-		rq->avg_load_per_task = rq->load.weight / nr_running;
+		rq->avg_load_per_task = weighted_cpuload(cpu) / nr_running;
 	else
 		rq->avg_load_per_task = 0;
 
@@ -2078,6 +2090,25 @@ static int irqtime_account_si_update(void)
 
 #endif
 
+#ifdef CONFIG_CPU_FREQ
+DEFINE_PER_CPU(struct update_util_data *, cpufreq_update_util_data);
+
+/**
+ * cpufreq_set_update_util_data - set the utilization callback of a cpu
+ * @cpu: the cpu to set the callback for
+ * @data: the callback, or NULL to clear it
+ *
+ * The callback is invoked from the scheduler under rcu_read_lock_sched()
+ * semantics, so after clearing it the caller has to synchronize_sched()
+ * before freeing @data.
+ */
+void cpufreq_set_update_util_data(int cpu, struct update_util_data *data)
+{
+	rcu_assign_pointer(per_cpu(cpufreq_update_util_data, cpu), data);
+}
+EXPORT_SYMBOL_GPL(cpufreq_set_update_util_data);
+#endif
+
 #include "sched_idletask.c"
 #include "sched_fair.c"
 #include "sched_rt.c"
@@ -2860,6 +2891,10 @@ static void __sched_fork(struct task_struct *p)
 	p->se.vruntime			= 0;
 	INIT_LIST_HEAD(&p->se.group_node);
 
+#ifdef CONFIG_SMP
+	memset(&p->se.avg, 0, sizeof(p->se.avg));
+#endif
+
 #ifdef CONFIG_SCHEDSTATS
 	memset(&p->se.statistics, 0, sizeof(p->se.statistics));
 #endif
@@ -3661,7 +3696,11 @@ decay_load_missed(unsigned long load, unsigned long missed_updates, int idx)
  */
 static void update_cpu_load(struct rq *this_rq)
 {
+#ifdef CONFIG_SMP
+	unsigned long this_load = weighted_cpuload(cpu_of(this_rq));
+#else
 	unsigned long this_load = this_rq->load.weight;
+#endif
 	unsigned long curr_jiffies = jiffies;
 	unsigned long pending_updates;
 	int i, scale;
@@ -661,10 +661,268 @@ add_cfs_task_weight(struct cfs_rq *cfs_rq, unsigned long weight)
 }
 #endif
 
+/*
+ * Per-entity load tracking.
+ *
+ * Each entity accumulates the time it spent runnable (queued or running)
+ * in 1024us periods; older periods are decayed geometrically by y, with
+ * y^32 = 1/2, so that runnable_avg_sum / runnable_avg_period is the
+ * recent runnable fraction. The load contribution of an entity is that
+ * fraction of its weight, and cfs_rq->runnable_load_avg sums the
+ * contributions of the entities currently queued.
+ */
+#define LOAD_AVG_PERIOD		32
+#define LOAD_AVG_MAX		47742	/* maximum possible load avg */
+#define LOAD_AVG_MAX_N		347	/* periods needed to reach LOAD_AVG_MAX */
+
+/* Precomputed fixed inverse multiplies for y^n, n < LOAD_AVG_PERIOD */
+static const u32 runnable_avg_yN_inv[] = {
+	0xffffffff, 0xfa83b2db, 0xf5257d15, 0xefe4b99b, 0xeac0c6e7, 0xe5b906e7,
+	0xe0ccdeec, 0xdbfbb797, 0xd744fcca, 0xd2a81d91, 0xce248c15, 0xc9b9bd86,
+	0xc5672a11, 0xc12c4cca, 0xbd08a39f, 0xb8fbaf47, 0xb504f333, 0xb123f581,
+	0xad583eea, 0xa9a15ab4, 0xa5fed6a9, 0xa2704303, 0x9ef53260, 0x9b8d39b9,
+	0x9837f051, 0x94f4efa8, 0x91c3d373, 0x8ea4398b, 0x8b95c1e3, 0x88980e80,
+	0x85aac367, 0x82cd8698,
+};
+
+/* runnable_avg_yN_sum[n] = 1024 * (y^1 + y^2 + ... + y^n) */
+static const u32 runnable_avg_yN_sum[] = {
+	    0,  1002,  1982,  2942,  3881,  4800,  5699,  6579,  7440,  8282,
+	 9107,  9914, 10704, 11476, 12232, 12972, 13696, 14405, 15098, 15777,
+	16441, 17091, 17726, 18349, 18957, 19553, 20136, 20707, 21265, 21812,
+	22346, 22870, 23382,
+};
+
+/*
+ * Approximate val * y^n, where y^32 = 1/2.
+ */
+static __always_inline u64 decay_load(u64 val, u64 n)
+{
+	unsigned int local_n;
+
+	if (!n)
+		return val;
+	else if (unlikely(n > LOAD_AVG_PERIOD * 63))
+		return 0;
+
+	local_n = n;
+	if (unlikely(local_n >= LOAD_AVG_PERIOD)) {
+		val >>= local_n / LOAD_AVG_PERIOD;
+		local_n %= LOAD_AVG_PERIOD;
+	}
+
+	val *= runnable_avg_yN_inv[local_n];
+	return val >> 32;
+}
+
+/*
+ * Contribution of n full periods of runnable time:
+ * 1024 * (y^1 + y^2 + ... + y^n).
+ */
+static u32 __compute_runnable_contrib(u64 n)
+{
+	u32 contrib = 0;
+
+	if (likely(n <= LOAD_AVG_PERIOD))
+		return runnable_avg_yN_sum[n];
+	else if (unlikely(n >= LOAD_AVG_MAX_N))
+		return LOAD_AVG_MAX;
+
+	/* Fold whole half-lives, the sum decays by 1/2 for each one. */
+	do {
+		contrib /= 2;
+		contrib += runnable_avg_yN_sum[LOAD_AVG_PERIOD];
+		n -= LOAD_AVG_PERIOD;
+	} while (n > LOAD_AVG_PERIOD);
+
+	contrib = decay_load(contrib, n);
+	return contrib + runnable_avg_yN_sum[n];
+}
+
+/*
+ * Account the time since the last update as runnable (or not) and decay
+ * the history for every period boundary crossed. Returns 1 if at least
+ * one period boundary was crossed.
+ */
+static __always_inline int
+__update_entity_runnable_avg(u64 now, struct sched_avg *sa, int runnable)
+{
+	u64 delta, periods;
+	u32 runnable_contrib;
+	int delta_w, decayed = 0;
+
+	delta = now - sa->last_runnable_update;
+	/*
+	 * The clock can appear to go backwards when an entity migrates
+	 * between cpus; restart the accounting window.
+	 */
+	if ((s64)delta < 0) {
+		sa->last_runnable_update = now;
+		return 0;
+	}
+
+	/* Use 1024ns as the unit of measurement, keep the remainder. */
+	delta >>= 10;
+	if (!delta)
+		return 0;
+	sa->last_runnable_update += delta << 10;
+
+	/* Time already accumulated in the current (partial) period. */
+	delta_w = sa->runnable_avg_period % 1024;
+	if (delta + delta_w >= 1024) {
+		decayed = 1;
+
+		/* Complete the current period first. */
+		delta_w = 1024 - delta_w;
+		if (runnable)
+			sa->runnable_avg_sum += delta_w;
+		sa->runnable_avg_period += delta_w;
+
+		delta -= delta_w;
+
+		periods = delta >> 10;
+		delta &= 1023;
+
+		sa->runnable_avg_sum = decay_load(sa->runnable_avg_sum,
+						  periods + 1);
+		sa->runnable_avg_period = decay_load(sa->runnable_avg_period,
+						     periods + 1);
+
+		/* Account the fully elapsed periods in between. */
+		runnable_contrib = __compute_runnable_contrib(periods);
+		if (runnable)
+			sa->runnable_avg_sum += runnable_contrib;
+		sa->runnable_avg_period += runnable_contrib;
+	}
+
+	/* Remainder of delta accrued against the new period. */
+	if (runnable)
+		sa->runnable_avg_sum += delta;
+	sa->runnable_avg_period += delta;
+
+	return decayed;
+}
+
+/*
+ * The runqueue itself tracks how much of the recent past it had any task
+ * to run; this is the cpu utilization handed to cpufreq governors.
+ */
+static void update_rq_runnable_avg(struct rq *rq, int runnable)
+{
+	__update_entity_runnable_avg(rq->clock_task, &rq->avg, runnable);
+}
+
+#ifdef CONFIG_CPU_FREQ
+static inline void cpufreq_update_util(struct rq *rq)
+{
+	struct update_util_data *data;
+	unsigned long util;
+
+	data = rcu_dereference_sched(per_cpu(cpufreq_update_util_data,
+					     cpu_of(rq)));
+	if (!data)
+		return;
+
+	util = div_u64((u64)rq->avg.runnable_avg_sum * SCHED_POWER_SCALE,
+		       rq->avg.runnable_avg_period + 1);
+	data->func(data, rq->clock, util, SCHED_POWER_SCALE);
+}
+#else
+static inline void cpufreq_update_util(struct rq *rq)
+{
+}
+#endif
+
+#ifdef CONFIG_SMP
+/*
+ * Recompute se->avg.load_avg_contrib and return the change.
+ */
+static long __update_entity_load_avg_contrib(struct sched_entity *se)
+{
+	long old_contrib = se->avg.load_avg_contrib;
+	u64 contrib;
+
+	contrib = (u64)se->avg.runnable_avg_sum * se->load.weight;
+	contrib = div_u64(contrib, se->avg.runnable_avg_period + 1);
+	se->avg.load_avg_contrib = contrib;
+
+	return (long)se->avg.load_avg_contrib - old_contrib;
+}
+
+/* Update a queued entity and fold the change into its cfs_rq. */
+static void update_entity_load_avg(struct sched_entity *se)
+{
+	struct cfs_rq *cfs_rq = cfs_rq_of(se);
+
+	if (!__update_entity_runnable_avg(rq_of(cfs_rq)->clock_task,
+					  &se->avg, 1))
+		return;
+
+	cfs_rq->runnable_load_avg += __update_entity_load_avg_contrib(se);
+}
+
+/*
+ * @runnable tells whether the entity was queued since its last update:
+ * false for a wakeup or a new task, true when re-adding it after a
+ * reweight.
+ */
+static void enqueue_entity_load_avg(struct cfs_rq *cfs_rq,
+				    struct sched_entity *se, int runnable)
+{
+	__update_entity_runnable_avg(rq_of(cfs_rq)->clock_task,
+				     &se->avg, runnable);
+	__update_entity_load_avg_contrib(se);
+	cfs_rq->runnable_load_avg += se->avg.load_avg_contrib;
+}
+
+static void dequeue_entity_load_avg(struct cfs_rq *cfs_rq,
+				    struct sched_entity *se)
+{
+	cfs_rq->runnable_load_avg -= se->avg.load_avg_contrib;
+	__update_entity_runnable_avg(rq_of(cfs_rq)->clock_task,
+				     &se->avg, 1);
+	__update_entity_load_avg_contrib(se);
+}
+
+/*
+ * New tasks start out as fully runnable so that fork balancing sees
+ * them; the history decays within a few tens of milliseconds if that
+ * turns out to be wrong.
+ */
+static void init_task_runnable_average(struct task_struct *p, struct rq *rq)
+{
+	p->se.avg.last_runnable_update = rq->clock_task;
+	p->se.avg.runnable_avg_sum = LOAD_AVG_MAX;
+	p->se.avg.runnable_avg_period = LOAD_AVG_MAX;
+	__update_entity_load_avg_contrib(&p->se);
+}
+#else
+static inline void update_entity_load_avg(struct sched_entity *se)
+{
+}
+
+static inline void enqueue_entity_load_avg(struct cfs_rq *cfs_rq,
+					   struct sched_entity *se,
+					   int runnable)
+{
+}
+
+static inline void dequeue_entity_load_avg(struct cfs_rq *cfs_rq,
+					   struct sched_entity *se)
+{
+}
+
+static inline void init_task_runnable_average(struct task_struct *p,
+					      struct rq *rq)
+{
+}
+#endif /* CONFIG_SMP */
+
 static void
 account_entity_enqueue(struct cfs_rq *cfs_rq, struct sched_entity *se)
 {
 	update_load_add(&cfs_rq->load, se->load.weight);
+	enqueue_entity_load_avg(cfs_rq, se, se->on_rq);
 	if (!parent_entity(se))
 		inc_cpu_load(rq_of(cfs_rq), se->load.weight);
 	if (entity_is_task(se)) {
@@ -678,6 +936,7 @@ static void
 account_entity_dequeue(struct cfs_rq *cfs_rq, struct sched_entity *se)
 {
 	update_load_sub(&cfs_rq->load, se->load.weight);
+	dequeue_entity_load_avg(cfs_rq, se);
 	if (!parent_entity(se))
 		dec_cpu_load(rq_of(cfs_rq), se->load.weight);
 	if (entity_is_task(se)) {
@@ -695,7 +954,14 @@ static void update_cfs_rq_load_contribution(struct cfs_rq *cfs_rq,
 	struct task_group *tg = cfs_rq->tg;
 	long load_avg;
 
-	load_avg = div64_u64(cfs_rq->load_avg, cfs_rq->load_period+1);
+	/*
+	 * tg->load_weight must be the sum of whatever calc_cfs_shares()
+	 * uses as the load of a cfs_rq, or the shares come out skewed.
+	 */
+	if (sched_feat(LB_LOAD_AVG))
+		load_avg = cfs_rq->runnable_load_avg;
+	else
+		load_avg = div64_u64(cfs_rq->load_avg, cfs_rq->load_period+1);
 	load_avg -= cfs_rq->load_contribution;
 
 	if (global_update || abs(load_avg) > cfs_rq->load_contribution / 8) {
@@ -732,9 +998,12 @@ static void update_cfs_load(struct cfs_rq *cfs_rq, int global_update)
 		cfs_rq->load_avg += delta * load;
 	}
 
-	/* consider updating load contribution on each fold or truncate */
+	/*
+	 * consider updating load contribution on each fold or truncate;
+	 * the runnable average changes on its own, consider it every time
+	 */
 	if (global_update || cfs_rq->load_period > period
-	    || !cfs_rq->load_period)
+	    || !cfs_rq->load_period || sched_feat(LB_LOAD_AVG))
 		update_cfs_rq_load_contribution(cfs_rq, global_update);
 
 	while (cfs_rq->load_period > period) {
@@ -756,7 +1025,10 @@ static long calc_cfs_shares(struct cfs_rq *cfs_rq, struct task_group *tg)
 {
 	long load_weight, load, shares;
 
-	load = cfs_rq->load.weight;
+	if (sched_feat(LB_LOAD_AVG))
+		load = cfs_rq->runnable_load_avg;
+	else
+		load = cfs_rq->load.weight;
 
 	load_weight = atomic_read(&tg->load_weight);
 	load_weight += load;
@@ -1125,6 +1397,7 @@ set_next_entity(struct cfs_rq *cfs_rq, struct sched_entity *se)
 		 */
 		update_stats_wait_end(cfs_rq, se);
 		__dequeue_entity(cfs_rq, se);
+		update_entity_load_avg(se);
 	}
 
 	update_stats_curr_start(cfs_rq, se);
@@ -1196,6 +1469,7 @@ static void put_prev_entity(struct cfs_rq *cfs_rq, struct sched_entity *prev)
 
 	check_spread(cfs_rq, prev);
 	if (prev->on_rq) {
+		update_entity_load_avg(prev);
 		update_stats_wait_start(cfs_rq, prev);
 		/* Put 'current' back into the tree. */
 		__enqueue_entity(cfs_rq, prev);
@@ -1211,6 +1485,11 @@ entity_tick(struct cfs_rq *cfs_rq, struct sched_entity *curr, int queued)
 	 */
 	update_curr(cfs_rq);
 
+	/*
+	 * Update the decayed runnable average of the running entity.
+	 */
+	update_entity_load_avg(curr);
+
 	/*
 	 * Update share accounting for long-running entities.
 	 */
@@ -1308,6 +1587,8 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	struct cfs_rq *cfs_rq;
 	struct sched_entity *se = &p->se;
 
+	update_rq_runnable_avg(rq, rq->nr_running);
+
 	for_each_sched_entity(se) {
 		if (se->on_rq)
 			break;
@@ -1323,6 +1604,7 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 		update_cfs_shares(cfs_rq);
 	}
 
+	cpufreq_update_util(rq);
 	hrtick_update(rq);
 }
 
@@ -1339,6 +1621,8 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	struct sched_entity *se = &p->se;
 	int task_sleep = flags & DEQUEUE_SLEEP;
 
+	update_rq_runnable_avg(rq, 1);
+
 	for_each_sched_entity(se) {
 		cfs_rq = cfs_rq_of(se);
 		dequeue_entity(cfs_rq, se, flags);
@@ -1366,6 +1650,7 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 		update_cfs_shares(cfs_rq);
 	}
 
+	cpufreq_update_util(rq);
 	hrtick_update(rq);
 }
 
@@ -2121,6 +2406,26 @@ move_one_task(struct rq *this_rq, int this_cpu, struct rq *busiest,
 	return 0;
 }
 
+/*
+ * Load of an entity and of a cfs_rq as seen by the load balancer; these
+ * must agree with weighted_cpuload().
+ */
+static inline unsigned long se_lb_load(struct sched_entity *se)
+{
+	if (sched_feat(LB_LOAD_AVG))
+		return se->avg.load_avg_contrib;
+
+	return se->load.weight;
+}
+
+static inline unsigned long cfs_rq_lb_load(struct cfs_rq *cfs_rq)
+{
+	if (sched_feat(LB_LOAD_AVG))
+		return cfs_rq->runnable_load_avg;
+
+	return cfs_rq->load.weight;
+}
+
 static unsigned long
 balance_tasks(struct rq *this_rq, int this_cpu, struct rq *busiest,
 	      unsigned long max_load_move, struct sched_domain *sd,
@@ -2129,6 +2434,7 @@ balance_tasks(struct rq *this_rq, int this_cpu, struct rq *busiest,
 {
 	int loops = 0, pulled = 0;
 	long rem_load_move = max_load_move;
+	unsigned long load;
 	struct task_struct *p, *n;
 
 	if (max_load_move == 0)
@@ -2138,14 +2444,15 @@ balance_tasks(struct rq *this_rq, int this_cpu, struct rq *busiest,
 		if (loops++ > sysctl_sched_nr_migrate)
 			break;
 
-		if ((p->se.load.weight >> 1) > rem_load_move ||
+		load = se_lb_load(&p->se);
+		if ((load >> 1) > rem_load_move ||
 		    !can_migrate_task(p, busiest, this_cpu, sd, idle,
 				      all_pinned))
 			continue;
 
 		pull_task(busiest, p, this_rq, this_cpu);
 		pulled++;
-		rem_load_move -= p->se.load.weight;
+		rem_load_move -= load;
 
 #ifdef CONFIG_PREEMPT
 		/*
@@ -2233,11 +2540,11 @@ static int tg_load_down(struct task_group *tg, void *data)
 	long cpu = (long)data;
 
 	if (!tg->parent) {
-		load = cpu_rq(cpu)->load.weight;
+		load = weighted_cpuload(cpu);
 	} else {
 		load = tg->parent->cfs_rq[cpu]->h_load;
-		load *= tg->se[cpu]->load.weight;
-		load /= tg->parent->cfs_rq[cpu]->load.weight + 1;
+		load *= se_lb_load(tg->se[cpu]);
+		load /= cfs_rq_lb_load(tg->parent->cfs_rq[cpu]) + 1;
 	}
 
 	tg->cfs_rq[cpu]->h_load = load;
@@ -2264,7 +2571,7 @@ load_balance_fair(struct rq *this_rq, int this_cpu, struct rq *busiest,
 
 	for_each_leaf_cfs_rq(busiest, busiest_cfs_rq) {
 		unsigned long busiest_h_load = busiest_cfs_rq->h_load;
-		unsigned long busiest_weight = busiest_cfs_rq->load.weight;
+		unsigned long busiest_weight = cfs_rq_lb_load(busiest_cfs_rq);
 		u64 rem_load, moved_load;
 
 		/*
@@ -4132,6 +4439,9 @@ static void task_tick_fair(struct rq *rq, struct task_struct *curr, int queued)
 		cfs_rq = cfs_rq_of(se);
 		entity_tick(cfs_rq, se, queued);
 	}
+
+	update_rq_runnable_avg(rq, 1);
+	cpufreq_update_util(rq);
 }
 
 /*
@@ -4158,6 +4468,7 @@ static void task_fork_fair(struct task_struct *p)
 	}
 
 	update_curr(cfs_rq);
+	init_task_runnable_average(p, rq);
 
 	if (curr)
 		se->vruntime = curr->vruntime;
@@ -53,6 +53,13 @@ SCHED_FEAT(HRTICK, 0)
 SCHED_FEAT(DOUBLE_TICK, 0)
 SCHED_FEAT(LB_BIAS, 1)
 
+/*
+ * Use the decayed per-entity runnable averages rather than the
+ * instantaneous queue weight for cpu load, task load during
+ * migration and group shares.
+ */
+SCHED_FEAT(LB_LOAD_AVG, 1)
+
 /*
  * Spin-wait on mutex acquisition when the mutex owner is running on
  * another cpu -- assumes that when the owner is running, it will soon
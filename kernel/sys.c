@@ -46,6 +46,7 @@
 #include <linux/user_namespace.h>
 
 #include <linux/kmsg_dump.h>
+#include <linux/ksm.h>
 /* Move somewhere else to avoid recompiling? */
 #include <generated/utsrelease.h>
 
@@ -1840,6 +1841,16 @@ SYSCALL_DEFINE5(prctl, int, option, unsigned long, arg2, unsigned long, arg3,
 			else
 				error = PR_MCE_KILL_DEFAULT;
 			break;
+		case PR_SET_KSM_HOT:
+			if (arg2 > 1 || arg3 | arg4 | arg5)
+				return -EINVAL;
+			error = ksm_set_hot(me->mm, arg2);
+			break;
+		case PR_GET_KSM_HOT:
+			if (arg2 | arg3 | arg4 | arg5)
+				return -EINVAL;
+			error = ksm_get_hot(me->mm);
+			break;
 		default:
 			error = -EINVAL;
 			break;
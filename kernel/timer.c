@@ -55,33 +55,79 @@ u64 jiffies_64 __cacheline_aligned_in_smp = INITIAL_JIFFIES;
 EXPORT_SYMBOL(jiffies_64);
 
 /*
- * per-CPU timer vector definitions:
+ * The timer wheel has LVL_DEPTH levels of LVL_SIZE buckets each. The
+ * granularity of a level is LVL_CLK_DIV times that of the level below:
+ * level 0 has a granularity of one jiffy, level 1 of 8 jiffies, level 2
+ * of 64 jiffies and so on. A timer goes into the finest level whose
+ * range covers its timeout, rounded up to that level's granularity, and
+ * stays in that bucket until it expires. Unlike the classic wheel,
+ * nothing is ever cascaded down from the outer levels; the price is
+ * that a timer may fire up to one granularity late, which is at most
+ * about 12.5% of its timeout for timeouts beyond 63 jiffies. Most long
+ * timeouts are deleted or re-armed long before they expire, and those
+ * operations are now O(1) without any cascading work behind them.
+ *
+ * With HZ=1000:
+ *
+ * Level Offset  Granularity            Range
+ *  0      0         1 ms                0 ms -         62 ms
+ *  1     64         8 ms               63 ms -        503 ms
+ *  2    128        64 ms              504 ms -       4031 ms (~4s)
+ *  3    192       512 ms             4032 ms -      32255 ms (~32s)
+ *  4    256      4096 ms (~4s)      32256 ms -     258047 ms (~4m)
+ *  5    320     32768 ms (~32s)    258048 ms -    2064383 ms (~34m)
+ *  6    384    262144 ms (~4m)    2064384 ms -   16515071 ms (~4.5h)
+ *  7    448   2097152 ms (~35m)  16515072 ms -  132120575 ms (~36h)
+ *  8    512  16777216 ms (~4.7h) 132120576 ms - 1056964607 ms (~12d)
+ *
+ * Each level has a bitmap of non-empty buckets, so expiry processing
+ * and the NO_HZ search for the next event never walk timer lists.
+ * Deferrable timers live in a wheel of their own which the NO_HZ code
+ * ignores; they are batched up and run together whenever the cpu is
+ * woken up by something else.
  */
-#define TVN_BITS (CONFIG_BASE_SMALL ? 4 : 6)
-#define TVR_BITS (CONFIG_BASE_SMALL ? 6 : 8)
-#define TVN_SIZE (1 << TVN_BITS)
-#define TVR_SIZE (1 << TVR_BITS)
-#define TVN_MASK (TVN_SIZE - 1)
-#define TVR_MASK (TVR_SIZE - 1)
-
-struct tvec {
-	struct list_head vec[TVN_SIZE];
-};
+#define LVL_CLK_SHIFT	3
+#define LVL_CLK_DIV	(1UL << LVL_CLK_SHIFT)
+#define LVL_CLK_MASK	(LVL_CLK_DIV - 1)
+#define LVL_SHIFT(n)	((n) * LVL_CLK_SHIFT)
+#define LVL_GRAN(n)	(1UL << LVL_SHIFT(n))
+
+#define LVL_BITS	6
+#define LVL_SIZE	(1UL << LVL_BITS)
+#define LVL_MASK	(LVL_SIZE - 1)
+#define LVL_OFFS(n)	((n) * LVL_SIZE)
+
+/* The first timeout (in jiffies) that needs level n */
+#define LVL_START(n)	((LVL_SIZE - 1) << (((n) - 1) * LVL_CLK_SHIFT))
+
+/* Lower HZ values need fewer levels to cover NEXT_TIMER_MAX_DELTA */
+#if HZ > 100
+# define LVL_DEPTH	9
+#else
+# define LVL_DEPTH	8
+#endif
+
+/* Longer timeouts are clamped to the last bucket of the last level */
+#define WHEEL_TIMEOUT_CUTOFF	(LVL_START(LVL_DEPTH))
+#define WHEEL_TIMEOUT_MAX	(WHEEL_TIMEOUT_CUTOFF - LVL_GRAN(LVL_DEPTH - 1))
+
+#define WHEEL_SIZE	(LVL_SIZE * LVL_DEPTH)
 
-struct tvec_root {
-	struct list_head vec[TVR_SIZE];
+struct tvec_wheel {
+	DECLARE_BITMAP(pending_map, WHEEL_SIZE);
+	struct list_head vec[WHEEL_SIZE];
 };
 
+/* tvec_base.wheel[] index, same as the deferrable bit of timer->base */
+#define WHEEL_STD	0
+#define WHEEL_DEF	TBASE_DEFERRABLE_FLAG
+#define NR_WHEELS	2
+
 struct tvec_base {
 	spinlock_t lock;
 	struct timer_list *running_timer;
-	unsigned long timer_jiffies;
-	unsigned long next_timer;
-	struct tvec_root tv1;
-	struct tvec tv2;
-	struct tvec tv3;
-	struct tvec tv4;
-	struct tvec tv5;
+	unsigned long timer_jiffies;	/* next jiffy to be processed */
+	struct tvec_wheel wheel[NR_WHEELS];
 } ____cacheline_aligned;
 
 struct tvec_base boot_tvec_bases;
@@ -330,46 +376,156 @@ void set_timer_slack(struct timer_list *timer, int slack_hz)
 }
 EXPORT_SYMBOL_GPL(set_timer_slack);
 
-static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
+static inline struct tvec_wheel *timer_wheel(struct tvec_base *base,
+					     struct timer_list *timer)
 {
-	unsigned long expires = timer->expires;
-	unsigned long idx = expires - base->timer_jiffies;
-	struct list_head *vec;
-
-	if (idx < TVR_SIZE) {
-		int i = expires & TVR_MASK;
-		vec = base->tv1.vec + i;
-	} else if (idx < 1 << (TVR_BITS + TVN_BITS)) {
-		int i = (expires >> TVR_BITS) & TVN_MASK;
-		vec = base->tv2.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 2 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK;
-		vec = base->tv3.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 3 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv4.vec + i;
-	} else if ((signed long) idx < 0) {
-		/*
-		 * Can happen if you add a timer with expires == jiffies,
-		 * or you set a timer to go off in the past
-		 */
-		vec = base->tv1.vec + (base->timer_jiffies & TVR_MASK);
-	} else {
-		int i;
-		/* If the timeout is larger than 0xffffffff on 64-bit
-		 * architectures then we use the maximum timeout:
-		 */
-		if (idx > 0xffffffffUL) {
-			idx = 0xffffffffUL;
-			expires = idx + base->timer_jiffies;
-		}
-		i = (expires >> (TVR_BITS + 3 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv5.vec + i;
+	return &base->wheel[tbase_get_deferrable(timer->base)];
+}
+
+/*
+ * Round @expires up to the granularity of @lvl, so that a timer never
+ * fires early, and return its bucket.
+ */
+static inline unsigned int calc_index(unsigned long expires, unsigned int lvl)
+{
+	expires = (expires + LVL_GRAN(lvl) - 1) >> LVL_SHIFT(lvl);
+	return LVL_OFFS(lvl) + (expires & LVL_MASK);
+}
+
+static unsigned int calc_wheel_index(unsigned long expires, unsigned long clk)
+{
+	unsigned long delta = expires - clk;
+	unsigned int lvl;
+
+	/*
+	 * Can happen if you add a timer with expires == jiffies,
+	 * or you set a timer to go off in the past
+	 */
+	if ((long)delta < 0)
+		return clk & LVL_MASK;
+
+	/*
+	 * Force obscenely large timeouts to expire at the capacity
+	 * limit of the wheel.
+	 */
+	if (delta >= WHEEL_TIMEOUT_CUTOFF) {
+		expires = clk + WHEEL_TIMEOUT_MAX;
+		delta = WHEEL_TIMEOUT_MAX;
 	}
+
+	for (lvl = 0; lvl < LVL_DEPTH - 1; lvl++)
+		if (delta < LVL_START(lvl + 1))
+			break;
+
+	return calc_index(expires, lvl);
+}
+
+static void enqueue_timer(struct tvec_base *base, struct timer_list *timer,
+			  unsigned int idx)
+{
+	struct tvec_wheel *wheel = timer_wheel(base, timer);
+
 	/*
 	 * Timers are FIFO:
 	 */
-	list_add_tail(&timer->entry, vec);
+	list_add_tail(&timer->entry, wheel->vec + idx);
+	__set_bit(idx, wheel->pending_map);
+	timer->bucket = idx;
+}
+
+static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
+{
+	enqueue_timer(base, timer,
+		      calc_wheel_index(timer->expires, base->timer_jiffies));
+}
+
+/*
+ * Distance from @clk to the next pending bucket of the level starting at
+ * @offset, wrapping around the level, or -1 if the level is empty.
+ */
+static int next_pending_bucket(struct tvec_wheel *wheel, unsigned int offset,
+			       unsigned int clk)
+{
+	unsigned int pos, start = offset + clk;
+	unsigned int end = offset + LVL_SIZE;
+
+	pos = find_next_bit(wheel->pending_map, end, start);
+	if (pos < end)
+		return pos - start;
+
+	pos = find_next_bit(wheel->pending_map, start, offset);
+	return pos < start ? pos + LVL_SIZE - start : -1;
+}
+
+/*
+ * Find the jiffy at which the first non-empty bucket of @wheel expires,
+ * searching from @clk. Returns @clk + NEXT_TIMER_MAX_DELTA if the wheel
+ * is empty.
+ */
+static unsigned long __next_timer_interrupt(struct tvec_wheel *wheel,
+					    unsigned long clk)
+{
+	unsigned long next, adj;
+	unsigned int lvl, offset = 0;
+
+	next = clk + NEXT_TIMER_MAX_DELTA;
+	for (lvl = 0; lvl < LVL_DEPTH; lvl++, offset += LVL_SIZE) {
+		int pos = next_pending_bucket(wheel, offset, clk & LVL_MASK);
+
+		if (pos >= 0) {
+			unsigned long tmp = clk + (unsigned long)pos;
+
+			tmp <<= LVL_SHIFT(lvl);
+			if (time_before(tmp, next))
+				next = tmp;
+		}
+		/*
+		 * The clock of the next level. If the lower bits of this
+		 * level's clock are not zero, the bucket at the next
+		 * level's current position has already been collected
+		 * and the next one to expire is one further. Carries
+		 * into the level above that were caused by this are
+		 * already part of the shifted value.
+		 */
+		adj = clk & LVL_CLK_MASK ? 1 : 0;
+		clk >>= LVL_CLK_SHIFT;
+		clk += adj;
+	}
+	return next;
+}
+
+/* First bucket expiry of @base, deferrable timers included. */
+static unsigned long next_base_expiry(struct tvec_base *base)
+{
+	unsigned long std, def;
+
+	std = __next_timer_interrupt(&base->wheel[WHEEL_STD],
+				     base->timer_jiffies);
+	def = __next_timer_interrupt(&base->wheel[WHEEL_DEF],
+				     base->timer_jiffies);
+	return time_before(def, std) ? def : std;
+}
+
+/*
+ * A cpu in NO_HZ idle does not advance ->timer_jiffies. Catch it up
+ * before queueing a timer, otherwise the timeout would be measured from
+ * a stale clock and the timer filed into a needlessly coarse level.
+ * The clock must not pass a pending bucket, so it only moves up to the
+ * earliest one.
+ */
+static void forward_timer_base(struct tvec_base *base)
+{
+	unsigned long jnow = jiffies;
+	unsigned long next;
+
+	if ((long)(jnow - base->timer_jiffies) < 2)
+		return;
+
+	next = next_base_expiry(base);
+	if (time_before(next, jnow))
+		jnow = next;
+	if (time_after(jnow, base->timer_jiffies))
+		base->timer_jiffies = jnow;
 }
 
 #ifdef CONFIG_TIMER_STATS
@@ -621,6 +777,22 @@ static inline void detach_timer(struct timer_list *timer,
 	entry->prev = LIST_POISON2;
 }
 
+/*
+ * Detach a pending timer and clear its bucket's pending bit if it was
+ * the last timer there. Expired timers that __run_timers() has moved to
+ * its private list are no longer in their bucket and leave it alone.
+ */
+static void detach_wheel_timer(struct tvec_base *base,
+			       struct timer_list *timer, int clear_pending)
+{
+	struct tvec_wheel *wheel = timer_wheel(base, timer);
+	struct list_head *head = wheel->vec + timer->bucket;
+
+	if (timer->entry.next == head && timer->entry.prev == head)
+		__clear_bit(timer->bucket, wheel->pending_map);
+	detach_timer(timer, clear_pending);
+}
+
 /*
  * We are using hashed locking: holding per_cpu(tvec_bases).lock
  * means that all timers which are tied to this base via timer->base are
@@ -667,10 +839,22 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 	base = lock_timer_base(timer, &flags);
 
 	if (timer_pending(timer)) {
-		detach_timer(timer, 0);
-		if (timer->expires == base->next_timer &&
-		    !tbase_get_deferrable(timer->base))
-			base->next_timer = base->timer_jiffies;
+		/*
+		 * Networking re-arms pending timeouts all the time. If the
+		 * new expiry lands in the bucket the timer already sits in,
+		 * updating ->expires is all there is to do. A timer whose
+		 * ->expires is behind the clock may already have been
+		 * collected by __run_timers(), so it takes the slow path.
+		 */
+		forward_timer_base(base);
+		if (time_after_eq(timer->expires, base->timer_jiffies) &&
+		    calc_wheel_index(expires, base->timer_jiffies) ==
+		    timer->bucket) {
+			timer->expires = expires;
+			ret = 1;
+			goto out_unlock;
+		}
+		detach_wheel_timer(base, timer, 0);
 		ret = 1;
 	} else {
 		if (pending_only)
@@ -705,10 +889,8 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 		}
 	}
 
+	forward_timer_base(base);
 	timer->expires = expires;
-	if (time_before(timer->expires, base->next_timer) &&
-	    !tbase_get_deferrable(timer->base))
-		base->next_timer = timer->expires;
 	internal_add_timer(base, timer);
 
 out_unlock:
@@ -868,9 +1050,7 @@ void add_timer_on(struct timer_list *timer, int cpu)
 	spin_lock_irqsave(&base->lock, flags);
 	timer_set_base(timer, base);
 	debug_activate(timer, timer->expires);
-	if (time_before(timer->expires, base->next_timer) &&
-	    !tbase_get_deferrable(timer->base))
-		base->next_timer = timer->expires;
+	forward_timer_base(base);
 	internal_add_timer(base, timer);
 	/*
 	 * Check whether the other CPU is idle and needs to be
@@ -906,10 +1086,7 @@ int del_timer(struct timer_list *timer)
 	if (timer_pending(timer)) {
 		base = lock_timer_base(timer, &flags);
 		if (timer_pending(timer)) {
-			detach_timer(timer, 1);
-			if (timer->expires == base->next_timer &&
-			    !tbase_get_deferrable(timer->base))
-				base->next_timer = base->timer_jiffies;
+			detach_wheel_timer(base, timer, 1);
 			ret = 1;
 		}
 		spin_unlock_irqrestore(&base->lock, flags);
@@ -940,10 +1117,7 @@ int try_to_del_timer_sync(struct timer_list *timer)
 	timer_stats_timer_clear_start_info(timer);
 	ret = 0;
 	if (timer_pending(timer)) {
-		detach_timer(timer, 1);
-		if (timer->expires == base->next_timer &&
-		    !tbase_get_deferrable(timer->base))
-			base->next_timer = base->timer_jiffies;
+		detach_wheel_timer(base, timer, 1);
 		ret = 1;
 	}
 out:
@@ -1019,26 +1193,6 @@ int del_timer_sync(struct timer_list *timer)
 EXPORT_SYMBOL(del_timer_sync);
 #endif
 
-static int cascade(struct tvec_base *base, struct tvec *tv, int index)
-{
-	/* cascade all the timers from tv up one level */
-	struct timer_list *timer, *tmp;
-	struct list_head tv_list;
-
-	list_replace_init(tv->vec + index, &tv_list);
-
-	/*
-	 * We are removing _all_ timers from the list, so we
-	 * don't have to detach them individually.
-	 */
-	list_for_each_entry_safe(timer, tmp, &tv_list, entry) {
-		BUG_ON(tbase_get_base(timer->base) != base);
-		internal_add_timer(base, timer);
-	}
-
-	return index;
-}
-
 static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 			  unsigned long data)
 {
@@ -1080,133 +1234,99 @@ static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 	}
 }
 
-#define INDEX(N) ((base->timer_jiffies >> (TVR_BITS + (N) * TVN_BITS)) & TVN_MASK)
+static void expire_timers(struct tvec_base *base, struct list_head *head)
+{
+	struct timer_list *timer;
+
+	while (!list_empty(head)) {
+		void (*fn)(unsigned long);
+		unsigned long data;
+
+		timer = list_first_entry(head, struct timer_list, entry);
+		fn = timer->function;
+		data = timer->data;
+
+		timer_stats_account_timer(timer);
+
+		base->running_timer = timer;
+		detach_timer(timer, 1);
+
+		spin_unlock_irq(&base->lock);
+		call_timer_fn(timer, fn, data);
+		spin_lock_irq(&base->lock);
+	}
+}
+
+/*
+ * Move the buckets that expire at ->timer_jiffies to @heads. A level is
+ * only due when the clock is a multiple of its granularity.
+ */
+static int __collect_expired_timers(struct tvec_base *base,
+				    struct list_head *heads)
+{
+	unsigned long clk = base->timer_jiffies;
+	int lvl, w, nr = 0;
+
+	for (lvl = 0; lvl < LVL_DEPTH; lvl++) {
+		unsigned int idx = LVL_OFFS(lvl) + (clk & LVL_MASK);
+
+		for (w = 0; w < NR_WHEELS; w++) {
+			struct tvec_wheel *wheel = &base->wheel[w];
+
+			if (__test_and_clear_bit(idx, wheel->pending_map))
+				list_replace_init(wheel->vec + idx, heads + nr++);
+		}
+		if (clk & LVL_CLK_MASK)
+			break;
+		clk >>= LVL_CLK_SHIFT;
+	}
+	return nr;
+}
+
+static int collect_expired_timers(struct tvec_base *base,
+				  struct list_head *heads)
+{
+	/*
+	 * After a long NO_HZ sleep, jump straight to the next pending
+	 * bucket instead of stepping through every jiffy in between.
+	 */
+	if ((long)(jiffies - base->timer_jiffies) > 2) {
+		unsigned long next = next_base_expiry(base);
+
+		if (time_after(next, jiffies)) {
+			/* the caller increments the clock */
+			base->timer_jiffies = jiffies - 1;
+			return 0;
+		}
+		base->timer_jiffies = next;
+	}
+	return __collect_expired_timers(base, heads);
+}
 
 /**
  * __run_timers - run all expired timers (if any) on this CPU.
  * @base: the timer vector to be processed.
  *
- * This function cascades all vectors and executes all expired timer
- * vectors.
+ * This function collects and executes all expired timer buckets.
  */
 static inline void __run_timers(struct tvec_base *base)
 {
-	struct timer_list *timer;
+	struct list_head heads[NR_WHEELS * LVL_DEPTH];
+	int levels;
 
 	spin_lock_irq(&base->lock);
 	while (time_after_eq(jiffies, base->timer_jiffies)) {
-		struct list_head work_list;
-		struct list_head *head = &work_list;
-		int index = base->timer_jiffies & TVR_MASK;
-
-		/*
-		 * Cascade timers:
-		 */
-		if (!index &&
-			(!cascade(base, &base->tv2, INDEX(0))) &&
-				(!cascade(base, &base->tv3, INDEX(1))) &&
-					!cascade(base, &base->tv4, INDEX(2)))
-			cascade(base, &base->tv5, INDEX(3));
+		levels = collect_expired_timers(base, heads);
 		++base->timer_jiffies;
-		list_replace_init(base->tv1.vec + index, &work_list);
-		while (!list_empty(head)) {
-			void (*fn)(unsigned long);
-			unsigned long data;
 
-			timer = list_first_entry(head, struct timer_list,entry);
-			fn = timer->function;
-			data = timer->data;
-
-			timer_stats_account_timer(timer);
-
-			base->running_timer = timer;
-			detach_timer(timer, 1);
-
-			spin_unlock_irq(&base->lock);
-			call_timer_fn(timer, fn, data);
-			spin_lock_irq(&base->lock);
-		}
+		while (levels--)
+			expire_timers(base, heads + levels);
 	}
 	base->running_timer = NULL;
 	spin_unlock_irq(&base->lock);
 }
 
 #ifdef CONFIG_NO_HZ
-/*
- * Find out when the next timer event is due to happen. This
- * is used on S/390 to stop all activity when a CPU is idle.
- * This function needs to be called with interrupts disabled.
- */
-static unsigned long __next_timer_interrupt(struct tvec_base *base)
-{
-	unsigned long timer_jiffies = base->timer_jiffies;
-	unsigned long expires = timer_jiffies + NEXT_TIMER_MAX_DELTA;
-	int index, slot, array, found = 0;
-	struct timer_list *nte;
-	struct tvec *varray[4];
-
-	/* Look for timer events in tv1. */
-	index = slot = timer_jiffies & TVR_MASK;
-	do {
-		list_for_each_entry(nte, base->tv1.vec + slot, entry) {
-			if (tbase_get_deferrable(nte->base))
-				continue;
-
-			found = 1;
-			expires = nte->expires;
-			/* Look at the cascade bucket(s)? */
-			if (!index || slot < index)
-				goto cascade;
-			return expires;
-		}
-		slot = (slot + 1) & TVR_MASK;
-	} while (slot != index);
-
-cascade:
-	/* Calculate the next cascade event */
-	if (index)
-		timer_jiffies += TVR_SIZE - index;
-	timer_jiffies >>= TVR_BITS;
-
-	/* Check tv2-tv5. */
-	varray[0] = &base->tv2;
-	varray[1] = &base->tv3;
-	varray[2] = &base->tv4;
-	varray[3] = &base->tv5;
-
-	for (array = 0; array < 4; array++) {
-		struct tvec *varp = varray[array];
-
-		index = slot = timer_jiffies & TVN_MASK;
-		do {
-			list_for_each_entry(nte, varp->vec + slot, entry) {
-				if (tbase_get_deferrable(nte->base))
-					continue;
-
-				found = 1;
-				if (time_before(nte->expires, expires))
-					expires = nte->expires;
-			}
-			/*
-			 * Do we still search for the first timer or are
-			 * we looking up the cascade buckets ?
-			 */
-			if (found) {
-				/* Look at the cascade bucket(s)? */
-				if (!index || slot < index)
-					break;
-				return expires;
-			}
-			slot = (slot + 1) & TVN_MASK;
-		} while (slot != index);
-
-		if (index)
-			timer_jiffies += TVN_SIZE - index;
-		timer_jiffies >>= TVN_BITS;
-	}
-	return expires;
-}
-
 /*
  * Check, if the next hrtimer event is before the next timer wheel
  * event:
@@ -1266,10 +1386,10 @@ unsigned long get_next_timer_interrupt(unsigned long now)
 	 */
 	if (cpu_is_offline(smp_processor_id()))
 		return now + NEXT_TIMER_MAX_DELTA;
+	/* Deferrable timers must not wake an idle cpu. */
 	spin_lock(&base->lock);
-	if (time_before_eq(base->next_timer, base->timer_jiffies))
-		base->next_timer = __next_timer_interrupt(base);
-	expires = base->next_timer;
+	expires = __next_timer_interrupt(&base->wheel[WHEEL_STD],
+					 base->timer_jiffies);
 	spin_unlock(&base->lock);
 
 	if (time_before_eq(expires, now))
@@ -1594,7 +1714,7 @@ SYSCALL_DEFINE1(sysinfo, struct sysinfo __user *, info)
 
 static int __cpuinit init_timers_cpu(int cpu)
 {
-	int j;
+	int j, w;
 	struct tvec_base *base;
 	static char __cpuinitdata tvec_base_done[NR_CPUS];
 
@@ -1635,17 +1755,13 @@ static int __cpuinit init_timers_cpu(int cpu)
 
 	spin_lock_init(&base->lock);
 
-	for (j = 0; j < TVN_SIZE; j++) {
-		INIT_LIST_HEAD(base->tv5.vec + j);
-		INIT_LIST_HEAD(base->tv4.vec + j);
-		INIT_LIST_HEAD(base->tv3.vec + j);
-		INIT_LIST_HEAD(base->tv2.vec + j);
+	for (w = 0; w < NR_WHEELS; w++) {
+		bitmap_zero(base->wheel[w].pending_map, WHEEL_SIZE);
+		for (j = 0; j < WHEEL_SIZE; j++)
+			INIT_LIST_HEAD(base->wheel[w].vec + j);
 	}
-	for (j = 0; j < TVR_SIZE; j++)
-		INIT_LIST_HEAD(base->tv1.vec + j);
 
 	base->timer_jiffies = jiffies;
-	base->next_timer = base->timer_jiffies;
 	return 0;
 }
 
@@ -1658,9 +1774,6 @@ static void migrate_timer_list(struct tvec_base *new_base, struct list_head *hea
 		timer = list_first_entry(head, struct timer_list, entry);
 		detach_timer(timer, 0);
 		timer_set_base(timer, new_base);
-		if (time_before(timer->expires, new_base->next_timer) &&
-		    !tbase_get_deferrable(timer->base))
-			new_base->next_timer = timer->expires;
 		internal_add_timer(new_base, timer);
 	}
 }
@@ -1669,7 +1782,7 @@ static void __cpuinit migrate_timers(int cpu)
 {
 	struct tvec_base *old_base;
 	struct tvec_base *new_base;
-	int i;
+	int i, w;
 
 	BUG_ON(cpu_online(cpu));
 	old_base = per_cpu(tvec_bases, cpu);
@@ -1683,13 +1796,13 @@ static void __cpuinit migrate_timers(int cpu)
 
 	BUG_ON(old_base->running_timer);
 
-	for (i = 0; i < TVR_SIZE; i++)
-		migrate_timer_list(new_base, old_base->tv1.vec + i);
-	for (i = 0; i < TVN_SIZE; i++) {
-		migrate_timer_list(new_base, old_base->tv2.vec + i);
-		migrate_timer_list(new_base, old_base->tv3.vec + i);
-		migrate_timer_list(new_base, old_base->tv4.vec + i);
-		migrate_timer_list(new_base, old_base->tv5.vec + i);
+	forward_timer_base(new_base);
+	for (w = 0; w < NR_WHEELS; w++) {
+		struct tvec_wheel *wheel = &old_base->wheel[w];
+
+		for_each_set_bit(i, wheel->pending_map, WHEEL_SIZE)
+			migrate_timer_list(new_base, wheel->vec + i);
+		bitmap_zero(wheel->pending_map, WHEEL_SIZE);
 	}
 
 	spin_unlock(&old_base->lock);
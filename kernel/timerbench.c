@@ -0,0 +1,198 @@
+/*
+ * Timer wheel benchmark module
+ *
+ * Loading the module runs, on one cpu, the operations that dominate
+ * timer wheel cost for networking and wakelock style timeouts: adding,
+ * re-arming and deleting a large number of timers that rarely fire,
+ * and the time the timer softirq steals from a busy cpu while they are
+ * pending or expiring. Results are printed to the kernel log when
+ * loading completes; unload the module before the next run.
+ *
+ * The cpu is monopolized with preemption disabled for the measurement
+ * windows, so pick an otherwise idle one.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include <linux/completion.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/timer.h>
+#include <linux/vmalloc.h>
+
+static unsigned int nr_timers = 100000;
+module_param(nr_timers, uint, 0444);
+MODULE_PARM_DESC(nr_timers, "Number of pending timers");
+
+static unsigned int nr_expire = 10000;
+module_param(nr_expire, uint, 0444);
+MODULE_PARM_DESC(nr_expire, "Number of timers expiring in the expiry run");
+
+static unsigned int timeout_ms = 30000;
+module_param(timeout_ms, uint, 0444);
+MODULE_PARM_DESC(timeout_ms, "Timeouts are spread over 1s to 1s + timeout_ms");
+
+static unsigned int measure_ms = 1000;
+module_param(measure_ms, uint, 0444);
+MODULE_PARM_DESC(measure_ms, "Length of each softirq measurement window");
+
+static unsigned int cpu;
+module_param(cpu, uint, 0444);
+MODULE_PARM_DESC(cpu, "Cpu to run on");
+
+/* Gaps in the busy loop longer than this are interrupt/softirq time. */
+#define STOLEN_THRESHOLD_NS	500
+
+struct bench_timer {
+	struct timer_list timer;
+	unsigned long timeout;
+};
+
+static struct bench_timer *timers;
+static atomic_t nr_fired;
+static DECLARE_COMPLETION(bench_done);
+
+static void bench_timer_fn(unsigned long data)
+{
+	atomic_inc(&nr_fired);
+}
+
+static unsigned long random_timeout(void)
+{
+	return msecs_to_jiffies(1000 + random32() % (timeout_ms + 1));
+}
+
+static void report(const char *what, unsigned int nr, u64 ns)
+{
+	printk(KERN_INFO "timerbench: %-8s %u timers %llu ns/op\n", what, nr,
+	       (unsigned long long)div_u64(ns, nr ?: 1));
+}
+
+/*
+ * Spin for @ms and return the time the loop did not get to run. Stops
+ * early once @until timers have fired, if @until is non-zero.
+ */
+static u64 measure_stolen(unsigned int ms, unsigned int until, u64 *max_gap)
+{
+	u64 start, last, now, gap, stolen = 0;
+
+	*max_gap = 0;
+	preempt_disable();
+	start = last = local_clock();
+	do {
+		now = local_clock();
+		gap = now - last;
+		if (gap > STOLEN_THRESHOLD_NS) {
+			stolen += gap;
+			if (gap > *max_gap)
+				*max_gap = gap;
+		}
+		last = now;
+		if (until && atomic_read(&nr_fired) >= until)
+			break;
+	} while (now - start < (u64)ms * NSEC_PER_MSEC);
+	preempt_enable();
+
+	return stolen;
+}
+
+static void report_stolen(const char *what, u64 stolen, u64 max_gap)
+{
+	printk(KERN_INFO "timerbench: %-8s stolen %llu us max gap %llu us\n",
+	       what, (unsigned long long)div_u64(stolen, NSEC_PER_USEC),
+	       (unsigned long long)div_u64(max_gap, NSEC_PER_USEC));
+}
+
+static int timerbench_thread(void *unused)
+{
+	u64 t0, stolen, max_gap;
+	unsigned int i, nr;
+
+	for (i = 0; i < nr_timers; i++) {
+		setup_timer(&timers[i].timer, bench_timer_fn, 0);
+		timers[i].timeout = random_timeout();
+	}
+
+	stolen = measure_stolen(measure_ms, 0, &max_gap);
+	report_stolen("idle", stolen, max_gap);
+
+	t0 = local_clock();
+	for (i = 0; i < nr_timers; i++)
+		mod_timer(&timers[i].timer, jiffies + timers[i].timeout);
+	report("add", nr_timers, local_clock() - t0);
+
+	/* A new random timeout, as for a different request */
+	t0 = local_clock();
+	for (i = 0; i < nr_timers; i++)
+		mod_timer(&timers[i].timer, jiffies + random_timeout());
+	report("mod", nr_timers, local_clock() - t0);
+
+	/* The same timeout again, as for a keepalive after each packet */
+	schedule_timeout_uninterruptible(2);
+	t0 = local_clock();
+	for (i = 0; i < nr_timers; i++)
+		mod_timer(&timers[i].timer, jiffies + timers[i].timeout);
+	report("rearm", nr_timers, local_clock() - t0);
+
+	stolen = measure_stolen(measure_ms, 0, &max_gap);
+	report_stolen("pending", stolen, max_gap);
+
+	/* Let a subset expire within the next 64 jiffies */
+	nr = min(nr_expire, nr_timers);
+	atomic_set(&nr_fired, 0);
+	for (i = 0; i < nr; i++)
+		mod_timer(&timers[i].timer, jiffies + 1 + random32() % 64);
+	stolen = measure_stolen(measure_ms, nr, &max_gap);
+	report_stolen("expire", stolen, max_gap);
+	printk(KERN_INFO "timerbench: expire   %d of %u timers fired\n",
+	       atomic_read(&nr_fired), nr);
+
+	t0 = local_clock();
+	for (i = 0; i < nr_timers; i++)
+		del_timer(&timers[i].timer);
+	report("del", nr_timers, local_clock() - t0);
+
+	for (i = 0; i < nr_timers; i++)
+		del_timer_sync(&timers[i].timer);
+
+	complete(&bench_done);
+	return 0;
+}
+
+static int __init timerbench_init(void)
+{
+	struct task_struct *tsk;
+
+	if (!nr_timers || cpu >= nr_cpu_ids || !cpu_online(cpu))
+		return -EINVAL;
+
+	timers = vmalloc(nr_timers * sizeof(*timers));
+	if (!timers)
+		return -ENOMEM;
+
+	tsk = kthread_create(timerbench_thread, NULL, "timerbench/%u", cpu);
+	if (IS_ERR(tsk)) {
+		vfree(timers);
+		return PTR_ERR(tsk);
+	}
+	kthread_bind(tsk, cpu);
+	wake_up_process(tsk);
+	wait_for_completion(&bench_done);
+	vfree(timers);
+
+	return 0;
+}
+
+static void __exit timerbench_exit(void)
+{
+}
+
+module_init(timerbench_init);
+module_exit(timerbench_exit);
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Timer wheel benchmark");
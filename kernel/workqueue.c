@@ -41,6 +41,9 @@
 #include <linux/debug_locks.h>
 #include <linux/lockdep.h>
 #include <linux/idr.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
 
 #include "workqueue_sched.h"
 
@@ -169,6 +172,27 @@ struct global_cwq {
 	struct worker		*first_idle;	/* L: first idle worker */
 } ____cacheline_aligned_in_smp;
 
+#ifdef CONFIG_WORKQUEUE_STATS
+/*
+ * Per-cwq execution statistics.  Wait times are bucketed by log2 of
+ * microseconds: bucket 0 is below 1us, bucket n covers [2^(n-1), 2^n)
+ * us and the last bucket everything longer.
+ */
+#define CWQ_LAT_BUCKETS		16
+
+struct cwq_stats {
+	u64			nr_executed;	/* works run */
+	u64			nr_throttled;	/* works held back by max_active */
+	u64			lat_total;	/* ns from queueing to start */
+	u64			lat_max;
+	u64			exec_total;	/* ns spent in the callback */
+	u64			exec_max;
+	u64			cpu_total;	/* ns of worker cpu time */
+	unsigned long		lat_hist[CWQ_LAT_BUCKETS];
+	int			peak_active;	/* highest nr_active seen */
+};
+#endif
+
 /*
  * The per-CPU workqueue.  The lower WORK_STRUCT_FLAG_BITS of
  * work_struct->data are used for flags and thus cwqs need to be
@@ -184,6 +208,9 @@ struct cpu_workqueue_struct {
 	int			nr_active;	/* L: nr of active works */
 	int			max_active;	/* L: max active works */
 	struct list_head	delayed_works;	/* L: delayed works */
+#ifdef CONFIG_WORKQUEUE_STATS
+	struct cwq_stats	stats;		/* L: execution statistics */
+#endif
 };
 
 /*
@@ -906,6 +933,76 @@ static inline struct list_head *gcwq_determine_ins_pos(struct global_cwq *gcwq,
 	return &twork->entry;
 }
 
+#ifdef CONFIG_WORKQUEUE_STATS
+static inline u64 wq_stat_clock(void)
+{
+	return local_clock();
+}
+
+static inline u64 wq_stat_cputime(void)
+{
+	return task_sched_runtime(current);
+}
+
+static inline void cwq_stat_queued(struct cpu_workqueue_struct *cwq,
+				   struct work_struct *work)
+{
+	work->queued_at = local_clock();
+}
+
+static inline void cwq_stat_activated(struct cpu_workqueue_struct *cwq)
+{
+	if (cwq->nr_active > cwq->stats.peak_active)
+		cwq->stats.peak_active = cwq->nr_active;
+}
+
+static inline void cwq_stat_throttled(struct cpu_workqueue_struct *cwq)
+{
+	cwq->stats.nr_throttled++;
+}
+
+/* Returns how long @work waited; called as a worker claims it. */
+static u64 cwq_stat_start(struct cpu_workqueue_struct *cwq,
+			  struct work_struct *work)
+{
+	struct cwq_stats *st = &cwq->stats;
+	u64 now = local_clock(), lat, lat_us;
+
+	/* clocks of different cpus may be slightly apart */
+	lat = now > work->queued_at ? now - work->queued_at : 0;
+	lat_us = div_u64(lat, NSEC_PER_USEC);
+
+	st->lat_total += lat;
+	if (lat > st->lat_max)
+		st->lat_max = lat;
+	st->lat_hist[min_t(int, fls64(lat_us), CWQ_LAT_BUCKETS - 1)]++;
+	return lat;
+}
+
+static void cwq_stat_done(struct cpu_workqueue_struct *cwq, u64 runtime,
+			  u64 cputime)
+{
+	struct cwq_stats *st = &cwq->stats;
+
+	st->nr_executed++;
+	st->exec_total += runtime;
+	if (runtime > st->exec_max)
+		st->exec_max = runtime;
+	st->cpu_total += cputime;
+}
+#else
+static inline u64 wq_stat_clock(void) { return 0; }
+static inline u64 wq_stat_cputime(void) { return 0; }
+static inline void cwq_stat_queued(struct cpu_workqueue_struct *cwq,
+				   struct work_struct *work) { }
+static inline void cwq_stat_activated(struct cpu_workqueue_struct *cwq) { }
+static inline void cwq_stat_throttled(struct cpu_workqueue_struct *cwq) { }
+static inline u64 cwq_stat_start(struct cpu_workqueue_struct *cwq,
+				 struct work_struct *work) { return 0; }
+static inline void cwq_stat_done(struct cpu_workqueue_struct *cwq,
+				 u64 runtime, u64 cputime) { }
+#endif
+
 /**
  * insert_work - insert a work into gcwq
  * @cwq: cwq @work belongs to
@@ -927,6 +1024,7 @@ static void insert_work(struct cpu_workqueue_struct *cwq,
 
 	/* we own @work, set data and link */
 	set_work_cwq(work, cwq, extra_flags);
+	cwq_stat_queued(cwq, work);
 
 	/*
 	 * Ensure that we get the right work->data if we see the
@@ -1043,10 +1141,12 @@ static void __queue_work(unsigned int cpu, struct workqueue_struct *wq,
 	if (likely(cwq->nr_active < cwq->max_active)) {
 		trace_workqueue_activate_work(work);
 		cwq->nr_active++;
+		cwq_stat_activated(cwq);
 		worklist = gcwq_determine_ins_pos(gcwq, cwq);
 	} else {
 		work_flags |= WORK_STRUCT_DELAYED;
 		worklist = &cwq->delayed_works;
+		cwq_stat_throttled(cwq);
 	}
 
 	insert_work(cwq, work, worklist, work_flags);
@@ -1729,6 +1829,7 @@ static void cwq_activate_first_delayed(struct cpu_workqueue_struct *cwq)
 	move_linked_works(work, pos, NULL);
 	__clear_bit(WORK_STRUCT_DELAYED_BIT, work_data_bits(work));
 	cwq->nr_active++;
+	cwq_stat_activated(cwq);
 }
 
 /**
@@ -1805,6 +1906,7 @@ __acquires(&gcwq->lock)
 	work_func_t f = work->func;
 	int work_color;
 	struct worker *collision;
+	u64 latency, start, cpu_start, runtime, cputime;
 #ifdef CONFIG_LOCKDEP
 	/*
 	 * It is permissible to free the struct work_struct from
@@ -1833,6 +1935,7 @@ __acquires(&gcwq->lock)
 	worker->current_work = work;
 	worker->current_cwq = cwq;
 	work_color = get_work_color(work);
+	latency = cwq_stat_start(cwq, work);
 
 	/* record the current cpu number in the work data and dequeue */
 	set_work_cpu(work, gcwq->cpu);
@@ -1865,13 +1968,17 @@ __acquires(&gcwq->lock)
 	work_clear_pending(work);
 	lock_map_acquire_read(&cwq->wq->lockdep_map);
 	lock_map_acquire(&lockdep_map);
-	trace_workqueue_execute_start(work);
+	trace_workqueue_execute_start(work, latency);
+	start = wq_stat_clock();
+	cpu_start = wq_stat_cputime();
 	f(work);
+	runtime = wq_stat_clock() - start;
+	cputime = wq_stat_cputime() - cpu_start;
 	/*
 	 * While we must be careful to not use "work" after this, the trace
 	 * point will only record its address.
 	 */
-	trace_workqueue_execute_end(work);
+	trace_workqueue_execute_end(work, runtime, cputime);
 	lock_map_release(&lockdep_map);
 	lock_map_release(&cwq->wq->lockdep_map);
 
@@ -1891,6 +1998,8 @@ __acquires(&gcwq->lock)
 	if (unlikely(cpu_intensive))
 		worker_clr_flags(worker, WORKER_CPU_INTENSIVE);
 
+	cwq_stat_done(cwq, runtime, cputime);
+
 	/* we're done with it, release */
 	hlist_del_init(&worker->hentry);
 	worker->current_work = NULL;
@@ -3767,6 +3876,120 @@ out_unlock:
 }
 #endif /* CONFIG_FREEZER */
 
+#ifdef CONFIG_WORKQUEUE_STATS
+/*
+ * <debugfs>/workqueue_stats: one line per workqueue with the statistics
+ * of all its cwqs folded together, followed by the wait time histogram.
+ * Times are in microseconds.  Writing anything clears the statistics.
+ */
+static int wq_stats_show(struct seq_file *m, void *v)
+{
+	struct workqueue_struct *wq;
+	struct cwq_stats sum;
+	unsigned int cpu;
+	int i;
+
+	seq_printf(m, "%-24s %10s %10s %11s %8s %8s %8s %8s %8s\n",
+		   "workqueue", "executed", "throttled", "peak/max", "lat_avg",
+		   "lat_max", "exec_avg", "exec_max", "cpu_avg");
+	seq_printf(m, "  lat_hist: <1us");
+	for (i = 1; i < CWQ_LAT_BUCKETS - 1; i++)
+		seq_printf(m, " <%lu", 1UL << i);
+	seq_printf(m, " >=%lu\n", 1UL << (CWQ_LAT_BUCKETS - 2));
+
+	spin_lock(&workqueue_lock);
+
+	list_for_each_entry(wq, &workqueues, list) {
+		u64 nr;
+
+		memset(&sum, 0, sizeof(sum));
+
+		for_each_cwq_cpu(cpu, wq) {
+			struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+			struct global_cwq *gcwq = cwq->gcwq;
+			struct cwq_stats *st = &cwq->stats;
+
+			spin_lock_irq(&gcwq->lock);
+			sum.nr_executed += st->nr_executed;
+			sum.nr_throttled += st->nr_throttled;
+			sum.lat_total += st->lat_total;
+			sum.lat_max = max(sum.lat_max, st->lat_max);
+			sum.exec_total += st->exec_total;
+			sum.exec_max = max(sum.exec_max, st->exec_max);
+			sum.cpu_total += st->cpu_total;
+			for (i = 0; i < CWQ_LAT_BUCKETS; i++)
+				sum.lat_hist[i] += st->lat_hist[i];
+			sum.peak_active = max(sum.peak_active, st->peak_active);
+			spin_unlock_irq(&gcwq->lock);
+		}
+
+		nr = sum.nr_executed ?: 1;
+		seq_printf(m, "%-24s %10llu %10llu %5d/%-5d %8llu %8llu %8llu "
+			   "%8llu %8llu\n", wq->name,
+			   (unsigned long long)sum.nr_executed,
+			   (unsigned long long)sum.nr_throttled,
+			   sum.peak_active, wq->saved_max_active,
+			   div64_u64(sum.lat_total, nr * NSEC_PER_USEC),
+			   div_u64(sum.lat_max, NSEC_PER_USEC),
+			   div64_u64(sum.exec_total, nr * NSEC_PER_USEC),
+			   div_u64(sum.exec_max, NSEC_PER_USEC),
+			   div64_u64(sum.cpu_total, nr * NSEC_PER_USEC));
+
+		seq_printf(m, "  lat_hist:");
+		for (i = 0; i < CWQ_LAT_BUCKETS; i++)
+			seq_printf(m, " %lu", sum.lat_hist[i]);
+		seq_putc(m, '\n');
+	}
+
+	spin_unlock(&workqueue_lock);
+	return 0;
+}
+
+static ssize_t wq_stats_write(struct file *file, const char __user *buf,
+			      size_t count, loff_t *ppos)
+{
+	struct workqueue_struct *wq;
+	unsigned int cpu;
+
+	spin_lock(&workqueue_lock);
+
+	list_for_each_entry(wq, &workqueues, list) {
+		for_each_cwq_cpu(cpu, wq) {
+			struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+
+			spin_lock_irq(&cwq->gcwq->lock);
+			memset(&cwq->stats, 0, sizeof(cwq->stats));
+			cwq->stats.peak_active = cwq->nr_active;
+			spin_unlock_irq(&cwq->gcwq->lock);
+		}
+	}
+
+	spin_unlock(&workqueue_lock);
+	return count;
+}
+
+static int wq_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, wq_stats_show, NULL);
+}
+
+static const struct file_operations wq_stats_fops = {
+	.open		= wq_stats_open,
+	.read		= seq_read,
+	.write		= wq_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init wq_stats_init(void)
+{
+	debugfs_create_file("workqueue_stats", 0644, NULL, NULL,
+			    &wq_stats_fops);
+	return 0;
+}
+late_initcall(wq_stats_init);
+#endif /* CONFIG_WORKQUEUE_STATS */
+
 static int __init init_workqueues(void)
 {
 	unsigned int cpu;
@@ -99,6 +99,9 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   "BackgroundThresh:   %10lu kB\n"
 		   "BdiWritten:         %10lu kB\n"
 		   "BdiWriteBandwidth:  %10lu kBps\n"
+		   "BdiReadahead:       %10lu kB\n"
+		   "BdiReadaheadHit:    %10lu kB\n"
+		   "BdiReadaheadWasted: %10lu kB\n"
 		   "b_dirty:            %10lu\n"
 		   "b_io:               %10lu\n"
 		   "b_more_io:          %10lu\n"
@@ -111,6 +114,9 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   K(background_thresh),
 		   (unsigned long) K(bdi_stat(bdi, BDI_WRITTEN)),
 		   (unsigned long) K(bdi->write_bandwidth),
+		   (unsigned long) K(bdi_stat(bdi, BDI_RA_SUBMITTED)),
+		   (unsigned long) K(bdi_stat(bdi, BDI_RA_HIT)),
+		   (unsigned long) K(bdi_stat(bdi, BDI_RA_WASTED)),
 		   nr_dirty,
 		   nr_io,
 		   nr_more_io,
@@ -186,6 +192,9 @@ static ssize_t name##_show(struct device *dev,				\
 }
 
 BDI_SHOW(read_ahead_kb, K(bdi->ra_pages))
+BDI_SHOW(read_ahead_submitted_kb, K(bdi_stat(bdi, BDI_RA_SUBMITTED)))
+BDI_SHOW(read_ahead_hit_kb, K(bdi_stat(bdi, BDI_RA_HIT)))
+BDI_SHOW(read_ahead_wasted_kb, K(bdi_stat(bdi, BDI_RA_WASTED)))
 
 static ssize_t min_ratio_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t count)
@@ -229,6 +238,9 @@ static struct device_attribute bdi_dev_attrs[] = {
 	__ATTR_RW(read_ahead_kb),
 	__ATTR_RW(min_ratio),
 	__ATTR_RW(max_ratio),
+	__ATTR_RO(read_ahead_submitted_kb),
+	__ATTR_RO(read_ahead_hit_kb),
+	__ATTR_RO(read_ahead_wasted_kb),
 	__ATTR_NULL,
 };
 
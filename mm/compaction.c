@@ -14,6 +14,9 @@
 #include <linux/backing-dev.h>
 #include <linux/sysctl.h>
 #include <linux/sysfs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/ctype.h>
 #include "internal.h"
 
 #define CREATE_TRACE_POINTS
@@ -42,6 +45,11 @@ struct compact_control {
 	unsigned int order;		/* order a direct compactor needs */
 	int migratetype;		/* MOVABLE, RECLAIMABLE etc */
 	struct zone *zone;
+
+	/* kcompactd: resume where the last run stopped, for max_blocks */
+	bool background;
+	unsigned int nr_blocks;		/* pageblocks scanned in this run */
+	unsigned int max_blocks;	/* pageblocks to scan at most */
 };
 
 static unsigned long release_freepages(struct list_head *freelist)
@@ -442,6 +450,10 @@ static int compact_finished(struct zone *zone,
 	if (cc->free_pfn <= cc->migrate_pfn)
 		return COMPACT_COMPLETE;
 
+	/* Background compaction works a few pageblocks at a time */
+	if (cc->background && cc->nr_blocks >= cc->max_blocks)
+		return COMPACT_PARTIAL;
+
 	/*
 	 * order == -1 is expected when compacting via
 	 * /proc/sys/vm/compact_memory
@@ -456,6 +468,10 @@ static int compact_finished(struct zone *zone,
 	if (!zone_watermark_ok(zone, cc->order, watermark, 0, 0))
 		return COMPACT_CONTINUE;
 
+	/* kcompactd: order sized pages are free in any migratetype */
+	if (cc->background)
+		return COMPACT_PARTIAL;
+
 	/* Direct compactor: Is a suitable page free? */
 	for (order = cc->order; order < MAX_ORDER; order++) {
 		/* Job done if page is free of the right migratetype */
@@ -524,7 +540,9 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 {
 	int ret;
 
-	ret = compaction_suitable(zone, cc->order);
+	/* kcompactd made its own checks, against its own threshold */
+	ret = cc->background ? COMPACT_CONTINUE :
+			       compaction_suitable(zone, cc->order);
 	switch (ret) {
 	case COMPACT_PARTIAL:
 	case COMPACT_SKIPPED:
@@ -540,12 +558,23 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 	cc->free_pfn = cc->migrate_pfn + zone->spanned_pages;
 	cc->free_pfn &= ~(pageblock_nr_pages-1);
 
+	/* Unless kcompactd is picking up where it left off */
+	if (cc->background &&
+	    zone->kcompactd_migrate_pfn >= cc->migrate_pfn &&
+	    zone->kcompactd_free_pfn <= cc->free_pfn &&
+	    zone->kcompactd_migrate_pfn < zone->kcompactd_free_pfn) {
+		cc->migrate_pfn = zone->kcompactd_migrate_pfn;
+		cc->free_pfn = zone->kcompactd_free_pfn;
+	}
+
 	migrate_prep_local();
 
 	while ((ret = compact_finished(zone, cc)) == COMPACT_CONTINUE) {
 		unsigned long nr_migrate, nr_remaining;
 		int err;
 
+		cc->nr_blocks++;
+
 		switch (isolate_migratepages(zone, cc)) {
 		case ISOLATE_ABORT:
 			ret = COMPACT_PARTIAL;
@@ -583,6 +612,16 @@ out:
 	cc->nr_freepages -= release_freepages(&cc->freepages);
 	VM_BUG_ON(cc->nr_freepages != 0);
 
+	if (cc->background) {
+		if (ret == COMPACT_COMPLETE) {
+			zone->kcompactd_migrate_pfn = 0;
+			zone->kcompactd_free_pfn = 0;
+		} else {
+			zone->kcompactd_migrate_pfn = cc->migrate_pfn;
+			zone->kcompactd_free_pfn = cc->free_pfn;
+		}
+	}
+
 	return ret;
 }
 
@@ -626,6 +665,7 @@ unsigned long try_to_compact_pages(struct zonelist *zonelist,
 	struct zoneref *z;
 	struct zone *zone;
 	int rc = COMPACT_SKIPPED;
+	u64 start;
 
 	/*
 	 * Check whether it is worth even starting compaction. The order check is
@@ -636,6 +676,7 @@ unsigned long try_to_compact_pages(struct zonelist *zonelist,
 		return rc;
 
 	count_vm_event(COMPACTSTALL);
+	start = local_clock();
 
 	/* Compact each zone in the list */
 	for_each_zone_zonelist_nodemask(zone, z, zonelist, high_zoneidx,
@@ -650,6 +691,9 @@ unsigned long try_to_compact_pages(struct zonelist *zonelist,
 			break;
 	}
 
+	count_vm_events(COMPACTSTALL_US,
+			div_u64(local_clock() - start, NSEC_PER_USEC));
+
 	return rc;
 }
 
@@ -724,6 +768,342 @@ int sysctl_extfrag_handler(struct ctl_table *table, int write,
 	return 0;
 }
 
+/*
+ * kcompactd: background compaction.
+ *
+ * One thread per node wakes up every kcompactd_sleep_millisecs, and when
+ * an allocation wakes kswapd for a high order, to look at the orders set
+ * in kcompactd_orders. For each zone where allocations of one of those
+ * orders would fail because of fragmentation rather than lack of memory,
+ * that is where the fragmentation index exceeds kcompactd_threshold, it
+ * compacts KCOMPACTD_BLOCKS pageblocks at a time, KCOMPACTD_BATCH_MSECS
+ * apart, until such allocations succeed again at the low watermark. That
+ * way high-order allocations find their pages free, instead of stalling in
+ * direct compaction. After a compaction run went through a whole zone
+ * without meeting that target, kcompactd waits twice as long as the time
+ * before, up to 64 times kcompactd_sleep_millisecs, before trying again.
+ */
+#define KCOMPACTD_BLOCKS	16
+#define KCOMPACTD_BATCH_MSECS	10
+#define KCOMPACTD_MAX_BACKOFF	6
+
+/* Orders kcompactd keeps free pages for, PAGE_ALLOC_COSTLY_ORDER by default */
+static unsigned long kcompactd_orders = 1UL << PAGE_ALLOC_COSTLY_ORDER;
+static unsigned int kcompactd_threshold = 500;
+static unsigned int kcompactd_sleep_millisecs = 1000;
+
+enum kcompactd_result {
+	KCOMPACTD_IDLE,		/* nothing to compact */
+	KCOMPACTD_MORE,		/* some progress, not there yet */
+	KCOMPACTD_FAILED,	/* a zone was compacted in vain */
+};
+
+/* The highest order of kcompactd_orders that @zone needs compacting for */
+static int kcompactd_zone_order(struct zone *zone)
+{
+	unsigned long orders = kcompactd_orders;
+	unsigned long watermark;
+	int order;
+
+	if (!populated_zone(zone))
+		return 0;
+
+	for (order = MAX_ORDER - 1; order > 0; order--) {
+		if (!(orders & (1UL << order)))
+			continue;
+		watermark = low_wmark_pages(zone);
+		if (zone_watermark_ok(zone, order, watermark, 0, 0))
+			continue;
+		/* Too little free memory for compaction to help, see above */
+		watermark += 2UL << order;
+		if (!zone_watermark_ok(zone, 0, watermark, 0, 0))
+			continue;
+		if (fragmentation_index(zone, order) > (int)kcompactd_threshold)
+			return order;
+	}
+	return 0;
+}
+
+static bool kcompactd_node_suitable(pg_data_t *pgdat)
+{
+	int zoneid;
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++)
+		if (kcompactd_zone_order(&pgdat->node_zones[zoneid]))
+			return true;
+	return false;
+}
+
+static enum kcompactd_result kcompactd_do_work(pg_data_t *pgdat)
+{
+	enum kcompactd_result result = KCOMPACTD_IDLE;
+	struct zone *zone;
+	int zoneid, order, ret;
+	u64 start = local_clock();
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct compact_control cc = {
+			.migratetype = MIGRATE_MOVABLE,
+			.sync = false,
+			.background = true,
+			.max_blocks = KCOMPACTD_BLOCKS,
+		};
+
+		zone = &pgdat->node_zones[zoneid];
+		order = kcompactd_zone_order(zone);
+		if (!order)
+			continue;
+
+		cc.order = order;
+		cc.zone = zone;
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		ret = compact_zone(zone, &cc);
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+
+		if (zone_watermark_ok(zone, order, low_wmark_pages(zone), 0, 0)) {
+			count_vm_event(KCOMPACTD_SUCCESS);
+		} else if (ret == COMPACT_COMPLETE) {
+			count_vm_event(KCOMPACTD_FAIL);
+			result = KCOMPACTD_FAILED;
+		} else if (result == KCOMPACTD_IDLE) {
+			result = KCOMPACTD_MORE;
+		}
+
+		if (kthread_should_stop() || freezing(current))
+			break;
+	}
+
+	count_vm_events(KCOMPACTD_US,
+			div_u64(local_clock() - start, NSEC_PER_USEC));
+	return result;
+}
+
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = p;
+	struct task_struct *tsk = current;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+	unsigned long next_try = jiffies;
+	unsigned int backoff = 0;
+	long timeout;
+	DEFINE_WAIT(wait);
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(tsk, cpumask);
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		timeout = msecs_to_jiffies(kcompactd_sleep_millisecs);
+
+		if (backoff && time_before(jiffies, next_try)) {
+			/* Woken early: ignore it, the last run was in vain */
+			timeout = next_try - jiffies;
+		} else if (kcompactd_node_suitable(pgdat)) {
+			count_vm_event(KCOMPACTD_WAKE);
+			switch (kcompactd_do_work(pgdat)) {
+			case KCOMPACTD_FAILED:
+				if (backoff < KCOMPACTD_MAX_BACKOFF)
+					backoff++;
+				/* sleep_millisecs may be up to UINT_MAX */
+				if (timeout > MAX_JIFFY_OFFSET >> backoff)
+					timeout = MAX_JIFFY_OFFSET;
+				else
+					timeout <<= backoff;
+				next_try = jiffies + timeout;
+				break;
+			case KCOMPACTD_MORE:
+				timeout = msecs_to_jiffies(KCOMPACTD_BATCH_MSECS);
+				/* fall through */
+			case KCOMPACTD_IDLE:
+				backoff = 0;
+				break;
+			}
+		} else {
+			backoff = 0;
+		}
+
+		prepare_to_wait(&pgdat->kcompactd_wait, &wait,
+				TASK_INTERRUPTIBLE);
+		if (!kthread_should_stop())
+			schedule_timeout(timeout);
+		finish_wait(&pgdat->kcompactd_wait, &wait);
+
+		try_to_freeze();
+	}
+
+	return 0;
+}
+
+/*
+ * Called from wakeup_kswapd() for high-order allocations, which might
+ * find their pages sooner if kcompactd had a look now.
+ */
+void wakeup_kcompactd(pg_data_t *pgdat, int order)
+{
+	if (!order || !(kcompactd_orders & ~((1UL << order) - 1)))
+		return;
+	if (!waitqueue_active(&pgdat->kcompactd_wait))
+		return;
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+/*
+ * This kcompactd start function will be called by init and node-hot-add.
+ */
+int kcompactd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+
+	if (pgdat->kcompactd)
+		return 0;
+
+	pgdat->kcompactd = kthread_run(kcompactd, pgdat, "kcompactd%d", nid);
+	if (IS_ERR(pgdat->kcompactd)) {
+		printk(KERN_ERR "Failed to start kcompactd on node %d\n", nid);
+		pgdat->kcompactd = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Called by memory hotplug when all memory in a node is offlined.
+ */
+void kcompactd_stop(int nid)
+{
+	struct task_struct *kcompactd = NODE_DATA(nid)->kcompactd;
+
+	if (kcompactd) {
+		kthread_stop(kcompactd);
+		NODE_DATA(nid)->kcompactd = NULL;
+	}
+}
+
+#ifdef CONFIG_SYSFS
+static ssize_t orders_show(struct kobject *kobj,
+			   struct kobj_attribute *attr, char *buf)
+{
+	unsigned long orders = kcompactd_orders;
+	ssize_t len = 0;
+	int order;
+
+	for (order = 1; order < MAX_ORDER; order++)
+		if (orders & (1UL << order))
+			len += sprintf(buf + len, "%s%d", len ? " " : "",
+				       order);
+	len += sprintf(buf + len, "\n");
+	return len;
+}
+
+/* A list of orders, "3" or "2 4" for instance, or "" for none */
+static ssize_t orders_store(struct kobject *kobj,
+			    struct kobj_attribute *attr,
+			    const char *buf, size_t count)
+{
+	unsigned long orders = 0, order;
+	const char *p = buf;
+	char *end;
+
+	while (*p) {
+		if (isspace(*p)) {
+			p++;
+			continue;
+		}
+		order = simple_strtoul(p, &end, 10);
+		if (end == p || !order || order >= MAX_ORDER)
+			return -EINVAL;
+		orders |= 1UL << order;
+		p = end;
+	}
+
+	kcompactd_orders = orders;
+
+	return count;
+}
+static struct kobj_attribute orders_attr =
+	__ATTR(orders, 0644, orders_show, orders_store);
+
+static ssize_t fragindex_threshold_show(struct kobject *kobj,
+					struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", kcompactd_threshold);
+}
+
+static ssize_t fragindex_threshold_store(struct kobject *kobj,
+					 struct kobj_attribute *attr,
+					 const char *buf, size_t count)
+{
+	unsigned long threshold;
+	int err;
+
+	err = strict_strtoul(buf, 10, &threshold);
+	if (err || threshold > 1000)
+		return -EINVAL;
+
+	kcompactd_threshold = threshold;
+
+	return count;
+}
+static struct kobj_attribute fragindex_threshold_attr =
+	__ATTR(fragindex_threshold, 0644, fragindex_threshold_show,
+	       fragindex_threshold_store);
+
+static ssize_t sleep_millisecs_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", kcompactd_sleep_millisecs);
+}
+
+static ssize_t sleep_millisecs_store(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     const char *buf, size_t count)
+{
+	unsigned long msecs;
+	int err;
+
+	err = strict_strtoul(buf, 10, &msecs);
+	if (err || !msecs || msecs > UINT_MAX)
+		return -EINVAL;
+
+	kcompactd_sleep_millisecs = msecs;
+
+	return count;
+}
+static struct kobj_attribute sleep_millisecs_attr =
+	__ATTR(sleep_millisecs, 0644, sleep_millisecs_show,
+	       sleep_millisecs_store);
+
+static struct attribute *kcompactd_attrs[] = {
+	&orders_attr.attr,
+	&fragindex_threshold_attr.attr,
+	&sleep_millisecs_attr.attr,
+	NULL,
+};
+
+static struct attribute_group kcompactd_attr_group = {
+	.attrs = kcompactd_attrs,
+	.name = "kcompactd",
+};
+#endif /* CONFIG_SYSFS */
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+#ifdef CONFIG_SYSFS
+	if (sysfs_create_group(mm_kobj, &kcompactd_attr_group))
+		printk(KERN_ERR "kcompactd: register sysfs failed\n");
+#endif
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		kcompactd_run(nid);
+	return 0;
+}
+module_init(kcompactd_init)
+
 #if defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
 ssize_t sysfs_compact_node(struct sys_device *dev,
 			struct sysdev_attribute *attr,
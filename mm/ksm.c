@@ -36,6 +36,7 @@
 #include <linux/hash.h>
 #include <linux/freezer.h>
 #include <linux/oom.h>
+#include <linux/workqueue.h>
 
 #include <asm/tlbflush.h>
 #include "internal.h"
@@ -78,6 +79,13 @@
  *    take 10 attempts to find a page in the unstable tree, once it is found,
  *    it is secured in the stable tree.  (When we scan a new page, we first
  *    compare it against the stable tree, and then against the unstable tree.)
+ *
+ * Both trees are sorted by the checksum of the pages first, and by their
+ * contents only among pages of equal checksum: most steps of a tree walk
+ * then compare two integers, instead of getting hold of the tree's page
+ * and comparing it with ours.  The checksum of a ksm page is taken when it
+ * is inserted into the stable tree, write-protected; the unstable tree uses
+ * the checksum each page had when it was last found unchanged.
  */
 
 /**
@@ -115,11 +123,13 @@ struct ksm_scan {
  * @node: rb node of this ksm page in the stable tree
  * @hlist: hlist head of rmap_items using this ksm page
  * @kpfn: page frame number of this ksm page
+ * @checksum: checksum of the contents of this ksm page
  */
 struct stable_node {
 	struct rb_node node;
 	struct hlist_head hlist;
 	unsigned long kpfn;
+	unsigned int checksum;
 };
 
 /**
@@ -189,6 +199,47 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/* Number of threads checksumming pages for ksmd, ksmd included */
+static unsigned int ksm_thread_nr_threads = 1;
+
+/* The number of pages scanned, and the number merged, since boot */
+static unsigned long ksm_pages_scanned;
+static unsigned long ksm_pages_merged;
+
+/* Pages scanned and merged per second, over about the last second */
+static unsigned long ksm_scan_rate;
+static unsigned long ksm_merge_rate;
+static unsigned long ksm_rate_stamp;
+static unsigned long ksm_rate_scanned;
+static unsigned long ksm_rate_merged;
+
+/*
+ * ksmd takes pages from the scan cursor a batch at a time, all from the
+ * same mm so that none of their rmap_items can be freed under it, has them
+ * checksummed by up to ksm_thread_nr_threads threads, then merges them one
+ * after another.  Batches are split between threads in chunks of at least
+ * KSM_MIN_PER_THREAD pages.
+ */
+#define KSM_BATCH		64
+#define KSM_MAX_THREADS		16
+#define KSM_MIN_PER_THREAD	8
+
+static struct {
+	unsigned int nr;
+	struct page *page[KSM_BATCH];
+	struct rmap_item *rmap_item[KSM_BATCH];
+	unsigned int checksum[KSM_BATCH];
+} ksm_batch;
+
+struct ksm_checksum_work {
+	struct work_struct work;
+	unsigned int start;
+	unsigned int end;
+};
+
+static struct ksm_checksum_work ksm_checksum_works[KSM_MAX_THREADS];
+static struct workqueue_struct *ksm_checksum_wq;
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
@@ -983,7 +1034,8 @@ static struct page *try_to_merge_two_pages(struct rmap_item *rmap_item,
  * This function returns the stable tree node of identical content if found,
  * NULL otherwise.
  */
-static struct page *stable_tree_search(struct page *page)
+static struct page *stable_tree_search(struct page *page,
+				       unsigned int checksum)
 {
 	struct rb_node *node = root_stable_tree.rb_node;
 	struct stable_node *stable_node;
@@ -1000,6 +1052,14 @@ static struct page *stable_tree_search(struct page *page)
 
 		cond_resched();
 		stable_node = rb_entry(node, struct stable_node, node);
+		if (checksum != stable_node->checksum) {
+			if (checksum < stable_node->checksum)
+				node = node->rb_left;
+			else
+				node = node->rb_right;
+			continue;
+		}
+
 		tree_page = get_ksm_page(stable_node);
 		if (!tree_page)
 			return NULL;
@@ -1031,6 +1091,10 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 	struct rb_node **new = &root_stable_tree.rb_node;
 	struct rb_node *parent = NULL;
 	struct stable_node *stable_node;
+	unsigned int checksum;
+
+	/* Now that kpage is write-protected, its checksum is for good */
+	checksum = calc_checksum(kpage);
 
 	while (*new) {
 		struct page *tree_page;
@@ -1038,6 +1102,15 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 
 		cond_resched();
 		stable_node = rb_entry(*new, struct stable_node, node);
+		if (checksum != stable_node->checksum) {
+			parent = *new;
+			if (checksum < stable_node->checksum)
+				new = &parent->rb_left;
+			else
+				new = &parent->rb_right;
+			continue;
+		}
+
 		tree_page = get_ksm_page(stable_node);
 		if (!tree_page)
 			return NULL;
@@ -1070,6 +1143,7 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 	INIT_HLIST_HEAD(&stable_node->hlist);
 
 	stable_node->kpfn = page_to_pfn(kpage);
+	stable_node->checksum = checksum;
 	set_page_stable_node(kpage, stable_node);
 
 	return stable_node;
@@ -1105,6 +1179,15 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 
 		cond_resched();
 		tree_rmap_item = rb_entry(*new, struct rmap_item, node);
+		if (rmap_item->oldchecksum != tree_rmap_item->oldchecksum) {
+			parent = *new;
+			if (rmap_item->oldchecksum < tree_rmap_item->oldchecksum)
+				new = &parent->rb_left;
+			else
+				new = &parent->rb_right;
+			continue;
+		}
+
 		tree_page = get_mergeable_page(tree_rmap_item);
 		if (IS_ERR_OR_NULL(tree_page))
 			return NULL;
@@ -1157,6 +1240,7 @@ static void stable_tree_append(struct rmap_item *rmap_item,
 		ksm_pages_sharing++;
 	else
 		ksm_pages_shared++;
+	ksm_pages_merged++;
 }
 
 /*
@@ -1167,20 +1251,21 @@ static void stable_tree_append(struct rmap_item *rmap_item,
  *
  * @page: the page that we are searching identical page to.
  * @rmap_item: the reverse mapping into the virtual address of this page
+ * @checksum: the checksum of the page, as taken for this scan
  */
-static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
+static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item,
+			       unsigned int checksum)
 {
 	struct rmap_item *tree_rmap_item;
 	struct page *tree_page = NULL;
 	struct stable_node *stable_node;
 	struct page *kpage;
-	unsigned int checksum;
 	int err;
 
 	remove_rmap_item_from_tree(rmap_item);
 
 	/* We first start with searching the page inside the stable tree */
-	kpage = stable_tree_search(page);
+	kpage = stable_tree_search(page, checksum);
 	if (kpage) {
 		err = try_to_merge_with_ksm_page(rmap_item, page, kpage);
 		if (!err) {
@@ -1202,7 +1287,6 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	 * don't want to insert it in the unstable tree, and we don't want
 	 * to waste our time searching for something identical to it there.
 	 */
-	checksum = calc_checksum(page);
 	if (rmap_item->oldchecksum != checksum) {
 		rmap_item->oldchecksum = checksum;
 		return;
@@ -1272,7 +1356,16 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
-static struct rmap_item *scan_get_next_rmap_item(struct page **page)
+/*
+ * scan_get_next_rmap_item - advance the scan cursor to the next page
+ * @page: where to return the page, with a reference held
+ * @stay: if set, don't move on from the current mm_slot
+ *
+ * Returns the rmap_item for the page, or NULL at the end of a full scan,
+ * or at the end of the current mm_slot's pages if @stay is set.
+ */
+static struct rmap_item *scan_get_next_rmap_item(struct page **page,
+						 bool stay)
 {
 	struct mm_struct *mm;
 	struct mm_slot *slot;
@@ -1358,6 +1451,15 @@ next_mm:
 		}
 	}
 
+	/*
+	 * Leave cleaning up after this mm_slot and moving on to the next
+	 * one until the caller is done with the rmap_items it already has.
+	 */
+	if (stay) {
+		up_read(&mm->mmap_sem);
+		return NULL;
+	}
+
 	if (ksm_test_exit(mm)) {
 		ksm_scan.address = 0;
 		ksm_scan.rmap_list = &slot->rmap_list;
@@ -1403,6 +1505,56 @@ next_mm:
 	return NULL;
 }
 
+static void ksm_checksum_pages(unsigned int start, unsigned int end)
+{
+	unsigned int i;
+
+	for (i = start; i < end; i++) {
+		if (PageKsm(ksm_batch.page[i]) &&
+		    in_stable_tree(ksm_batch.rmap_item[i]))
+			continue;
+		ksm_batch.checksum[i] = calc_checksum(ksm_batch.page[i]);
+	}
+}
+
+static void ksm_checksum_fn(struct work_struct *work)
+{
+	struct ksm_checksum_work *cw;
+
+	cw = container_of(work, struct ksm_checksum_work, work);
+	ksm_checksum_pages(cw->start, cw->end);
+}
+
+/*
+ * Checksum the pages of the batch: ksmd takes the first chunk and queues
+ * the others for the checksum workqueue, then waits for them.
+ */
+static void ksm_checksum_batch(void)
+{
+	unsigned int nr = ksm_batch.nr;
+	unsigned int nr_threads = ksm_thread_nr_threads;
+	struct ksm_checksum_work *cw;
+	unsigned int chunk, i;
+
+	nr_threads = min(nr_threads, DIV_ROUND_UP(nr, KSM_MIN_PER_THREAD));
+	if (!ksm_checksum_wq || !nr_threads)
+		nr_threads = 1;
+	chunk = DIV_ROUND_UP(nr, nr_threads);
+
+	for (i = 1; i < nr_threads; i++) {
+		cw = &ksm_checksum_works[i];
+		cw->start = min(nr, i * chunk);
+		cw->end = min(nr, cw->start + chunk);
+		if (cw->start < cw->end)
+			queue_work(ksm_checksum_wq, &cw->work);
+	}
+
+	ksm_checksum_pages(0, min(nr, chunk));
+
+	for (i = 1; i < nr_threads; i++)
+		flush_work(&ksm_checksum_works[i].work);
+}
+
 /**
  * ksm_do_scan  - the ksm scanner main worker function.
  * @scan_npages - number of pages we want to scan before we return.
@@ -1411,18 +1563,59 @@ static void ksm_do_scan(unsigned int scan_npages)
 {
 	struct rmap_item *rmap_item;
 	struct page *uninitialized_var(page);
+	unsigned int i, batch;
 
-	while (scan_npages-- && likely(!freezing(current))) {
-		cond_resched();
-		rmap_item = scan_get_next_rmap_item(&page);
-		if (!rmap_item)
+	while (scan_npages && likely(!freezing(current))) {
+		batch = min_t(unsigned int, scan_npages, KSM_BATCH);
+		ksm_batch.nr = 0;
+		while (ksm_batch.nr < batch) {
+			cond_resched();
+			rmap_item = scan_get_next_rmap_item(&page,
+							    ksm_batch.nr);
+			if (!rmap_item)
+				break;
+			ksm_batch.page[ksm_batch.nr] = page;
+			ksm_batch.rmap_item[ksm_batch.nr] = rmap_item;
+			ksm_batch.nr++;
+		}
+		if (!ksm_batch.nr)
 			return;
-		if (!PageKsm(page) || !in_stable_tree(rmap_item))
-			cmp_and_merge_page(page, rmap_item);
-		put_page(page);
+
+		ksm_checksum_batch();
+
+		for (i = 0; i < ksm_batch.nr; i++) {
+			page = ksm_batch.page[i];
+			rmap_item = ksm_batch.rmap_item[i];
+			if (!PageKsm(page) || !in_stable_tree(rmap_item))
+				cmp_and_merge_page(page, rmap_item,
+						   ksm_batch.checksum[i]);
+			put_page(page);
+		}
+		ksm_pages_scanned += ksm_batch.nr;
+		scan_npages -= ksm_batch.nr;
 	}
 }
 
+static void ksm_update_rates(bool reset)
+{
+	unsigned long elapsed = jiffies - ksm_rate_stamp;
+
+	if (reset) {
+		ksm_scan_rate = 0;
+		ksm_merge_rate = 0;
+	} else if (elapsed >= HZ) {
+		ksm_scan_rate = (ksm_pages_scanned - ksm_rate_scanned) *
+				HZ / elapsed;
+		ksm_merge_rate = (ksm_pages_merged - ksm_rate_merged) *
+				 HZ / elapsed;
+	} else
+		return;
+
+	ksm_rate_stamp = jiffies;
+	ksm_rate_scanned = ksm_pages_scanned;
+	ksm_rate_merged = ksm_pages_merged;
+}
+
 static int ksmd_should_run(void)
 {
 	return (ksm_run & KSM_RUN_MERGE) && !list_empty(&ksm_mm_head.mm_list);
@@ -1435,8 +1628,10 @@ static int ksm_scan_thread(void *nothing)
 
 	while (!kthread_should_stop()) {
 		mutex_lock(&ksm_thread_mutex);
-		if (ksmd_should_run())
+		if (ksmd_should_run()) {
 			ksm_do_scan(ksm_thread_pages_to_scan);
+			ksm_update_rates(false);
+		}
 		mutex_unlock(&ksm_thread_mutex);
 
 		try_to_freeze();
@@ -1447,11 +1642,38 @@ static int ksm_scan_thread(void *nothing)
 		} else {
 			wait_event_freezable(ksm_thread_wait,
 				ksmd_should_run() || kthread_should_stop());
+			ksm_update_rates(true);
 		}
 	}
 	return 0;
 }
 
+/*
+ * PR_SET_KSM_HOT: scan @mm before the others from now on, or stop doing
+ * so. When marked hot, its mm_slot, if it has one already, moves in front
+ * of those of the mms not marked hot; the mm_slot under the cursor is
+ * left where it is, it is being scanned anyway. An mm that becomes
+ * mergeable later goes to the front in __ksm_enter().
+ */
+int ksm_set_hot(struct mm_struct *mm, bool hot)
+{
+	struct mm_slot *mm_slot;
+
+	if (!hot) {
+		clear_bit(MMF_VM_MERGEABLE_HOT, &mm->flags);
+		return 0;
+	}
+	if (test_and_set_bit(MMF_VM_MERGEABLE_HOT, &mm->flags))
+		return 0;
+
+	spin_lock(&ksm_mmlist_lock);
+	mm_slot = get_mm_slot(mm);
+	if (mm_slot && ksm_scan.mm_slot != mm_slot)
+		list_move(&mm_slot->mm_list, &ksm_mm_head.mm_list);
+	spin_unlock(&ksm_mmlist_lock);
+	return 0;
+}
+
 int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 		unsigned long end, int advice, unsigned long *vm_flags)
 {
@@ -1513,8 +1735,13 @@ int __ksm_enter(struct mm_struct *mm)
 	 * Insert just behind the scanning cursor, to let the area settle
 	 * down a little; when fork is followed by immediate exec, we don't
 	 * want ksmd to waste time setting up and tearing down an rmap_list.
+	 * Hot mms, children of a zygote process for instance, go to the
+	 * front to be scanned first in the next full scan.
 	 */
-	list_add_tail(&mm_slot->mm_list, &ksm_scan.mm_slot->mm_list);
+	if (test_bit(MMF_VM_MERGEABLE_HOT, &mm->flags))
+		list_add(&mm_slot->mm_list, &ksm_mm_head.mm_list);
+	else
+		list_add_tail(&mm_slot->mm_list, &ksm_scan.mm_slot->mm_list);
 	spin_unlock(&ksm_mmlist_lock);
 
 	set_bit(MMF_VM_MERGEABLE, &mm->flags);
@@ -1872,6 +2099,29 @@ static ssize_t pages_to_scan_store(struct kobject *kobj,
 }
 KSM_ATTR(pages_to_scan);
 
+static ssize_t nr_threads_show(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_thread_nr_threads);
+}
+
+static ssize_t nr_threads_store(struct kobject *kobj,
+				struct kobj_attribute *attr,
+				const char *buf, size_t count)
+{
+	int err;
+	unsigned long nr_threads;
+
+	err = strict_strtoul(buf, 10, &nr_threads);
+	if (err || !nr_threads || nr_threads > KSM_MAX_THREADS)
+		return -EINVAL;
+
+	ksm_thread_nr_threads = nr_threads;
+
+	return count;
+}
+KSM_ATTR(nr_threads);
+
 static ssize_t run_show(struct kobject *kobj, struct kobj_attribute *attr,
 			char *buf)
 {
@@ -1966,15 +2216,40 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t pages_scanned_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_scanned);
+}
+KSM_ATTR_RO(pages_scanned);
+
+static ssize_t scan_rate_show(struct kobject *kobj,
+			      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_scan_rate);
+}
+KSM_ATTR_RO(scan_rate);
+
+static ssize_t merge_rate_show(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_merge_rate);
+}
+KSM_ATTR_RO(merge_rate);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
+	&nr_threads_attr.attr,
 	&run_attr.attr,
 	&pages_shared_attr.attr,
 	&pages_sharing_attr.attr,
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&pages_scanned_attr.attr,
+	&scan_rate_attr.attr,
+	&merge_rate_attr.attr,
 	NULL,
 };
 
@@ -1987,12 +2262,18 @@ static struct attribute_group ksm_attr_group = {
 static int __init ksm_init(void)
 {
 	struct task_struct *ksm_thread;
-	int err;
+	int err, i;
 
 	err = ksm_slab_init();
 	if (err)
 		goto out;
 
+	/* Without the workqueue, ksmd checksums all pages itself */
+	ksm_checksum_wq = alloc_workqueue("ksm_checksum", WQ_UNBOUND,
+					  KSM_MAX_THREADS);
+	for (i = 0; i < KSM_MAX_THREADS; i++)
+		INIT_WORK(&ksm_checksum_works[i].work, ksm_checksum_fn);
+
 	ksm_thread = kthread_run(ksm_scan_thread, NULL, "ksmd");
 	if (IS_ERR(ksm_thread)) {
 		printk(KERN_ERR "ksm: creating kthread failed\n");
@@ -111,6 +111,7 @@ success:
 	 * vm_flags is protected by the mmap_sem held in write mode.
 	 */
 	vma->vm_flags = new_flags;
+	mm_vmas_changed(vma->vm_mm);
 
 out:
 	if (error == -ENOMEM)
@@ -21,7 +21,7 @@
  * GNU General Public License for more details.
  */
 
-#include <linux/res_counter.h>
+#include <linux/page_counter.h>
 #include <linux/memcontrol.h>
 #include <linux/cgroup.h>
 #include <linux/mm.h>
@@ -114,6 +114,15 @@ enum mem_cgroup_events_target {
 #define SOFTLIMIT_EVENTS_TARGET (1024)
 #define NUMAINFO_EVENTS_TARGET	(1024)
 
+/*
+ * Statistics and events, but for MEM_CGROUP_EVENTS_COUNT, are counted per
+ * cpu and folded into the counters of the memcg, and into the hierarchical
+ * totals of it and its ancestors, each time a per-cpu count reaches
+ * MEMCG_STAT_BATCH. Reading them costs no more than an atomic read, at the
+ * price of an error of up to MEMCG_STAT_BATCH per cpu.
+ */
+#define MEMCG_STAT_BATCH	32
+
 struct mem_cgroup_stat_cpu {
 	long count[MEM_CGROUP_STAT_NSTATS];
 	unsigned long events[MEM_CGROUP_EVENTS_NSTATS];
@@ -218,13 +227,18 @@ static void mem_cgroup_oom_notify(struct mem_cgroup *mem);
 struct mem_cgroup {
 	struct cgroup_subsys_state css;
 	/*
-	 * the counter to account for memory usage
+	 * the counter to account for memory usage, in pages
 	 */
-	struct res_counter res;
+	struct page_counter res;
 	/*
-	 * the counter to account for mem+swap usage.
+	 * the counter to account for mem+swap usage, in pages
 	 */
-	struct res_counter memsw;
+	struct page_counter memsw;
+	/*
+	 * usage above which the group is reclaimed first under global
+	 * memory pressure, in pages
+	 */
+	unsigned long soft_limit;
 	/*
 	 * Per cgroup active and inactive list, similar to the
 	 * per zone LRU lists.
@@ -281,10 +295,18 @@ struct mem_cgroup {
 	struct mem_cgroup_stat_cpu *stat;
 	/*
 	 * used when a cpu is offlined or other synchronizations
-	 * See mem_cgroup_read_stat().
+	 * See mem_cgroup_start_move().
 	 */
 	struct mem_cgroup_stat_cpu nocpu_base;
 	spinlock_t pcp_counter_lock;
+	/*
+	 * percpu counters folded in, for this memcg and for the hierarchy
+	 * below it. See mem_cgroup_read_stat().
+	 */
+	atomic_long_t vmstat[MEM_CGROUP_STAT_DATA];
+	atomic_long_t vmevents[MEM_CGROUP_EVENTS_NSTATS];
+	atomic_long_t tree_vmstat[MEM_CGROUP_STAT_DATA];
+	atomic_long_t tree_vmevents[MEM_CGROUP_EVENTS_NSTATS];
 };
 
 /* Stuffs for move charges at task migration. */
@@ -351,6 +373,14 @@ enum charge_type {
 #define MEMFILE_ATTR(val)	((val) & 0xffff)
 /* Used for OOM nofiier */
 #define OOM_CONTROL		(0)
+/* Attributes of the _MEM and _MEMSWAP files */
+enum {
+	RES_USAGE,
+	RES_LIMIT,
+	RES_MAX_USAGE,
+	RES_FAILCNT,
+	RES_SOFT_LIMIT,
+};
 
 /*
  * Reclaim flags for mem_cgroup_hierarchical_reclaim
@@ -458,9 +488,17 @@ mem_cgroup_remove_exceeded(struct mem_cgroup *mem,
 }
 
 
+static unsigned long soft_limit_excess(struct mem_cgroup *mem)
+{
+	unsigned long nr_pages = page_counter_read(&mem->res);
+	unsigned long soft_limit = ACCESS_ONCE(mem->soft_limit);
+
+	return nr_pages > soft_limit ? nr_pages - soft_limit : 0;
+}
+
 static void mem_cgroup_update_tree(struct mem_cgroup *mem, struct page *page)
 {
-	unsigned long long excess;
+	unsigned long excess;
 	struct mem_cgroup_per_zone *mz;
 	struct mem_cgroup_tree_per_zone *mctz;
 	int nid = page_to_nid(page);
@@ -473,7 +511,7 @@ static void mem_cgroup_update_tree(struct mem_cgroup *mem, struct page *page)
 	 */
 	for (; mem; mem = parent_mem_cgroup(mem)) {
 		mz = mem_cgroup_zoneinfo(mem, nid, zid);
-		excess = res_counter_soft_limit_excess(&mem->res);
+		excess = soft_limit_excess(mem);
 		/*
 		 * We have to update the tree if mz is on RB-tree or
 		 * mem is over its softlimit.
@@ -527,7 +565,7 @@ retry:
 	 * position in the tree.
 	 */
 	__mem_cgroup_remove_exceeded(mz->mem, mz, mctz);
-	if (!res_counter_soft_limit_excess(&mz->mem->res) ||
+	if (!soft_limit_excess(mz->mem) ||
 		!css_tryget(&mz->mem->css))
 		goto retry;
 done:
@@ -548,71 +586,136 @@ mem_cgroup_largest_soft_limit_node(struct mem_cgroup_tree_per_zone *mctz)
 /*
  * Implementation Note: reading percpu statistics for memcg.
  *
- * Both of vmstat[] and percpu_counter has threshold and do periodic
- * synchronization to implement "quick" read. There are trade-off between
- * reading cost and precision of value. Then, we may have a chance to implement
- * a periodic synchronizion of counter in memcg's counter.
- *
- * But this _read() function is used for user interface now. The user accounts
- * memory usage by memory cgroup and he _always_ requires exact value because
- * he accounts memory. Even if we provide quick-and-fuzzy read, we always
- * have to visit all online cpus and make sum. So, for now, unnecessary
- * synchronization is not implemented. (just implemented for cpu hotplug)
+ * Like vmstat[], the per-cpu counts are folded into the memcg's counters
+ * once they cross a threshold, MEMCG_STAT_BATCH, and reads only look at
+ * those. Each fold also goes to the tree_ counters of the memcg and of all
+ * its ancestors in the hierarchy, so that the totals of memory.stat and the
+ * usage of the root cgroup are as cheap to read as local values, instead
+ * of summing all cpus of all the cgroups of the hierarchy.
  *
- * If there are kernel internal actions which can make use of some not-exact
- * value, and reading all cpu value can be performance bottleneck in some
- * common workload, threashold and synchonization as vmstat[] should be
- * implemented.
+ * The counters can lag behind the exact value by up to MEMCG_STAT_BATCH
+ * pages or events per cpu, and can even be transiently negative. Charges
+ * and limits are exact, they are kept by the page counters.
+ */
+static void mem_cgroup_fold_stat(struct mem_cgroup *mem, int idx, long val)
+{
+	atomic_long_add(val, &mem->vmstat[idx]);
+	for (; mem; mem = parent_mem_cgroup(mem))
+		atomic_long_add(val, &mem->tree_vmstat[idx]);
+}
+
+static void mem_cgroup_fold_events(struct mem_cgroup *mem, int idx,
+				   unsigned long val)
+{
+	atomic_long_add(val, &mem->vmevents[idx]);
+	for (; mem; mem = parent_mem_cgroup(mem))
+		atomic_long_add(val, &mem->tree_vmevents[idx]);
+}
+
+/* Must be called with preemption disabled */
+static void __mem_cgroup_stat_add(struct mem_cgroup *mem,
+				  enum mem_cgroup_stat_index idx, long val)
+{
+	long x = __this_cpu_read(mem->stat->count[idx]) + val;
+
+	if (unlikely(x > MEMCG_STAT_BATCH || x < -MEMCG_STAT_BATCH)) {
+		mem_cgroup_fold_stat(mem, idx, x);
+		x = 0;
+	}
+	__this_cpu_write(mem->stat->count[idx], x);
+}
+
+/* Must be called with preemption disabled */
+static void __mem_cgroup_events_add(struct mem_cgroup *mem,
+				    enum mem_cgroup_events_index idx,
+				    unsigned long val)
+{
+	unsigned long x = __this_cpu_read(mem->stat->events[idx]) + val;
+
+	if (unlikely(x > MEMCG_STAT_BATCH)) {
+		mem_cgroup_fold_events(mem, idx, x);
+		x = 0;
+	}
+	__this_cpu_write(mem->stat->events[idx], x);
+}
+
+/*
+ * Fold what @cpu has not folded yet. The cpu must be dead, or the memcg
+ * unused.
  */
+static void mem_cgroup_fold_cpu(struct mem_cgroup *mem, int cpu)
+{
+	int i;
+
+	for (i = 0; i < MEM_CGROUP_STAT_DATA; i++) {
+		long x = per_cpu(mem->stat->count[i], cpu);
+
+		per_cpu(mem->stat->count[i], cpu) = 0;
+		if (x)
+			mem_cgroup_fold_stat(mem, i, x);
+	}
+	for (i = 0; i < MEM_CGROUP_EVENTS_NSTATS; i++) {
+		unsigned long x = per_cpu(mem->stat->events[i], cpu);
+
+		/* The count only drives the per-cpu event targets */
+		if (i == MEM_CGROUP_EVENTS_COUNT)
+			continue;
+		per_cpu(mem->stat->events[i], cpu) = 0;
+		if (x)
+			mem_cgroup_fold_events(mem, i, x);
+	}
+}
+
 static long mem_cgroup_read_stat(struct mem_cgroup *mem,
 				 enum mem_cgroup_stat_index idx)
 {
-	long val = 0;
-	int cpu;
+	long val = atomic_long_read(&mem->vmstat[idx]);
 
-	get_online_cpus();
-	for_each_online_cpu(cpu)
-		val += per_cpu(mem->stat->count[idx], cpu);
-#ifdef CONFIG_HOTPLUG_CPU
-	spin_lock(&mem->pcp_counter_lock);
-	val += mem->nocpu_base.count[idx];
-	spin_unlock(&mem->pcp_counter_lock);
-#endif
-	put_online_cpus();
-	return val;
+	return val < 0 ? 0 : val;
+}
+
+static long mem_cgroup_read_tree_stat(struct mem_cgroup *mem,
+				      enum mem_cgroup_stat_index idx)
+{
+	long val = atomic_long_read(&mem->tree_vmstat[idx]);
+
+	return val < 0 ? 0 : val;
 }
 
 static void mem_cgroup_swap_statistics(struct mem_cgroup *mem,
 					 bool charge)
 {
 	int val = (charge) ? 1 : -1;
-	this_cpu_add(mem->stat->count[MEM_CGROUP_STAT_SWAPOUT], val);
+
+	preempt_disable();
+	__mem_cgroup_stat_add(mem, MEM_CGROUP_STAT_SWAPOUT, val);
+	preempt_enable();
 }
 
 void mem_cgroup_pgfault(struct mem_cgroup *mem, int val)
 {
-	this_cpu_add(mem->stat->events[MEM_CGROUP_EVENTS_PGFAULT], val);
+	preempt_disable();
+	__mem_cgroup_events_add(mem, MEM_CGROUP_EVENTS_PGFAULT, val);
+	preempt_enable();
 }
 
 void mem_cgroup_pgmajfault(struct mem_cgroup *mem, int val)
 {
-	this_cpu_add(mem->stat->events[MEM_CGROUP_EVENTS_PGMAJFAULT], val);
+	preempt_disable();
+	__mem_cgroup_events_add(mem, MEM_CGROUP_EVENTS_PGMAJFAULT, val);
+	preempt_enable();
 }
 
 static unsigned long mem_cgroup_read_events(struct mem_cgroup *mem,
 					    enum mem_cgroup_events_index idx)
 {
-	unsigned long val = 0;
-	int cpu;
+	return atomic_long_read(&mem->vmevents[idx]);
+}
 
-	for_each_online_cpu(cpu)
-		val += per_cpu(mem->stat->events[idx], cpu);
-#ifdef CONFIG_HOTPLUG_CPU
-	spin_lock(&mem->pcp_counter_lock);
-	val += mem->nocpu_base.events[idx];
-	spin_unlock(&mem->pcp_counter_lock);
-#endif
-	return val;
+static unsigned long mem_cgroup_read_tree_events(struct mem_cgroup *mem,
+					    enum mem_cgroup_events_index idx)
+{
+	return atomic_long_read(&mem->tree_vmevents[idx]);
 }
 
 static void mem_cgroup_charge_statistics(struct mem_cgroup *mem,
@@ -621,15 +724,15 @@ static void mem_cgroup_charge_statistics(struct mem_cgroup *mem,
 	preempt_disable();
 
 	if (file)
-		__this_cpu_add(mem->stat->count[MEM_CGROUP_STAT_CACHE], nr_pages);
+		__mem_cgroup_stat_add(mem, MEM_CGROUP_STAT_CACHE, nr_pages);
 	else
-		__this_cpu_add(mem->stat->count[MEM_CGROUP_STAT_RSS], nr_pages);
+		__mem_cgroup_stat_add(mem, MEM_CGROUP_STAT_RSS, nr_pages);
 
 	/* pagein of a big page is an event. So, ignore page size */
 	if (nr_pages > 0)
-		__this_cpu_inc(mem->stat->events[MEM_CGROUP_EVENTS_PGPGIN]);
+		__mem_cgroup_events_add(mem, MEM_CGROUP_EVENTS_PGPGIN, 1);
 	else {
-		__this_cpu_inc(mem->stat->events[MEM_CGROUP_EVENTS_PGPGOUT]);
+		__mem_cgroup_events_add(mem, MEM_CGROUP_EVENTS_PGPGOUT, 1);
 		nr_pages = -nr_pages; /* for event */
 	}
 
@@ -1243,7 +1346,7 @@ unsigned long mem_cgroup_isolate_pages(unsigned long nr_to_scan,
 	return nr_taken;
 }
 
-#define mem_cgroup_from_res_counter(counter, member)	\
+#define mem_cgroup_from_counter(counter, member)	\
 	container_of(counter, struct mem_cgroup, member)
 
 /**
@@ -1255,12 +1358,25 @@ unsigned long mem_cgroup_isolate_pages(unsigned long nr_to_scan,
  */
 static unsigned long mem_cgroup_margin(struct mem_cgroup *mem)
 {
-	unsigned long long margin;
+	unsigned long margin = 0;
+	unsigned long count;
+	unsigned long limit;
 
-	margin = res_counter_margin(&mem->res);
-	if (do_swap_account)
-		margin = min(margin, res_counter_margin(&mem->memsw));
-	return margin >> PAGE_SHIFT;
+	count = page_counter_read(&mem->res);
+	limit = ACCESS_ONCE(mem->res.limit);
+	if (count < limit)
+		margin = limit - count;
+
+	if (do_swap_account) {
+		count = page_counter_read(&mem->memsw);
+		limit = ACCESS_ONCE(mem->memsw.limit);
+		if (count <= limit)
+			margin = min(margin, limit - count);
+		else
+			margin = 0;
+	}
+
+	return margin;
 }
 
 int mem_cgroup_swappiness(struct mem_cgroup *memcg)
@@ -1415,15 +1531,15 @@ void mem_cgroup_print_oom_info(struct mem_cgroup *memcg, struct task_struct *p)
 	printk(KERN_CONT " as a result of limit of %s\n", memcg_name);
 done:
 
-	printk(KERN_INFO "memory: usage %llukB, limit %llukB, failcnt %llu\n",
-		res_counter_read_u64(&memcg->res, RES_USAGE) >> 10,
-		res_counter_read_u64(&memcg->res, RES_LIMIT) >> 10,
-		res_counter_read_u64(&memcg->res, RES_FAILCNT));
+	printk(KERN_INFO "memory: usage %llukB, limit %llukB, failcnt %lu\n",
+		(u64)page_counter_read(&memcg->res) << (PAGE_SHIFT - 10),
+		(u64)memcg->res.limit << (PAGE_SHIFT - 10),
+		memcg->res.failcnt);
 	printk(KERN_INFO "memory+swap: usage %llukB, limit %llukB, "
-		"failcnt %llu\n",
-		res_counter_read_u64(&memcg->memsw, RES_USAGE) >> 10,
-		res_counter_read_u64(&memcg->memsw, RES_LIMIT) >> 10,
-		res_counter_read_u64(&memcg->memsw, RES_FAILCNT));
+		"failcnt %lu\n",
+		(u64)page_counter_read(&memcg->memsw) << (PAGE_SHIFT - 10),
+		(u64)memcg->memsw.limit << (PAGE_SHIFT - 10),
+		memcg->memsw.failcnt);
 }
 
 /*
@@ -1448,10 +1564,10 @@ u64 mem_cgroup_get_limit(struct mem_cgroup *memcg)
 	u64 limit;
 	u64 memsw;
 
-	limit = res_counter_read_u64(&memcg->res, RES_LIMIT);
+	limit = (u64)memcg->res.limit << PAGE_SHIFT;
 	limit += total_swap_pages << PAGE_SHIFT;
 
-	memsw = res_counter_read_u64(&memcg->memsw, RES_LIMIT);
+	memsw = (u64)memcg->memsw.limit << PAGE_SHIFT;
 	/*
 	 * If memsw is finite and limits the amount of swap space available
 	 * to this memcg, return that limit.
@@ -1660,7 +1776,7 @@ static int mem_cgroup_hierarchical_reclaim(struct mem_cgroup *root_mem,
 	unsigned long excess;
 	unsigned long nr_scanned;
 
-	excess = res_counter_soft_limit_excess(&root_mem->res) >> PAGE_SHIFT;
+	excess = soft_limit_excess(root_mem);
 
 	/* If memsw_is_minimum==1, swap-out is of-no-use. */
 	if (!check_soft && !shrink && root_mem->memsw_is_minimum)
@@ -1724,7 +1840,7 @@ static int mem_cgroup_hierarchical_reclaim(struct mem_cgroup *root_mem,
 			return ret;
 		total += ret;
 		if (check_soft) {
-			if (!res_counter_soft_limit_excess(&root_mem->res))
+			if (!soft_limit_excess(root_mem))
 				return total;
 		} else if (mem_cgroup_margin(root_mem))
 			return total;
@@ -1959,7 +2075,9 @@ void mem_cgroup_update_page_stat(struct page *page,
 		BUG();
 	}
 
-	this_cpu_add(mem->stat->count[idx], val);
+	preempt_disable();
+	__mem_cgroup_stat_add(mem, idx, val);
+	preempt_enable();
 
 out:
 	if (unlikely(need_unlock))
@@ -1972,11 +2090,21 @@ EXPORT_SYMBOL(mem_cgroup_update_page_stat);
 /*
  * size of first charge trial. "32" comes from vmscan.c's magic value.
  * TODO: maybe necessary to use big numbers in big irons.
+ *
+ * A charge takes CHARGE_BATCH pages from the page counters of the cgroup
+ * and all its ancestors, and keeps what it did not use in a per-cpu stock,
+ * so that most charges touch no shared cacheline at all. The stock of a
+ * cpu holds the precharges of the last NR_MEMCG_STOCK cgroups that charged
+ * there, so that tasks of different cgroups sharing a cpu do not give back
+ * each other's precharge at every context switch.
  */
 #define CHARGE_BATCH	32U
+#define NR_MEMCG_STOCK	4
 struct memcg_stock_pcp {
-	struct mem_cgroup *cached; /* this never be root cgroup */
-	unsigned int nr_pages;
+	/* these never be root cgroup */
+	struct mem_cgroup *cached[NR_MEMCG_STOCK];
+	unsigned int nr_pages[NR_MEMCG_STOCK];
+	unsigned int next;	/* slot to reuse when all are taken */
 	struct work_struct work;
 	unsigned long flags;
 #define FLUSHING_CACHED_CHARGE	(0)
@@ -1993,33 +2121,48 @@ static DEFINE_MUTEX(percpu_charge_mutex);
 static bool consume_stock(struct mem_cgroup *mem)
 {
 	struct memcg_stock_pcp *stock;
-	bool ret = true;
+	bool ret = false;
+	int i;
 
 	stock = &get_cpu_var(memcg_stock);
-	if (mem == stock->cached && stock->nr_pages)
-		stock->nr_pages--;
-	else /* need to call res_counter_charge */
-		ret = false;
+	for (i = 0; i < NR_MEMCG_STOCK; i++) {
+		if (mem == stock->cached[i] && stock->nr_pages[i]) {
+			stock->nr_pages[i]--;
+			ret = true;
+			break;
+		}
+	}
 	put_cpu_var(memcg_stock);
 	return ret;
 }
 
 /*
- * Returns stocks cached in percpu to res_counter and reset cached information.
+ * Returns the charges cached in one slot of the stock to the page counters
+ * and resets it.
  */
-static void drain_stock(struct memcg_stock_pcp *stock)
+static void drain_stock_slot(struct memcg_stock_pcp *stock, int i)
 {
-	struct mem_cgroup *old = stock->cached;
-
-	if (stock->nr_pages) {
-		unsigned long bytes = stock->nr_pages * PAGE_SIZE;
+	struct mem_cgroup *old = stock->cached[i];
 
-		res_counter_uncharge(&old->res, bytes);
+	if (stock->nr_pages[i]) {
+		page_counter_uncharge(&old->res, stock->nr_pages[i]);
 		if (do_swap_account)
-			res_counter_uncharge(&old->memsw, bytes);
-		stock->nr_pages = 0;
+			page_counter_uncharge(&old->memsw, stock->nr_pages[i]);
+		stock->nr_pages[i] = 0;
 	}
-	stock->cached = NULL;
+	stock->cached[i] = NULL;
+}
+
+/*
+ * Returns stocks cached in percpu to the page counters and reset cached
+ * information.
+ */
+static void drain_stock(struct memcg_stock_pcp *stock)
+{
+	int i;
+
+	for (i = 0; i < NR_MEMCG_STOCK; i++)
+		drain_stock_slot(stock, i);
 }
 
 /*
@@ -2034,21 +2177,49 @@ static void drain_local_stock(struct work_struct *dummy)
 }
 
 /*
- * Cache charges(val) which is from res_counter, to local per_cpu area.
+ * Cache charges(val) which is from the page counters, to local per_cpu area.
  * This will be consumed by consume_stock() function, later.
  */
 static void refill_stock(struct mem_cgroup *mem, unsigned int nr_pages)
 {
 	struct memcg_stock_pcp *stock = &get_cpu_var(memcg_stock);
+	int i, free = -1;
 
-	if (stock->cached != mem) { /* reset if necessary */
-		drain_stock(stock);
-		stock->cached = mem;
+	for (i = 0; i < NR_MEMCG_STOCK; i++) {
+		if (stock->cached[i] == mem)
+			break;
+		if (!stock->cached[i] && free < 0)
+			free = i;
 	}
-	stock->nr_pages += nr_pages;
+	if (i == NR_MEMCG_STOCK) { /* reset a slot if necessary */
+		if (free < 0) {
+			free = stock->next;
+			stock->next = (free + 1) % NR_MEMCG_STOCK;
+			drain_stock_slot(stock, free);
+		}
+		i = free;
+		stock->cached[i] = mem;
+	}
+	stock->nr_pages[i] += nr_pages;
 	put_cpu_var(memcg_stock);
 }
 
+/* Whether @stock holds charges of @root_mem or of cgroups below it */
+static bool stock_in_subtree(struct memcg_stock_pcp *stock,
+			     struct mem_cgroup *root_mem)
+{
+	struct mem_cgroup *mem;
+	int i;
+
+	for (i = 0; i < NR_MEMCG_STOCK; i++) {
+		mem = stock->cached[i];
+		if (mem && stock->nr_pages[i] &&
+		    mem_cgroup_same_or_subtree(root_mem, mem))
+			return true;
+	}
+	return false;
+}
+
 /*
  * Drains all per-CPU charge caches for given root_mem resp. subtree
  * of the hierarchy under it. sync flag says whether we should block
@@ -2063,12 +2234,8 @@ static void drain_all_stock(struct mem_cgroup *root_mem, bool sync)
 	curcpu = get_cpu();
 	for_each_online_cpu(cpu) {
 		struct memcg_stock_pcp *stock = &per_cpu(memcg_stock, cpu);
-		struct mem_cgroup *mem;
 
-		mem = stock->cached;
-		if (!mem || !stock->nr_pages)
-			continue;
-		if (!mem_cgroup_same_or_subtree(root_mem, mem))
+		if (!stock_in_subtree(stock, root_mem))
 			continue;
 		if (!test_and_set_bit(FLUSHING_CACHED_CHARGE, &stock->flags)) {
 			if (cpu == curcpu)
@@ -2094,8 +2261,8 @@ out:
 /*
  * Tries to drain stocked charges in other cpus. This function is asynchronous
  * and just put a work per cpu for draining localy on each cpu. Caller can
- * expects some charges will be back to res_counter later but cannot wait for
- * it.
+ * expects some charges will be back to the page counters later but cannot wait
+ * for it.
  */
 static void drain_all_stock_async(struct mem_cgroup *root_mem)
 {
@@ -2118,26 +2285,14 @@ static void drain_all_stock_sync(struct mem_cgroup *root_mem)
 }
 
 /*
- * This function drains percpu counter value from DEAD cpu and
- * move it to local cpu. Note that this function can be preempted.
+ * This function folds percpu counter value from DEAD cpu into the
+ * memcg's counters. Note that this function can be preempted.
  */
 static void mem_cgroup_drain_pcp_counter(struct mem_cgroup *mem, int cpu)
 {
-	int i;
+	mem_cgroup_fold_cpu(mem, cpu);
 
 	spin_lock(&mem->pcp_counter_lock);
-	for (i = 0; i < MEM_CGROUP_STAT_DATA; i++) {
-		long x = per_cpu(mem->stat->count[i], cpu);
-
-		per_cpu(mem->stat->count[i], cpu) = 0;
-		mem->nocpu_base.count[i] += x;
-	}
-	for (i = 0; i < MEM_CGROUP_EVENTS_NSTATS; i++) {
-		unsigned long x = per_cpu(mem->stat->events[i], cpu);
-
-		per_cpu(mem->stat->events[i], cpu) = 0;
-		mem->nocpu_base.events[i] += x;
-	}
 	/* need to clear ON_MOVE value, works as a kind of lock. */
 	per_cpu(mem->stat->count[MEM_CGROUP_ON_MOVE], cpu) = 0;
 	spin_unlock(&mem->pcp_counter_lock);
@@ -2190,26 +2345,25 @@ enum {
 static int mem_cgroup_do_charge(struct mem_cgroup *mem, gfp_t gfp_mask,
 				unsigned int nr_pages, bool oom_check)
 {
-	unsigned long csize = nr_pages * PAGE_SIZE;
 	struct mem_cgroup *mem_over_limit;
-	struct res_counter *fail_res;
+	struct page_counter *counter;
 	unsigned long flags = 0;
 	int ret;
 
-	ret = res_counter_charge(&mem->res, csize, &fail_res);
+	ret = page_counter_try_charge(&mem->res, nr_pages, &counter);
 
 	if (likely(!ret)) {
 		if (!do_swap_account)
 			return CHARGE_OK;
-		ret = res_counter_charge(&mem->memsw, csize, &fail_res);
+		ret = page_counter_try_charge(&mem->memsw, nr_pages, &counter);
 		if (likely(!ret))
 			return CHARGE_OK;
 
-		res_counter_uncharge(&mem->res, csize);
-		mem_over_limit = mem_cgroup_from_res_counter(fail_res, memsw);
+		page_counter_uncharge(&mem->res, nr_pages);
+		mem_over_limit = mem_cgroup_from_counter(counter, memsw);
 		flags |= MEM_CGROUP_RECLAIM_NOSWAP;
 	} else
-		mem_over_limit = mem_cgroup_from_res_counter(fail_res, res);
+		mem_over_limit = mem_cgroup_from_counter(counter, res);
 	/*
 	 * nr_pages can be either a huge page (HPAGE_PMD_NR), a batch
 	 * of regular pages (CHARGE_BATCH), or a single regular page (1).
@@ -2401,11 +2555,9 @@ static void __mem_cgroup_cancel_charge(struct mem_cgroup *mem,
 				       unsigned int nr_pages)
 {
 	if (!mem_cgroup_is_root(mem)) {
-		unsigned long bytes = nr_pages * PAGE_SIZE;
-
-		res_counter_uncharge(&mem->res, bytes);
+		page_counter_uncharge(&mem->res, nr_pages);
 		if (do_swap_account)
-			res_counter_uncharge(&mem->memsw, bytes);
+			page_counter_uncharge(&mem->memsw, nr_pages);
 	}
 }
 
@@ -2598,8 +2750,8 @@ static int mem_cgroup_move_account(struct page *page,
 	if (PageCgroupFileMapped(pc)) {
 		/* Update mapped_file data for mem_cgroup */
 		preempt_disable();
-		__this_cpu_dec(from->stat->count[MEM_CGROUP_STAT_FILE_MAPPED]);
-		__this_cpu_inc(to->stat->count[MEM_CGROUP_STAT_FILE_MAPPED]);
+		__mem_cgroup_stat_add(from, MEM_CGROUP_STAT_FILE_MAPPED, -1);
+		__mem_cgroup_stat_add(to, MEM_CGROUP_STAT_FILE_MAPPED, 1);
 		preempt_enable();
 	}
 	mem_cgroup_charge_statistics(from, PageCgroupCache(pc), -nr_pages);
@@ -2870,7 +3022,7 @@ __mem_cgroup_commit_charge_swapin(struct page *page, struct mem_cgroup *ptr,
 			 * calling css_tryget
 			 */
 			if (!mem_cgroup_is_root(memcg))
-				res_counter_uncharge(&memcg->memsw, PAGE_SIZE);
+				page_counter_uncharge(&memcg->memsw, 1);
 			mem_cgroup_swap_statistics(memcg, false);
 			mem_cgroup_put(memcg);
 		}
@@ -2934,8 +3086,8 @@ static void mem_cgroup_do_uncharge(struct mem_cgroup *mem,
 
 	/*
 	 * In typical case, batch->memcg == mem. This means we can
-	 * merge a series of uncharges to an uncharge of res_counter.
-	 * If not, we uncharge res_counter ony by one.
+	 * merge a series of uncharges to an uncharge of the page counters.
+	 * If not, we uncharge them ony by one.
 	 */
 	if (batch->memcg != mem)
 		goto direct_uncharge;
@@ -2945,9 +3097,9 @@ static void mem_cgroup_do_uncharge(struct mem_cgroup *mem,
 		batch->memsw_nr_pages++;
 	return;
 direct_uncharge:
-	res_counter_uncharge(&mem->res, nr_pages * PAGE_SIZE);
+	page_counter_uncharge(&mem->res, nr_pages);
 	if (uncharge_memsw)
-		res_counter_uncharge(&mem->memsw, nr_pages * PAGE_SIZE);
+		page_counter_uncharge(&mem->memsw, nr_pages);
 	if (unlikely(batch->memcg != mem))
 		memcg_oom_recover(mem);
 	return;
@@ -3089,11 +3241,10 @@ void mem_cgroup_uncharge_end(void)
 	 * bacause we hide charges behind us.
 	 */
 	if (batch->nr_pages)
-		res_counter_uncharge(&batch->memcg->res,
-				     batch->nr_pages * PAGE_SIZE);
+		page_counter_uncharge(&batch->memcg->res, batch->nr_pages);
 	if (batch->memsw_nr_pages)
-		res_counter_uncharge(&batch->memcg->memsw,
-				     batch->memsw_nr_pages * PAGE_SIZE);
+		page_counter_uncharge(&batch->memcg->memsw,
+				      batch->memsw_nr_pages);
 	memcg_oom_recover(batch->memcg);
 	/* forget this pointer (for sanity check) */
 	batch->memcg = NULL;
@@ -3146,7 +3297,7 @@ void mem_cgroup_uncharge_swap(swp_entry_t ent)
 		 * This memcg can be obsolete one. We avoid calling css_tryget
 		 */
 		if (!mem_cgroup_is_root(memcg))
-			res_counter_uncharge(&memcg->memsw, PAGE_SIZE);
+			page_counter_uncharge(&memcg->memsw, 1);
 		mem_cgroup_swap_statistics(memcg, false);
 		mem_cgroup_put(memcg);
 	}
@@ -3158,15 +3309,15 @@ void mem_cgroup_uncharge_swap(swp_entry_t ent)
  * @entry: swap entry to be moved
  * @from:  mem_cgroup which the entry is moved from
  * @to:  mem_cgroup which the entry is moved to
- * @need_fixup: whether we should fixup res_counters and refcounts.
+ * @need_fixup: whether we should fixup page counters and refcounts.
  *
  * It succeeds only when the swap_cgroup's record for this entry is the same
  * as the mem_cgroup's id of @from.
  *
  * Returns 0 on success, -EINVAL on failure.
  *
- * The caller must have charged to @to, IOW, called res_counter_charge() about
- * both res and memsw, and called css_get().
+ * The caller must have charged to @to, IOW, called page_counter_try_charge()
+ * about both res and memsw, and called css_get().
  */
 static int mem_cgroup_move_swap_account(swp_entry_t entry,
 		struct mem_cgroup *from, struct mem_cgroup *to, bool need_fixup)
@@ -3181,7 +3332,7 @@ static int mem_cgroup_move_swap_account(swp_entry_t entry,
 		mem_cgroup_swap_statistics(to, true);
 		/*
 		 * This function is only called from task migration context now.
-		 * It postpones res_counter and refcount handling till the end
+		 * It postpones page counter and refcount handling till the end
 		 * of task migration(mem_cgroup_clear_mc()) for performance
 		 * improvement. But we cannot postpone mem_cgroup_get(to)
 		 * because if the process that has been moved to @to does
@@ -3190,14 +3341,14 @@ static int mem_cgroup_move_swap_account(swp_entry_t entry,
 		mem_cgroup_get(to);
 		if (need_fixup) {
 			if (!mem_cgroup_is_root(from))
-				res_counter_uncharge(&from->memsw, PAGE_SIZE);
+				page_counter_uncharge(&from->memsw, 1);
 			mem_cgroup_put(from);
 			/*
 			 * we charged both to->res and to->memsw, so we should
 			 * uncharge to->res.
 			 */
 			if (!mem_cgroup_is_root(to))
-				res_counter_uncharge(&to->res, PAGE_SIZE);
+				page_counter_uncharge(&to->res, 1);
 		}
 		return 0;
 	}
@@ -3357,7 +3508,7 @@ void mem_cgroup_end_migration(struct mem_cgroup *mem,
 
 /*
  * At replace page cache, newpage is not under any memcg but it's on
- * LRU. So, this function doesn't touch res_counter but handles LRU
+ * LRU. So, this function doesn't touch page counters but handles LRU
  * in correct way. Both pages are locked so we cannot race with uncharge.
  */
 void mem_cgroup_replace_page_cache(struct page *oldpage,
@@ -3448,13 +3599,13 @@ void mem_cgroup_print_bad_page(struct page *page)
 static DEFINE_MUTEX(set_limit_mutex);
 
 static int mem_cgroup_resize_limit(struct mem_cgroup *memcg,
-				unsigned long long val)
+				unsigned long val)
 {
 	int retry_count;
-	u64 memswlimit, memlimit;
+	unsigned long memswlimit, memlimit;
 	int ret = 0;
 	int children = mem_cgroup_count_children(memcg);
-	u64 curusage, oldusage;
+	unsigned long curusage, oldusage;
 	int enlarge;
 
 	/*
@@ -3464,7 +3615,7 @@ static int mem_cgroup_resize_limit(struct mem_cgroup *memcg,
 	 */
 	retry_count = MEM_CGROUP_RECLAIM_RETRIES * children;
 
-	oldusage = res_counter_read_u64(&memcg->res, RES_USAGE);
+	oldusage = page_counter_read(&memcg->res);
 
 	enlarge = 0;
 	while (retry_count) {
@@ -3478,18 +3629,18 @@ static int mem_cgroup_resize_limit(struct mem_cgroup *memcg,
 		 * We have to guarantee mem->res.limit < mem->memsw.limit.
 		 */
 		mutex_lock(&set_limit_mutex);
-		memswlimit = res_counter_read_u64(&memcg->memsw, RES_LIMIT);
+		memswlimit = memcg->memsw.limit;
 		if (memswlimit < val) {
 			ret = -EINVAL;
 			mutex_unlock(&set_limit_mutex);
 			break;
 		}
 
-		memlimit = res_counter_read_u64(&memcg->res, RES_LIMIT);
+		memlimit = memcg->res.limit;
 		if (memlimit < val)
 			enlarge = 1;
 
-		ret = res_counter_set_limit(&memcg->res, val);
+		ret = page_counter_limit(&memcg->res, val);
 		if (!ret) {
 			if (memswlimit == val)
 				memcg->memsw_is_minimum = true;
@@ -3504,7 +3655,7 @@ static int mem_cgroup_resize_limit(struct mem_cgroup *memcg,
 		mem_cgroup_hierarchical_reclaim(memcg, NULL, GFP_KERNEL,
 						MEM_CGROUP_RECLAIM_SHRINK,
 						NULL);
-		curusage = res_counter_read_u64(&memcg->res, RES_USAGE);
+		curusage = page_counter_read(&memcg->res);
 		/* Usage is reduced ? */
   		if (curusage >= oldusage)
 			retry_count--;
@@ -3518,17 +3669,17 @@ static int mem_cgroup_resize_limit(struct mem_cgroup *memcg,
 }
 
 static int mem_cgroup_resize_memsw_limit(struct mem_cgroup *memcg,
-					unsigned long long val)
+					unsigned long val)
 {
 	int retry_count;
-	u64 memlimit, memswlimit, oldusage, curusage;
+	unsigned long memlimit, memswlimit, oldusage, curusage;
 	int children = mem_cgroup_count_children(memcg);
 	int ret = -EBUSY;
 	int enlarge = 0;
 
 	/* see mem_cgroup_resize_res_limit */
  	retry_count = children * MEM_CGROUP_RECLAIM_RETRIES;
-	oldusage = res_counter_read_u64(&memcg->memsw, RES_USAGE);
+	oldusage = page_counter_read(&memcg->memsw);
 	while (retry_count) {
 		if (signal_pending(current)) {
 			ret = -EINTR;
@@ -3540,16 +3691,16 @@ static int mem_cgroup_resize_memsw_limit(struct mem_cgroup *memcg,
 		 * We have to guarantee mem->res.limit < mem->memsw.limit.
 		 */
 		mutex_lock(&set_limit_mutex);
-		memlimit = res_counter_read_u64(&memcg->res, RES_LIMIT);
+		memlimit = memcg->res.limit;
 		if (memlimit > val) {
 			ret = -EINVAL;
 			mutex_unlock(&set_limit_mutex);
 			break;
 		}
-		memswlimit = res_counter_read_u64(&memcg->memsw, RES_LIMIT);
+		memswlimit = memcg->memsw.limit;
 		if (memswlimit < val)
 			enlarge = 1;
-		ret = res_counter_set_limit(&memcg->memsw, val);
+		ret = page_counter_limit(&memcg->memsw, val);
 		if (!ret) {
 			if (memlimit == val)
 				memcg->memsw_is_minimum = true;
@@ -3565,7 +3716,7 @@ static int mem_cgroup_resize_memsw_limit(struct mem_cgroup *memcg,
 						MEM_CGROUP_RECLAIM_NOSWAP |
 						MEM_CGROUP_RECLAIM_SHRINK,
 						NULL);
-		curusage = res_counter_read_u64(&memcg->memsw, RES_USAGE);
+		curusage = page_counter_read(&memcg->memsw);
 		/* Usage is reduced ? */
 		if (curusage >= oldusage)
 			retry_count--;
@@ -3642,7 +3793,7 @@ unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
 			} while (1);
 		}
 		__mem_cgroup_remove_exceeded(mz->mem, mz, mctz);
-		excess = res_counter_soft_limit_excess(&mz->mem->res);
+		excess = soft_limit_excess(mz->mem);
 		/*
 		 * One school of thought says that we should not add
 		 * back the node to the tree if reclaim returns 0.
@@ -3780,7 +3931,7 @@ move_account:
 			goto try_to_free;
 		cond_resched();
 	/* "ret" should also be checked to ensure all lists are empty. */
-	} while (mem->res.usage > 0 || ret);
+	} while (page_counter_read(&mem->res) > 0 || ret);
 out:
 	css_put(&mem->css);
 	return ret;
@@ -3795,7 +3946,7 @@ try_to_free:
 	lru_add_drain_all();
 	/* try to free all pages in this cgroup */
 	shrink = 1;
-	while (nr_retries && mem->res.usage > 0) {
+	while (nr_retries && page_counter_read(&mem->res) > 0) {
 		int progress;
 
 		if (signal_pending(current)) {
@@ -3861,67 +4012,72 @@ static int mem_cgroup_hierarchy_write(struct cgroup *cont, struct cftype *cft,
 }
 
 
-static unsigned long mem_cgroup_recursive_stat(struct mem_cgroup *mem,
-					       enum mem_cgroup_stat_index idx)
-{
-	struct mem_cgroup *iter;
-	long val = 0;
-
-	/* Per-cpu values can be negative, use a signed accumulator */
-	for_each_mem_cgroup_tree(iter, mem)
-		val += mem_cgroup_read_stat(iter, idx);
-
-	if (val < 0) /* race ? */
-		val = 0;
-	return val;
-}
-
 static inline u64 mem_cgroup_usage(struct mem_cgroup *mem, bool swap)
 {
 	u64 val;
 
 	if (!mem_cgroup_is_root(mem)) {
 		if (!swap)
-			return res_counter_read_u64(&mem->res, RES_USAGE);
+			val = page_counter_read(&mem->res);
 		else
-			return res_counter_read_u64(&mem->memsw, RES_USAGE);
+			val = page_counter_read(&mem->memsw);
+		return val << PAGE_SHIFT;
 	}
 
-	val = mem_cgroup_recursive_stat(mem, MEM_CGROUP_STAT_CACHE);
-	val += mem_cgroup_recursive_stat(mem, MEM_CGROUP_STAT_RSS);
+	val = mem_cgroup_read_tree_stat(mem, MEM_CGROUP_STAT_CACHE);
+	val += mem_cgroup_read_tree_stat(mem, MEM_CGROUP_STAT_RSS);
 
 	if (swap)
-		val += mem_cgroup_recursive_stat(mem, MEM_CGROUP_STAT_SWAPOUT);
+		val += mem_cgroup_read_tree_stat(mem, MEM_CGROUP_STAT_SWAPOUT);
 
 	return val << PAGE_SHIFT;
 }
 
+/*
+ * Limits are kept in pages but read in bytes. No limit reads as LLONG_MAX,
+ * the RESOURCE_MAX of the res_counters limits used to be kept in, not as
+ * the byte size of PAGE_COUNTER_MAX pages.
+ */
+static u64 mem_cgroup_limit_bytes(unsigned long limit)
+{
+	if (limit == PAGE_COUNTER_MAX)
+		return LLONG_MAX;
+	return (u64)limit << PAGE_SHIFT;
+}
+
 static u64 mem_cgroup_read(struct cgroup *cont, struct cftype *cft)
 {
 	struct mem_cgroup *mem = mem_cgroup_from_cont(cont);
-	u64 val;
+	struct page_counter *counter;
 	int type, name;
 
 	type = MEMFILE_TYPE(cft->private);
 	name = MEMFILE_ATTR(cft->private);
 	switch (type) {
 	case _MEM:
-		if (name == RES_USAGE)
-			val = mem_cgroup_usage(mem, false);
-		else
-			val = res_counter_read_u64(&mem->res, name);
+		counter = &mem->res;
 		break;
 	case _MEMSWAP:
-		if (name == RES_USAGE)
-			val = mem_cgroup_usage(mem, true);
-		else
-			val = res_counter_read_u64(&mem->memsw, name);
+		counter = &mem->memsw;
 		break;
 	default:
 		BUG();
-		break;
 	}
-	return val;
+
+	switch (name) {
+	case RES_USAGE:
+		return mem_cgroup_usage(mem, type == _MEMSWAP);
+	case RES_LIMIT:
+		return mem_cgroup_limit_bytes(counter->limit);
+	case RES_MAX_USAGE:
+		return (u64)counter->watermark << PAGE_SHIFT;
+	case RES_FAILCNT:
+		return counter->failcnt;
+	case RES_SOFT_LIMIT:
+		return mem_cgroup_limit_bytes(mem->soft_limit);
+	default:
+		BUG();
+	}
 }
 /*
  * The user of this function is...
@@ -3932,7 +4088,7 @@ static int mem_cgroup_write(struct cgroup *cont, struct cftype *cft,
 {
 	struct mem_cgroup *memcg = mem_cgroup_from_cont(cont);
 	int type, name;
-	unsigned long long val;
+	unsigned long val;
 	int ret;
 
 	type = MEMFILE_TYPE(cft->private);
@@ -3944,7 +4100,7 @@ static int mem_cgroup_write(struct cgroup *cont, struct cftype *cft,
 			break;
 		}
 		/* This function does all necessary parse...reuse it */
-		ret = res_counter_memparse_write_strategy(buffer, &val);
+		ret = page_counter_memparse(buffer, &val);
 		if (ret)
 			break;
 		if (type == _MEM)
@@ -3953,7 +4109,7 @@ static int mem_cgroup_write(struct cgroup *cont, struct cftype *cft,
 			ret = mem_cgroup_resize_memsw_limit(memcg, val);
 		break;
 	case RES_SOFT_LIMIT:
-		ret = res_counter_memparse_write_strategy(buffer, &val);
+		ret = page_counter_memparse(buffer, &val);
 		if (ret)
 			break;
 		/*
@@ -3961,9 +4117,10 @@ static int mem_cgroup_write(struct cgroup *cont, struct cftype *cft,
 		 * of semantics, for now, we support soft limits for
 		 * control without swap
 		 */
-		if (type == _MEM)
-			ret = res_counter_set_soft_limit(&memcg->res, val);
-		else
+		if (type == _MEM) {
+			memcg->soft_limit = val;
+			ret = 0;
+		} else
 			ret = -EINVAL;
 		break;
 	default:
@@ -3979,8 +4136,8 @@ static void memcg_get_hierarchical_limit(struct mem_cgroup *memcg,
 	struct cgroup *cgroup;
 	unsigned long long min_limit, min_memsw_limit, tmp;
 
-	min_limit = res_counter_read_u64(&memcg->res, RES_LIMIT);
-	min_memsw_limit = res_counter_read_u64(&memcg->memsw, RES_LIMIT);
+	min_limit = memcg->res.limit;
+	min_memsw_limit = memcg->memsw.limit;
 	cgroup = memcg->css.cgroup;
 	if (!memcg->use_hierarchy)
 		goto out;
@@ -3990,14 +4147,14 @@ static void memcg_get_hierarchical_limit(struct mem_cgroup *memcg,
 		memcg = mem_cgroup_from_cont(cgroup);
 		if (!memcg->use_hierarchy)
 			break;
-		tmp = res_counter_read_u64(&memcg->res, RES_LIMIT);
+		tmp = memcg->res.limit;
 		min_limit = min(min_limit, tmp);
-		tmp = res_counter_read_u64(&memcg->memsw, RES_LIMIT);
+		tmp = memcg->memsw.limit;
 		min_memsw_limit = min(min_memsw_limit, tmp);
 	}
 out:
-	*mem_limit = min_limit;
-	*memsw_limit = min_memsw_limit;
+	*mem_limit = mem_cgroup_limit_bytes(min_limit);
+	*memsw_limit = mem_cgroup_limit_bytes(min_memsw_limit);
 	return;
 }
 
@@ -4012,15 +4169,15 @@ static int mem_cgroup_reset(struct cgroup *cont, unsigned int event)
 	switch (name) {
 	case RES_MAX_USAGE:
 		if (type == _MEM)
-			res_counter_reset_max(&mem->res);
+			page_counter_reset_watermark(&mem->res);
 		else
-			res_counter_reset_max(&mem->memsw);
+			page_counter_reset_watermark(&mem->memsw);
 		break;
 	case RES_FAILCNT:
 		if (type == _MEM)
-			res_counter_reset_failcnt(&mem->res);
+			mem->res.failcnt = 0;
 		else
-			res_counter_reset_failcnt(&mem->memsw);
+			mem->memsw.failcnt = 0;
 		break;
 	}
 
@@ -4103,6 +4260,24 @@ struct {
 };
 
 
+static void
+mem_cgroup_get_lru_stat(struct mem_cgroup *mem, struct mcs_total_stat *s)
+{
+	s64 val;
+
+	/* per zone stat */
+	val = mem_cgroup_nr_lru_pages(mem, BIT(LRU_INACTIVE_ANON));
+	s->stat[MCS_INACTIVE_ANON] += val * PAGE_SIZE;
+	val = mem_cgroup_nr_lru_pages(mem, BIT(LRU_ACTIVE_ANON));
+	s->stat[MCS_ACTIVE_ANON] += val * PAGE_SIZE;
+	val = mem_cgroup_nr_lru_pages(mem, BIT(LRU_INACTIVE_FILE));
+	s->stat[MCS_INACTIVE_FILE] += val * PAGE_SIZE;
+	val = mem_cgroup_nr_lru_pages(mem, BIT(LRU_ACTIVE_FILE));
+	s->stat[MCS_ACTIVE_FILE] += val * PAGE_SIZE;
+	val = mem_cgroup_nr_lru_pages(mem, BIT(LRU_UNEVICTABLE));
+	s->stat[MCS_UNEVICTABLE] += val * PAGE_SIZE;
+}
+
 static void
 mem_cgroup_get_local_stat(struct mem_cgroup *mem, struct mcs_total_stat *s)
 {
@@ -4128,26 +4303,38 @@ mem_cgroup_get_local_stat(struct mem_cgroup *mem, struct mcs_total_stat *s)
 	val = mem_cgroup_read_events(mem, MEM_CGROUP_EVENTS_PGMAJFAULT);
 	s->stat[MCS_PGMAJFAULT] += val;
 
-	/* per zone stat */
-	val = mem_cgroup_nr_lru_pages(mem, BIT(LRU_INACTIVE_ANON));
-	s->stat[MCS_INACTIVE_ANON] += val * PAGE_SIZE;
-	val = mem_cgroup_nr_lru_pages(mem, BIT(LRU_ACTIVE_ANON));
-	s->stat[MCS_ACTIVE_ANON] += val * PAGE_SIZE;
-	val = mem_cgroup_nr_lru_pages(mem, BIT(LRU_INACTIVE_FILE));
-	s->stat[MCS_INACTIVE_FILE] += val * PAGE_SIZE;
-	val = mem_cgroup_nr_lru_pages(mem, BIT(LRU_ACTIVE_FILE));
-	s->stat[MCS_ACTIVE_FILE] += val * PAGE_SIZE;
-	val = mem_cgroup_nr_lru_pages(mem, BIT(LRU_UNEVICTABLE));
-	s->stat[MCS_UNEVICTABLE] += val * PAGE_SIZE;
+	mem_cgroup_get_lru_stat(mem, s);
 }
 
 static void
 mem_cgroup_get_total_stat(struct mem_cgroup *mem, struct mcs_total_stat *s)
 {
 	struct mem_cgroup *iter;
+	s64 val;
+
+	/* per cpu stat, already summed up over the hierarchy */
+	val = mem_cgroup_read_tree_stat(mem, MEM_CGROUP_STAT_CACHE);
+	s->stat[MCS_CACHE] += val * PAGE_SIZE;
+	val = mem_cgroup_read_tree_stat(mem, MEM_CGROUP_STAT_RSS);
+	s->stat[MCS_RSS] += val * PAGE_SIZE;
+	val = mem_cgroup_read_tree_stat(mem, MEM_CGROUP_STAT_FILE_MAPPED);
+	s->stat[MCS_FILE_MAPPED] += val * PAGE_SIZE;
+	val = mem_cgroup_read_tree_events(mem, MEM_CGROUP_EVENTS_PGPGIN);
+	s->stat[MCS_PGPGIN] += val;
+	val = mem_cgroup_read_tree_events(mem, MEM_CGROUP_EVENTS_PGPGOUT);
+	s->stat[MCS_PGPGOUT] += val;
+	if (do_swap_account) {
+		val = mem_cgroup_read_tree_stat(mem, MEM_CGROUP_STAT_SWAPOUT);
+		s->stat[MCS_SWAP] += val * PAGE_SIZE;
+	}
+	val = mem_cgroup_read_tree_events(mem, MEM_CGROUP_EVENTS_PGFAULT);
+	s->stat[MCS_PGFAULT] += val;
+	val = mem_cgroup_read_tree_events(mem, MEM_CGROUP_EVENTS_PGMAJFAULT);
+	s->stat[MCS_PGMAJFAULT] += val;
 
+	/* per zone stat */
 	for_each_mem_cgroup_tree(iter, mem)
-		mem_cgroup_get_local_stat(iter, s);
+		mem_cgroup_get_lru_stat(iter, s);
 }
 
 #ifdef CONFIG_NUMA
@@ -4394,12 +4581,14 @@ static int mem_cgroup_usage_register_event(struct cgroup *cgrp,
 	struct mem_cgroup_thresholds *thresholds;
 	struct mem_cgroup_threshold_ary *new;
 	int type = MEMFILE_TYPE(cft->private);
+	unsigned long nr_pages;
 	u64 threshold, usage;
 	int i, size, ret;
 
-	ret = res_counter_memparse_write_strategy(args, &threshold);
+	ret = page_counter_memparse(args, &nr_pages);
 	if (ret)
 		return ret;
+	threshold = (u64)nr_pages << PAGE_SHIFT;
 
 	mutex_lock(&memcg->thresholds_lock);
 
@@ -4840,7 +5029,7 @@ out_free:
 
 static void __mem_cgroup_free(struct mem_cgroup *mem)
 {
-	int node;
+	int node, cpu;
 
 	mem_cgroup_remove_from_trees(mem);
 	free_css_id(&mem_cgroup_subsys, &mem->css);
@@ -4848,6 +5037,10 @@ static void __mem_cgroup_free(struct mem_cgroup *mem)
 	for_each_node_state(node, N_POSSIBLE)
 		free_mem_cgroup_per_zone_info(mem, node);
 
+	/* Leave the ancestors' totals right */
+	for_each_possible_cpu(cpu)
+		mem_cgroup_fold_cpu(mem, cpu);
+
 	free_percpu(mem->stat);
 	if (sizeof(struct mem_cgroup) < PAGE_SIZE)
 		kfree(mem);
@@ -4882,7 +5075,7 @@ static struct mem_cgroup *parent_mem_cgroup(struct mem_cgroup *mem)
 {
 	if (!mem->res.parent)
 		return NULL;
-	return mem_cgroup_from_res_counter(mem->res.parent, res);
+	return mem_cgroup_from_counter(mem->res.parent, res);
 }
 
 #ifdef CONFIG_CGROUP_MEM_RES_CTLR_SWAP
@@ -4958,19 +5151,20 @@ mem_cgroup_create(struct cgroup_subsys *ss, struct cgroup *cont)
 	}
 
 	if (parent && parent->use_hierarchy) {
-		res_counter_init(&mem->res, &parent->res);
-		res_counter_init(&mem->memsw, &parent->memsw);
+		page_counter_init(&mem->res, &parent->res);
+		page_counter_init(&mem->memsw, &parent->memsw);
 		/*
 		 * We increment refcnt of the parent to ensure that we can
-		 * safely access it on res_counter_charge/uncharge.
+		 * safely access it on page_counter_charge/uncharge.
 		 * This refcnt will be decremented when freeing this
 		 * mem_cgroup(see mem_cgroup_put).
 		 */
 		mem_cgroup_get(parent);
 	} else {
-		res_counter_init(&mem->res, NULL);
-		res_counter_init(&mem->memsw, NULL);
+		page_counter_init(&mem->res, NULL);
+		page_counter_init(&mem->memsw, NULL);
 	}
+	mem->soft_limit = PAGE_COUNTER_MAX;
 	mem->last_scanned_child = 0;
 	mem->last_scanned_node = MAX_NUMNODES;
 	INIT_LIST_HEAD(&mem->oom_notify);
@@ -5031,18 +5225,18 @@ static int mem_cgroup_do_precharge(unsigned long count)
 	}
 	/* try to charge at once */
 	if (count > 1) {
-		struct res_counter *dummy;
+		struct page_counter *dummy;
 		/*
 		 * "mem" cannot be under rmdir() because we've already checked
 		 * by cgroup_lock_live_cgroup() that it is not removed and we
 		 * are still under the same cgroup_mutex. So we can postpone
 		 * css_get().
 		 */
-		if (res_counter_charge(&mem->res, PAGE_SIZE * count, &dummy))
+		if (page_counter_try_charge(&mem->res, count, &dummy))
 			goto one_by_one;
-		if (do_swap_account && res_counter_charge(&mem->memsw,
-						PAGE_SIZE * count, &dummy)) {
-			res_counter_uncharge(&mem->res, PAGE_SIZE * count);
+		if (do_swap_account &&
+		    page_counter_try_charge(&mem->memsw, count, &dummy)) {
+			page_counter_uncharge(&mem->res, count);
 			goto one_by_one;
 		}
 		mc.precharge += count;
@@ -5292,8 +5486,7 @@ static void __mem_cgroup_clear_mc(void)
 	if (mc.moved_swap) {
 		/* uncharge swap account from the old cgroup */
 		if (!mem_cgroup_is_root(mc.from))
-			res_counter_uncharge(&mc.from->memsw,
-						PAGE_SIZE * mc.moved_swap);
+			page_counter_uncharge(&mc.from->memsw, mc.moved_swap);
 		__mem_cgroup_put(mc.from, mc.moved_swap);
 
 		if (!mem_cgroup_is_root(mc.to)) {
@@ -5301,8 +5494,7 @@ static void __mem_cgroup_clear_mc(void)
 			 * we charged both to->res and to->memsw, so we should
 			 * uncharge to->res.
 			 */
-			res_counter_uncharge(&mc.to->res,
-						PAGE_SIZE * mc.moved_swap);
+			page_counter_uncharge(&mc.to->res, mc.moved_swap);
 		}
 		/* we've already done mem_cgroup_get(mc.to) */
 		mc.moved_swap = 0;
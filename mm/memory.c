@@ -1120,6 +1120,7 @@ again:
 	init_rss_vec(rss);
 	start_pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
 	pte = start_pte;
+	flush_tlb_batched_pending(mm);
 	arch_enter_lazy_mmu_mode();
 	do {
 		pte_t ptent = *pte;
@@ -3503,6 +3504,245 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Speculative page faults.
+ *
+ * Threads of a big process keep faulting in fresh anonymous memory
+ * (heaps, JIT caches, thread stacks), and each of those faults takes
+ * mmap_sem for read. Once another thread queues for mmap_sem in write
+ * mode to mmap, munmap or mprotect, all of them wait for it.
+ *
+ * A first touch of anonymous memory whose page table already exists is
+ * handled here without mmap_sem. The vma is looked up and its state
+ * copied under mm->mm_rb_lock, the page is allocated and charged with
+ * nothing held, and the pte is only installed if mm->vma_seq shows that
+ * no vma was added, removed or changed in the meantime. The page table
+ * is walked and its lock taken with interrupts disabled: as for
+ * get_user_pages_fast(), page tables are only freed after a TLB flush
+ * IPI, so they cannot go away until we have validated the vma, and with
+ * the vma validated, anything that frees them has to take mm_rb_lock or
+ * the pte lock first. Everything else is left to the mmap_sem path.
+ */
+
+static struct vm_area_struct *spf_find_vma(struct mm_struct *mm,
+					   unsigned long address)
+{
+	struct rb_node *rb_node = mm->mm_rb.rb_node;
+
+	while (rb_node) {
+		struct vm_area_struct *vma;
+
+		vma = rb_entry(rb_node, struct vm_area_struct, vm_rb);
+		if (address >= vma->vm_end)
+			rb_node = rb_node->rb_right;
+		else if (address < vma->vm_start)
+			rb_node = rb_node->rb_left;
+		else
+			return vma;
+	}
+	return NULL;
+}
+
+/*
+ * Walk down to the pmd of @address without allocating anything.
+ * Called with interrupts disabled; returns NULL unless a regular pte
+ * table is mapped there, whose pmd value is stored in @pmdval.
+ */
+static pmd_t *spf_walk(struct mm_struct *mm, unsigned long address,
+		       pmd_t *pmdval)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	pgd = pgd_offset(mm, address);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		return NULL;
+	pud = pud_offset(pgd, address);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		return NULL;
+	pmd = pmd_offset(pud, address);
+	*pmdval = *pmd;
+	barrier();
+	if (pmd_none(*pmdval) || pmd_trans_huge(*pmdval) ||
+	    unlikely(pmd_bad(*pmdval)))
+		return NULL;
+	return pmd;
+}
+
+/*
+ * Lock the pte of @address, and make sure that the vma we sampled
+ * @seq from is still there. On success, returns with the pte mapped
+ * and locked, and mm->mm_rb_lock held for read.
+ */
+static pte_t *spf_lock_pte(struct mm_struct *mm, unsigned long address,
+			   unsigned long seq, spinlock_t **ptlp)
+{
+	spinlock_t *ptl;
+	pmd_t *pmd, pmdval;
+	pte_t *pte = NULL;
+
+	local_irq_disable();
+	pmd = spf_walk(mm, address, &pmdval);
+	if (!pmd)
+		goto out;
+	/* Don't spin with interrupts off, whoever holds it may want an IPI */
+	ptl = pte_lockptr(mm, &pmdval);
+	if (!spin_trylock(ptl))
+		goto out;
+	if (!pmd_same(*pmd, pmdval))
+		goto out_unlock;
+	read_lock(&mm->mm_rb_lock);
+	if (mm->vma_seq != seq) {
+		read_unlock(&mm->mm_rb_lock);
+		goto out_unlock;
+	}
+	pte = pte_offset_map(&pmdval, address);
+	*ptlp = ptl;
+	goto out;
+out_unlock:
+	spin_unlock(ptl);
+out:
+	local_irq_enable();
+	return pte;
+}
+
+static void spf_unlock_pte(struct mm_struct *mm, pte_t *pte, spinlock_t *ptl)
+{
+	read_unlock(&mm->mm_rb_lock);
+	pte_unmap_unlock(pte, ptl);
+}
+
+/**
+ * handle_speculative_fault - try to handle a user page fault without mmap_sem
+ * @mm: the faulting mm, that of current
+ * @address: the faulting address
+ * @flags: FAULT_FLAG_xxx
+ *
+ * Only called for faults on a not present pte, from user mode. Returns 0
+ * if the fault was handled, and VM_FAULT_RETRY if the caller has to take
+ * mmap_sem and go through handle_mm_fault(), including for every fault
+ * that would result in an error.
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+			     unsigned int flags)
+{
+	struct vm_area_struct *vma;
+	struct page *page = NULL;
+	unsigned long vm_flags, seq;
+	pgprot_t vm_page_prot;
+	spinlock_t *ptl;
+	pmd_t *pmd, pmdval;
+	pte_t *pte, entry;
+	int none;
+
+	read_lock(&mm->mm_rb_lock);
+	vma = spf_find_vma(mm, address);
+	/*
+	 * Anonymous memory with an anon_vma and no policy of its own only;
+	 * stacks may need to grow and are left alone as well.
+	 */
+	if (!vma || vma->vm_ops || !vma->anon_vma || vma_policy(vma) ||
+	    (vma->vm_flags & (VM_GROWSDOWN | VM_GROWSUP))) {
+		read_unlock(&mm->mm_rb_lock);
+		return VM_FAULT_RETRY;
+	}
+	vm_flags = vma->vm_flags;
+	vm_page_prot = vma->vm_page_prot;
+	seq = mm->vma_seq;
+	read_unlock(&mm->mm_rb_lock);
+
+	/* Let the regular path deliver the signal */
+	if (flags & FAULT_FLAG_WRITE) {
+		if (!(vm_flags & VM_WRITE))
+			return VM_FAULT_RETRY;
+	} else if (!(vm_flags & (VM_READ | VM_EXEC | VM_WRITE)))
+		return VM_FAULT_RETRY;
+
+	/* Page table allocation is left to the regular path. */
+	local_irq_disable();
+	none = 0;
+	pmd = spf_walk(mm, address, &pmdval);
+	if (pmd) {
+		pte = pte_offset_map(&pmdval, address);
+		none = pte_none(*pte);
+		pte_unmap(pte);
+	}
+	local_irq_enable();
+	if (!none)
+		return VM_FAULT_RETRY;
+
+	__set_current_state(TASK_RUNNING);
+	check_sync_rss_stat(current);
+
+	if (!(flags & FAULT_FLAG_WRITE)) {
+		entry = pte_mkspecial(pfn_pte(my_zero_pfn(address),
+					      vm_page_prot));
+	} else {
+		/*
+		 * The vma may go away while we sleep here: it has no policy
+		 * of its own, so the task's applies anyway.
+		 */
+		page = alloc_zeroed_user_highpage_movable(NULL, address);
+		if (!page)
+			goto abort;
+		__SetPageUptodate(page);
+
+		if (mem_cgroup_newpage_charge(page, mm, GFP_KERNEL)) {
+			page_cache_release(page);
+			goto abort;
+		}
+
+		entry = mk_pte(page, vm_page_prot);
+		if (vm_flags & VM_WRITE)
+			entry = pte_mkwrite(pte_mkdirty(entry));
+	}
+
+	pte = spf_lock_pte(mm, address, seq, &ptl);
+	if (!pte)
+		goto abort_release;
+
+	count_vm_event(PGFAULT);
+	mem_cgroup_count_vm_event(mm, PGFAULT);
+	count_vm_event(SPECULATIVE_PGFAULT);
+
+	/* Someone else populated it meanwhile: that's handled too. */
+	if (!pte_none(*pte)) {
+		spf_unlock_pte(mm, pte, ptl);
+		goto release;
+	}
+
+	/* The vma can't change or go away while we hold mm_rb_lock. */
+	if (page) {
+		inc_mm_counter_fast(mm, MM_ANONPAGES);
+		page_add_new_anon_rmap(page, vma, address);
+	}
+	set_pte_at(mm, address, pte, entry);
+
+	/* No need to invalidate - it was non-present before */
+	update_mmu_cache(vma, address, pte);
+	spf_unlock_pte(mm, pte, ptl);
+	return 0;
+
+abort_release:
+	if (page) {
+		mem_cgroup_uncharge_page(page);
+		page_cache_release(page);
+	}
+abort:
+	count_vm_event(SPECULATIVE_PGFAULT_ABORT);
+	return VM_FAULT_RETRY;
+
+release:
+	if (page) {
+		mem_cgroup_uncharge_page(page);
+		page_cache_release(page);
+	}
+	return 0;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
@@ -623,6 +623,7 @@ static int policy_vma(struct vm_area_struct *vma, struct mempolicy *new)
 	if (!err) {
 		mpol_get(new);
 		vma->vm_policy = new;
+		mm_vmas_changed(vma->vm_mm);
 		mpol_put(old);
 	}
 	return err;
@@ -358,6 +358,7 @@ success:
 		vma->vm_flags = newflags;
 	else
 		munlock_vma_pages_range(vma, start, end);
+	mm_vmas_changed(mm);
 
 out:
 	*prev = vma;
@@ -20,13 +20,21 @@
 
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
- * memset *ra to zero.
+ * memset *ra to zero.  The stride, thrashing and stream state is cleared
+ * here all the same: some callers keep *ra on the stack and don't, and a
+ * stale ra_shift would make ra_max_pages() shift by garbage.
  */
 void
 file_ra_state_init(struct file_ra_state *ra, struct address_space *mapping)
 {
 	ra->ra_pages = mapping->backing_dev_info->ra_pages;
 	ra->prev_pos = -1;
+	ra->stride_prev = 0;
+	ra->stride = 0;
+	ra->stride_count = 0;
+	ra->ra_shift = 0;
+	ra->ra_hits = 0;
+	memset(ra->streams, 0, sizeof(ra->streams));
 }
 EXPORT_SYMBOL_GPL(file_ra_state_init);
 
@@ -177,7 +185,7 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		rcu_read_lock();
 		page = radix_tree_lookup(&mapping->page_tree, page_offset);
 		rcu_read_unlock();
-		if (page)
+		if (page && !radix_tree_exceptional_entry(page))
 			continue;
 
 		page = page_cache_alloc_readahead(mapping);
@@ -255,10 +263,72 @@ unsigned long ra_submit(struct file_ra_state *ra,
 
 	actual = __do_page_cache_readahead(mapping, filp,
 					ra->start, ra->size, ra->async_size);
+	if (actual > 0)
+		__add_bdi_stat(mapping->backing_dev_info, BDI_RA_SUBMITTED,
+			       actual);
 
 	return actual;
 }
 
+/*
+ * Windows are shrunk by half each time readahead pages are found to have
+ * been evicted before they were used, down to 1/8 of ra_pages, and grown
+ * back by one step after every RA_HITS_TO_GROW windows used since then.
+ */
+#define RA_MAX_SHIFT	3
+#define RA_HITS_TO_GROW	8
+
+/*
+ * The largest window for @ra, given the memory left and how readahead
+ * of this file fared recently.
+ */
+static unsigned long ra_max_pages(struct file_ra_state *ra)
+{
+	return max_sane_readahead((ra->ra_pages >> ra->ra_shift) ?: 1);
+}
+
+/*
+ * The reader got to the readahead marker or the end of the current
+ * window, so the pages read ahead for it were worth the I/O.
+ */
+static void ra_window_hit(struct address_space *mapping,
+			  struct file_ra_state *ra)
+{
+	__add_bdi_stat(mapping->backing_dev_info, BDI_RA_HIT, ra->size);
+
+	if (ra->ra_shift && ++ra->ra_hits >= RA_HITS_TO_GROW) {
+		ra->ra_shift--;
+		ra->ra_hits = 0;
+	}
+}
+
+/*
+ * A cache miss inside the current window: the page was read ahead, but
+ * reclaim got to it before the reader did, and probably to the rest of
+ * the window with it. Count what is gone and read ahead less from now on.
+ */
+static void ra_window_thrashed(struct address_space *mapping,
+			       struct file_ra_state *ra, pgoff_t offset)
+{
+	pgoff_t end = ra->start + ra->size;
+	unsigned long wasted = 0;
+	void *page;
+
+	rcu_read_lock();
+	for (; offset < end; offset++) {
+		page = radix_tree_lookup(&mapping->page_tree, offset);
+		if (!page || radix_tree_exceptional_entry(page))
+			wasted++;
+	}
+	rcu_read_unlock();
+
+	__add_bdi_stat(mapping->backing_dev_info, BDI_RA_WASTED, wasted);
+
+	if (ra->ra_shift < RA_MAX_SHIFT)
+		ra->ra_shift++;
+	ra->ra_hits = 0;
+}
+
 /*
  * Set the initial window size, round to next power of 2 and square
  * for small size, x 4 for medium, and x 2 for large
@@ -336,6 +406,110 @@ static unsigned long get_next_ra_size(struct file_ra_state *ra,
  * it approaches max_readhead.
  */
 
+/*
+ * Interleaved streams.
+ *
+ * Readers that alternate between a few sequential streams in one file,
+ * like a zip archive being unpacked or a database joining two tables,
+ * would keep replacing the readahead state with that of the other stream
+ * and never ramp up. Instead, when a new window replaces a valid one, the
+ * old window is kept in ra->streams[], most recently replaced first, and
+ * a read at the marker or at the end of one of those windows switches it
+ * back in.
+ */
+static void ra_save_stream(struct file_ra_state *ra)
+{
+	int i;
+
+	if (!ra->size)
+		return;
+
+	for (i = RA_STREAMS - 1; i > 0; i--)
+		ra->streams[i] = ra->streams[i - 1];
+	ra->streams[0].start = ra->start;
+	ra->streams[0].size = ra->size;
+	ra->streams[0].async_size = ra->async_size;
+}
+
+static int ra_switch_stream(struct file_ra_state *ra, pgoff_t offset)
+{
+	struct file_ra_stream *s, tmp;
+	int i;
+
+	for (i = 0; i < RA_STREAMS; i++) {
+		s = &ra->streams[i];
+		if (!s->size)
+			continue;
+		if (offset != s->start + s->size - s->async_size &&
+		    offset != s->start + s->size)
+			continue;
+
+		tmp = *s;
+		s->start = ra->start;
+		s->size = ra->size;
+		s->async_size = ra->async_size;
+		ra->start = tmp.start;
+		ra->size = tmp.size;
+		ra->async_size = tmp.async_size;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Strided reads.
+ *
+ * Misses a fixed distance apart, like reads of records of a fixed-size
+ * table or of every Nth block of an index, are not sequential and
+ * would be served one by one. Once the same distance has been seen
+ * between three misses in a row, read the next few records ahead as
+ * well, twice as many each time the stride holds, up to the size of a
+ * readahead window. The readahead state of the file is left alone.
+ */
+static int try_stride_readahead(struct address_space *mapping,
+				struct file_ra_state *ra, struct file *filp,
+				pgoff_t offset, unsigned long req_size,
+				unsigned long max)
+{
+	pgoff_t prev = ra->stride_prev;
+	unsigned long nr, i;
+	int actual;
+
+	ra->stride_prev = offset;
+
+	if (offset <= prev || offset - prev <= req_size ||
+	    offset - prev > UINT_MAX) {
+		ra->stride = 0;
+		return 0;
+	}
+	if (offset - prev != ra->stride) {
+		ra->stride = offset - prev;
+		ra->stride_count = 0;
+		return 0;
+	}
+	if (ra->stride_count < 8)
+		ra->stride_count++;
+	if (ra->stride_count < 2)
+		return 0;
+
+	nr = min(1UL << (ra->stride_count - 1), max / req_size);
+	if (!nr)
+		return 0;
+
+	__do_page_cache_readahead(mapping, filp, offset, req_size, 0);
+	for (i = 1; i <= nr; i++) {
+		actual = __do_page_cache_readahead(mapping, filp,
+				offset + i * ra->stride, req_size, 0);
+		if (actual > 0)
+			__add_bdi_stat(mapping->backing_dev_info,
+				       BDI_RA_SUBMITTED, actual);
+	}
+
+	/* The records read ahead won't miss, expect the next one to */
+	ra->stride_prev = offset + nr * ra->stride;
+	return 1;
+}
+
 /*
  * Count contiguously cached pages from @offset-1 to @offset-@max,
  * this count is a conservative estimation of
@@ -349,7 +523,7 @@ static pgoff_t count_history_pages(struct address_space *mapping,
 	pgoff_t head;
 
 	rcu_read_lock();
-	head = radix_tree_prev_hole(&mapping->page_tree, offset - 1, max);
+	head = page_cache_prev_hole(mapping, offset - 1, max);
 	rcu_read_unlock();
 
 	return offset - 1 - head;
@@ -382,6 +556,7 @@ static int try_context_readahead(struct address_space *mapping,
 	if (size >= offset)
 		size *= 2;
 
+	ra_save_stream(ra);
 	ra->start = offset;
 	ra->size = get_init_ra_size(size + req_size, max);
 	ra->async_size = ra->size;
@@ -398,7 +573,7 @@ ondemand_readahead(struct address_space *mapping,
 		   bool hit_readahead_marker, pgoff_t offset,
 		   unsigned long req_size)
 {
-	unsigned long max = max_sane_readahead(ra->ra_pages);
+	unsigned long max = ra_max_pages(ra);
 
 	/*
 	 * start of file
@@ -409,9 +584,12 @@ ondemand_readahead(struct address_space *mapping,
 	/*
 	 * It's the expected callback offset, assume sequential access.
 	 * Ramp up sizes, and push forward the readahead window.
+	 * The same for the window of another stream in the same file.
 	 */
 	if ((offset == (ra->start + ra->size - ra->async_size) ||
-	     offset == (ra->start + ra->size))) {
+	     offset == (ra->start + ra->size)) ||
+	    ra_switch_stream(ra, offset)) {
+		ra_window_hit(mapping, ra);
 		ra->start += ra->size;
 		ra->size = get_next_ra_size(ra, max);
 		ra->async_size = ra->size;
@@ -428,12 +606,13 @@ ondemand_readahead(struct address_space *mapping,
 		pgoff_t start;
 
 		rcu_read_lock();
-		start = radix_tree_next_hole(&mapping->page_tree, offset+1,max);
+		start = page_cache_next_hole(mapping, offset + 1, max);
 		rcu_read_unlock();
 
 		if (!start || start - offset > max)
 			return 0;
 
+		ra_save_stream(ra);
 		ra->start = start;
 		ra->size = start - offset;	/* old async_size */
 		ra->size += req_size;
@@ -442,6 +621,20 @@ ondemand_readahead(struct address_space *mapping,
 		goto readit;
 	}
 
+	/*
+	 * The page was read ahead, but did not stay around long enough
+	 * to be used: shrink the window and start over from here. Misses
+	 * behind the last read position are pages that were used already
+	 * and are read again, not read ahead in vain.
+	 */
+	if (ra->size && ra_has_index(ra, offset) &&
+	    (loff_t)offset >= (ra->prev_pos >> PAGE_CACHE_SHIFT)) {
+		ra_window_thrashed(mapping, ra, offset);
+		max = ra_max_pages(ra);
+		ra->size = 0;
+		goto initial_readahead;
+	}
+
 	/*
 	 * oversize read
 	 */
@@ -461,6 +654,13 @@ ondemand_readahead(struct address_space *mapping,
 	if (try_context_readahead(mapping, ra, offset, req_size, max))
 		goto readit;
 
+	/*
+	 * Random at first sight, but maybe the same distance away from
+	 * the last one as that was from the one before.
+	 */
+	if (try_stride_readahead(mapping, ra, filp, offset, req_size, max))
+		return 0;
+
 	/*
 	 * standalone, small random read
 	 * Read as is, and do not pollute the readahead state.
@@ -468,6 +668,7 @@ ondemand_readahead(struct address_space *mapping,
 	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
 
 initial_readahead:
+	ra_save_stream(ra);
 	ra->start = offset;
 	ra->size = get_init_ra_size(req_size, max);
 	ra->async_size = ra->size > req_size ? ra->size - req_size : ra->size;
@@ -3863,6 +3863,87 @@ void kmem_cache_free(struct kmem_cache *cachep, void *objp)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/**
+ * kmem_cache_alloc_bulk - Allocate a number of objects
+ * @cachep: The cache to allocate from.
+ * @flags: See kmalloc().
+ * @size: The number of objects to allocate.
+ * @p: Array the objects are returned in.
+ *
+ * Like calling kmem_cache_alloc() @size times, but interrupts are disabled
+ * only once. Either all objects are allocated and @size is returned, or
+ * none are and 0 is returned.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *cachep, gfp_t flags,
+			  size_t size, void **p)
+{
+	unsigned long save_flags;
+	size_t i, j;
+
+	flags &= gfp_allowed_mask;
+
+	lockdep_trace_alloc(flags);
+
+	if (slab_should_failslab(cachep, flags))
+		return 0;
+
+	cache_alloc_debugcheck_before(cachep, flags);
+	local_irq_save(save_flags);
+	for (i = 0; i < size; i++) {
+		p[i] = __do_cache_alloc(cachep, flags);
+		if (unlikely(!p[i]))
+			break;
+	}
+	local_irq_restore(save_flags);
+
+	for (j = 0; j < i; j++) {
+		p[j] = cache_alloc_debugcheck_after(cachep, flags, p[j],
+						    __builtin_return_address(0));
+		kmemleak_alloc_recursive(p[j], obj_size(cachep), 1,
+					 cachep->flags, flags);
+		kmemcheck_slab_alloc(cachep, flags, p[j], obj_size(cachep));
+		if (unlikely(flags & __GFP_ZERO))
+			memset(p[j], 0, obj_size(cachep));
+		trace_kmem_cache_alloc(_RET_IP_, p[j], obj_size(cachep),
+				       cachep->buffer_size, flags);
+	}
+
+	if (unlikely(i < size)) {
+		kmem_cache_free_bulk(cachep, i, p);
+		return 0;
+	}
+	return size;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
+/**
+ * kmem_cache_free_bulk - Deallocate a number of objects
+ * @cachep: The cache the allocations were from.
+ * @size: The number of objects to free.
+ * @p: Array of the previously allocated objects.
+ *
+ * Like calling kmem_cache_free() for each object, but interrupts are
+ * disabled only once.
+ */
+void kmem_cache_free_bulk(struct kmem_cache *cachep, size_t size, void **p)
+{
+	unsigned long flags;
+	size_t i;
+
+	local_irq_save(flags);
+	for (i = 0; i < size; i++) {
+		debug_check_no_locks_freed(p[i], obj_size(cachep));
+		if (!(cachep->flags & SLAB_DEBUG_OBJECTS))
+			debug_check_no_obj_freed(p[i], obj_size(cachep));
+		__cache_free(cachep, p[i], __builtin_return_address(0));
+	}
+	local_irq_restore(flags);
+
+	for (i = 0; i < size; i++)
+		trace_kmem_cache_free(_RET_IP_, p[i]);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
 /**
  * kfree - free previously allocated memory
  * @objp: pointer returned by kmalloc.
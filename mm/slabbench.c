@@ -0,0 +1,288 @@
+/*
+ * Slab allocator benchmark module
+ *
+ * Loading the module creates a cache and measures, on the current cpu,
+ * back to back allocation and free of one object and allocation of a
+ * batch of objects followed by freeing all of them, the same for small
+ * batches of 1 to 64 objects through kmem_cache_alloc_bulk() and
+ * kmem_cache_free_bulk() against a loop of single calls, and then, with one
+ * thread per online cpu, allocation of a batch on every cpu at once
+ * followed by each cpu freeing the batch its neighbour allocated. The
+ * last test is the producer/consumer pattern of network buffers and
+ * block requests that completes on another cpu and hits the partial
+ * list handling of the allocator. Results are printed to the kernel log
+ * when loading completes.
+ *
+ * The cache is kept until the module is unloaded so that its statistics
+ * in /sys/kernel/slab/slabbench (with CONFIG_SLUB_STATS) can be read.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+static unsigned int object_size = 256;
+module_param(object_size, uint, 0444);
+MODULE_PARM_DESC(object_size, "Size of the objects allocated");
+
+static unsigned int nr_objects = 1000;
+module_param(nr_objects, uint, 0444);
+MODULE_PARM_DESC(nr_objects, "Number of objects in a batch");
+
+static unsigned int nr_loops = 1000;
+module_param(nr_loops, uint, 0444);
+MODULE_PARM_DESC(nr_loops, "Number of batches per test");
+
+static unsigned int nr_cpus;
+module_param(nr_cpus, uint, 0444);
+MODULE_PARM_DESC(nr_cpus, "Cpus in the cross cpu test (default all online)");
+
+struct bench_thread {
+	struct task_struct *tsk;
+	void **objs;
+	u64 alloc_ns;
+	u64 free_ns;
+};
+
+static struct kmem_cache *cache;
+static struct bench_thread *threads;
+static atomic_t nr_busy;
+static atomic_t barrier_count;
+static atomic_t barrier_gen;
+static DECLARE_COMPLETION(bench_done);
+
+static void report(const char *what, unsigned long nr, u64 ns)
+{
+	printk(KERN_INFO "slabbench: %-12s %lu ops %llu ns/op\n", what, nr,
+	       (unsigned long long)div_u64(ns, nr ?: 1));
+}
+
+/* Wait until all @nr threads got here. */
+static void bench_barrier(unsigned int nr)
+{
+	int gen = atomic_read(&barrier_gen);
+
+	if (atomic_inc_return(&barrier_count) == nr) {
+		atomic_set(&barrier_count, 0);
+		atomic_inc(&barrier_gen);
+	} else {
+		while (atomic_read(&barrier_gen) == gen)
+			cpu_relax();
+	}
+}
+
+static void free_objs(void **objs, unsigned int nr)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr; i++)
+		if (objs[i])
+			kmem_cache_free(cache, objs[i]);
+}
+
+static void bench_local(void **objs)
+{
+	unsigned long i, j;
+	u64 t0, alloc_ns = 0, free_ns = 0;
+
+	t0 = local_clock();
+	for (i = 0; i < (unsigned long)nr_loops * nr_objects; i++) {
+		void *p = kmem_cache_alloc(cache, GFP_KERNEL);
+
+		if (!p)
+			break;
+		kmem_cache_free(cache, p);
+	}
+	report("fast", i, local_clock() - t0);
+
+	for (i = 0; i < nr_loops; i++) {
+		t0 = local_clock();
+		for (j = 0; j < nr_objects; j++)
+			objs[j] = kmem_cache_alloc(cache, GFP_KERNEL);
+		alloc_ns += local_clock() - t0;
+
+		t0 = local_clock();
+		free_objs(objs, nr_objects);
+		free_ns += local_clock() - t0;
+		cond_resched();
+	}
+	report("batch alloc", (unsigned long)nr_loops * nr_objects, alloc_ns);
+	report("batch free", (unsigned long)nr_loops * nr_objects, free_ns);
+}
+
+#define MAX_BULK	64
+
+/*
+ * Allocate and free @nr objects at a time, one by one or in bulk, until
+ * about nr_loops * nr_objects objects went through the cache.
+ */
+static u64 bench_bulk_size(void **objs, unsigned int nr, int bulk,
+			   unsigned long *ops)
+{
+	unsigned long i, rounds;
+	unsigned int j;
+	u64 t0;
+
+	rounds = (unsigned long)nr_loops * nr_objects / nr ?: 1;
+	*ops = 0;
+
+	t0 = local_clock();
+	for (i = 0; i < rounds; i++) {
+		if (bulk) {
+			if (!kmem_cache_alloc_bulk(cache, GFP_KERNEL, nr, objs))
+				break;
+			kmem_cache_free_bulk(cache, nr, objs);
+		} else {
+			for (j = 0; j < nr; j++)
+				objs[j] = kmem_cache_alloc(cache, GFP_KERNEL);
+			free_objs(objs, nr);
+		}
+		*ops += nr;
+	}
+	return local_clock() - t0;
+}
+
+static void bench_bulk(void **objs)
+{
+	unsigned int nr;
+	unsigned long ops;
+	u64 ns;
+
+	for (nr = 1; nr <= MAX_BULK; nr *= 2) {
+		ns = bench_bulk_size(objs, nr, 0, &ops);
+		printk(KERN_INFO "slabbench: bulk %2u   single %llu ns/obj",
+		       nr, (unsigned long long)div_u64(ns, ops ?: 1));
+		ns = bench_bulk_size(objs, nr, 1, &ops);
+		printk(KERN_CONT "  bulk %llu ns/obj\n",
+		       (unsigned long long)div_u64(ns, ops ?: 1));
+		cond_resched();
+	}
+}
+
+static int bench_remote_thread(void *data)
+{
+	struct bench_thread *t = data;
+	struct bench_thread *next;
+	unsigned int i, j;
+	u64 t0;
+
+	next = &threads[(t - threads + 1) % nr_cpus];
+
+	for (i = 0; i < nr_loops; i++) {
+		t0 = local_clock();
+		for (j = 0; j < nr_objects; j++)
+			t->objs[j] = kmem_cache_alloc(cache, GFP_KERNEL);
+		t->alloc_ns += local_clock() - t0;
+
+		bench_barrier(nr_cpus);
+
+		t0 = local_clock();
+		free_objs(next->objs, nr_objects);
+		t->free_ns += local_clock() - t0;
+
+		bench_barrier(nr_cpus);
+	}
+
+	if (atomic_dec_and_test(&nr_busy))
+		complete(&bench_done);
+	return 0;
+}
+
+static void bench_remote(void)
+{
+	unsigned int i, cpu;
+	u64 alloc_ns = 0, free_ns = 0;
+
+	i = 0;
+	for_each_online_cpu(cpu) {
+		if (i == nr_cpus)
+			break;
+		threads[i].tsk = kthread_create(bench_remote_thread,
+						&threads[i], "slabbench/%u",
+						cpu);
+		if (IS_ERR(threads[i].tsk)) {
+			printk(KERN_ERR "slabbench: cannot start threads\n");
+			while (i--)
+				kthread_stop(threads[i].tsk);
+			return;
+		}
+		kthread_bind(threads[i].tsk, cpu);
+		i++;
+	}
+
+	atomic_set(&nr_busy, nr_cpus);
+	for (i = 0; i < nr_cpus; i++)
+		wake_up_process(threads[i].tsk);
+	wait_for_completion(&bench_done);
+
+	for (i = 0; i < nr_cpus; i++) {
+		alloc_ns += threads[i].alloc_ns;
+		free_ns += threads[i].free_ns;
+	}
+	printk(KERN_INFO "slabbench: cross cpu on %u cpus\n", nr_cpus);
+	report("remote alloc", (unsigned long)nr_loops * nr_objects *
+	       nr_cpus, alloc_ns);
+	report("remote free", (unsigned long)nr_loops * nr_objects *
+	       nr_cpus, free_ns);
+}
+
+static int __init slabbench_init(void)
+{
+	unsigned int i;
+	int ret = -ENOMEM;
+
+	if (!object_size || !nr_objects || !nr_loops)
+		return -EINVAL;
+
+	if (!nr_cpus || nr_cpus > num_online_cpus())
+		nr_cpus = num_online_cpus();
+
+	cache = kmem_cache_create("slabbench", object_size, 0, 0, NULL);
+	if (!cache)
+		return -ENOMEM;
+
+	threads = kzalloc(nr_cpus * sizeof(*threads), GFP_KERNEL);
+	if (!threads)
+		goto out_cache;
+
+	for (i = 0; i < nr_cpus; i++) {
+		threads[i].objs = vzalloc(max_t(unsigned int, nr_objects, MAX_BULK) *
+					  sizeof(void *));
+		if (!threads[i].objs)
+			goto out_objs;
+	}
+
+	bench_local(threads[0].objs);
+	bench_bulk(threads[0].objs);
+	bench_remote();
+	ret = 0;
+
+out_objs:
+	for (i = 0; i < nr_cpus; i++)
+		vfree(threads[i].objs);
+	kfree(threads);
+	if (!ret)
+		return 0;
+out_cache:
+	kmem_cache_destroy(cache);
+	return ret;
+}
+
+static void __exit slabbench_exit(void)
+{
+	kmem_cache_destroy(cache);
+}
+
+module_init(slabbench_init);
+module_exit(slabbench_exit);
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Slab allocator benchmark");
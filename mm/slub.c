@@ -1551,64 +1551,79 @@ static inline void remove_partial(struct kmem_cache_node *n,
 }
 
 /*
- * Lock slab, remove from the partial list and put the object into the
- * per cpu freelist.
+ * Take the list_lock of a node, counting how often somebody else held it.
+ */
+static inline void lock_node_list(struct kmem_cache *s,
+					struct kmem_cache_node *n)
+{
+	if (!spin_trylock(&n->list_lock)) {
+		stat(s, LIST_LOCK_CONTENDED);
+		spin_lock(&n->list_lock);
+	}
+}
+
+/*
+ * Lock slab, remove from the partial list and return its freelist.
+ *
+ * If @mode is set the slab becomes the cpu slab: the freelist is zapped
+ * and handed to the caller as the per cpu allocation list. Otherwise the
+ * slab is only frozen and keeps its freelist, to be put onto the per cpu
+ * partial list.
  *
  * Must hold list_lock.
  */
-static inline int acquire_slab(struct kmem_cache *s,
-		struct kmem_cache_node *n, struct page *page)
+static inline void *acquire_slab(struct kmem_cache *s,
+		struct kmem_cache_node *n, struct page *page, int mode)
 {
 	void *freelist;
 	unsigned long counters;
 	struct page new;
 
-	/*
-	 * Zap the freelist and set the frozen bit.
-	 * The old freelist is the list of objects for the
-	 * per cpu allocation list.
-	 */
 	do {
 		freelist = page->freelist;
 		counters = page->counters;
 		new.counters = counters;
-		new.inuse = page->objects;
+		if (mode)
+			new.inuse = page->objects;
 
 		VM_BUG_ON(new.frozen);
 		new.frozen = 1;
 
 	} while (!__cmpxchg_double_slab(s, page,
 			freelist, counters,
-			NULL, new.counters,
+			mode ? NULL : freelist, new.counters,
 			"lock and freeze"));
 
 	remove_partial(n, page);
 
-	if (freelist) {
-		/* Populate the per cpu freelist */
-		this_cpu_write(s->cpu_slab->freelist, freelist);
-		this_cpu_write(s->cpu_slab->page, page);
-		this_cpu_write(s->cpu_slab->node, page_to_nid(page));
-		return 1;
-	} else {
+	if (!freelist)
 		/*
 		 * Slab page came from the wrong list. No object to allocate
-		 * from. Put it onto the correct list and continue partial
-		 * scan.
+		 * from.
 		 */
 		printk(KERN_ERR "SLUB: %s : Page without available objects on"
 			" partial list\n", s->name);
-		return 0;
-	}
+
+	return freelist;
 }
 
+static int put_cpu_partial(struct kmem_cache *s, struct page *page, int drain);
+
 /*
  * Try to allocate a partial slab from a specific node.
+ *
+ * The first slab found becomes the cpu slab and its first free object is
+ * returned. Further slabs are moved to the per cpu partial list until it
+ * holds about half of s->cpu_partial objects, so that the next few refills
+ * do not have to take the list_lock again.
  */
-static struct page *get_partial_node(struct kmem_cache *s,
-					struct kmem_cache_node *n)
+static void *get_partial_node(struct kmem_cache *s,
+		struct kmem_cache_node *n, struct kmem_cache_cpu *c)
 {
-	struct page *page;
+	struct page *page, *page2;
+	void *object = NULL;
+	void *t;
+	int available = 0;
 
 	/*
 	 * Racy check. If we mistakenly see no partial slabs then we
@@ -1619,27 +1634,43 @@ static struct page *get_partial_node(struct kmem_cache *s,
 	if (!n || !n->nr_partial)
 		return NULL;
 
-	spin_lock(&n->list_lock);
-	list_for_each_entry(page, &n->partial, lru)
-		if (acquire_slab(s, n, page))
-			goto out;
-	page = NULL;
-out:
+	lock_node_list(s, n);
+	list_for_each_entry_safe(page, page2, &n->partial, lru) {
+		int objects = page->objects - page->inuse;
+
+		t = acquire_slab(s, n, page, object == NULL);
+		if (!t)
+			break;
+
+		if (!object) {
+			c->page = page;
+			c->node = page_to_nid(page);
+			stat(s, ALLOC_FROM_PARTIAL);
+			object = t;
+			available = objects;
+		} else {
+			available = put_cpu_partial(s, page, 0);
+			stat(s, CPU_PARTIAL_NODE);
+		}
+		if (kmem_cache_debug(s) || available > s->cpu_partial / 2)
+			break;
+	}
 	spin_unlock(&n->list_lock);
-	return page;
+	return object;
 }
 
 /*
  * Get a page from somewhere. Search in increasing NUMA distances.
  */
-static struct page *get_any_partial(struct kmem_cache *s, gfp_t flags)
+static void *get_any_partial(struct kmem_cache *s, gfp_t flags,
+		struct kmem_cache_cpu *c)
 {
 #ifdef CONFIG_NUMA
 	struct zonelist *zonelist;
 	struct zoneref *z;
 	struct zone *zone;
 	enum zone_type high_zoneidx = gfp_zone(flags);
-	struct page *page;
+	void *object;
 
 	/*
 	 * The defrag ratio allows a configuration of the tradeoffs between
@@ -1672,10 +1703,10 @@ static struct page *get_any_partial(struct kmem_cache *s, gfp_t flags)
 
 		if (n && cpuset_zone_allowed_hardwall(zone, flags) &&
 				n->nr_partial > s->min_partial) {
-			page = get_partial_node(s, n);
-			if (page) {
+			object = get_partial_node(s, n, c);
+			if (object) {
 				put_mems_allowed();
-				return page;
+				return object;
 			}
 		}
 	}
@@ -1685,18 +1716,20 @@ static struct page *get_any_partial(struct kmem_cache *s, gfp_t flags)
 }
 
 /*
- * Get a partial page, lock it and return it.
+ * Get a partial page, lock it, make it the cpu slab and return its first
+ * free object.
  */
-static struct page *get_partial(struct kmem_cache *s, gfp_t flags, int node)
+static void *get_partial(struct kmem_cache *s, gfp_t flags, int node,
+		struct kmem_cache_cpu *c)
 {
-	struct page *page;
+	void *object;
 	int searchnode = (node == NUMA_NO_NODE) ? numa_node_id() : node;
 
-	page = get_partial_node(s, get_node(s, searchnode));
-	if (page || node != NUMA_NO_NODE)
-		return page;
+	object = get_partial_node(s, get_node(s, searchnode), c);
+	if (object || node != NUMA_NO_NODE)
+		return object;
 
-	return get_any_partial(s, flags);
+	return get_any_partial(s, flags, c);
 }
 
 #ifdef CONFIG_PREEMPT
@@ -1865,7 +1898,7 @@ redo:
 			 * that acquire_slab() will see a slab page that
 			 * is frozen
 			 */
-			spin_lock(&n->list_lock);
+			lock_node_list(s, n);
 		}
 	} else {
 		m = M_FULL;
@@ -1876,7 +1909,7 @@ redo:
 			 * slabs from diagnostic functions will not see
 			 * any frozen slabs.
 			 */
-			spin_lock(&n->list_lock);
+			lock_node_list(s, n);
 		}
 	}
 
@@ -1920,6 +1953,127 @@ redo:
 	}
 }
 
+/*
+ * Unfreeze all the slabs on the per cpu partial list of @c and put them
+ * back onto the partial lists of their nodes, or free them if they became
+ * empty and the node has enough partial slabs.
+ *
+ * Slabs on the per cpu partial list always have free objects: they were
+ * either taken off a node partial list or had an object freed into them,
+ * and only the cpu slab is allocated from. So unfreezing never has to deal
+ * with a full slab.
+ *
+ * Interrupts must be disabled, and @c must belong to this cpu or to a cpu
+ * that is gone.
+ */
+static void unfreeze_partials(struct kmem_cache *s, struct kmem_cache_cpu *c)
+{
+	struct kmem_cache_node *n = NULL;
+	struct page *page, *next;
+
+	page = c->partial;
+	c->partial = NULL;
+
+	for (; page; page = next) {
+		struct kmem_cache_node *n2 = get_node(s, page_to_nid(page));
+		struct page new;
+		struct page old;
+
+		next = page->next;
+
+		if (n != n2) {
+			if (n)
+				spin_unlock(&n->list_lock);
+			n = n2;
+			lock_node_list(s, n);
+		}
+
+		/*
+		 * Frees into the slab that race with the unfreeze see it
+		 * unfrozen and off the lists, and then wait for the
+		 * list_lock we hold before touching the lists.
+		 */
+		do {
+			old.freelist = page->freelist;
+			old.counters = page->counters;
+			VM_BUG_ON(!old.frozen);
+
+			new.counters = old.counters;
+			new.freelist = old.freelist;
+			new.frozen = 0;
+
+		} while (!__cmpxchg_double_slab(s, page,
+				old.freelist, old.counters,
+				new.freelist, new.counters,
+				"unfreezing slab"));
+
+		if (unlikely(!new.inuse && n->nr_partial > s->min_partial)) {
+			stat(s, DEACTIVATE_EMPTY);
+			discard_slab(s, page);
+			stat(s, FREE_SLAB);
+		} else
+			add_partial(n, page, 1);
+	}
+
+	if (n)
+		spin_unlock(&n->list_lock);
+}
+
+/*
+ * Put a frozen slab with free objects onto the per cpu partial list.
+ *
+ * The list head is replaced with irqsafe_cpu_cmpxchg() so that frees
+ * need not disable interrupts around the whole update. It has to be the
+ * irqsafe variant: __slab_alloc() and unfreeze_partials() change
+ * c->partial with interrupts off but may interrupt us, and the generic
+ * this_cpu_cmpxchg() fallback used on e.g. ARM only disables preemption.
+ * If @drain is set and the list already holds more than s->cpu_partial
+ * objects it is first moved back to the node partial lists.
+ *
+ * Returns the approximate number of free objects on the list.
+ */
+static int put_cpu_partial(struct kmem_cache *s, struct page *page, int drain)
+{
+	struct page *oldpage;
+	int pages;
+	int pobjects;
+
+	do {
+		pages = 0;
+		pobjects = 0;
+		oldpage = this_cpu_read(s->cpu_slab->partial);
+
+		if (oldpage) {
+			pobjects = oldpage->pobjects;
+			pages = oldpage->pages;
+			if (drain && pobjects > s->cpu_partial) {
+				unsigned long flags;
+
+				/*
+				 * The partial list is full. Move the existing
+				 * set to the per node partial lists.
+				 */
+				local_irq_save(flags);
+				unfreeze_partials(s, this_cpu_ptr(s->cpu_slab));
+				local_irq_restore(flags);
+				stat(s, CPU_PARTIAL_DRAIN);
+				pobjects = 0;
+				pages = 0;
+			}
+		}
+
+		pages++;
+		pobjects += page->objects - page->inuse;
+
+		page->pages = pages;
+		page->pobjects = pobjects;
+		page->next = oldpage;
+
+	} while (irqsafe_cpu_cmpxchg(s->cpu_slab->partial, oldpage, page)
+								!= oldpage);
+	return pobjects;
+}
+
 static inline void flush_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 {
 	stat(s, CPUSLAB_FLUSH);
@@ -1935,8 +2089,12 @@ static inline void __flush_cpu_slab(struct kmem_cache *s, int cpu)
 {
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
-	if (likely(c && c->page))
-		flush_slab(s, c);
+	if (likely(c)) {
+		if (c->page)
+			flush_slab(s, c);
+
+		unfreeze_partials(s, c);
+	}
 }
 
 static void flush_cpu_slab(void *d)
@@ -2037,9 +2195,10 @@ slab_out_of_memory(struct kmem_cache *s, gfp_t gfpflags, int nid)
  * regular freelist. In that case we simply take over the regular freelist
  * as the lockless freelist and zap the regular freelist.
  *
- * If that is not working then we fall back to the partial lists. We take the
- * first element of the freelist as the object to allocate now and move the
- * rest of the freelist to the lockless freelist.
+ * If that is not working then we fall back to the per cpu partial list and
+ * then to the node partial lists. We take the first element of the freelist
+ * as the object to allocate now and move the rest of the freelist to the
+ * lockless freelist.
  *
  * And if we were unable to get a new slab from the partial slab lists then
  * we need to allocate a new slab. This is the slowest path since it involves
@@ -2070,7 +2229,7 @@ static void *__slab_alloc(struct kmem_cache *s, gfp_t gfpflags, int node,
 	page = c->page;
 	if (!page)
 		goto new_slab;
-
+redo:
 	if (unlikely(!node_match(c, node))) {
 		stat(s, ALLOC_NODE_MISMATCH);
 		deactivate_slab(s, c);
@@ -2117,18 +2276,25 @@ static void *__slab_alloc(struct kmem_cache *s, gfp_t gfpflags, int node,
 	stat(s, ALLOC_REFILL);
 
 load_freelist:
-	VM_BUG_ON(!page->frozen);
+	VM_BUG_ON(!c->page->frozen);
 	c->freelist = get_freepointer(s, object);
 	c->tid = next_tid(c->tid);
 	local_irq_restore(flags);
 	return object;
 
 new_slab:
-	page = get_partial(s, gfpflags, node);
-	if (page) {
-		stat(s, ALLOC_FROM_PARTIAL);
-		object = c->freelist;
+	if (c->partial) {
+		page = c->page = c->partial;
+		c->partial = page->next;
+		c->node = page_to_nid(page);
+		c->freelist = NULL;
+		stat(s, CPU_PARTIAL_ALLOC);
+		goto redo;
+	}
 
+	object = get_partial(s, gfpflags, node, c);
+	if (object) {
+		page = c->page;
 		if (kmem_cache_debug(s))
 			goto debug;
 		goto load_freelist;
@@ -2338,16 +2504,30 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 		was_frozen = new.frozen;
 		new.inuse--;
 		if ((!new.inuse || !prior) && !was_frozen && !n) {
-                        n = get_node(s, page_to_nid(page));
-			/*
-			 * Speculatively acquire the list_lock.
-			 * If the cmpxchg does not succeed then we may
-			 * drop the list_lock without any processing.
-			 *
-			 * Otherwise the list_lock will synchronize with
-			 * other processors updating the list of slabs.
-			 */
-                        spin_lock_irqsave(&n->list_lock, flags);
+
+			if (!kmem_cache_debug(s) && s->cpu_partial && !prior)
+
+				/*
+				 * The slab was full and on no list. Instead
+				 * of moving it to the node partial list,
+				 * freeze it and defer the list move by
+				 * putting it onto the per cpu partial list.
+				 */
+				new.frozen = 1;
+
+			else {
+				n = get_node(s, page_to_nid(page));
+				/*
+				 * Speculatively acquire the list_lock.
+				 * If the cmpxchg does not succeed then we may
+				 * drop the list_lock without any processing.
+				 *
+				 * Otherwise the list_lock will synchronize with
+				 * other processors updating the list of slabs.
+				 */
+				local_irq_save(flags);
+				lock_node_list(s, n);
+			}
 		}
 		inuse = new.inuse;
 
@@ -2357,6 +2537,16 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 		"__slab_free"));
 
 	if (likely(!n)) {
+
+		/*
+		 * If we just froze the page then put it onto the
+		 * per cpu partial list.
+		 */
+		if (new.frozen && !was_frozen) {
+			put_cpu_partial(s, page, 1);
+			stat(s, CPU_PARTIAL_FREE);
+		}
+
                 /*
 		 * The list lock was not taken therefore no list
 		 * activity can be necessary.
@@ -2467,6 +2657,121 @@ void kmem_cache_free(struct kmem_cache *s, void *x)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/*
+ * Bulk allocation and freeing. Interrupts are disabled once for the whole
+ * array, so the per cpu freelist can be manipulated directly instead of
+ * through a cmpxchg per object. Bumping the tid when done makes any
+ * lockless fastpath on this cpu that raced with us retry.
+ */
+
+/**
+ * kmem_cache_alloc_bulk - Allocate a number of objects
+ * @s: The cache to allocate from.
+ * @flags: See kmalloc().
+ * @size: The number of objects to allocate.
+ * @p: Array the objects are returned in.
+ *
+ * Like calling kmem_cache_alloc() @size times, so it may be called from
+ * any context kmem_cache_alloc() may be called from with the same @flags;
+ * the interrupt state is saved and restored. Either all objects are
+ * allocated and @size is returned, or none are and 0 is returned.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
+			  void **p)
+{
+	struct kmem_cache_cpu *c;
+	unsigned long save_flags;
+	size_t i;
+
+	if (slab_pre_alloc_hook(s, flags))
+		return 0;
+
+	local_irq_save(save_flags);
+	c = this_cpu_ptr(s->cpu_slab);
+
+	for (i = 0; i < size; i++) {
+		void *object = c->freelist;
+
+		if (unlikely(!object)) {
+			/*
+			 * The slow path may enable interrupts. Objects taken
+			 * from the freelist so far must not be handed out
+			 * again by a fastpath that read the old tid.
+			 */
+			c->tid = next_tid(c->tid);
+			p[i] = __slab_alloc(s, flags, NUMA_NO_NODE, _RET_IP_, c);
+			if (unlikely(!p[i]))
+				break;
+
+			c = this_cpu_ptr(s->cpu_slab);
+			continue;
+		}
+		c->freelist = get_freepointer(s, object);
+		p[i] = object;
+		stat(s, ALLOC_FASTPATH);
+	}
+	c->tid = next_tid(c->tid);
+	local_irq_restore(save_flags);
+
+	if (unlikely(i < size)) {
+		size_t j;
+
+		for (j = 0; j < i; j++)
+			slab_post_alloc_hook(s, flags, p[j]);
+		kmem_cache_free_bulk(s, i, p);
+		return 0;
+	}
+
+	for (i = 0; i < size; i++) {
+		if (unlikely(flags & __GFP_ZERO))
+			memset(p[i], 0, s->objsize);
+		slab_post_alloc_hook(s, flags, p[i]);
+		trace_kmem_cache_alloc(_RET_IP_, p[i], s->objsize, s->size,
+				       flags);
+	}
+	return size;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
+/**
+ * kmem_cache_free_bulk - Deallocate a number of objects
+ * @s: The cache the allocations were from.
+ * @size: The number of objects to free.
+ * @p: Array of the previously allocated objects.
+ *
+ * Like calling kmem_cache_free() for each object, so it may be called
+ * from any context kmem_cache_free() may be called from; the interrupt
+ * state is saved and restored.
+ */
+void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
+{
+	struct kmem_cache_cpu *c;
+	unsigned long flags;
+	size_t i;
+
+	local_irq_save(flags);
+	c = this_cpu_ptr(s->cpu_slab);
+
+	for (i = 0; i < size; i++) {
+		void *object = p[i];
+		struct page *page = virt_to_head_page(object);
+
+		slab_free_hook(s, object);
+
+		if (likely(page == c->page)) {
+			set_freepointer(s, object, c->freelist);
+			c->freelist = object;
+			stat(s, FREE_FASTPATH);
+		} else
+			__slab_free(s, page, object, _RET_IP_);
+
+		trace_kmem_cache_free(_RET_IP_, object);
+	}
+	c->tid = next_tid(c->tid);
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
 /*
  * Object placement in a slab is made very easy because we always start at
  * offset 0. If we tune the size of the object to the alignment then we can
@@ -2917,6 +3222,25 @@ static int kmem_cache_open(struct kmem_cache *s,
 	 * list to avoid pounding the page allocator excessively.
 	 */
 	set_min_partial(s, ilog2(s->size));
+
+	/*
+	 * The number of free objects to keep on the per cpu partial lists.
+	 * This trades memory held by each cpu against trips to the node
+	 * list_lock: small objects come and go in large numbers, while a
+	 * single slab of large objects already holds few of them. Debug
+	 * caches have to go through the locked slow paths anyway.
+	 */
+	if (kmem_cache_debug(s))
+		s->cpu_partial = 0;
+	else if (s->size >= PAGE_SIZE)
+		s->cpu_partial = 2;
+	else if (s->size >= 1024)
+		s->cpu_partial = 6;
+	else if (s->size >= 256)
+		s->cpu_partial = 13;
+	else
+		s->cpu_partial = 30;
+
 	s->refcount = 1;
 #ifdef CONFIG_NUMA
 	s->remote_node_defrag_ratio = 1000;
@@ -4324,6 +4648,7 @@ static ssize_t show_slab_objects(struct kmem_cache *s,
 
 		for_each_possible_cpu(cpu) {
 			struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
+			struct page *page;
 
 			if (!c || c->node < 0)
 				continue;
@@ -4339,6 +4664,18 @@ static ssize_t show_slab_objects(struct kmem_cache *s,
 				total += x;
 				nodes[c->node] += x;
 			}
+
+			/*
+			 * Only the number of per cpu partial slabs is known
+			 * without walking a list the owning cpu may be
+			 * changing.
+			 */
+			page = ACCESS_ONCE(c->partial);
+			if (page && !(flags & (SO_TOTAL | SO_OBJECTS))) {
+				x = page->pages;
+				total += x;
+				nodes[c->node] += x;
+			}
 			per_cpu[c->node]++;
 		}
 	}
@@ -4490,6 +4827,31 @@ static ssize_t min_partial_store(struct kmem_cache *s, const char *buf,
 }
 SLAB_ATTR(min_partial);
 
+static ssize_t cpu_partial_show(struct kmem_cache *s, char *buf)
+{
+	return sprintf(buf, "%u\n", s->cpu_partial);
+}
+
+static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
+				 size_t length)
+{
+	unsigned long objects;
+	int err;
+
+	err = strict_strtoul(buf, 10, &objects);
+	if (err)
+		return err;
+	if (objects && kmem_cache_debug(s))
+		return -EINVAL;
+	if (objects > INT_MAX)
+		return -EINVAL;
+
+	s->cpu_partial = objects;
+	flush_all(s);
+	return length;
+}
+SLAB_ATTR(cpu_partial);
+
 static ssize_t ctor_show(struct kmem_cache *s, char *buf)
 {
 	if (!s->ctor)
@@ -4516,6 +4878,39 @@ static ssize_t cpu_slabs_show(struct kmem_cache *s, char *buf)
 }
 SLAB_ATTR_RO(cpu_slabs);
 
+static ssize_t slabs_cpu_partial_show(struct kmem_cache *s, char *buf)
+{
+	int objects = 0;
+	int pages = 0;
+	int cpu;
+	int len;
+
+	for_each_online_cpu(cpu) {
+		struct page *page;
+
+		page = ACCESS_ONCE(per_cpu_ptr(s->cpu_slab, cpu)->partial);
+		if (page) {
+			pages += page->pages;
+			objects += page->pobjects;
+		}
+	}
+
+	len = sprintf(buf, "%d(%d)", objects, pages);
+
+#ifdef CONFIG_SMP
+	for_each_online_cpu(cpu) {
+		struct page *page;
+
+		page = ACCESS_ONCE(per_cpu_ptr(s->cpu_slab, cpu)->partial);
+		if (page && len < PAGE_SIZE - 20)
+			len += sprintf(buf + len, " C%d=%d(%d)", cpu,
+				       page->pobjects, page->pages);
+	}
+#endif
+	return len + sprintf(buf + len, "\n");
+}
+SLAB_ATTR_RO(slabs_cpu_partial);
+
 static ssize_t objects_show(struct kmem_cache *s, char *buf)
 {
 	return show_slab_objects(s, buf, SO_ALL|SO_OBJECTS);
@@ -4850,6 +5245,11 @@ STAT_ATTR(DEACTIVATE_BYPASS, deactivate_bypass);
 STAT_ATTR(ORDER_FALLBACK, order_fallback);
 STAT_ATTR(CMPXCHG_DOUBLE_CPU_FAIL, cmpxchg_double_cpu_fail);
 STAT_ATTR(CMPXCHG_DOUBLE_FAIL, cmpxchg_double_fail);
+STAT_ATTR(CPU_PARTIAL_ALLOC, cpu_partial_alloc);
+STAT_ATTR(CPU_PARTIAL_FREE, cpu_partial_free);
+STAT_ATTR(CPU_PARTIAL_NODE, cpu_partial_node);
+STAT_ATTR(CPU_PARTIAL_DRAIN, cpu_partial_drain);
+STAT_ATTR(LIST_LOCK_CONTENDED, list_lock_contended);
 #endif
 
 static struct attribute *slab_attrs[] = {
@@ -4858,10 +5258,12 @@ static struct attribute *slab_attrs[] = {
 	&objs_per_slab_attr.attr,
 	&order_attr.attr,
 	&min_partial_attr.attr,
+	&cpu_partial_attr.attr,
 	&objects_attr.attr,
 	&objects_partial_attr.attr,
 	&partial_attr.attr,
 	&cpu_slabs_attr.attr,
+	&slabs_cpu_partial_attr.attr,
 	&ctor_attr.attr,
 	&aliases_attr.attr,
 	&align_attr.attr,
@@ -4911,6 +5313,11 @@ static struct attribute *slab_attrs[] = {
 	&order_fallback_attr.attr,
 	&cmpxchg_double_fail_attr.attr,
 	&cmpxchg_double_cpu_fail_attr.attr,
+	&cpu_partial_alloc_attr.attr,
+	&cpu_partial_free_attr.attr,
+	&cpu_partial_node_attr.attr,
+	&cpu_partial_drain_attr.attr,
+	&list_lock_contended_attr.attr,
 #endif
 #ifdef CONFIG_FAILSLAB
 	&failslab_attr.attr,
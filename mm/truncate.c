@@ -183,6 +183,54 @@ int invalidate_inode_page(struct page *page)
 	return invalidate_complete_page(mapping, page);
 }
 
+/**
+ * truncate_shadow_entries - remove the shadows of evicted pages
+ * @mapping: mapping to clear
+ * @start: first page index
+ * @end: last page index, inclusive
+ *
+ * Shadow entries outlive neither the range of the file they describe
+ * nor the inode: they are removed on truncation and in end_writeback().
+ */
+void truncate_shadow_entries(struct address_space *mapping,
+			     pgoff_t start, pgoff_t end)
+{
+	void **slots[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	unsigned long shadows[PAGEVEC_SIZE];
+	pgoff_t index = start;
+	unsigned int i, nr, nr_shadows;
+
+	while (index <= end) {
+		spin_lock_irq(&mapping->tree_lock);
+		if (!mapping->nrshadows) {
+			spin_unlock_irq(&mapping->tree_lock);
+			break;
+		}
+		nr = radix_tree_gang_lookup_slot(&mapping->page_tree, slots,
+						 indices, index, PAGEVEC_SIZE);
+		nr_shadows = 0;
+		for (i = 0; i < nr && indices[i] <= end; i++) {
+			void *entry;
+
+			entry = radix_tree_deref_slot_protected(slots[i],
+							&mapping->tree_lock);
+			if (radix_tree_exceptional_entry(entry))
+				shadows[nr_shadows++] = indices[i];
+		}
+		/* Deleting may free nodes, so no slot is used after this */
+		for (i = 0; i < nr_shadows; i++)
+			radix_tree_delete(&mapping->page_tree, shadows[i]);
+		mapping->nrshadows -= nr_shadows;
+		spin_unlock_irq(&mapping->tree_lock);
+
+		if (!nr || indices[nr - 1] >= end)
+			break;
+		index = indices[nr - 1] + 1;
+		cond_resched();
+	}
+}
+
 /**
  * truncate_inode_pages - truncate range of pages specified by start & end byte offsets
  * @mapping: mapping to truncate
@@ -214,12 +262,12 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	int i;
 
 	cleancache_flush_inode(mapping);
-	if (mapping->nrpages == 0)
-		return;
-
 	BUG_ON((lend & (PAGE_CACHE_SIZE - 1)) != (PAGE_CACHE_SIZE - 1));
 	end = (lend >> PAGE_CACHE_SHIFT);
 
+	if (mapping->nrpages == 0)
+		goto shadows;
+
 	pagevec_init(&pvec, 0);
 	index = start;
 	while (index <= end && pagevec_lookup(&pvec, mapping, index,
@@ -293,6 +341,13 @@ void truncate_inode_pages_range(struct address_space *mapping,
 		index++;
 	}
 	cleancache_flush_inode(mapping);
+shadows:
+	/*
+	 * Only now: reclaim may leave a shadow for any page it gets to
+	 * before the loops above do.
+	 */
+	if (mapping->nrshadows)
+		truncate_shadow_entries(mapping, start, end);
 }
 EXPORT_SYMBOL(truncate_inode_pages_range);
 
@@ -400,7 +455,7 @@ invalidate_complete_page2(struct address_space *mapping, struct page *page)
 
 	clear_page_mlock(page);
 	BUG_ON(page_has_private(page));
-	__delete_from_page_cache(page);
+	__delete_from_page_cache(page, NULL);
 	spin_unlock_irq(&mapping->tree_lock);
 	mem_cgroup_uncharge_cache_page(page);
 
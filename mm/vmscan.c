@@ -523,7 +523,8 @@ static pageout_t pageout(struct page *page, struct address_space *mapping,
  * Same as remove_mapping, but if the page is removed from the mapping, it
  * gets returned with a refcount of 0.
  */
-static int __remove_mapping(struct address_space *mapping, struct page *page)
+static int __remove_mapping(struct address_space *mapping, struct page *page,
+			    bool reclaimed)
 {
 	BUG_ON(!PageLocked(page));
 	BUG_ON(mapping != page_mapping(page));
@@ -569,10 +570,21 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 		swapcache_free(swap, page);
 	} else {
 		void (*freepage)(struct page *);
+		void *shadow = NULL;
 
 		freepage = mapping->a_ops->freepage;
 
-		__delete_from_page_cache(page);
+		/*
+		 * Remember when a reclaimed page was evicted, so that its
+		 * refault can tell thrashing from a cold miss. Only pages
+		 * that come back through ->readpage() can refault, and
+		 * shmem keeps swap entries in its radix tree instead.
+		 */
+		if (reclaimed && page_is_file_cache(page) &&
+		    mapping->a_ops->readpage &&
+		    !mapping_cap_swap_backed(mapping))
+			shadow = workingset_eviction(mapping, page);
+		__delete_from_page_cache(page, shadow);
 		spin_unlock_irq(&mapping->tree_lock);
 		mem_cgroup_uncharge_cache_page(page);
 
@@ -595,7 +607,7 @@ cannot_free:
  */
 int remove_mapping(struct address_space *mapping, struct page *page)
 {
-	if (__remove_mapping(mapping, page)) {
+	if (__remove_mapping(mapping, page, false)) {
 		/*
 		 * Unfreezing the refcount with 1 rather than 2 effectively
 		 * drops the pagecache ref for us without requiring another
@@ -692,7 +704,17 @@ static enum page_references page_check_references(struct page *page,
 	int referenced_ptes, referenced_page;
 	unsigned long vm_flags;
 
-	referenced_ptes = page_referenced(page, 1, sc->mem_cgroup, &vm_flags);
+	/*
+	 * The multi-generational LRU learns about accessed ptes from its
+	 * aging walks, and try_to_unmap() still backs off from young ptes:
+	 * skip the rmap walk.
+	 */
+	if (lru_gen_enabled() && scanning_global_lru(sc)) {
+		referenced_ptes = 0;
+		vm_flags = 0;
+	} else
+		referenced_ptes = page_referenced(page, 1, sc->mem_cgroup,
+						  &vm_flags);
 	referenced_page = TestClearPageReferenced(page);
 
 	/* Lumpy reclaim - ignore references */
@@ -855,7 +877,8 @@ unsigned long shrink_page_list(struct list_head *page_list,
 		 * processes. Try to unmap it here.
 		 */
 		if (page_mapped(page) && mapping) {
-			switch (try_to_unmap(page, TTU_UNMAP)) {
+			switch (try_to_unmap(page,
+					TTU_UNMAP | TTU_BATCH_FLUSH)) {
 			case SWAP_FAIL:
 				goto activate_locked;
 			case SWAP_AGAIN:
@@ -877,7 +900,12 @@ unsigned long shrink_page_list(struct list_head *page_list,
 			if (!sc->may_writepage)
 				goto keep_locked;
 
-			/* Page is dirty, try to write it out here */
+			/*
+			 * Page is dirty. Flush the TLB if a writable entry
+			 * potentially exists to avoid CPU writes after IO
+			 * starts and then write it out here.
+			 */
+			try_to_unmap_flush_dirty();
 			switch (pageout(page, mapping, sc)) {
 			case PAGE_KEEP:
 				nr_congested++;
@@ -946,7 +974,7 @@ unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
-		if (!mapping || !__remove_mapping(mapping, page))
+		if (!mapping || !__remove_mapping(mapping, page, true))
 			goto keep_locked;
 
 		/*
@@ -1000,6 +1028,7 @@ keep_lumpy:
 	if (nr_dirty && nr_dirty == nr_congested && scanning_global_lru(sc))
 		zone_set_flag(zone, ZONE_CONGESTED);
 
+	try_to_unmap_flush();
 	free_page_list(&free_pages);
 
 	list_splice(&ret_pages, page_list);
@@ -1203,6 +1232,294 @@ static unsigned long isolate_lru_pages(unsigned long nr_to_scan,
 	return nr_taken;
 }
 
+#ifdef CONFIG_LRU_GEN
+bool lru_gen_on __read_mostly = IS_ENABLED(CONFIG_LRU_GEN_ENABLED);
+
+static int __init setup_lru_gen(char *str)
+{
+	return strtobool(str, &lru_gen_on) ? 0 : 1;
+}
+__setup("lru_gen=", setup_lru_gen);
+
+void __meminit lru_gen_init_zone(struct zone *zone)
+{
+	struct lru_gen *lrugen = &zone->lrugen;
+	int gen, file;
+
+	for (gen = 0; gen < MAX_NR_GENS; gen++)
+		for (file = 0; file < 2; file++)
+			INIT_LIST_HEAD(&lrugen->lists[gen][file]);
+	lrugen->min_seq[0] = lrugen->min_seq[1] = 0;
+	lrugen->max_seq = MIN_NR_GENS;
+}
+
+/*
+ * All user mms, for the aging walk. Visited mms are moved to the tail,
+ * so the walk is over once the head has been visited. New mms start at
+ * the tail too, their accessed bits are fresh anyway.
+ */
+static LIST_HEAD(lru_gen_mm_list);
+static DEFINE_SPINLOCK(lru_gen_mm_lock);
+static DEFINE_MUTEX(lru_gen_aging_mutex);
+static unsigned long lru_gen_walk_seq;
+
+void lru_gen_add_mm(struct mm_struct *mm)
+{
+	INIT_LIST_HEAD(&mm->lru_gen_mm);
+	if (!lru_gen_enabled())
+		return;
+
+	spin_lock(&lru_gen_mm_lock);
+	mm->lru_gen_seq = lru_gen_walk_seq;
+	list_add_tail(&mm->lru_gen_mm, &lru_gen_mm_list);
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+void lru_gen_del_mm(struct mm_struct *mm)
+{
+	if (list_empty(&mm->lru_gen_mm))
+		return;
+
+	spin_lock(&lru_gen_mm_lock);
+	list_del_init(&mm->lru_gen_mm);
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+/*
+ * Clear the accessed bits of a pte table and mark the pages that had
+ * them set; they are promoted when reclaim finds them in the oldest
+ * generation. There is no TLB flush, a page whose young pte is still
+ * cached will merely look idle until the next walk.
+ */
+static int lru_gen_pmd_entry(pmd_t *pmd, unsigned long addr,
+			     unsigned long end, struct mm_walk *walk)
+{
+	struct vm_area_struct *vma = walk->private;
+	unsigned long young = 0;
+	spinlock_t *ptl;
+	pte_t *pte, *orig_pte;
+
+	if (pmd_trans_huge(*pmd) || unlikely(pmd_bad(*pmd)))
+		return 0;
+
+	orig_pte = pte = pte_offset_map_lock(walk->mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		struct page *page;
+
+		if (!pte_present(*pte) || !pte_young(*pte))
+			continue;
+		page = vm_normal_page(vma, addr, *pte);
+		if (!page || !PageLRU(page))
+			continue;
+		if (ptep_test_and_clear_young(vma, addr, pte)) {
+			SetPageReferenced(page);
+			young++;
+		}
+	}
+	pte_unmap_unlock(orig_pte, ptl);
+
+	count_vm_events(LRU_GEN_YOUNG, young);
+	cond_resched();
+	return 0;
+}
+
+static void lru_gen_walk_mm(struct mm_struct *mm)
+{
+	struct vm_area_struct *vma;
+	struct mm_walk walk = {
+		.pmd_entry = lru_gen_pmd_entry,
+		.mm = mm,
+	};
+
+	/* Whoever holds it for write may be waiting on our reclaim */
+	if (!down_read_trylock(&mm->mmap_sem))
+		return;
+
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		if (vma->vm_flags & (VM_IO | VM_PFNMAP | VM_LOCKED |
+				     VM_HUGETLB))
+			continue;
+		walk.private = vma;
+		walk_page_range(vma->vm_start, vma->vm_end, &walk);
+	}
+
+	up_read(&mm->mmap_sem);
+}
+
+/* Open a new youngest generation, folding the oldest if out of slots. */
+static void lru_gen_inc_max_seq(struct zone *zone)
+{
+	struct lru_gen *lrugen = &zone->lrugen;
+	int file;
+
+	spin_lock_irq(&zone->lru_lock);
+	for (file = 0; file < 2; file++) {
+		unsigned long min_seq = lrugen->min_seq[file];
+
+		if (lrugen->max_seq + 1 - min_seq < MAX_NR_GENS)
+			continue;
+		list_splice_tail_init(
+			&lrugen->lists[lru_gen_from_seq(min_seq)][file],
+			&lrugen->lists[lru_gen_from_seq(min_seq + 1)][file]);
+		lrugen->min_seq[file]++;
+	}
+	lrugen->max_seq++;
+	spin_unlock_irq(&zone->lru_lock);
+}
+
+/*
+ * Harvest the accessed bits of all user page tables and open a new
+ * generation in every zone, unless someone else did since @zone's
+ * youngest generation was @max_seq.
+ */
+static void lru_gen_age(struct zone *zone, unsigned long max_seq)
+{
+	struct mm_struct *mm;
+	struct zone *z;
+
+	/*
+	 * One walk ages every zone. Whoever finds it in progress goes on
+	 * reclaiming rather than queueing up behind it for another.
+	 */
+	if (!mutex_trylock(&lru_gen_aging_mutex))
+		return;
+	if (ACCESS_ONCE(zone->lrugen.max_seq) != max_seq)
+		goto out;
+
+	spin_lock(&lru_gen_mm_lock);
+	lru_gen_walk_seq++;
+	spin_unlock(&lru_gen_mm_lock);
+
+	for (;;) {
+		spin_lock(&lru_gen_mm_lock);
+		if (list_empty(&lru_gen_mm_list)) {
+			spin_unlock(&lru_gen_mm_lock);
+			break;
+		}
+		mm = list_first_entry(&lru_gen_mm_list, struct mm_struct,
+				      lru_gen_mm);
+		if (mm->lru_gen_seq == lru_gen_walk_seq) {
+			spin_unlock(&lru_gen_mm_lock);
+			break;
+		}
+		mm->lru_gen_seq = lru_gen_walk_seq;
+		list_move_tail(&mm->lru_gen_mm, &lru_gen_mm_list);
+		if (!atomic_inc_not_zero(&mm->mm_users))
+			mm = NULL;
+		spin_unlock(&lru_gen_mm_lock);
+
+		if (mm) {
+			lru_gen_walk_mm(mm);
+			/* Don't tear down an exited mm from reclaim */
+			mmput_async(mm);
+		}
+		cond_resched();
+	}
+
+	for_each_populated_zone(z)
+		lru_gen_inc_max_seq(z);
+	count_vm_event(LRU_GEN_AGING);
+out:
+	mutex_unlock(&lru_gen_aging_mutex);
+}
+
+/*
+ * Age before reclaiming @file pages from @zone if its oldest evictable
+ * generation is used up. The youngest MIN_NR_GENS generations are not
+ * evicted from.
+ */
+static void lru_gen_maybe_age(struct zone *zone, int file)
+{
+	struct lru_gen *lrugen = &zone->lrugen;
+	unsigned long max_seq = ACCESS_ONCE(lrugen->max_seq);
+	unsigned long min_seq = ACCESS_ONCE(lrugen->min_seq[file]);
+
+	if (max_seq - min_seq > MIN_NR_GENS)
+		return;
+	if (!list_empty(&lrugen->lists[lru_gen_from_seq(min_seq)][file]))
+		return;
+	lru_gen_age(zone, max_seq);
+}
+
+/*
+ * Isolate up to @nr_to_scan pages from the oldest generation of @zone.
+ * Pages that were referenced since they entered it go to the youngest
+ * generation instead: anon pages and mapped file pages that the aging
+ * walk found accessed, and active file pages read again. Pages of any
+ * activity state are isolated, update_isolated_counts() sorts them out.
+ */
+static unsigned long lru_gen_isolate_pages(struct zone *zone,
+		unsigned long nr_to_scan, struct list_head *dst,
+		unsigned long *scanned, int file)
+{
+	struct lru_gen *lrugen = &zone->lrugen;
+	unsigned long nr_taken = 0;
+	unsigned long promoted = 0;
+	unsigned long scan = 0;
+
+	while (scan < nr_to_scan) {
+		unsigned long min_seq = lrugen->min_seq[file];
+		struct list_head *src;
+		struct page *page;
+
+		src = &lrugen->lists[lru_gen_from_seq(min_seq)][file];
+		if (list_empty(src)) {
+			if (lrugen->max_seq - min_seq <= MIN_NR_GENS)
+				break;
+			lrugen->min_seq[file]++;
+			continue;
+		}
+
+		page = lru_to_page(src);
+		prefetchw_prev_lru_page(page, src, flags);
+		VM_BUG_ON(!PageLRU(page));
+		scan++;
+
+		if (PageReferenced(page) &&
+		    (!file || PageActive(page) || page_mapped(page))) {
+			ClearPageReferenced(page);
+			list_move(&page->lru, &lrugen->lists[
+				  lru_gen_from_seq(lrugen->max_seq)][file]);
+			mem_cgroup_rotate_lru_list(page, page_lru(page));
+			promoted++;
+			continue;
+		}
+
+		switch (__isolate_lru_page(page, ISOLATE_BOTH, file)) {
+		case 0:
+			list_move(&page->lru, dst);
+			mem_cgroup_del_lru(page);
+			nr_taken += hpage_nr_pages(page);
+			break;
+
+		case -EBUSY:
+			/* else it is being freed elsewhere */
+			list_move(&page->lru, src);
+			mem_cgroup_rotate_lru_list(page, page_lru(page));
+			break;
+
+		default:
+			BUG();
+		}
+	}
+
+	*scanned = scan;
+	__count_vm_events(LRU_GEN_PROMOTE, promoted);
+	return nr_taken;
+}
+#else
+static inline void lru_gen_maybe_age(struct zone *zone, int file)
+{
+}
+
+static inline unsigned long lru_gen_isolate_pages(struct zone *zone,
+		unsigned long nr_to_scan, struct list_head *dst,
+		unsigned long *scanned, int file)
+{
+	return 0;
+}
+#endif /* CONFIG_LRU_GEN */
+
 static unsigned long isolate_pages_global(unsigned long nr,
 					struct list_head *dst,
 					unsigned long *scanned, int order,
@@ -1210,6 +1527,9 @@ static unsigned long isolate_pages_global(unsigned long nr,
 					int active, int file)
 {
 	int lru = LRU_BASE;
+
+	if (lru_gen_enabled())
+		return lru_gen_isolate_pages(z, nr, dst, scanned, file);
 	if (active)
 		lru += LRU_ACTIVE;
 	if (file)
@@ -1633,7 +1953,7 @@ static void move_active_pages_to_lru(struct zone *zone,
 		VM_BUG_ON(PageLRU(page));
 		SetPageLRU(page);
 
-		list_move(&page->lru, &zone->lru[lru].list);
+		list_move(&page->lru, lru_list_head(zone, lru));
 		mem_cgroup_add_lru_list(page, lru);
 		pgmoved += hpage_nr_pages(page);
 
@@ -1776,6 +2096,10 @@ static int inactive_anon_is_low(struct zone *zone, struct scan_control *sc)
 	if (!total_swap_pages)
 		return 0;
 
+	/* Generations are aged by lru_gen_maybe_age() instead */
+	if (lru_gen_enabled() && scanning_global_lru(sc))
+		return 0;
+
 	if (scanning_global_lru(sc))
 		low = inactive_anon_is_low_global(zone);
 	else
@@ -1840,6 +2164,13 @@ static unsigned long shrink_list(enum lru_list lru, unsigned long nr_to_scan,
 {
 	int file = is_file_lru(lru);
 
+	/* Both shares of the scan evict from the oldest generation */
+	if (lru_gen_enabled() && scanning_global_lru(sc)) {
+		lru_gen_maybe_age(zone, file);
+		return shrink_inactive_list(nr_to_scan, zone, sc, priority,
+					    file);
+	}
+
 	if (is_active_lru(lru)) {
 		if (inactive_list_is_low(zone, sc, file))
 		    shrink_active_list(nr_to_scan, zone, sc, priority, file);
@@ -2934,6 +3265,8 @@ void wakeup_kswapd(struct zone *zone, int order, enum zone_type classzone_idx)
 	if (!cpuset_zone_allowed_hardwall(zone, GFP_KERNEL))
 		return;
 	pgdat = zone->zone_pgdat;
+	if (order)
+		wakeup_kcompactd(pgdat, order);
 	if (pgdat->kswapd_max_order < order) {
 		pgdat->kswapd_max_order = order;
 		pgdat->classzone_idx = min(pgdat->classzone_idx, classzone_idx);
@@ -3356,7 +3689,7 @@ retry:
 		enum lru_list l = page_lru_base_type(page);
 
 		__dec_zone_state(zone, NR_UNEVICTABLE);
-		list_move(&page->lru, &zone->lru[l].list);
+		list_move(&page->lru, lru_list_head(zone, l));
 		mem_cgroup_move_lists(page, LRU_UNEVICTABLE, l);
 		__inc_zone_state(zone, NR_INACTIVE_ANON + l);
 		__count_vm_event(UNEVICTABLE_PGRESCUED);
@@ -708,6 +708,8 @@ const char * const vmstat_text[] = {
 	"nr_shmem",
 	"nr_dirtied",
 	"nr_written",
+	"workingset_refault",
+	"workingset_activate",
 
 #ifdef CONFIG_NUMA
 	"numa_hit",
@@ -763,6 +765,11 @@ const char * const vmstat_text[] = {
 	"compact_stall",
 	"compact_fail",
 	"compact_success",
+	"compact_stall_us",
+	"kcompactd_wake",
+	"kcompactd_success",
+	"kcompactd_fail",
+	"kcompactd_us",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE
@@ -785,6 +792,19 @@ const char * const vmstat_text[] = {
 	"thp_collapse_alloc_failed",
 	"thp_split",
 #endif
+#ifdef CONFIG_LRU_GEN
+	"lru_gen_aging",
+	"lru_gen_young",
+	"lru_gen_promote",
+#endif
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	"speculative_pgfault",
+	"speculative_pgfault_abort",
+#endif
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+	"tlb_unmap_deferred",
+	"tlb_unmap_batch_flush",
+#endif
 
 #endif /* CONFIG_VM_EVENTS_COUNTERS */
 };
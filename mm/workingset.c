@@ -0,0 +1,138 @@
+/*
+ * mm/workingset.c
+ *
+ * Workingset detection
+ *
+ * A page cache page that is evicted and read back in shortly afterwards
+ * was evicted too early: the inactive list was too short to let it be
+ * referenced a second time. Each zone counts the evictions and the
+ * activations from its inactive file list; both move the other pages on
+ * that list towards its tail by one slot. When a file page is evicted,
+ * the counter is stored in a shadow entry that takes the page's place
+ * in the page cache radix tree.
+ *
+ * When the page is faulted back in, the difference between the counter
+ * then and the one in the shadow entry is the number of inactive list
+ * slots the page missed to stay resident: its refault distance. Had the
+ * active list been that much smaller and the inactive list that much
+ * larger, the page would have been referenced before it was evicted. So
+ * when the refault distance is not larger than the active file list,
+ * the page goes straight to the active list, where it competes with the
+ * rest of the working set instead of being evicted again with the
+ * use-once pages. Refaults at larger distances were cold misses that no
+ * list balancing could have avoided; they start out inactive as usual.
+ *
+ * Shadow entries keep radix tree nodes alive after all their pages are
+ * gone, and nothing reclaims such nodes by themselves: they go when the
+ * range is truncated or the inode is evicted. Two things bound them.
+ * Block device inodes live as long as the device, so their mappings get
+ * no shadows at all. And every eviction in a zone advances its counter,
+ * so if a mapping has more shadows than there are active file pages, at
+ * least one of them is too old to ever activate its page. A mapping at
+ * that many shadows gets no new ones until refaults or truncation have
+ * used some up.
+ */
+
+#include <linux/memcontrol.h>
+#include <linux/writeback.h>
+#include <linux/pagemap.h>
+#include <linux/module.h>
+#include <linux/swap.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+
+#define EVICTION_SHIFT	(RADIX_TREE_EXCEPTIONAL_SHIFT + \
+			 ZONES_SHIFT + NODES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << RADIX_TREE_EXCEPTIONAL_SHIFT);
+
+	return (void *)(eviction | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static void unpack_shadow(void *shadow, struct zone **zone,
+			  unsigned long *distance)
+{
+	unsigned long entry = (unsigned long)shadow;
+	unsigned long eviction, refault;
+	int zid;
+
+	entry >>= RADIX_TREE_EXCEPTIONAL_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	/* Without NUMA, NODE_DATA() ignores the node, which is 0 anyway */
+	*zone = NODE_DATA(entry & ((1UL << NODES_SHIFT) - 1))->node_zones + zid;
+	entry >>= NODES_SHIFT;
+	eviction = entry;
+
+	/*
+	 * The counter is truncated to the bits that fit into the shadow
+	 * entry, so the distance is taken modulo that width. A page that
+	 * stayed out for a full wrap-around of the counter looks like a
+	 * recent eviction, but so many evictions later it is a cold miss
+	 * either way and the error only costs one misplaced activation.
+	 */
+	refault = atomic_long_read(&(*zone)->inactive_age);
+	*distance = (refault - eviction) & EVICTION_MASK;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page from memory
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @page->mapping->page_tree in
+ * place of the evicted @page so that a later refault can be detected,
+ * or NULL if @mapping should not get another one. The caller must hold
+ * the mapping's tree_lock.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	if (S_ISBLK(mapping->host->i_mode))
+		return NULL;
+	if (mapping->nrshadows >= global_page_state(NR_ACTIVE_FILE))
+		return NULL;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	return pack_shadow(eviction, zone);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates and evaluates the refault distance of the previously
+ * evicted page in the context of the zone it was allocated in.
+ *
+ * Returns %true if the page should be activated, %false otherwise.
+ */
+bool workingset_refault(void *shadow)
+{
+	unsigned long refault_distance;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &refault_distance);
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (refault_distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
@@ -433,6 +433,44 @@ void __kfree_skb(struct sk_buff *skb)
 }
 EXPORT_SYMBOL(__kfree_skb);
 
+#define KFREE_SKB_BULK_SIZE	16
+
+/**
+ *	__kfree_skb_list - private function
+ *	@skb: first buffer of a list linked through ->next
+ *
+ *	Free a list of sk_buffs whose usage count already dropped to zero,
+ *	as __kfree_skb() does for one. The sk_buff shells that are not part
+ *	of a fast clone are returned to their cache in batches, which is
+ *	cheaper than one at a time when a transmit completion hands back
+ *	many buffers.
+ */
+void __kfree_skb_list(struct sk_buff *skb)
+{
+	void *heads[KFREE_SKB_BULK_SIZE];
+	size_t n = 0;
+
+	while (skb) {
+		struct sk_buff *next = skb->next;
+
+		skb_release_all(skb);
+		if (skb->fclone == SKB_FCLONE_UNAVAILABLE) {
+			heads[n++] = skb;
+			if (n == KFREE_SKB_BULK_SIZE) {
+				kmem_cache_free_bulk(skbuff_head_cache, n,
+						     heads);
+				n = 0;
+			}
+		} else
+			kfree_skbmem(skb);
+		skb = next;
+	}
+
+	if (n)
+		kmem_cache_free_bulk(skbuff_head_cache, n, heads);
+}
+EXPORT_SYMBOL(__kfree_skb_list);
+
 /**
  *	kfree_skb - free an sk_buff
  *	@skb: buffer to free
@@ -0,0 +1,369 @@
+/*
+ * cpufreq-replay -- replay recorded 'interactive' governor load traces
+ * through the governor's frequency selection with different tunables.
+ *
+ * Record with:
+ *   echo 1 > /sys/kernel/debug/tracing/events/cpufreq_interactive/enable
+ *   ... run the workload ...
+ *   cat /sys/kernel/debug/tracing/trace > trace.txt
+ *
+ * Each cpufreq_interactive_target event carries the load the governor
+ * saw and the frequency the cpu ran at. The work demanded during the
+ * interval before an event is taken as load * cur; the replay runs that
+ * demand against the frequencies the simulated governor picks and
+ * reports an energy proxy (busy time weighted by (f/fmax)^3) and a
+ * latency proxy (demand above the current capacity). Demand hidden by
+ * a recorded load of 100% cannot be recovered, so traces taken at low
+ * frequencies underestimate what a faster governor would have had to
+ * serve.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "../../../include/linux/cpufreq_interactive.h"
+
+#define MAX_CPUS	256
+#define MAX_FREQS	64
+
+struct sample {
+	double ts;		/* seconds */
+	unsigned int cpu;
+	int load;
+	int load_since_change;
+	unsigned int cur;
+	unsigned int chosen;
+};
+
+struct result {
+	unsigned long samples;
+	unsigned long transitions;
+	double time;		/* seconds covered */
+	double busy;		/* seconds busy */
+	double energy;		/* busy seconds * (f / fmax)^3 */
+	double saturated;	/* seconds with demand >= capacity */
+	double unserved;	/* demand above capacity, fmax-seconds */
+};
+
+struct cpu_state {
+	int valid;
+	double last_ts;
+	/* replay */
+	unsigned int freq;
+	double change_ts;
+	double busy_since_change;
+	double time_since_change;
+	/* recorded */
+	unsigned int rec_chosen;
+	struct result replay, recorded;
+};
+
+static struct interactive_tunables tunables = {
+	.go_maxspeed_load	= 85,
+};
+static double min_sample_time = 0.030;	/* seconds */
+static unsigned int freqs[MAX_FREQS];
+static int nr_freqs;
+static int verbose;
+
+static struct sample *samples;
+static size_t nr_samples, max_samples;
+
+static const char *reason_name[] = {
+	[INTERACTIVE_MAXSPEED]	= "maxspeed",
+	[INTERACTIVE_BOOST]	= "boost",
+	[INTERACTIVE_SCALE_MAX]	= "scale_max",
+	[INTERACTIVE_SUSTAIN]	= "sustain",
+	[INTERACTIVE_HOLD]	= "hold",
+};
+
+static void usage(void)
+{
+	fprintf(stderr,
+"Usage: cpufreq-replay [options] [trace]\n"
+"  -g LOAD   go_maxspeed_load (default 85)\n"
+"  -b N      boost_factor (default 0)\n"
+"  -m KHZ    max_boost (default 0)\n"
+"  -s LOAD   sustain_load (default 0)\n"
+"  -t USEC   min_sample_time (default 30000)\n"
+"  -f LIST   comma separated frequency table in kHz\n"
+"            (default: frequencies seen in the trace)\n"
+"  -v        print every replayed decision\n");
+	exit(1);
+}
+
+static void add_freq(unsigned int f)
+{
+	int i, j;
+
+	if (!f)
+		return;
+	for (i = 0; i < nr_freqs; i++)
+		if (freqs[i] == f)
+			return;
+	if (nr_freqs == MAX_FREQS) {
+		fprintf(stderr, "too many frequencies\n");
+		exit(1);
+	}
+	/* keep the table sorted ascending */
+	for (i = 0; i < nr_freqs && freqs[i] < f; i++)
+		;
+	for (j = nr_freqs; j > i; j--)
+		freqs[j] = freqs[j - 1];
+	freqs[i] = f;
+	nr_freqs++;
+}
+
+static void parse_freqs(char *list)
+{
+	char *tok;
+
+	for (tok = strtok(list, ","); tok; tok = strtok(NULL, ","))
+		add_freq(strtoul(tok, NULL, 0));
+}
+
+/* CPUFREQ_RELATION_H: highest frequency at or below target */
+static unsigned int table_target(unsigned int target)
+{
+	int i;
+
+	for (i = nr_freqs - 1; i > 0; i--)
+		if (freqs[i] <= target)
+			break;
+	return freqs[i];
+}
+
+/*
+ * Parse one line of the ftrace text output:
+ *   comm-pid [cpu] flags ts: cpufreq_interactive_target: cpu=...
+ */
+static int parse_line(const char *line, struct sample *s)
+{
+	const char *ev, *p;
+
+	ev = strstr(line, ": cpufreq_interactive_target: ");
+	if (!ev)
+		return 0;
+
+	for (p = ev; p > line && p[-1] != ' '; p--)
+		;
+	s->ts = strtod(p, NULL);
+
+	ev += strlen(": cpufreq_interactive_target: ");
+	return sscanf(ev, "cpu=%u load=%d load_since_change=%d cur=%u "
+		      "target=%*u chosen=%u", &s->cpu, &s->load,
+		      &s->load_since_change, &s->cur, &s->chosen) == 5;
+}
+
+static void read_trace(FILE *f)
+{
+	char line[1024];
+	struct sample s;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (!parse_line(line, &s) || s.cpu >= MAX_CPUS)
+			continue;
+
+		if (nr_samples == max_samples) {
+			max_samples = max_samples ? 2 * max_samples : 4096;
+			samples = realloc(samples,
+					  max_samples * sizeof(*samples));
+			if (!samples) {
+				perror("realloc");
+				exit(1);
+			}
+		}
+		samples[nr_samples++] = s;
+	}
+}
+
+static void account(struct result *r, double dt, double demand,
+		    unsigned int freq, unsigned int fmax)
+{
+	double capacity = freq, busy, scale;
+
+	busy = demand >= capacity ? 1.0 : demand / capacity;
+	scale = (double)freq / fmax;
+
+	r->time += dt;
+	r->busy += busy * dt;
+	r->energy += busy * dt * scale * scale * scale;
+	if (demand >= capacity) {
+		r->saturated += dt;
+		r->unserved += (demand - capacity) / fmax * dt;
+	}
+}
+
+static void replay_sample(struct cpu_state *c, const struct sample *s,
+			  unsigned int fmax)
+{
+	double dt, demand, busy;
+	unsigned int target, new_freq;
+	int load, load_since_change, reason;
+
+	if (!c->valid) {
+		c->valid = 1;
+		c->last_ts = c->change_ts = s->ts;
+		c->freq = s->cur;
+		c->rec_chosen = s->chosen;
+		return;
+	}
+
+	dt = s->ts - c->last_ts;
+	c->last_ts = s->ts;
+	if (dt <= 0)
+		return;
+
+	/* Work the recorded cpu did in the interval, in kHz. */
+	demand = s->load / 100.0 * s->cur;
+
+	c->recorded.samples++;
+	account(&c->recorded, dt, demand, s->cur, fmax);
+	if (s->chosen != c->rec_chosen) {
+		c->recorded.transitions++;
+		c->rec_chosen = s->chosen;
+	}
+
+	c->replay.samples++;
+	account(&c->replay, dt, demand, c->freq, fmax);
+
+	busy = demand >= c->freq ? 1.0 : demand / c->freq;
+	load = (int)(busy * 100);
+	c->busy_since_change += busy * dt;
+	c->time_since_change += dt;
+	load_since_change = (int)(100 * c->busy_since_change /
+				  c->time_since_change);
+
+	target = interactive_target_freq(&tunables, load, load_since_change,
+					 c->freq, fmax, &reason);
+	new_freq = table_target(target);
+
+	if (new_freq < c->freq && s->ts - c->change_ts < min_sample_time) {
+		reason = INTERACTIVE_HOLD;
+		new_freq = c->freq;
+	}
+
+	if (verbose)
+		printf("%12.6f cpu=%u load=%d load_since_change=%d cur=%u "
+		       "target=%u chosen=%u reason=%s\n", s->ts, s->cpu, load,
+		       load_since_change, c->freq, target, new_freq,
+		       reason_name[reason]);
+
+	if (new_freq != c->freq) {
+		c->replay.transitions++;
+		c->freq = new_freq;
+		c->change_ts = s->ts;
+		c->busy_since_change = 0;
+		c->time_since_change = 0;
+	}
+}
+
+static void print_result(const char *name, int cpu, const struct result *r)
+{
+	char id[16];
+
+	if (cpu < 0)
+		snprintf(id, sizeof(id), "all");
+	else
+		snprintf(id, sizeof(id), "%d", cpu);
+
+	printf("%-4s %-9s %9lu %11lu %9.3f %9.3f %11.4f %10.4f %10.4f\n",
+	       id, name, r->samples, r->transitions, r->time, r->busy,
+	       r->energy, r->saturated, r->unserved);
+}
+
+static void sum_result(struct result *total, const struct result *r)
+{
+	total->samples += r->samples;
+	total->transitions += r->transitions;
+	total->time += r->time;
+	total->busy += r->busy;
+	total->energy += r->energy;
+	total->saturated += r->saturated;
+	total->unserved += r->unserved;
+}
+
+int main(int argc, char **argv)
+{
+	static struct cpu_state cpus[MAX_CPUS];
+	struct result rec_total = { 0 }, replay_total = { 0 };
+	FILE *f = stdin;
+	size_t i;
+	int opt, cpu;
+
+	while ((opt = getopt(argc, argv, "g:b:m:s:t:f:vh")) != -1) {
+		switch (opt) {
+		case 'g':
+			tunables.go_maxspeed_load = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			tunables.boost_factor = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			tunables.max_boost = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			tunables.sustain_load = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			min_sample_time = strtoul(optarg, NULL, 0) / 1e6;
+			break;
+		case 'f':
+			parse_freqs(optarg);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (optind < argc) {
+		f = fopen(argv[optind], "r");
+		if (!f) {
+			perror(argv[optind]);
+			return 1;
+		}
+	}
+
+	read_trace(f);
+	if (!nr_samples) {
+		fprintf(stderr, "no cpufreq_interactive_target events found\n");
+		return 1;
+	}
+
+	if (!nr_freqs)
+		for (i = 0; i < nr_samples; i++) {
+			add_freq(samples[i].cur);
+			add_freq(samples[i].chosen);
+		}
+
+	for (i = 0; i < nr_samples; i++)
+		replay_sample(&cpus[samples[i].cpu], &samples[i],
+			      freqs[nr_freqs - 1]);
+
+	printf("%-4s %-9s %9s %11s %9s %9s %11s %10s %10s\n", "cpu", "governor",
+	       "samples", "transitions", "time_s", "busy_s", "energy",
+	       "saturated", "unserved");
+
+	for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+		if (!cpus[cpu].valid)
+			continue;
+		print_result("recorded", cpu, &cpus[cpu].recorded);
+		print_result("replay", cpu, &cpus[cpu].replay);
+		sum_result(&rec_total, &cpus[cpu].recorded);
+		sum_result(&replay_total, &cpus[cpu].replay);
+	}
+	print_result("recorded", -1, &rec_total);
+	print_result("replay", -1, &replay_total);
+
+	return 0;
+}
@@ -0,0 +1,206 @@
+/*
+ * fault-bench -- multithreaded anonymous page fault microbenchmark
+ *
+ * Each thread maps a private anonymous region of its own, touches every
+ * page of it and drops the pages again with MADV_DONTNEED, which keeps
+ * the page tables, for the duration of the run. Optionally another
+ * thread keeps mapping, mprotecting and unmapping a small region at the
+ * same time, so that faults contend with mmap_sem writers as they do
+ * in a process whose heap or JIT cache changes while its threads run.
+ *
+ * The faults per second and the speculative_pgfault counters from
+ * /proc/vmstat are printed at the end, when the kernel has them.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+static unsigned int nr_threads = 4;
+static size_t region_size = 16 << 20;
+static unsigned int duration = 5;	/* seconds */
+static int churn;
+static int read_faults;
+
+static volatile int stop;
+static long page_size;
+
+struct worker {
+	pthread_t thread;
+	unsigned long faults;
+};
+
+static void usage(void)
+{
+	fprintf(stderr,
+"Usage: fault-bench [options]\n"
+"  -t N      number of faulting threads (default 4)\n"
+"  -s MB     region size per thread in MB (default 16)\n"
+"  -d SEC    duration in seconds (default 5)\n"
+"  -c        run a thread doing mmap/mprotect/munmap meanwhile\n"
+"  -r        read faults (zero page) instead of write faults\n");
+	exit(1);
+}
+
+static void *fault_thread(void *arg)
+{
+	struct worker *w = arg;
+	volatile char *region;
+	size_t off;
+	char sum = 0;
+
+	region = mmap(NULL, region_size, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (region == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+
+	while (!stop) {
+		for (off = 0; off < region_size && !stop; off += page_size) {
+			if (read_faults)
+				sum += region[off];
+			else
+				region[off] = 1;
+			w->faults++;
+		}
+		madvise((void *)region, region_size, MADV_DONTNEED);
+	}
+
+	munmap((void *)region, region_size);
+	return (void *)(long)sum;
+}
+
+static void *churn_thread(void *arg)
+{
+	unsigned long *ops = arg;
+	void *p;
+
+	while (!stop) {
+		p = mmap(NULL, 4 * page_size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+		mprotect(p, page_size, PROT_READ);
+		munmap(p, 4 * page_size);
+		(*ops)++;
+	}
+	return NULL;
+}
+
+static int read_vmstat(const char *name, unsigned long long *val)
+{
+	char line[256];
+	size_t len = strlen(name);
+	FILE *f;
+	int found = 0;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return 0;
+	while (fgets(line, sizeof(line), f)) {
+		if (!strncmp(line, name, len) && line[len] == ' ') {
+			*val = strtoull(line + len + 1, NULL, 10);
+			found = 1;
+			break;
+		}
+	}
+	fclose(f);
+	return found;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long spf0 = 0, spf1 = 0, abort0 = 0, abort1 = 0;
+	unsigned long total = 0, churn_ops = 0;
+	struct timeval start, end;
+	pthread_t churner;
+	struct worker *workers;
+	double secs;
+	unsigned int i;
+	int opt, have_spf;
+
+	while ((opt = getopt(argc, argv, "t:s:d:crh")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			region_size = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'd':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			churn = 1;
+			break;
+		case 'r':
+			read_faults = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (!nr_threads || !region_size || !duration)
+		usage();
+
+	page_size = sysconf(_SC_PAGESIZE);
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers) {
+		perror("calloc");
+		return 1;
+	}
+
+	have_spf = read_vmstat("speculative_pgfault", &spf0) &&
+		   read_vmstat("speculative_pgfault_abort", &abort0);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&workers[i].thread, NULL, fault_thread,
+				   &workers[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	if (churn && pthread_create(&churner, NULL, churn_thread, &churn_ops)) {
+		perror("pthread_create");
+		return 1;
+	}
+
+	sleep(duration);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		total += workers[i].faults;
+	}
+	if (churn)
+		pthread_join(churner, NULL);
+	gettimeofday(&end, NULL);
+
+	secs = (end.tv_sec - start.tv_sec) +
+	       (end.tv_usec - start.tv_usec) / 1e6;
+
+	printf("threads %u  %s faults %lu  %.0f faults/s  %.0f faults/s/thread\n",
+	       nr_threads, read_faults ? "read" : "write", total,
+	       total / secs, total / secs / nr_threads);
+	if (churn)
+		printf("mmap/mprotect/munmap cycles %lu  %.0f/s\n",
+		       churn_ops, churn_ops / secs);
+	if (have_spf && read_vmstat("speculative_pgfault", &spf1) &&
+	    read_vmstat("speculative_pgfault_abort", &abort1))
+		printf("speculative_pgfault %llu  speculative_pgfault_abort %llu\n",
+		       spf1 - spf0, abort1 - abort0);
+
+	return 0;
+}
@@ -0,0 +1,424 @@
+/*
+ * loop-dio-test -- direct I/O mode of loop devices
+ *
+ * Runs a few checks of LO_FLAGS_DIRECT_IO against backing files in a
+ * directory of the file system to test:
+ *
+ *   sparse      a sparse backing file is refused
+ *   unwritten   a backing file preallocated with fallocate() is refused
+ *   data        processes write their own blocks of the loop device with
+ *               O_DIRECT and read them back, in buffered and then direct
+ *               I/O mode; the backing file must hold what the loop device
+ *               returned, and the throughput of both modes is reported
+ *   discard     a discard is refused in direct I/O mode, which stays on;
+ *               in buffered mode it punches a hole into the backing file
+ *               and reads back as zeroes
+ *
+ * Needs root and a free loop device. Exits with 1 if a check failed.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <linux/fs.h>
+#include <linux/loop.h>
+
+#ifndef LO_FLAGS_DIRECT_IO
+#define LO_FLAGS_DIRECT_IO	16
+#endif
+
+static size_t file_size = 64 << 20;
+static size_t block_size = 64 << 10;
+static unsigned int nr_procs = 4;
+static unsigned int nr_passes = 4;
+static const char *dir;
+
+static char loop_dev[64];
+static int failed;
+
+static void usage(void)
+{
+	fprintf(stderr,
+"Usage: loop-dio-test [options] DIR\n"
+"  -s MB     size of the backing files in MB (default 64)\n"
+"  -b KB     size of each IO in kB (default 64)\n"
+"  -p N      number of processes for the data check (default 4)\n"
+"  -n N      passes over the device for the data check (default 4)\n");
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static void check(int ok, const char *test, const char *what)
+{
+	printf("%-10s %-50s %s\n", test, what, ok ? "ok" : "FAILED");
+	if (!ok)
+		failed = 1;
+}
+
+static void *alloc_buf(void)
+{
+	void *buf;
+
+	if (posix_memalign(&buf, 4096, block_size))
+		die("memory");
+	return buf;
+}
+
+/* Create a backing file: written, sparse or preallocated */
+static int create_file(const char *path, const char *how)
+{
+	void *buf = alloc_buf();
+	off_t off;
+	int fd;
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		die(path);
+
+	if (!strcmp(how, "written")) {
+		memset(buf, 0, block_size);
+		for (off = 0; off < file_size; off += block_size)
+			if (pwrite(fd, buf, block_size, off) != block_size)
+				die(path);
+	} else if (!strcmp(how, "sparse")) {
+		if (ftruncate(fd, file_size))
+			die(path);
+	} else if (fallocate(fd, 0, 0, file_size)) {
+		free(buf);
+		close(fd);
+		return -1;
+	}
+	if (fsync(fd))
+		die(path);
+	free(buf);
+	return fd;
+}
+
+static int loop_attach(int file_fd)
+{
+	int ctl, nr, fd;
+
+	ctl = open("/dev/loop-control", O_RDWR);
+	if (ctl < 0)
+		die("/dev/loop-control");
+	nr = ioctl(ctl, LOOP_CTL_GET_FREE);
+	if (nr < 0)
+		die("LOOP_CTL_GET_FREE");
+	close(ctl);
+
+	snprintf(loop_dev, sizeof(loop_dev), "/dev/loop%d", nr);
+	fd = open(loop_dev, O_RDWR);
+	if (fd < 0)
+		die(loop_dev);
+	if (ioctl(fd, LOOP_SET_FD, file_fd))
+		die("LOOP_SET_FD");
+	return fd;
+}
+
+static void loop_detach(int fd)
+{
+	if (ioctl(fd, LOOP_CLR_FD, 0))
+		perror("LOOP_CLR_FD");
+	close(fd);
+}
+
+static int set_direct_io(int fd, int on)
+{
+	struct loop_info64 info;
+
+	if (ioctl(fd, LOOP_GET_STATUS64, &info))
+		die("LOOP_GET_STATUS64");
+	if (on)
+		info.lo_flags |= LO_FLAGS_DIRECT_IO;
+	else
+		info.lo_flags &= ~LO_FLAGS_DIRECT_IO;
+	return ioctl(fd, LOOP_SET_STATUS64, &info) ? -errno : 0;
+}
+
+/* What /sys/block/loopN/loop/direct_io says */
+static int direct_io_state(void)
+{
+	char path[128];
+	FILE *f;
+	int val = -1;
+
+	snprintf(path, sizeof(path), "/sys/block/%s/loop/direct_io",
+		 loop_dev + 5);
+	f = fopen(path, "r");
+	if (!f)
+		die(path);
+	if (fscanf(f, "%d", &val) != 1)
+		val = -1;
+	fclose(f);
+	return val;
+}
+
+static void test_refused(const char *how)
+{
+	char path[4096], what[80];
+	int file_fd, fd, err;
+
+	snprintf(path, sizeof(path), "%s/loop-dio-test.%s", dir, how);
+	file_fd = create_file(path, how);
+	if (file_fd < 0) {
+		printf("%-10s %-50s skipped\n", how,
+		       "fallocate() not supported");
+		unlink(path);
+		return;
+	}
+
+	fd = loop_attach(file_fd);
+	err = set_direct_io(fd, 1);
+	snprintf(what, sizeof(what), "%s file refused (%s)", how,
+		 strerror(-err));
+	check(err == -EINVAL && direct_io_state() == 0, how, what);
+
+	loop_detach(fd);
+	close(file_fd);
+	unlink(path);
+}
+
+static void fill(uint64_t *buf, uint64_t block, unsigned int pass)
+{
+	size_t i;
+
+	for (i = 0; i < block_size / sizeof(*buf); i++)
+		buf[i] = (block << 16 | pass) + i;
+}
+
+static int verify(uint64_t *buf, uint64_t block, unsigned int pass)
+{
+	size_t i;
+
+	for (i = 0; i < block_size / sizeof(*buf); i++)
+		if (buf[i] != (block << 16 | pass) + i)
+			return 0;
+	return 1;
+}
+
+/*
+ * Process @id writes and reads back blocks id, id + nr_procs... of the
+ * loop device, @nr_passes times; returns nonzero on a mismatch.
+ */
+static int data_proc(unsigned int id, unsigned int first_pass)
+{
+	uint64_t nr_blocks = file_size / block_size, block;
+	uint64_t *buf = alloc_buf();
+	unsigned int pass;
+	int fd, bad = 0;
+
+	fd = open(loop_dev, O_RDWR | O_DIRECT);
+	if (fd < 0)
+		die(loop_dev);
+
+	for (pass = first_pass; pass < first_pass + nr_passes; pass++) {
+		for (block = id; block < nr_blocks; block += nr_procs) {
+			fill(buf, block, pass);
+			if (pwrite(fd, buf, block_size,
+				   block * block_size) != block_size)
+				die("write");
+		}
+		for (block = id; block < nr_blocks; block += nr_procs) {
+			if (pread(fd, buf, block_size,
+				  block * block_size) != block_size)
+				die("read");
+			bad |= !verify(buf, block, pass);
+		}
+	}
+	close(fd);
+	return bad;
+}
+
+/* Run the data processes, returning MB/s written and read */
+static double run_data(unsigned int first_pass, int *bad)
+{
+	double start, mbytes;
+	unsigned int i;
+	int status;
+
+	start = now();
+	for (i = 0; i < nr_procs; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0)
+			die("fork");
+		if (!pid)
+			exit(data_proc(i, first_pass));
+	}
+	for (i = 0; i < nr_procs; i++) {
+		if (wait(&status) < 0)
+			die("wait");
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			*bad = 1;
+	}
+
+	mbytes = 2.0 * nr_passes * (file_size / block_size) * block_size;
+	return mbytes / (1 << 20) / (now() - start);
+}
+
+/* Check that the backing file holds what the last pass wrote */
+static int verify_file(const char *path, unsigned int pass)
+{
+	uint64_t *buf = alloc_buf();
+	uint64_t block;
+	int fd, ok = 1;
+
+	fd = open(path, O_RDONLY | O_DIRECT);
+	if (fd < 0)
+		die(path);
+	for (block = 0; block < file_size / block_size; block++) {
+		if (pread(fd, buf, block_size,
+			  block * block_size) != block_size)
+			die(path);
+		ok &= verify(buf, block, pass);
+	}
+	close(fd);
+	free(buf);
+	return ok;
+}
+
+static void test_data(void)
+{
+	double buffered, direct;
+	char path[4096], what[80];
+	int file_fd, fd, bad = 0;
+
+	snprintf(path, sizeof(path), "%s/loop-dio-test.data", dir);
+	file_fd = create_file(path, "written");
+	fd = loop_attach(file_fd);
+
+	buffered = run_data(0, &bad);
+	check(!bad, "data", "buffered mode reads back what was written");
+
+	check(!set_direct_io(fd, 1) && direct_io_state() == 1, "data",
+	      "direct I/O enabled on a written file");
+	bad = 0;
+	direct = run_data(nr_passes, &bad);
+	check(!bad, "data", "direct I/O reads back what was written");
+
+	check(!set_direct_io(fd, 0) && direct_io_state() == 0, "data",
+	      "direct I/O disabled");
+	check(verify_file(path, 2 * nr_passes - 1), "data",
+	      "backing file holds the data written");
+
+	snprintf(what, sizeof(what), "%u processes: buffered %.0f MB/s, "
+		 "direct %.0f MB/s", nr_procs, buffered, direct);
+	printf("%-10s %s\n", "data", what);
+
+	loop_detach(fd);
+	close(file_fd);
+	unlink(path);
+}
+
+static void test_discard(void)
+{
+	uint64_t range[2] = { 0, file_size / 2 };
+	uint64_t *buf = alloc_buf();
+	char path[4096];
+	struct stat before, after;
+	int file_fd, fd, dev_fd, zero = 1;
+	size_t i;
+
+	snprintf(path, sizeof(path), "%s/loop-dio-test.discard", dir);
+	file_fd = create_file(path, "written");
+	fd = loop_attach(file_fd);
+
+	if (set_direct_io(fd, 1)) {
+		check(0, "discard", "direct I/O enabled on a written file");
+		goto out;
+	}
+	check(ioctl(fd, BLKDISCARD, range) && errno == EOPNOTSUPP &&
+	      direct_io_state() == 1, "discard",
+	      "refused in direct I/O mode, which stays on");
+	check(!set_direct_io(fd, 0), "discard", "direct I/O disabled");
+
+	fstat(file_fd, &before);
+	if (ioctl(fd, BLKDISCARD, range)) {
+		printf("%-10s %-50s skipped\n", "discard",
+		       "discard not supported");
+		goto out;
+	}
+	fstat(file_fd, &after);
+
+	check(after.st_blocks < before.st_blocks, "discard",
+	      "hole punched into the backing file");
+
+	dev_fd = open(loop_dev, O_RDONLY | O_DIRECT);
+	if (dev_fd < 0 || pread(dev_fd, buf, block_size, 0) != block_size)
+		die(loop_dev);
+	for (i = 0; i < block_size / sizeof(*buf); i++)
+		zero &= !buf[i];
+	check(zero, "discard", "discarded range reads back as zeroes");
+	close(dev_fd);
+
+	check(set_direct_io(fd, 1) == -EINVAL, "discard",
+	      "direct I/O refused on the file with a hole");
+out:
+	loop_detach(fd);
+	close(file_fd);
+	unlink(path);
+	free(buf);
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:b:p:n:h")) != -1) {
+		switch (opt) {
+		case 's':
+			file_size = (size_t)strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'b':
+			block_size = (size_t)strtoul(optarg, NULL, 0) << 10;
+			break;
+		case 'p':
+			nr_procs = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			nr_passes = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 1 || !block_size || (block_size & 4095) ||
+	    file_size < block_size || !nr_procs || !nr_passes)
+		usage();
+	dir = argv[optind];
+	file_size -= file_size % block_size;
+
+	test_refused("sparse");
+	test_refused("unwritten");
+	test_data();
+	test_discard();
+
+	return failed;
+}
@@ -0,0 +1,295 @@
+/*
+ * lru-bench -- page reclaim under a hot working set and streaming I/O
+ *
+ * One thread keeps touching an anonymous working set while others read
+ * a file that is larger than what is left of memory from start to end
+ * over and over, the way a media scanner or a backup competes with the
+ * foreground application. Good reclaim keeps the working set resident
+ * and recycles the use-once file pages; poor reclaim swaps the working
+ * set out and faults it back in.
+ *
+ * Reported are the working set passes and the streamed bytes per
+ * second, the major fault and swap-in counts, the cpu time kswapd spent
+ * and, when the kernel has them, the lru_gen and workingset counters
+ * from /proc/vmstat. Size the working set and the file for the memory
+ * of the machine, or run it in a memory-limited cgroup.
+ *
+ * With -w 0 and a file that fits into memory but not into the inactive
+ * list, only the readers run: a kernel without refault detection keeps
+ * evicting the file before it is read again, one with it settles with
+ * the file on the active list.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#define BUF_SIZE	(256 << 10)
+
+static size_t hot_size = 256 << 20;
+static size_t file_size = 1024 << 20;
+static unsigned int nr_readers = 1;
+static unsigned int duration = 30;	/* seconds */
+static const char *path = "lru-bench.data";
+static int keep_file;
+
+static volatile int stop;
+static long page_size;
+
+static const char *counters[] = {
+	"pgmajfault", "pswpin", "pswpout", "pgscan_kswapd_normal",
+	"pgsteal_normal", "lru_gen_aging", "lru_gen_young",
+	"lru_gen_promote", "workingset_refault", "workingset_activate",
+};
+#define NR_COUNTERS	(sizeof(counters) / sizeof(counters[0]))
+
+struct reader {
+	pthread_t thread;
+	unsigned long long bytes;
+};
+
+static void usage(void)
+{
+	fprintf(stderr,
+"Usage: lru-bench [options]\n"
+"  -w MB     hot anonymous working set in MB (default 256, 0 for none)\n"
+"  -f MB     size of the streamed file in MB (default 1024)\n"
+"  -r N      number of streaming readers (default 1)\n"
+"  -d SEC    duration in seconds (default 30)\n"
+"  -p PATH   file to stream (default lru-bench.data, created if\n"
+"            missing and then removed unless -k is given)\n"
+"  -k        keep the file afterwards\n");
+	exit(1);
+}
+
+static void create_file(void)
+{
+	char *buf;
+	size_t done;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path);
+		exit(1);
+	}
+	buf = malloc(BUF_SIZE);
+	if (!buf) {
+		perror("malloc");
+		exit(1);
+	}
+	memset(buf, 0x5a, BUF_SIZE);
+	for (done = 0; done < file_size; done += BUF_SIZE)
+		if (write(fd, buf, BUF_SIZE) != BUF_SIZE) {
+			perror("write");
+			exit(1);
+		}
+	fsync(fd);
+	close(fd);
+	free(buf);
+}
+
+static void *reader_thread(void *arg)
+{
+	struct reader *r = arg;
+	char *buf;
+	ssize_t ret;
+	int fd;
+
+	buf = malloc(BUF_SIZE);
+	fd = open(path, O_RDONLY);
+	if (!buf || fd < 0) {
+		perror(path);
+		exit(1);
+	}
+	while (!stop) {
+		ret = read(fd, buf, BUF_SIZE);
+		if (ret <= 0) {
+			lseek(fd, 0, SEEK_SET);
+			continue;
+		}
+		r->bytes += ret;
+	}
+	close(fd);
+	free(buf);
+	return NULL;
+}
+
+static void *hot_thread(void *arg)
+{
+	unsigned long *passes = arg;
+	volatile char *hot;
+	size_t off;
+
+	hot = mmap(NULL, hot_size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (hot == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	while (!stop) {
+		for (off = 0; off < hot_size && !stop; off += page_size)
+			hot[off]++;
+		(*passes)++;
+	}
+	munmap((void *)hot, hot_size);
+	return NULL;
+}
+
+static void read_vmstat(unsigned long long *val)
+{
+	char line[256];
+	unsigned int i;
+	size_t len;
+	FILE *f;
+
+	memset(val, 0, NR_COUNTERS * sizeof(*val));
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return;
+	while (fgets(line, sizeof(line), f)) {
+		for (i = 0; i < NR_COUNTERS; i++) {
+			len = strlen(counters[i]);
+			if (!strncmp(line, counters[i], len) &&
+			    line[len] == ' ')
+				val[i] = strtoull(line + len + 1, NULL, 10);
+		}
+	}
+	fclose(f);
+}
+
+/* utime + stime of all kswapd threads, in clock ticks */
+static unsigned long long kswapd_ticks(void)
+{
+	unsigned long long total = 0, utime, stime;
+	char name[300], comm[64];
+	struct dirent *de;
+	DIR *proc;
+	FILE *f;
+
+	proc = opendir("/proc");
+	if (!proc)
+		return 0;
+	while ((de = readdir(proc))) {
+		if (de->d_name[0] < '0' || de->d_name[0] > '9')
+			continue;
+		snprintf(name, sizeof(name), "/proc/%s/stat", de->d_name);
+		f = fopen(name, "r");
+		if (!f)
+			continue;
+		if (fscanf(f, "%*d (%63[^)]) %*c %*d %*d %*d %*d %*d %*u "
+			   "%*u %*u %*u %*u %llu %llu", comm, &utime,
+			   &stime) == 3 && !strncmp(comm, "kswapd", 6))
+			total += utime + stime;
+		fclose(f);
+	}
+	closedir(proc);
+	return total;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long before[NR_COUNTERS], after[NR_COUNTERS];
+	unsigned long long ticks, bytes = 0;
+	unsigned long passes = 0;
+	struct timeval start, end;
+	struct reader *readers;
+	pthread_t hot;
+	unsigned int i;
+	double secs;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "w:f:r:d:p:kh")) != -1) {
+		switch (opt) {
+		case 'w':
+			hot_size = (size_t)strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'f':
+			file_size = (size_t)strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'r':
+			nr_readers = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			path = optarg;
+			break;
+		case 'k':
+			keep_file = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (!file_size || !nr_readers || !duration)
+		usage();
+
+	page_size = sysconf(_SC_PAGESIZE);
+	readers = calloc(nr_readers, sizeof(*readers));
+	if (!readers) {
+		perror("calloc");
+		return 1;
+	}
+	if (access(path, R_OK))
+		create_file();
+	else
+		keep_file = 1;
+
+	read_vmstat(before);
+	ticks = kswapd_ticks();
+	gettimeofday(&start, NULL);
+
+	if (hot_size && pthread_create(&hot, NULL, hot_thread, &passes)) {
+		perror("pthread_create");
+		return 1;
+	}
+	for (i = 0; i < nr_readers; i++)
+		if (pthread_create(&readers[i].thread, NULL, reader_thread,
+				   &readers[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+
+	sleep(duration);
+	stop = 1;
+
+	if (hot_size)
+		pthread_join(hot, NULL);
+	for (i = 0; i < nr_readers; i++) {
+		pthread_join(readers[i].thread, NULL);
+		bytes += readers[i].bytes;
+	}
+	gettimeofday(&end, NULL);
+	ticks = kswapd_ticks() - ticks;
+	read_vmstat(after);
+
+	secs = (end.tv_sec - start.tv_sec) +
+	       (end.tv_usec - start.tv_usec) / 1e6;
+
+	if (hot_size)
+		printf("working set %zu MB  %.2f passes/s\n", hot_size >> 20,
+		       passes / secs);
+	printf("streaming   %zu MB x %u  %.1f MB/s\n", file_size >> 20,
+	       nr_readers, bytes / secs / (1 << 20));
+	printf("kswapd      %.2f s cpu\n",
+	       (double)ticks / sysconf(_SC_CLK_TCK));
+	for (i = 0; i < NR_COUNTERS; i++)
+		printf("%-20s %llu\n", counters[i], after[i] - before[i]);
+
+	if (!keep_file)
+		unlink(path);
+	return 0;
+}
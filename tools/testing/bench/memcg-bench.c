@@ -0,0 +1,324 @@
+/*
+ * memcg-bench -- page faults of many processes in many memory cgroups
+ *
+ * One process per cpu faults in the pages of a private anonymous region
+ * and drops them again with MADV_DONTNEED, for the duration of the run,
+ * so that every fault charges a page to its memory cgroup and every
+ * MADV_DONTNEED uncharges it. The processes are spread over a number of
+ * cgroups created below a common parent with use_hierarchy set, each of
+ * them a number of levels deep, so that charges go up a hierarchy as they
+ * do on a system that nests cgroups for users, sessions and services.
+ * Meanwhile the main process keeps reading memory.stat of the parent,
+ * whose totals cover all the cgroups below it.
+ *
+ * Reported are the faults per second, overall and per process, the time
+ * a read of memory.stat took, and the total_pgfault of memory.stat against
+ * the faults counted. Run it with 1, 2, 4... processes to see how charging
+ * scales with the number of cpus.
+ *
+ * The memory controller must be mounted, /sys/fs/cgroup/memory by default.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#define PATH_LEN	512
+
+static unsigned int nr_procs;
+static unsigned int nr_groups = 4;
+static unsigned int depth = 1;
+static size_t region_size = 16 << 20;
+static size_t limit;
+static unsigned int duration = 10;	/* seconds */
+static int read_stat = 1;
+static const char *mount_point = "/sys/fs/cgroup/memory";
+
+static char top[PATH_LEN];
+static long page_size;
+
+/* Shared with the faulting processes */
+struct shared {
+	volatile int start;
+	volatile int stop;
+	unsigned long long faults[0];
+};
+static struct shared *shared;
+
+static void usage(void)
+{
+	fprintf(stderr,
+"Usage: memcg-bench [options]\n"
+"  -p N      number of faulting processes, one per cpu (default all cpus)\n"
+"  -g N      number of cgroups the processes are spread over (default 4)\n"
+"  -D N      levels of cgroups below the parent (default 1)\n"
+"  -s MB     region size per process in MB (default 16)\n"
+"  -l MB     memory limit of each cgroup in MB (default none)\n"
+"  -d SEC    duration in seconds (default 10)\n"
+"  -n        do not read memory.stat meanwhile\n"
+"  -m PATH   mount point of the memory controller\n"
+"            (default /sys/fs/cgroup/memory)\n");
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void write_file(const char *dir, const char *file, const char *val)
+{
+	char path[PATH_LEN + 32];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, file);
+	f = fopen(path, "w");
+	if (!f || fputs(val, f) < 0 || fclose(f)) {
+		perror(path);
+		exit(1);
+	}
+}
+
+/* The cgroup at @level of group @group, level 1 being g<group> itself */
+static void group_path(char *path, unsigned int group, unsigned int level)
+{
+	unsigned int i;
+	int len;
+
+	len = snprintf(path, PATH_LEN, "%s/g%u", top, group);
+	for (i = 1; i < level; i++)
+		len += snprintf(path + len, PATH_LEN - len, "/l%u", i);
+}
+
+static void make_dir(const char *path)
+{
+	if (mkdir(path, 0755) && errno != EEXIST) {
+		perror(path);
+		exit(1);
+	}
+}
+
+static void create_groups(void)
+{
+	char path[PATH_LEN], val[32];
+	unsigned int g, l;
+
+	snprintf(top, sizeof(top), "%s/memcg-bench", mount_point);
+	make_dir(top);
+	write_file(top, "memory.use_hierarchy", "1");
+
+	for (g = 0; g < nr_groups; g++) {
+		for (l = 1; l <= depth; l++) {
+			group_path(path, g, l);
+			make_dir(path);
+		}
+		if (limit) {
+			snprintf(val, sizeof(val), "%zu", limit);
+			write_file(path, "memory.limit_in_bytes", val);
+		}
+	}
+}
+
+static void remove_groups(void)
+{
+	char path[PATH_LEN];
+	unsigned int g, l;
+
+	for (g = 0; g < nr_groups; g++) {
+		for (l = depth; l >= 1; l--) {
+			group_path(path, g, l);
+			if (rmdir(path))
+				perror(path);
+		}
+	}
+	if (rmdir(top))
+		perror(top);
+}
+
+static void fault_proc(unsigned int id)
+{
+	char path[PATH_LEN], pid[32];
+	unsigned long long faults = 0;
+	volatile char *region;
+	cpu_set_t set;
+	size_t off;
+
+	CPU_ZERO(&set);
+	CPU_SET(id % sysconf(_SC_NPROCESSORS_ONLN), &set);
+	sched_setaffinity(0, sizeof(set), &set);
+
+	group_path(path, id % nr_groups, depth);
+	snprintf(pid, sizeof(pid), "%d", getpid());
+	write_file(path, "tasks", pid);
+
+	region = mmap(NULL, region_size, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (region == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+
+	while (!shared->start && !shared->stop)
+		sched_yield();
+
+	while (!shared->stop) {
+		for (off = 0; off < region_size && !shared->stop;
+		     off += page_size) {
+			region[off] = 1;
+			faults++;
+		}
+		madvise((void *)region, region_size, MADV_DONTNEED);
+	}
+	/* Not bumped per fault, the counters share cachelines */
+	shared->faults[id] = faults;
+	exit(0);
+}
+
+/* Read memory.stat of @dir, returning its total_pgfault */
+static unsigned long long read_memory_stat(const char *dir)
+{
+	char path[PATH_LEN + 32], line[256];
+	unsigned long long pgfault = 0;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/memory.stat", dir);
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), f))
+		if (!strncmp(line, "total_pgfault ", 14))
+			pgfault = strtoull(line + 14, NULL, 10);
+	fclose(f);
+	return pgfault;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long faults = 0, min = ~0ULL, max = 0;
+	unsigned long long pgfault_before, pgfault_after;
+	unsigned long nr_reads = 0;
+	double start, end, t, read_time = 0;
+	unsigned int i;
+	pid_t *pids;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "p:g:D:s:l:d:nm:h")) != -1) {
+		switch (opt) {
+		case 'p':
+			nr_procs = strtoul(optarg, NULL, 0);
+			break;
+		case 'g':
+			nr_groups = strtoul(optarg, NULL, 0);
+			break;
+		case 'D':
+			depth = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			region_size = (size_t)strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'l':
+			limit = (size_t)strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'd':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			read_stat = 0;
+			break;
+		case 'm':
+			mount_point = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (!nr_procs)
+		nr_procs = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!nr_procs || !nr_groups || !depth || !region_size || !duration)
+		usage();
+
+	page_size = sysconf(_SC_PAGESIZE);
+	shared = mmap(NULL, sizeof(*shared) + nr_procs * sizeof(long long),
+		      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	pids = calloc(nr_procs, sizeof(*pids));
+	if (shared == MAP_FAILED || !pids) {
+		perror("memory");
+		return 1;
+	}
+
+	create_groups();
+
+	for (i = 0; i < nr_procs; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			perror("fork");
+			shared->stop = 1;
+			break;
+		}
+		if (!pids[i])
+			fault_proc(i);
+	}
+
+	/* Let them all join their cgroup first */
+	sleep(1);
+	pgfault_before = read_memory_stat(top);
+	start = now();
+	shared->start = 1;
+
+	end = start + duration;
+	while ((t = now()) < end) {
+		if (read_stat) {
+			read_memory_stat(top);
+			read_time += now() - t;
+			nr_reads++;
+			usleep(10000);
+		} else {
+			sleep(1);
+		}
+	}
+	shared->stop = 1;
+	end = now();
+
+	for (i = 0; i < nr_procs; i++) {
+		if (pids[i] > 0)
+			waitpid(pids[i], NULL, 0);
+		faults += shared->faults[i];
+		if (shared->faults[i] < min)
+			min = shared->faults[i];
+		if (shared->faults[i] > max)
+			max = shared->faults[i];
+	}
+	pgfault_after = read_memory_stat(top);
+
+	printf("processes   %u in %u cgroups, %u levels deep\n",
+	       nr_procs, nr_groups, depth);
+	printf("faults/s    %.0f total  %.0f min  %.0f max per process\n",
+	       faults / (end - start), min / (end - start),
+	       max / (end - start));
+	if (nr_reads)
+		printf("memory.stat %lu reads  %.1f us per read\n",
+		       nr_reads, read_time * 1e6 / nr_reads);
+	printf("total_pgfault %llu  faults counted %llu\n",
+	       pgfault_after - pgfault_before, faults);
+
+	remove_groups();
+	return 0;
+}
@@ -0,0 +1,170 @@
+/*
+ * ra-bench -- readahead of interleaved and strided reads of one file
+ *
+ * Drops the page cache of a file and reads it through one descriptor in
+ * one of three patterns:
+ *
+ *   seq         one sequential pass
+ *   interleave  N sequential streams over N equal parts of the file,
+ *               one read from each in turn, as when unpacking several
+ *               members of a zip archive or merging sorted runs
+ *   stride      one read every S kB, as when scanning the records of a
+ *               fixed-size table
+ *
+ * Reported are the throughput and the readahead counters of the backing
+ * device from /sys/class/bdi/<bdi>/, when the kernel provides them.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/sysmacros.h>
+
+static const char *counters[] = {
+	"read_ahead_submitted_kb", "read_ahead_hit_kb", "read_ahead_wasted_kb",
+};
+#define NR_COUNTERS	(sizeof(counters) / sizeof(counters[0]))
+
+static size_t read_size = 4096;
+static unsigned int nr_streams = 4;
+static size_t stride = 64 << 10;
+static const char *pattern = "seq";
+static char bdi_dir[64];
+
+static void usage(void)
+{
+	fprintf(stderr,
+"Usage: ra-bench [options] FILE\n"
+"  -p PATTERN  seq, interleave or stride (default seq)\n"
+"  -r KB       size of each read in kB (default 4)\n"
+"  -n N        number of streams for interleave (default 4)\n"
+"  -s KB       distance between reads for stride (default 64)\n");
+	exit(1);
+}
+
+static void read_counters(unsigned long long *val)
+{
+	char path[128];
+	unsigned int i;
+	FILE *f;
+
+	for (i = 0; i < NR_COUNTERS; i++) {
+		val[i] = 0;
+		snprintf(path, sizeof(path), "%s/%s", bdi_dir, counters[i]);
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		if (fscanf(f, "%llu", &val[i]) != 1)
+			val[i] = 0;
+		fclose(f);
+	}
+}
+
+static void do_read(int fd, char *buf, off_t pos)
+{
+	if (pread(fd, buf, read_size, pos) < 0) {
+		perror("pread");
+		exit(1);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long before[NR_COUNTERS], after[NR_COUNTERS];
+	struct timeval start, end;
+	unsigned long long bytes = 0;
+	off_t pos, part, size;
+	struct stat st;
+	unsigned int i;
+	double secs;
+	char *buf;
+	int opt, fd;
+
+	while ((opt = getopt(argc, argv, "p:r:n:s:h")) != -1) {
+		switch (opt) {
+		case 'p':
+			pattern = optarg;
+			break;
+		case 'r':
+			read_size = strtoul(optarg, NULL, 0) << 10;
+			break;
+		case 'n':
+			nr_streams = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			stride = strtoul(optarg, NULL, 0) << 10;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 1 || !read_size || !nr_streams || !stride)
+		usage();
+
+	fd = open(argv[optind], O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		perror(argv[optind]);
+		return 1;
+	}
+	size = st.st_size;
+	snprintf(bdi_dir, sizeof(bdi_dir), "/sys/class/bdi/%u:%u",
+		 major(st.st_dev), minor(st.st_dev));
+
+	buf = malloc(read_size);
+	if (!buf) {
+		perror("malloc");
+		return 1;
+	}
+
+	if (posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED))
+		fprintf(stderr, "cannot drop the cached pages of the file\n");
+
+	read_counters(before);
+	gettimeofday(&start, NULL);
+
+	if (!strcmp(pattern, "seq")) {
+		for (pos = 0; pos < size; pos += read_size) {
+			do_read(fd, buf, pos);
+			bytes += read_size;
+		}
+	} else if (!strcmp(pattern, "interleave")) {
+		part = size / nr_streams / read_size * read_size;
+		for (pos = 0; pos < part; pos += read_size) {
+			for (i = 0; i < nr_streams; i++)
+				do_read(fd, buf, i * part + pos);
+			bytes += (unsigned long long)read_size * nr_streams;
+		}
+	} else if (!strcmp(pattern, "stride")) {
+		for (pos = 0; pos < size; pos += stride) {
+			do_read(fd, buf, pos);
+			bytes += read_size;
+		}
+	} else {
+		usage();
+	}
+
+	gettimeofday(&end, NULL);
+	read_counters(after);
+
+	secs = (end.tv_sec - start.tv_sec) +
+	       (end.tv_usec - start.tv_usec) / 1e6;
+
+	printf("%-24s %llu kB in %.3f s  %.1f MB/s\n", pattern, bytes >> 10,
+	       secs, bytes / secs / (1 << 20));
+	for (i = 0; i < NR_COUNTERS; i++)
+		printf("%-24s %llu\n", counters[i], after[i] - before[i]);
+
+	free(buf);
+	close(fd);
+	return 0;
+}
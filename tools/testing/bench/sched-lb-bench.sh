@@ -0,0 +1,114 @@
+#!/bin/bash
+#
+# sched-lb-bench.sh -- A/B comparison of the LB_LOAD_AVG sched feature
+#
+# Runs "perf bench sched messaging" (hackbench) alternately with the
+# decayed per-entity load averages (LB_LOAD_AVG) and with the
+# instantaneous weights (NO_LB_LOAD_AVG), so that both modes see the
+# same conditions, and prints the mean and standard deviation of the
+# run times of each mode.
+#
+# With -c the benchmark runs in two cpu cgroups of equal shares at the
+# same time, which exercises the group share calculation as well; the
+# times of both groups are counted.
+#
+# Needs root, debugfs mounted at /sys/kernel/debug, a kernel with
+# CONFIG_SCHED_DEBUG, and perf in $PATH or in $PERF.
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms and conditions of the GNU General Public License,
+# version 2, as published by the Free Software Foundation.
+
+FEATURES=/sys/kernel/debug/sched_features
+CPU_CGROUP=/sys/fs/cgroup/cpu
+PERF=${PERF:-perf}
+
+runs=10
+groups=10
+loops=1000
+cgroups=0
+
+usage()
+{
+	echo "Usage: sched-lb-bench.sh [options]"
+	echo "  -r N      runs per mode (default 10)"
+	echo "  -g N      hackbench groups (default 10)"
+	echo "  -l N      hackbench loops (default 1000)"
+	echo "  -c        run in two cpu cgroups at once"
+	echo "  -m PATH   mount point of the cpu controller"
+	echo "            (default /sys/fs/cgroup/cpu)"
+	exit 1
+}
+
+while getopts "r:g:l:cm:h" opt; do
+	case $opt in
+	r) runs=$OPTARG ;;
+	g) groups=$OPTARG ;;
+	l) loops=$OPTARG ;;
+	c) cgroups=1 ;;
+	m) CPU_CGROUP=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+
+if ! grep -q LB_LOAD_AVG $FEATURES 2>/dev/null; then
+	echo "$FEATURES has no LB_LOAD_AVG" >&2
+	exit 1
+fi
+
+# Seconds one hackbench run took
+hackbench()
+{
+	$PERF bench sched messaging -g $groups -l $loops 2>/dev/null |
+		awk '/Total time/ { print $3 }'
+}
+
+# Run hackbench in cgroup $1, appending the time to file $2
+hackbench_in()
+{
+	(echo $BASHPID > $CPU_CGROUP/$1/tasks && hackbench >> $2)
+}
+
+run()
+{
+	if [ $cgroups = 0 ]; then
+		hackbench >> $1
+		return
+	fi
+	hackbench_in sched-lb-bench/a $1 &
+	hackbench_in sched-lb-bench/b $1 &
+	wait
+}
+
+stats()
+{
+	awk '{ n++; s += $1; ss += $1 * $1 }
+	     END { m = s / n; v = ss / n - m * m; if (v < 0) v = 0;
+		   printf "%d runs  mean %.3fs  stddev %.3fs\n", n, m, sqrt(v) }' $1
+}
+
+if [ $cgroups = 1 ]; then
+	mkdir -p $CPU_CGROUP/sched-lb-bench/a $CPU_CGROUP/sched-lb-bench/b || exit 1
+fi
+
+saved=$(tr ' ' '\n' < $FEATURES | grep LB_LOAD_AVG)
+on=$(mktemp)
+off=$(mktemp)
+
+for i in $(seq $runs); do
+	echo LB_LOAD_AVG > $FEATURES
+	run $on
+	echo NO_LB_LOAD_AVG > $FEATURES
+	run $off
+done
+
+echo $saved > $FEATURES
+if [ $cgroups = 1 ]; then
+	rmdir $CPU_CGROUP/sched-lb-bench/a $CPU_CGROUP/sched-lb-bench/b \
+	      $CPU_CGROUP/sched-lb-bench
+fi
+
+echo "hackbench -g $groups -l $loops$([ $cgroups = 1 ] && echo ', two cgroups')"
+echo "LB_LOAD_AVG     $(stats $on)"
+echo "NO_LB_LOAD_AVG  $(stats $off)"
+rm -f $on $off
@@ -0,0 +1,383 @@
+/*
+ * throttle-bench -- blkio throttling of a hierarchy of cgroups
+ *
+ * Creates a blkio cgroup with a bandwidth limit on a block device and a
+ * number of child cgroups below it, each with a limit of its own, and
+ * runs a number of processes in each child doing O_DIRECT reads (or
+ * writes) of the device as fast as they can, like fio with a rate-less
+ * job per cgroup would. Use a loop device over a file in tmpfs, or a
+ * ram disk, so that the device itself is never the bottleneck:
+ *
+ *   dd if=/dev/zero of=/dev/shm/disk bs=1M count=256
+ *   losetup /dev/loop0 /dev/shm/disk
+ *   throttle-bench -P 4096 -c 1024 -g 4 /dev/loop0
+ *
+ * Once a second the bandwidth of every child and of the parent is
+ * printed, followed by the averages over the run against the limits.
+ * With hierarchical limits the children together stay within the limit
+ * of the parent; each of them stays within its own limit. The first
+ * second includes the burst each group may dispatch after being idle,
+ * see throttle_burst_ms in Documentation/block/queue-sysfs.txt, which
+ * can be set with -b.
+ *
+ * The blkio controller must be mounted, /sys/fs/cgroup/blkio by default.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/sysmacros.h>
+#include <linux/fs.h>
+
+#define PATH_LEN	512
+#define MAX_GROUPS	64
+
+static unsigned int nr_groups = 4;
+static unsigned int nr_procs = 2;		/* per group */
+static unsigned long parent_kbps;
+static unsigned long child_kbps;
+static unsigned long parent_iops;
+static size_t block_size = 64 << 10;
+static unsigned int duration = 10;		/* seconds */
+static int burst_ms = -1;
+static int do_write;
+static const char *mount_point = "/sys/fs/cgroup/blkio";
+
+static const char *device;
+static unsigned int dev_major, dev_minor;
+static unsigned long long dev_size;
+static char top[PATH_LEN - 16];
+
+/* One per process, each in a cacheline of its own */
+struct counter {
+	volatile unsigned long long bytes;
+	char pad[64 - sizeof(unsigned long long)];
+};
+
+struct shared {
+	volatile int start;
+	volatile int stop;
+	struct counter procs[0];
+};
+static struct shared *shared;
+
+static void usage(void)
+{
+	fprintf(stderr,
+"Usage: throttle-bench [options] DEVICE\n"
+"  -g N      number of child cgroups (default 4, at most %d)\n"
+"  -p N      processes per child cgroup (default 2)\n"
+"  -P KB     bandwidth limit of the parent in kB/s (default none)\n"
+"  -c KB     bandwidth limit of each child in kB/s (default none)\n"
+"  -I N      iops limit of the parent (default none)\n"
+"  -s KB     size of each IO in kB (default 64)\n"
+"  -d SEC    duration in seconds (default 10)\n"
+"  -b MS     set throttle_burst_ms of the device first\n"
+"  -w        write instead of read; destroys the device contents\n"
+"  -m PATH   mount point of the blkio controller\n"
+"            (default /sys/fs/cgroup/blkio)\n", MAX_GROUPS);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void write_file(const char *dir, const char *file, const char *val)
+{
+	char path[PATH_LEN + 64];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, file);
+	f = fopen(path, "w");
+	if (!f || fputs(val, f) < 0 || fclose(f)) {
+		perror(path);
+		exit(1);
+	}
+}
+
+static void set_limit(const char *dir, const char *file,
+		      unsigned long long val)
+{
+	char buf[64];
+
+	snprintf(buf, sizeof(buf), "%u:%u %llu", dev_major, dev_minor, val);
+	write_file(dir, file, buf);
+}
+
+static void group_path(char *path, unsigned int group)
+{
+	snprintf(path, PATH_LEN, "%s/c%u", top, group);
+}
+
+static void make_dir(const char *path)
+{
+	if (mkdir(path, 0755) && errno != EEXIST) {
+		perror(path);
+		exit(1);
+	}
+}
+
+static void create_groups(void)
+{
+	const char *bps = do_write ? "blkio.throttle.write_bps_device" :
+				     "blkio.throttle.read_bps_device";
+	const char *iops = do_write ? "blkio.throttle.write_iops_device" :
+				      "blkio.throttle.read_iops_device";
+	char path[PATH_LEN];
+	unsigned int g;
+
+	snprintf(top, sizeof(top), "%s/throttle-bench", mount_point);
+	make_dir(top);
+	if (parent_kbps)
+		set_limit(top, bps, parent_kbps << 10);
+	if (parent_iops)
+		set_limit(top, iops, parent_iops);
+
+	for (g = 0; g < nr_groups; g++) {
+		group_path(path, g);
+		make_dir(path);
+		if (child_kbps)
+			set_limit(path, bps, child_kbps << 10);
+	}
+}
+
+static void remove_groups(void)
+{
+	char path[PATH_LEN];
+	unsigned int g;
+
+	for (g = 0; g < nr_groups; g++) {
+		group_path(path, g);
+		if (rmdir(path))
+			perror(path);
+	}
+	if (rmdir(top))
+		perror(top);
+}
+
+static void set_burst(void)
+{
+	char dir[PATH_LEN], val[32];
+
+	snprintf(dir, sizeof(dir), "/sys/dev/block/%u:%u/queue",
+		 dev_major, dev_minor);
+	snprintf(val, sizeof(val), "%d", burst_ms);
+	write_file(dir, "throttle_burst_ms", val);
+}
+
+static void io_proc(unsigned int id)
+{
+	unsigned long long nr_blocks = dev_size / block_size;
+	char path[PATH_LEN], pid[32];
+	unsigned int seed = id;
+	ssize_t ret;
+	void *buf;
+	int fd;
+
+	group_path(path, id / nr_procs);
+	snprintf(pid, sizeof(pid), "%d", getpid());
+	write_file(path, "tasks", pid);
+
+	fd = open(device, (do_write ? O_WRONLY : O_RDONLY) | O_DIRECT);
+	if (fd < 0 || posix_memalign(&buf, 4096, block_size)) {
+		perror(device);
+		exit(1);
+	}
+	memset(buf, 0x5a, block_size);
+
+	while (!shared->start && !shared->stop)
+		usleep(1000);
+
+	while (!shared->stop) {
+		off_t off = (off_t)(rand_r(&seed) % nr_blocks) * block_size;
+
+		if (do_write)
+			ret = pwrite(fd, buf, block_size, off);
+		else
+			ret = pread(fd, buf, block_size, off);
+		if (ret < 0) {
+			perror(device);
+			exit(1);
+		}
+		shared->procs[id].bytes += ret;
+	}
+	close(fd);
+	exit(0);
+}
+
+static unsigned long long group_bytes(unsigned int group)
+{
+	unsigned long long bytes = 0;
+	unsigned int i;
+
+	for (i = group * nr_procs; i < (group + 1) * nr_procs; i++)
+		bytes += shared->procs[i].bytes;
+	return bytes;
+}
+
+static void print_rates(const char *label, unsigned long long *bytes,
+			double secs)
+{
+	unsigned long long total = 0;
+	unsigned int g;
+
+	printf("%-8s", label);
+	for (g = 0; g < nr_groups; g++) {
+		printf(" %8.0f", bytes[g] / 1024.0 / secs);
+		total += bytes[g];
+	}
+	printf(" %9.0f\n", total / 1024.0 / secs);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long last[MAX_GROUPS] = { 0 }, delta[MAX_GROUPS];
+	unsigned int i, g, nr, second = 0;
+	double start, t, next;
+	struct stat st;
+	pid_t *pids;
+	char label[16];
+	int opt, fd;
+
+	while ((opt = getopt(argc, argv, "g:p:P:c:I:s:d:b:wm:h")) != -1) {
+		switch (opt) {
+		case 'g':
+			nr_groups = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			nr_procs = strtoul(optarg, NULL, 0);
+			break;
+		case 'P':
+			parent_kbps = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			child_kbps = strtoul(optarg, NULL, 0);
+			break;
+		case 'I':
+			parent_iops = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			block_size = (size_t)strtoul(optarg, NULL, 0) << 10;
+			break;
+		case 'd':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			burst_ms = atoi(optarg);
+			break;
+		case 'w':
+			do_write = 1;
+			break;
+		case 'm':
+			mount_point = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 1 || !nr_groups || nr_groups > MAX_GROUPS ||
+	    !nr_procs || !block_size || (block_size & 511) || !duration)
+		usage();
+	device = argv[optind];
+
+	fd = open(device, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) || ioctl(fd, BLKGETSIZE64, &dev_size)) {
+		perror(device);
+		return 1;
+	}
+	close(fd);
+	if (!S_ISBLK(st.st_mode) || dev_size < block_size) {
+		fprintf(stderr, "%s: not a block device of at least %zu bytes\n",
+			device, block_size);
+		return 1;
+	}
+	dev_major = major(st.st_rdev);
+	dev_minor = minor(st.st_rdev);
+
+	nr = nr_groups * nr_procs;
+	shared = mmap(NULL, sizeof(*shared) + nr * sizeof(struct counter),
+		      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	pids = calloc(nr, sizeof(*pids));
+	if (shared == MAP_FAILED || !pids) {
+		perror("memory");
+		return 1;
+	}
+
+	if (burst_ms >= 0)
+		set_burst();
+	create_groups();
+
+	for (i = 0; i < nr; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			perror("fork");
+			shared->stop = 1;
+			break;
+		}
+		if (!pids[i])
+			io_proc(i);
+	}
+
+	/* Let them all join their cgroup and open the device first */
+	sleep(1);
+
+	printf("kB/s    ");
+	for (g = 0; g < nr_groups; g++)
+		printf("      c%-2u", g);
+	printf("     total\n");
+
+	start = now();
+	next = start + 1;
+	shared->start = 1;
+
+	while (second < duration) {
+		t = now();
+		if (t < next) {
+			usleep((next - t) * 1e6);
+			continue;
+		}
+		for (g = 0; g < nr_groups; g++) {
+			unsigned long long bytes = group_bytes(g);
+
+			delta[g] = bytes - last[g];
+			last[g] = bytes;
+		}
+		snprintf(label, sizeof(label), "%us", ++second);
+		print_rates(label, delta, t - (next - 1));
+		next += 1;
+	}
+	shared->stop = 1;
+	t = now();
+
+	for (i = 0; i < nr; i++)
+		if (pids[i] > 0)
+			waitpid(pids[i], NULL, 0);
+
+	for (g = 0; g < nr_groups; g++)
+		last[g] = group_bytes(g);
+	print_rates("average", last, t - start);
+	printf("limits   child %lu kB/s  parent %lu kB/s  parent %lu iops\n",
+	       child_kbps, parent_kbps, parent_iops);
+
+	remove_groups();
+	return 0;
+}
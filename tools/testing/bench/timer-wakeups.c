@@ -0,0 +1,244 @@
+/*
+ * timer-wakeups -- timer interrupts saved by timer slack
+ *
+ * Runs a number of threads on one cpu, each sleeping in a loop with a
+ * period of its own, like a set of usleep_range() or epoll_wait() users
+ * with timeouts that don't line up. The run is done twice: first with a
+ * timer slack of 1 ns, so that every sleep needs an interrupt of its own,
+ * then with the slack given, which lets hrtimer_interrupt() expire the
+ * sleeps whose slack window has opened on an interrupt raised for
+ * another one.
+ *
+ * For both runs the local timer interrupts of the cpu (the LOC line of
+ * /proc/interrupts, or the one given with -i) and the nr_wakeups_saved
+ * of the cpu in /proc/timer_list are printed per second. The interrupts
+ * of the second run plus the wakeups saved should come close to the
+ * interrupts of the first one. Let the cpu be otherwise idle, and the
+ * kernel run NO_HZ with high resolution timers.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/prctl.h>
+#include <sys/time.h>
+
+#define MAX_THREADS	256
+
+static unsigned int nr_threads = 8;
+static unsigned int period_us = 1000;
+static unsigned int slack_us = 500;
+static unsigned int duration = 10;	/* seconds */
+static unsigned int cpu;
+static const char *irq_name = "LOC";
+
+static volatile int stop;
+static unsigned long slack_ns;
+static unsigned long long sleeps[MAX_THREADS];
+
+static void usage(void)
+{
+	fprintf(stderr,
+"Usage: timer-wakeups [options]\n"
+"  -n N      number of sleeping threads (default 8, at most %d)\n"
+"  -p US     period of the first thread in us; the others sleep a bit\n"
+"            longer each (default 1000)\n"
+"  -s US     timer slack of the second run in us (default 500)\n"
+"  -d SEC    duration of each run in seconds (default 10)\n"
+"  -c CPU    cpu to run on (default 0)\n"
+"  -i NAME   line of /proc/interrupts with the local timer (default LOC)\n",
+		MAX_THREADS);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Interrupts of @cpu on the line of /proc/interrupts named irq_name */
+static unsigned long long read_interrupts(void)
+{
+	char line[4096], *p, *end;
+	unsigned long long val;
+	unsigned int i, col = 0, ncpus = 0;
+	FILE *f;
+
+	f = fopen("/proc/interrupts", "r");
+	if (!f || !fgets(line, sizeof(line), f)) {
+		perror("/proc/interrupts");
+		exit(1);
+	}
+	/* The header names the online cpus, the column of @cpu is needed */
+	for (p = strtok(line, " \t\n"); p; p = strtok(NULL, " \t\n")) {
+		if (!strncmp(p, "CPU", 3) && (unsigned int)atoi(p + 3) == cpu)
+			col = ncpus;
+		ncpus++;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		p = line + strspn(line, " ");
+		if (strncmp(p, irq_name, strlen(irq_name)) ||
+		    p[strlen(irq_name)] != ':')
+			continue;
+		p += strlen(irq_name) + 1;
+		for (i = 0; i <= col; i++) {
+			val = strtoull(p, &end, 10);
+			if (end == p)
+				break;
+			p = end;
+		}
+		fclose(f);
+		if (i <= col) {
+			fprintf(stderr, "/proc/interrupts: bad %s line\n",
+				irq_name);
+			exit(1);
+		}
+		return val;
+	}
+	fprintf(stderr, "/proc/interrupts: no %s line\n", irq_name);
+	exit(1);
+}
+
+/* nr_wakeups_saved of @cpu in /proc/timer_list */
+static unsigned long long read_saved(void)
+{
+	char line[256];
+	int this_cpu = -1;
+	FILE *f;
+
+	f = fopen("/proc/timer_list", "r");
+	if (!f) {
+		perror("/proc/timer_list");
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "cpu: %d", &this_cpu) == 1)
+			continue;
+		if (this_cpu == (int)cpu &&
+		    !strncmp(line, "  .nr_wakeups_saved", 19)) {
+			fclose(f);
+			return strtoull(strchr(line, ':') + 1, NULL, 10);
+		}
+	}
+	fprintf(stderr, "/proc/timer_list: no nr_wakeups_saved of cpu %u\n",
+		cpu);
+	exit(1);
+}
+
+static void *sleeper(void *arg)
+{
+	unsigned long id = (unsigned long)arg;
+	struct timespec ts;
+	long ns;
+
+	/* Periods 1/nr_threads apart, so that the sleeps don't line up */
+	ns = period_us * 1000L + id * period_us * 1000L / nr_threads;
+	ts.tv_sec = ns / 1000000000L;
+	ts.tv_nsec = ns % 1000000000L;
+
+	prctl(PR_SET_TIMERSLACK, slack_ns, 0, 0, 0);
+	while (!stop) {
+		clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+		sleeps[id]++;
+	}
+	return NULL;
+}
+
+static void run(unsigned long slack)
+{
+	unsigned long long irqs, saved, total = 0;
+	pthread_t threads[MAX_THREADS];
+	double start, secs;
+	unsigned long i;
+
+	slack_ns = slack;
+	stop = 0;
+	memset(sleeps, 0, sizeof(sleeps));
+
+	irqs = read_interrupts();
+	saved = read_saved();
+	start = now();
+
+	for (i = 0; i < nr_threads; i++) {
+		if (pthread_create(&threads[i], NULL, sleeper, (void *)i)) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	sleep(duration);
+	stop = 1;
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(threads[i], NULL);
+		total += sleeps[i];
+	}
+
+	secs = now() - start;
+	irqs = read_interrupts() - irqs;
+	saved = read_saved() - saved;
+	printf("slack %8lu ns  sleeps/s %8.0f  interrupts/s %8.0f  "
+	       "saved/s %8.0f\n", slack, total / secs, irqs / secs,
+	       saved / secs);
+}
+
+int main(int argc, char **argv)
+{
+	cpu_set_t set;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:p:s:d:c:i:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			period_us = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			slack_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			cpu = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			irq_name = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc || !nr_threads || nr_threads > MAX_THREADS ||
+	    !period_us || !slack_us || !duration)
+		usage();
+
+	/* Threads inherit the affinity */
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set)) {
+		perror("sched_setaffinity");
+		return 1;
+	}
+
+	printf("%u threads on cpu %u, periods %u to %u us\n", nr_threads,
+	       cpu, period_us,
+	       period_us + (nr_threads - 1) * period_us / nr_threads);
+	run(1);
+	run(slack_us * 1000UL);
+	return 0;
+}
@@ -0,0 +1,297 @@
+/*
+ * unmap-bench -- reclaim of a file mapped by a multithreaded process
+ *
+ * One thread per cpu walks a shared mapping of a file that is larger than
+ * what is left of memory, touching one byte per page, so that reclaim
+ * keeps unmapping pages of an mm that is live on every cpu. Each unmap
+ * needs the TLB of those cpus flushed; without batching that is an IPI
+ * to all of them per page.
+ *
+ * Reported are the pages touched per second, the major faults, the
+ * pages reclaimed, the TLB shootdown and function call interrupts from
+ * /proc/interrupts and, when the kernel batches reclaim TLB flushes, the
+ * unmaps whose flush was deferred and the batched flushes that replaced
+ * them. Size the file for the memory of the machine, or run it in a
+ * memory-limited cgroup.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#define BUF_SIZE	(256 << 10)
+
+static size_t file_size = 2048 << 20;
+static unsigned int nr_threads;
+static unsigned int duration = 30;	/* seconds */
+static const char *path = "unmap-bench.data";
+static int keep_file;
+static int do_write;
+
+static volatile int stop;
+static long page_size;
+static char *map;
+
+static const char *counters[] = {
+	"pgmajfault", "pgscan_kswapd_normal", "pgscan_direct_normal",
+	"pgsteal_normal", "tlb_unmap_deferred", "tlb_unmap_batch_flush",
+};
+#define NR_COUNTERS	(sizeof(counters) / sizeof(counters[0]))
+#define DEFERRED	4
+#define BATCH_FLUSH	5
+
+/* Interrupt lines of /proc/interrupts that carry TLB flush IPIs on x86 */
+static const char *irqs[] = { "TLB", "CAL" };
+#define NR_IRQS		(sizeof(irqs) / sizeof(irqs[0]))
+
+struct walker {
+	pthread_t thread;
+	unsigned int cpu;
+	unsigned long long pages;
+};
+
+static void usage(void)
+{
+	fprintf(stderr,
+"Usage: unmap-bench [options]\n"
+"  -f MB     size of the mapped file in MB (default 2048)\n"
+"  -t N      number of threads, one per cpu (default all cpus)\n"
+"  -d SEC    duration in seconds (default 30)\n"
+"  -w        write to the pages instead of reading them\n"
+"  -p PATH   file to map (default unmap-bench.data, created if\n"
+"            missing and then removed unless -k is given)\n"
+"  -k        keep the file afterwards\n");
+	exit(1);
+}
+
+static void create_file(void)
+{
+	char *buf;
+	size_t done;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path);
+		exit(1);
+	}
+	buf = malloc(BUF_SIZE);
+	if (!buf) {
+		perror("malloc");
+		exit(1);
+	}
+	memset(buf, 0x5a, BUF_SIZE);
+	for (done = 0; done < file_size; done += BUF_SIZE)
+		if (write(fd, buf, BUF_SIZE) != BUF_SIZE) {
+			perror("write");
+			exit(1);
+		}
+	fsync(fd);
+	close(fd);
+	free(buf);
+}
+
+static void *walker_thread(void *arg)
+{
+	struct walker *w = arg;
+	size_t nr_pages = file_size / page_size;
+	size_t i, start;
+	cpu_set_t set;
+	volatile char *p;
+	char sum = 0;
+
+	CPU_ZERO(&set);
+	CPU_SET(w->cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+	/* Spread the threads over the file so they fault different pages */
+	start = (size_t)w->cpu * (nr_pages / nr_threads);
+
+	while (!stop) {
+		for (i = 0; i < nr_pages && !stop; i++) {
+			p = map + ((start + i) % nr_pages) * page_size;
+			if (do_write)
+				(*p)++;
+			else
+				sum += *p;
+			w->pages++;
+		}
+	}
+	return (void *)(long)sum;
+}
+
+static void read_vmstat(unsigned long long *val)
+{
+	char line[256];
+	unsigned int i;
+	size_t len;
+	FILE *f;
+
+	memset(val, 0, NR_COUNTERS * sizeof(*val));
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return;
+	while (fgets(line, sizeof(line), f)) {
+		for (i = 0; i < NR_COUNTERS; i++) {
+			len = strlen(counters[i]);
+			if (!strncmp(line, counters[i], len) &&
+			    line[len] == ' ')
+				val[i] = strtoull(line + len + 1, NULL, 10);
+		}
+	}
+	fclose(f);
+}
+
+/* Sum over all cpus of the interrupt lines in irqs[] */
+static void read_irqs(unsigned long long *val)
+{
+	char line[4096], *p, *end;
+	unsigned long long n;
+	unsigned int i;
+	FILE *f;
+
+	memset(val, 0, NR_IRQS * sizeof(*val));
+	f = fopen("/proc/interrupts", "r");
+	if (!f)
+		return;
+	while (fgets(line, sizeof(line), f)) {
+		for (p = line; *p == ' '; p++)
+			;
+		for (i = 0; i < NR_IRQS; i++) {
+			if (strncmp(p, irqs[i], strlen(irqs[i])) ||
+			    p[strlen(irqs[i])] != ':')
+				continue;
+			p += strlen(irqs[i]) + 1;
+			for (;;) {
+				n = strtoull(p, &end, 10);
+				if (end == p)
+					break;
+				val[i] += n;
+				p = end;
+			}
+		}
+	}
+	fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long before[NR_COUNTERS], after[NR_COUNTERS];
+	unsigned long long irq_before[NR_IRQS], irq_after[NR_IRQS];
+	unsigned long long pages = 0, deferred, flushes;
+	struct timeval start, end;
+	struct walker *walkers;
+	unsigned int i;
+	double secs;
+	int opt, fd;
+
+	while ((opt = getopt(argc, argv, "f:t:d:wp:kh")) != -1) {
+		switch (opt) {
+		case 'f':
+			file_size = (size_t)strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 't':
+			nr_threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			do_write = 1;
+			break;
+		case 'p':
+			path = optarg;
+			break;
+		case 'k':
+			keep_file = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (!nr_threads)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!file_size || !nr_threads || !duration)
+		usage();
+
+	page_size = sysconf(_SC_PAGESIZE);
+	walkers = calloc(nr_threads, sizeof(*walkers));
+	if (!walkers) {
+		perror("calloc");
+		return 1;
+	}
+	if (access(path, R_OK))
+		create_file();
+	else
+		keep_file = 1;
+
+	fd = open(path, do_write ? O_RDWR : O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		return 1;
+	}
+	map = mmap(NULL, file_size, do_write ? PROT_READ | PROT_WRITE :
+		   PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	read_vmstat(before);
+	read_irqs(irq_before);
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < nr_threads; i++) {
+		walkers[i].cpu = i;
+		if (pthread_create(&walkers[i].thread, NULL, walker_thread,
+				   &walkers[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	sleep(duration);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(walkers[i].thread, NULL);
+		pages += walkers[i].pages;
+	}
+	gettimeofday(&end, NULL);
+	read_irqs(irq_after);
+	read_vmstat(after);
+
+	secs = (end.tv_sec - start.tv_sec) +
+	       (end.tv_usec - start.tv_usec) / 1e6;
+
+	printf("mapping     %zu MB x %u threads  %.0f pages/s\n",
+	       file_size >> 20, nr_threads, pages / secs);
+	for (i = 0; i < NR_COUNTERS; i++)
+		printf("%-22s %llu\n", counters[i], after[i] - before[i]);
+	for (i = 0; i < NR_IRQS; i++)
+		printf("%-22s %llu\n", irqs[i], irq_after[i] - irq_before[i]);
+
+	deferred = after[DEFERRED] - before[DEFERRED];
+	flushes = after[BATCH_FLUSH] - before[BATCH_FLUSH];
+	if (deferred)
+		printf("flushes avoided        %llu (%.1f unmaps per flush)\n",
+		       deferred - flushes, (double)deferred / (flushes ?: 1));
+
+	munmap(map, file_size);
+	close(fd);
+	if (!keep_file)
+		unlink(path);
+	return 0;
+}